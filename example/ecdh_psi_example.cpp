@@ -59,6 +59,8 @@ void ecdh_psi_example(const std::string& config_path, const std::string& log_pat
 
     // 3. Read keys and features from file or use randomly generated data.
     std::vector<std::string> keys;
+    std::vector<std::vector<std::string>> keys_2d;
+    std::size_t ids_num = params["common"]["ids_num"];
 
     if (use_random_data) {
         std::vector<std::string> common_keys;
@@ -76,24 +78,33 @@ void ecdh_psi_example(const std::string& config_path, const std::string& log_pat
         LOG(INFO) << "Read data from csv.";
         std::string input_path = params["data"]["input_file"];
         bool has_header = params["data"]["has_header"];
-        std::size_t ids_num = params["common"]["ids_num"];
         petace::setops::CsvDataProvider csv(input_path, has_header, ids_num);
-        csv.get_next_batch(kBatchSize, keys);
+        if (ids_num > 1) {
+            csv.get_next_batch_2d(kBatchSize, keys_2d);
+        } else {
+            csv.get_next_batch(kBatchSize, keys);
+        }
     }
 
-    // 4. run ecdh-psi.
+    // 4. run ecdh-psi, matching several id columns in priority order if any.
     std::vector<std::string> output_keys;
+    std::vector<std::vector<std::string>> output_keys_2d;
     petace::setops::EcdhPSI psi;
     psi.init(net, params);
-    psi.preprocess_data(net, keys, keys);
-    psi.process(net, keys, output_keys);
+    if (!use_random_data && ids_num > 1) {
+        std::vector<std::size_t> output_id_indices;
+        psi.process_multi_id(net, keys_2d, output_keys_2d, output_id_indices);
+        output_keys = output_keys_2d[0];
+    } else {
+        psi.preprocess_data(net, keys, keys);
+        psi.process(net, keys, output_keys);
+        output_keys_2d.push_back(output_keys);
+    }
 
     if (!use_random_data) {
         bool obtain_result = params["ecdh_params"]["obtain_result"];
         if (obtain_result) {
             std::string output_path = params["data"]["output_file"];
-            std::vector<std::vector<std::string>> output_keys_2d;
-            output_keys_2d.push_back(output_keys);
             petace::setops::CsvDataProvider::write_data_to_file(output_keys_2d, {}, output_path, false, {});
             LOG(INFO) << "write result to output file.";
         }
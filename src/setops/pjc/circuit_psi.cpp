@@ -15,6 +15,8 @@
 #include "setops/pjc/circuit_psi.h"
 
 #include <algorithm>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
 #include <unordered_map>
 #include <vector>
@@ -23,11 +25,20 @@
 
 #include "solo/prng.h"
 
+#include "setops/util/cuckoo_stash.h"
 #include "setops/util/parameter_check.h"
+#include "setops/util/simple_hashing_table.h"
 
 namespace petace {
 namespace setops {
 
+namespace {
+
+// The default bits of the probability that the stash of the receiver overflows.
+const std::size_t kDefaultStashFailureBits = 40;
+
+}  // namespace
+
 void CircuitPSI::init(const std::shared_ptr<network::Network>& net, const json& params) {
     // set parameter
     verbose_ = params["common"]["verbose"];
@@ -36,9 +47,14 @@ void CircuitPSI::init(const std::shared_ptr<network::Network>& net, const json&
     epsilon_hint_ = params["circuit_psi_params"]["fun_epsilon"];
     num_of_fun_ = params["circuit_psi_params"]["fun_num"];
     num_of_fun_hint_ = params["circuit_psi_params"]["hint_fun_num"];
+    stash_failure_bits_ = params["circuit_psi_params"].value("stash_failure_bits", kDefaultStashFailureBits);
 
     check_params(net);
 
+    worker_pool_ = WorkerPool::get(WorkerPoolOptions::from_params(params));
+    // Workers are pinned only within init and process, so that the affinity of the caller is restored.
+    ScopedWorkerBinding binding(*worker_pool_);
+
     LOG_IF(INFO, verbose_) << "\nCircuit PSI parameters: \n" << params.dump(4);
 
     // prng
@@ -92,6 +108,7 @@ void CircuitPSI::init(const std::shared_ptr<network::Network>& net, const json&
 void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
         const std::vector<std::vector<std::uint64_t>>& input_features,
         std::vector<std::vector<std::uint64_t>>& output_shares) const {
+    ScopedWorkerBinding binding(*worker_pool_);
     std::size_t sender_data_size;
     std::size_t sender_feature_size;
     std::size_t receiver_data_size;
@@ -112,10 +129,15 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
         net->recv_data(&sender_feature_size, sizeof(sender_feature_size));
     }
 
-    std::size_t num_of_bins = static_cast<std::size_t>(std::ceil(static_cast<double>(receiver_data_size) * epsilon_));
+    std::size_t num_of_cuckoo_bins =
+            static_cast<std::size_t>(std::ceil(static_cast<double>(receiver_data_size) * epsilon_));
+    std::size_t stash_size = max_stash_size(receiver_data_size, epsilon_, num_of_fun_, stash_failure_bits_);
+    // Stash slots of the receiver follow cuckoo bins as bins of their own, so that later phases treat them alike.
+    std::size_t num_of_bins = num_of_cuckoo_bins + stash_size;
+    std::size_t num_of_entries = sender_data_size * (num_of_fun_ + stash_size);
     std::size_t num_of_bins_hint =
-            static_cast<std::size_t>(std::ceil(epsilon_hint_ * static_cast<double>(sender_data_size * num_of_fun_)));
-    if (sender_data_size * num_of_fun_ < num_of_bins) {
+            static_cast<std::size_t>(std::ceil(epsilon_hint_ * static_cast<double>(num_of_entries)));
+    if (num_of_entries < num_of_bins) {
         num_of_bins_hint = static_cast<std::size_t>(std::ceil(epsilon_hint_ * static_cast<double>(num_of_bins)));
     }
 
@@ -131,40 +153,32 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
     if (is_sender_) {
         std::vector<Byte> simple_table_seed(kRandSeedBytesLen);
         common_prng_->generate(kRandSeedBytesLen, simple_table_seed.data());
-        auto simple_table = std::make_shared<solo::SimpleHashing<kItemBytesLen>>(num_of_bins, simple_table_seed);
 
         // Hashing Phase
-        simple_table->set_num_of_hash_functions(num_of_fun_);
-        simple_table->insert(keys);
-        simple_table->map_elements();
-
-        std::size_t stash_size;
-        net->recv_data(&stash_size, sizeof(std::size_t));
-        if (stash_size > 0u) {
-            LOG_IF(INFO, verbose_) << "stash of size is not zero.";
-            throw std::invalid_argument("stash of size is not zero.");
+        SimpleHashingTable simple_table(
+                keys, num_of_cuckoo_bins, num_of_fun_, simple_table_seed, worker_pool_->num_threads(), stash_size);
+
+        std::size_t stash_overflow;
+        net->recv_data(&stash_overflow, sizeof(std::size_t));
+        if (stash_overflow > 0u) {
+            LOG_IF(INFO, verbose_) << "stash of size exceeds its bound.";
+            throw std::invalid_argument("stash of size exceeds its bound.");
         }
 
-        auto simple_table_values = simple_table->obtain_bin_entry_values();
+        const auto& simple_table_values = simple_table.values();
 
         LOG_IF(INFO, verbose_) << "simple hash done.";
 
         // OPRF
-        std::vector<std::vector<block>> masks(num_of_bins);
-        std::vector<std::vector<block>> simple_table_values_block(num_of_bins);
-        for (std::size_t i = 0; i < simple_table_values.size(); i++) {
-            for (std::size_t j = 0; j < simple_table_values[i].size(); j++) {
-                simple_table_values_block[i].emplace_back(
-                        *(reinterpret_cast<block*>(simple_table_values[i][j].data())));
-            }
-        }
-
+        // Masks are laid out as entries of the simple hashing table, and entries are encoded in parallel, since a stash
+        // bin holds all sender keys.
+        std::vector<block> masks(simple_table.entry_count());
         nco_ot_ext_sender_->send(net, num_of_bins);
-        for (std::size_t i = 0; i < num_of_bins; i++) {
-            masks[i].resize(simple_table_values_block[i].size());
-            for (std::size_t j = 0; j < simple_table_values_block[i].size(); j++) {
-                nco_ot_ext_sender_->encode(i, simple_table_values_block[i][j], masks[i][j]);
-            }
+#pragma omp parallel for num_threads(worker_pool_->num_threads())
+        for (std::size_t j = 0; j < simple_table.entry_count(); j++) {
+            block value;
+            std::memcpy(&value, simple_table_values[j].data(), sizeof(block));
+            nco_ot_ext_sender_->encode(simple_table.bin_of(j), value, masks[j]);
         }
 
         LOG_IF(INFO, verbose_) << "oprf done.";
@@ -178,15 +192,13 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
         }
 
         std::unordered_map<std::string, HashLocMap> table_loc;
-        std::vector<Item> filter_inputs;
+        table_loc.reserve(simple_table.entry_count());
         for (std::size_t i = 0; i < num_of_bins; i++) {
-            std::size_t bin_size = simple_table_values[i].size();
-            for (std::size_t j = 0; j < bin_size; j++) {
-                table_loc[std::string(reinterpret_cast<char*>(simple_table_values[i][j].data()), sizeof(Item))].bin =
-                        static_cast<int>(i);
-                table_loc[std::string(reinterpret_cast<char*>(simple_table_values[i][j].data()), sizeof(Item))].index =
-                        static_cast<int>(j);
-                filter_inputs.push_back(simple_table_values[i][j]);
+            for (std::size_t j = simple_table.bin_begin(i); j < simple_table.bin_end(i); j++) {
+                std::string value(reinterpret_cast<const char*>(simple_table_values[j].data()), sizeof(Item));
+                HashLocMap& location = table_loc[value];
+                location.bin = static_cast<int>(i);
+                location.index = static_cast<int>(j - simple_table.bin_begin(i));
             }
         }
 
@@ -195,12 +207,12 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
         auto local_cuckoo_table =
                 std::make_shared<solo::CuckooHashing<kItemBytesLen>>(num_of_bins_hint, local_cuckoo_table_seed);
         local_cuckoo_table->set_num_of_hash_functions(num_of_fun_hint_);
-        local_cuckoo_table->insert(filter_inputs);
+        local_cuckoo_table->insert(simple_table_values);
         local_cuckoo_table->map_elements();
 
-        stash_size = local_cuckoo_table->get_stash_size();
-        net->send_data(&stash_size, sizeof(std::size_t));
-        if (stash_size > 0u) {
+        std::size_t hint_stash_size = local_cuckoo_table->get_stash_size();
+        net->send_data(&hint_stash_size, sizeof(std::size_t));
+        if (hint_stash_size > 0u) {
             LOG_IF(INFO, verbose_) << "stash of size is not zero.";
             throw std::invalid_argument("stash of size is not zero.");
         }
@@ -215,9 +227,8 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
                 auto function_id = local_cuckoo_table_functions[i];
                 HashLocMap location = table_loc[std::string(reinterpret_cast<char*>(element.data()), sizeof(Item))];
                 std::vector<Byte> seed(kRandSeedBytesLen);
-                std::memcpy(seed.data(),
-                        reinterpret_cast<Byte*>(const_cast<block*>(&masks[location.bin][location.index])),
-                        kRandSeedBytesLen);
+                const block& mask = masks[simple_table.bin_begin(location.bin) + location.index];
+                std::memcpy(seed.data(), reinterpret_cast<const Byte*>(&mask), kRandSeedBytesLen);
                 auto local_prng = prng_factory.create(seed);
                 std::uint64_t pad = 0;
                 for (std::size_t j = 0; j <= function_id; j++) {
@@ -241,7 +252,7 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
                 for (std::size_t j = 0; j < sender_feature_size; j++) {
                     feature.emplace_back(input_features[j][i]);
                 }
-                for (std::size_t j = 0; j < num_of_fun_; j++) {
+                for (std::size_t j = 0; j < num_of_fun_ + stash_size; j++) {
                     Item keys_xor_fun = keys[i];
                     keys_xor_fun[0] ^= Byte(j);
                     table_features_loc.emplace(
@@ -268,7 +279,8 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
                                 table_loc[std::string(reinterpret_cast<char*>(element.data()), sizeof(Item))];
 
                         std::vector<Byte> seed(kRandSeedBytesLen);
-                        auto seed_block = masks[location.bin][location.index] ^ _mm_set_epi64x(0, fid);
+                        auto seed_block =
+                                masks[simple_table.bin_begin(location.bin) + location.index] ^ _mm_set_epi64x(0, fid);
                         std::memcpy(seed.data(), reinterpret_cast<Byte*>(const_cast<block*>(&seed_block)),
                                 kRandSeedBytesLen);
                         auto local_prng = prng_factory.create(seed);
@@ -339,19 +351,27 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
     } else {
         std::vector<Byte> cuckoo_table_seed(kRandSeedBytesLen);
         common_prng_->generate(kRandSeedBytesLen, cuckoo_table_seed.data());
-        auto cuckoo_table = std::make_shared<solo::CuckooHashing<kItemBytesLen>>(num_of_bins, cuckoo_table_seed);
+        auto cuckoo_table =
+                std::make_shared<solo::CuckooHashing<kItemBytesLen>>(num_of_cuckoo_bins, cuckoo_table_seed);
 
         // Hashing Phase
         cuckoo_table->set_num_of_hash_functions(num_of_fun_);
         cuckoo_table->insert(keys);
         cuckoo_table->map_elements();
-        auto stash_size = cuckoo_table->get_stash_size();
-        net->send_data(&stash_size, sizeof(std::size_t));
-        if (stash_size > 0u) {
-            LOG_IF(INFO, verbose_) << "stash of size is not zero.";
-            throw std::invalid_argument("stash of size is not zero.");
-        }
         auto cuckoo_table_values = cuckoo_table->obtain_entry_values();
+        auto cuckoo_table_entry_ids = cuckoo_table->obtain_entry_ids();
+        auto cuckoo_table_function_ids = cuckoo_table->obtain_entry_function_ids();
+
+        // A stash key takes a stash slot, which is matched against a stash bin of the sender holding all sender keys.
+        auto stash_ids = find_stash_ids(cuckoo_table->obtain_bin_occupancy(), cuckoo_table_entry_ids, keys.size());
+        std::size_t stash_overflow = stash_ids.size() > stash_size ? stash_ids.size() : 0;
+        net->send_data(&stash_overflow, sizeof(std::size_t));
+        if (stash_overflow > 0u) {
+            LOG_IF(INFO, verbose_) << "stash of size exceeds its bound.";
+            throw std::invalid_argument("stash of size exceeds its bound.");
+        }
+        append_stash_entries(keys, stash_ids, num_of_fun_, stash_size, cuckoo_table_values, cuckoo_table_function_ids,
+                cuckoo_table_entry_ids);
 
         LOG_IF(INFO, verbose_) << "cuckoo hash done.";
 
@@ -366,8 +386,9 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
 
         LOG_IF(INFO, verbose_) << "oprf done.";
 
-        net->recv_data(&stash_size, sizeof(std::size_t));
-        if (stash_size > 0u) {
+        std::size_t hint_stash_size;
+        net->recv_data(&hint_stash_size, sizeof(std::size_t));
+        if (hint_stash_size > 0u) {
             LOG_IF(INFO, verbose_) << "stash of size is not zero.";
             throw std::invalid_argument("stash of size is not zero.");
         }
@@ -458,7 +479,9 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
 
         if ((sender_feature_size != 0) || (receiver_feature_size != 0)) {
             auto cuckoo_bin_occupancy = cuckoo_table->obtain_bin_occupancy();
-            auto cuckoo_table_source_values = cuckoo_table->obtain_entry_source_values();
+            for (std::size_t i = num_of_cuckoo_bins; i < num_of_bins; i++) {
+                cuckoo_bin_occupancy.push_back(cuckoo_table_function_ids[i] != std::numeric_limits<std::size_t>::max());
+            }
             std::vector<duet::ArithMatrix> feature_shares(sender_feature_size);
             std::vector<duet::ArithMatrix> feature_result(sender_feature_size);
             for (std::size_t i = 0; i < sender_feature_size; i++) {
@@ -479,9 +502,11 @@ void CircuitPSI::process(const std::shared_ptr<network::Network>& net, const std
                 }
 
                 if (cuckoo_bin_occupancy[i]) {
+                    const Item& key = keys[cuckoo_table_entry_ids[i]];
                     for (std::size_t k = 0; k < receiver_feature_size; k++) {
-                        output_shares[sender_feature_size + k + 1][i] += table_features_loc[std::string(
-                                reinterpret_cast<char*>(cuckoo_table_source_values[i].data()), sizeof(Item))][k];
+                        output_shares[sender_feature_size + k + 1][i] +=
+                                table_features_loc[std::string(reinterpret_cast<const char*>(key.data()), sizeof(Item))]
+                                                  [k];
                     }
                 }
             }
@@ -495,6 +520,8 @@ void CircuitPSI::check_params(const std::shared_ptr<network::Network>& net) {
     check_consistency(is_sender_, net, "epsilon_hint", epsilon_hint_);
     check_consistency(is_sender_, net, "number of function", num_of_fun_);
     check_consistency(is_sender_, net, "number of hint function", num_of_fun_hint_);
+    check_consistency(is_sender_, net, "stash failure bits", stash_failure_bits_);
+    check_stash_params(epsilon_, num_of_fun_, stash_failure_bits_);
 }
 
 template <>
@@ -21,11 +21,11 @@
 #include "duet/duet.h"
 #include "network/network.h"
 #include "solo/cuckoo_hashing.h"
-#include "solo/simple_hashing.h"
 #include "verse/verse_factory.h"
 
 #include "setops/pjc/pjc.h"
 #include "setops/util/defines.h"
+#include "setops/util/worker_pool.h"
 
 namespace petace {
 namespace setops {
@@ -68,14 +68,27 @@ class CircuitPSI : public PJC {
      *         "has_header": false,
      *         "output_file": "/data/receiver_output_file.csv"
      *     },
+     *     "threads": {
+     *         "num_threads": 0,
+     *         "cpu_affinity": [],
+     *         "numa_node": -1
+     *     },
      *     "circuit_psi_params": {
      *         "epsilon": 1.27,
      *         "fun_epsilon": 1.27,
      *         "fun_num": 3,
-     *         "hint_fun_num": 3
+     *         "hint_fun_num": 3,
+     *         "stash_failure_bits": 40
      *     }
      * }
      *
+     * The optional "threads" block configures the shared worker pool, see WorkerPoolOptions. Receiver keys that
+     * overflow cuckoo hashing go to a stash of max_stash_size(receiver keys, "epsilon", "fun_num",
+     * "stash_failure_bits") slots, which follow the cuckoo bins as bins holding all sender keys. The optional
+     * "stash_failure_bits" defaults to 40, and 0 allows no stash. The default "epsilon" and "fun_num" are stashless
+     * and reserve no stash slot. Both parties throw std::invalid_argument before any OT if check_stash_params rejects
+     * "epsilon" and "fun_num".
+     *
      * @param[in] net The network interface (e.g., PETAce-Network interface).
      * @param[in] params The PJC parameters configuration.
      */
@@ -87,7 +100,8 @@ class CircuitPSI : public PJC {
      * @param[in] net The network interface (e.g., PETAce-Network interface).
      * @param[in] input_keys The input keys  to perform intersection, such as phone numbers and emails. Only one ID type
      * can be supported at the same time。
-     * @param[out] output_keys The intersection corresponding to input keys.
+     * @param[out] output_keys The intersection corresponding to input keys, with a row per cuckoo bin followed by a row
+     * per stash slot.
      */
     void process(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
             const std::vector<std::vector<std::uint64_t>>& input_features,
@@ -124,6 +138,8 @@ class CircuitPSI : public PJC {
 
     std::shared_ptr<verse::NcoOtExtReceiver> nco_ot_ext_recver_ = nullptr;
 
+    std::shared_ptr<WorkerPool> worker_pool_ = nullptr;
+
     double epsilon_ = 0.0;
 
     double epsilon_hint_ = 0.0;
@@ -131,6 +147,8 @@ class CircuitPSI : public PJC {
     std::size_t num_of_fun_ = 0;
 
     std::size_t num_of_fun_hint_ = 0;
+
+    std::size_t stash_failure_bits_ = 0;
 };
 
 }  // namespace setops
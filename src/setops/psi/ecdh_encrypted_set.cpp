@@ -0,0 +1,144 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/psi/ecdh_encrypted_set.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include "solo/hash.h"
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+const char kEncryptedSetFileMagic[8] = {'E', 'C', 'D', 'H', 'P', 'R', 'E', '1'};
+// Guards against allocating for a corrupted header.
+const std::size_t kMaxPointBytesLen = 256;
+// Input keys are hashed in chunks of this many keys, each chunk chained with the digest of previous chunks.
+const std::size_t kInputKeysHashChunkSize = 4096;
+
+struct EncryptedSetFileHeader {
+    char magic[8];
+    std::int32_t curve_id;
+    std::uint32_t reserved;
+    Byte key_seed[kRandSeedBytesLen];
+    std::uint64_t key_count;
+    std::uint64_t point_byte_count;
+    Byte input_keys_hash[kInputKeysHashBytesLen];
+};
+
+void hash_input_keys(const std::vector<std::string>& input_keys, Byte* digest) {
+    auto hash = petace::solo::Hash::create(petace::solo::HashScheme::SHA_256);
+    std::fill_n(digest, kInputKeysHashBytesLen, Byte(0));
+    ByteVector buffer;
+    for (std::size_t begin = 0; begin < input_keys.size(); begin += kInputKeysHashChunkSize) {
+        std::size_t end = std::min(begin + kInputKeysHashChunkSize, input_keys.size());
+        buffer.assign(digest, digest + kInputKeysHashBytesLen);
+        for (std::size_t item_idx = begin; item_idx < end; ++item_idx) {
+            std::uint64_t key_length = input_keys[item_idx].size();
+            for (std::size_t byte_idx = 0; byte_idx < sizeof(key_length); ++byte_idx) {
+                buffer.push_back(static_cast<Byte>(key_length >> (8 * byte_idx)));
+            }
+            buffer.insert(buffer.end(), input_keys[item_idx].begin(), input_keys[item_idx].end());
+        }
+        hash->compute(buffer.data(), buffer.size(), digest, kInputKeysHashBytesLen);
+    }
+}
+
+}  // namespace
+
+EcdhEncryptedSet::EcdhEncryptedSet(int curve_id, const ByteVector& key_seed,
+        const std::vector<std::string>& input_keys, PointBuffer encrypted_keys)
+        : curve_id_(curve_id), key_seed_(key_seed) {
+    if (key_seed.size() != kRandSeedBytesLen) {
+        throw std::invalid_argument("key_seed size is not " + std::to_string(kRandSeedBytesLen) + ".");
+    }
+    if (encrypted_keys.size() != input_keys.size() || encrypted_keys.point_byte_count() == 0) {
+        throw std::invalid_argument("encrypted_keys do not match input_keys.");
+    }
+    hash_input_keys(input_keys, input_keys_hash_.data());
+    encrypted_keys_.swap(encrypted_keys);
+}
+
+std::shared_ptr<EcdhEncryptedSet> EcdhEncryptedSet::load(const std::string& file_path) {
+    std::ifstream in(file_path, std::ios::binary);
+    EncryptedSetFileHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || !std::equal(header.magic, header.magic + sizeof(header.magic), kEncryptedSetFileMagic)) {
+        throw std::invalid_argument("file " + file_path + " is not an encrypted set.");
+    }
+    if (header.point_byte_count == 0 || header.point_byte_count > kMaxPointBytesLen) {
+        throw std::invalid_argument("file " + file_path + " has unexpected point length.");
+    }
+    // The key count is checked against the file size before allocating for it.
+    auto keys_begin = in.tellg();
+    in.seekg(0, std::ios::end);
+    auto keys_byte_count = static_cast<std::uint64_t>(in.tellg() - keys_begin);
+    in.seekg(keys_begin);
+    if (keys_byte_count % header.point_byte_count != 0 ||
+            header.key_count != keys_byte_count / header.point_byte_count) {
+        throw std::invalid_argument("file " + file_path + " has unexpected key count.");
+    }
+
+    std::shared_ptr<EcdhEncryptedSet> encrypted_set(new EcdhEncryptedSet());
+    encrypted_set->curve_id_ = header.curve_id;
+    encrypted_set->key_seed_.assign(header.key_seed, header.key_seed + kRandSeedBytesLen);
+    std::copy_n(header.input_keys_hash, kInputKeysHashBytesLen, encrypted_set->input_keys_hash_.data());
+    encrypted_set->encrypted_keys_.resize(
+            static_cast<std::size_t>(header.key_count), static_cast<std::size_t>(header.point_byte_count));
+    in.read(reinterpret_cast<char*>(encrypted_set->encrypted_keys_.data()),
+            static_cast<std::streamsize>(encrypted_set->encrypted_keys_.byte_count()));
+    if (!in) {
+        throw std::runtime_error("file " + file_path + " read failed.");
+    }
+    return encrypted_set;
+}
+
+void EcdhEncryptedSet::save(const std::string& file_path) const {
+    EncryptedSetFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::copy_n(kEncryptedSetFileMagic, sizeof(header.magic), header.magic);
+    header.curve_id = curve_id_;
+    std::copy_n(key_seed_.data(), kRandSeedBytesLen, header.key_seed);
+    header.key_count = encrypted_keys_.size();
+    header.point_byte_count = encrypted_keys_.point_byte_count();
+    std::copy_n(input_keys_hash_.data(), kInputKeysHashBytesLen, header.input_keys_hash);
+
+    std::ofstream out(file_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(encrypted_keys_.data()),
+            static_cast<std::streamsize>(encrypted_keys_.byte_count()));
+    out.close();
+    if (!out) {
+        throw std::runtime_error("file " + file_path + " write failed.");
+    }
+}
+
+bool EcdhEncryptedSet::matches(const std::vector<std::string>& input_keys) const {
+    if (input_keys.size() != encrypted_keys_.size()) {
+        return false;
+    }
+    std::array<Byte, kInputKeysHashBytesLen> input_keys_hash;
+    hash_input_keys(input_keys, input_keys_hash.data());
+    return input_keys_hash == input_keys_hash_;
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,103 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+
+namespace petace {
+namespace setops {
+
+// The byte length of the hash of input keys of an encrypted set.
+const std::size_t kInputKeysHashBytesLen = 32;
+
+/**
+ * @brief Self keys encrypted under one ECDH secret key, which any number of ECDH-PSI sessions can share read-only.
+ *
+ * The set holds the seed the secret key is derived from, a hash of input keys to check that a session runs on the same
+ * input keys, and the encrypted keys in the order of input keys.
+ */
+class EcdhEncryptedSet {
+public:
+    /**
+     * @brief Creates a set from keys already encrypted.
+     *
+     * @param[in] curve_id The ECC curve ID.
+     * @param[in] key_seed The seed of the secret key that encrypted keys.
+     * @param[in] input_keys The input keys.
+     * @param[in] encrypted_keys The encrypted input keys in the order of input keys.
+     * @throws std::invalid_argument if the sizes of input keys and encrypted keys mismatch.
+     */
+    EcdhEncryptedSet(int curve_id, const ByteVector& key_seed, const std::vector<std::string>& input_keys,
+            PointBuffer encrypted_keys);
+
+    /**
+     * @brief Loads a set saved by save.
+     *
+     * @param[in] file_path The file path.
+     * @throws std::invalid_argument if the file is not a saved set.
+     * @throws std::runtime_error if the file cannot be read.
+     */
+    static std::shared_ptr<EcdhEncryptedSet> load(const std::string& file_path);
+
+    /**
+     * @brief Saves the set, including its secret key, to a binary file in native byte order.
+     *
+     * @param[in] file_path The file path.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void save(const std::string& file_path) const;
+
+    /**
+     * @brief Returns whether the set is encrypted from exactly the given input keys in the same order.
+     */
+    bool matches(const std::vector<std::string>& input_keys) const;
+
+    int curve_id() const {
+        return curve_id_;
+    }
+
+    const ByteVector& key_seed() const {
+        return key_seed_;
+    }
+
+    const std::array<Byte, kInputKeysHashBytesLen>& input_keys_hash() const {
+        return input_keys_hash_;
+    }
+
+    const PointBuffer& encrypted_keys() const {
+        return encrypted_keys_;
+    }
+
+    std::size_t size() const {
+        return encrypted_keys_.size();
+    }
+
+private:
+    EcdhEncryptedSet() = default;
+
+    int curve_id_ = 0;
+    ByteVector key_seed_{};
+    std::array<Byte, kInputKeysHashBytesLen> input_keys_hash_{};
+    PointBuffer encrypted_keys_{};
+};
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,291 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/psi/ecdh_group.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "solo/ec_openssl.h"
+#include "solo/hash.h"
+
+#include "setops/util/p256.h"
+#include "setops/util/ristretto255.h"
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+// The domain separation tag of hashing keys to P-256, following the naming of RFC 9380, section 3.1.
+const char kP256HashToCurveDst[] = "PETAce-SetOps-V01-CS01-with-P256_XMD:SHA-256_SSWU_RO_";
+
+// The scratch state of P-256 of one thread, which all batches that the thread runs reuse, whichever group instance runs
+// them. It has its own curve, since any P-256 curve multiplies by the secret key of any group instance.
+struct P256Scratch {
+    P256Scratch() : ecc_cipher(kP256CurveId, petace::solo::HashScheme::SHA3_256), point(ecc_cipher) {
+    }
+
+    petace::solo::ECOpenSSL ecc_cipher;
+    petace::solo::ECOpenSSL::Point point;
+    std::array<Byte, kEccPointLen> point_bytes_buffer{};
+    PointBuffer hashed_keys{};
+};
+
+// Returns the scratch state of the calling thread, which is created on first use and lives as long as the thread, so
+// that OpenMP worker threads keep it across parallel regions.
+P256Scratch& p256_scratch() {
+    thread_local P256Scratch scratch;
+    return scratch;
+}
+
+// NIST P-256 through OpenSSL, whose encrypted keys are compressed points.
+// Keys are hashed to the curve in batches by the constant-time simplified SWU map of RFC 9380.
+class EcdhGroupP256 : public EcdhGroup {
+public:
+    EcdhGroupP256() : ecc_cipher_(kP256CurveId, petace::solo::HashScheme::SHA3_256) {
+    }
+
+    std::size_t point_byte_count() const override {
+        return kEccPointLen;
+    }
+
+    // A compressed point ends with its big-endian x-coordinate, whose last bytes are its low-order bytes.
+    std::size_t tag_offset(std::size_t tag_byte_count) const override {
+        return kEccPointLen - tag_byte_count;
+    }
+
+    void create_secret_key(const std::shared_ptr<petace::solo::PRNG>& prng) override {
+        ecc_cipher_.create_secret_key(prng, sk_);
+    }
+
+    void encrypt_key(const std::string& key, Byte* encrypted_key) const override {
+        encrypt_keys(Span<const std::string>(&key, 1), encrypted_key);
+    }
+
+    void encrypt_keys(Span<const std::string> keys, Byte* encrypted_keys) const override {
+        P256Scratch& scratch = p256_scratch();
+        p256_hash_to_curve_batch(keys, kP256HashToCurveDst, scratch.hashed_keys);
+        encrypt_hashed_keys(scratch, encrypted_keys);
+    }
+
+    void encrypt_keys(
+            Span<const std::string> keys, Span<const std::size_t> indices, Byte* encrypted_keys) const override {
+        P256Scratch& scratch = p256_scratch();
+        p256_hash_to_curve_batch(keys, indices, kP256HashToCurveDst, scratch.hashed_keys);
+        encrypt_hashed_keys(scratch, encrypted_keys);
+    }
+
+    bool doublely_encrypt_key(const Byte* encrypted_key, std::size_t tag_byte_count, Byte* tag) const override {
+        return multiply_encrypted_keys(encrypted_key, 1, false, tag_byte_count, tag);
+    }
+
+    bool decrypt_key(const Byte* encrypted_key, std::size_t tag_byte_count, Byte* tag) const override {
+        return multiply_encrypted_keys(encrypted_key, 1, true, tag_byte_count, tag);
+    }
+
+    bool doublely_encrypt_keys(
+            const Byte* encrypted_keys, std::size_t count, std::size_t tag_byte_count, Byte* tags) const override {
+        return multiply_encrypted_keys(encrypted_keys, count, false, tag_byte_count, tags);
+    }
+
+    bool decrypt_keys(
+            const Byte* encrypted_keys, std::size_t count, std::size_t tag_byte_count, Byte* tags) const override {
+        return multiply_encrypted_keys(encrypted_keys, count, true, tag_byte_count, tags);
+    }
+
+private:
+    // Encrypts keys hashed to uncompressed points in the scratch state.
+    void encrypt_hashed_keys(P256Scratch& scratch, Byte* encrypted_keys) const {
+        const PointBuffer& hashed_keys = scratch.hashed_keys;
+        for (std::size_t item_idx = 0; item_idx < hashed_keys.size(); ++item_idx) {
+            scratch.ecc_cipher.point_from_bytes(
+                    hashed_keys.point_data(item_idx), kP256UncompressedPointBytesLen, scratch.point);
+            scratch.ecc_cipher.encrypt(scratch.point, sk_, scratch.point);
+            scratch.ecc_cipher.point_to_bytes(scratch.point, kEccPointLen, encrypted_keys + item_idx * kEccPointLen);
+        }
+    }
+
+    // Decompresses encrypted keys, multiplies them by the secret key or its inverse and keeps the last
+    // tag_byte_count bytes of every result.
+    // The point and byte buffer of the thread scratch are reused, instead of allocating an EC_POINT per key or batch.
+    bool multiply_encrypted_keys(const Byte* encrypted_keys, std::size_t count, bool by_inverse,
+            std::size_t tag_byte_count, Byte* tags) const {
+        P256Scratch& scratch = p256_scratch();
+        bool all_valid = true;
+        for (std::size_t item_idx = 0; item_idx < count; ++item_idx) {
+            try {
+                scratch.ecc_cipher.point_from_bytes(
+                        encrypted_keys + item_idx * kEccPointLen, kEccPointLen, scratch.point);
+            } catch (const std::exception&) {
+                all_valid = false;
+                continue;
+            }
+            if (by_inverse) {
+                scratch.ecc_cipher.decrypt(scratch.point, sk_, scratch.point);
+            } else {
+                scratch.ecc_cipher.encrypt(scratch.point, sk_, scratch.point);
+            }
+            scratch.ecc_cipher.point_to_bytes(scratch.point, kEccPointLen, scratch.point_bytes_buffer.data());
+            std::copy_n(scratch.point_bytes_buffer.begin() + tag_offset(tag_byte_count), tag_byte_count,
+                    tags + item_idx * tag_byte_count);
+        }
+        return all_valid;
+    }
+
+    petace::solo::ECOpenSSL ecc_cipher_;
+    petace::solo::ECOpenSSL::SecretKey sk_{};
+};
+
+// The Ristretto255 group on Curve25519, whose encrypted keys are 32-byte encodings.
+// Keys are hashed to 64 uniform bytes by two domain-separated SHA3-256 digests.
+class EcdhGroupRistretto255 : public EcdhGroup {
+public:
+    std::size_t point_byte_count() const override {
+        return kRistretto255PointBytesLen;
+    }
+
+    // An encoding is a non-negative field element below 2^255 in little-endian order, so that the lowest bit of the
+    // first byte and the highest bit of the last byte are always 0. Shorter tags start at the second byte instead.
+    std::size_t tag_offset(std::size_t tag_byte_count) const override {
+        return tag_byte_count < kRistretto255PointBytesLen ? 1 : 0;
+    }
+
+    // A uniform scalar below 2^252 is statistically close to uniform modulo the group order 2^252 + (a 125-bit value).
+    void create_secret_key(const std::shared_ptr<petace::solo::PRNG>& prng) override {
+        bool is_zero = true;
+        while (is_zero) {
+            prng->generate(sk_.size(), sk_.data());
+            sk_.back() &= 0x0f;
+            is_zero = std::all_of(sk_.begin(), sk_.end(), [](Byte byte) { return byte == 0; });
+        }
+        ristretto255_scalar_invert(sk_.data(), sk_inverse_.data());
+    }
+
+    void encrypt_key(const std::string& key, Byte* encrypted_key) const override {
+        encrypt_keys(Span<const std::string>(&key, 1), encrypted_key);
+    }
+
+    void encrypt_keys(Span<const std::string> keys, Byte* encrypted_keys) const override {
+        encrypt_keys_at(
+                keys.size(), [&](std::size_t idx) -> const std::string& { return keys[idx]; }, encrypted_keys);
+    }
+
+    void encrypt_keys(
+            Span<const std::string> keys, Span<const std::size_t> indices, Byte* encrypted_keys) const override {
+        encrypt_keys_at(
+                indices.size(), [&](std::size_t idx) -> const std::string& { return keys[indices[idx]]; },
+                encrypted_keys);
+    }
+
+    bool doublely_encrypt_key(const Byte* encrypted_key, std::size_t tag_byte_count, Byte* tag) const override {
+        std::array<Byte, kRistretto255PointBytesLen> point_bytes_buffer;
+        if (!ristretto255_scalar_mul(encrypted_key, sk_.data(), point_bytes_buffer.data())) {
+            return false;
+        }
+        std::copy_n(point_bytes_buffer.begin() + tag_offset(tag_byte_count), tag_byte_count, tag);
+        return true;
+    }
+
+    bool decrypt_key(const Byte* encrypted_key, std::size_t tag_byte_count, Byte* tag) const override {
+        std::array<Byte, kRistretto255PointBytesLen> point_bytes_buffer;
+        if (!ristretto255_scalar_mul(encrypted_key, sk_inverse_.data(), point_bytes_buffer.data())) {
+            return false;
+        }
+        std::copy_n(point_bytes_buffer.begin() + tag_offset(tag_byte_count), tag_byte_count, tag);
+        return true;
+    }
+
+private:
+    // Encrypts key_at(0), ..., key_at(key_count - 1).
+    template <typename KeyAt>
+    void encrypt_keys_at(std::size_t key_count, KeyAt key_at, Byte* encrypted_keys) const {
+        auto hash = petace::solo::Hash::create(petace::solo::HashScheme::SHA3_256);
+        ByteVector input;
+        std::array<Byte, kRistretto255UniformBytesLen> uniform_bytes;
+        const std::size_t digest_bytes_len = kRistretto255UniformBytesLen / 2;
+        for (std::size_t item_idx = 0; item_idx < key_count; ++item_idx) {
+            const std::string& key = key_at(item_idx);
+            input.assign(1, 0);
+            input.insert(input.end(), key.begin(), key.end());
+            for (std::size_t digest_idx = 0; digest_idx < 2; ++digest_idx) {
+                input[0] = static_cast<Byte>(digest_idx);
+                hash->compute(input.data(), input.size(), uniform_bytes.data() + digest_idx * digest_bytes_len,
+                        digest_bytes_len);
+            }
+            ristretto255_from_uniform_bytes_mul(
+                    uniform_bytes.data(), sk_.data(), encrypted_keys + item_idx * kRistretto255PointBytesLen);
+        }
+    }
+
+    std::array<Byte, kRistretto255ScalarBytesLen> sk_{};
+    std::array<Byte, kRistretto255ScalarBytesLen> sk_inverse_{};
+};
+
+}  // namespace
+
+void EcdhGroup::encrypt_keys(Span<const std::string> keys, Byte* encrypted_keys) const {
+    for (std::size_t item_idx = 0; item_idx < keys.size(); ++item_idx) {
+        encrypt_key(keys[item_idx], encrypted_keys + item_idx * point_byte_count());
+    }
+}
+
+void EcdhGroup::encrypt_keys(
+        Span<const std::string> keys, Span<const std::size_t> indices, Byte* encrypted_keys) const {
+    for (std::size_t item_idx = 0; item_idx < indices.size(); ++item_idx) {
+        encrypt_key(keys[indices[item_idx]], encrypted_keys + item_idx * point_byte_count());
+    }
+}
+
+bool EcdhGroup::doublely_encrypt_keys(
+        const Byte* encrypted_keys, std::size_t count, std::size_t tag_byte_count, Byte* tags) const {
+    bool all_valid = true;
+    for (std::size_t item_idx = 0; item_idx < count; ++item_idx) {
+        if (!doublely_encrypt_key(
+                    encrypted_keys + item_idx * point_byte_count(), tag_byte_count, tags + item_idx * tag_byte_count)) {
+            all_valid = false;
+        }
+    }
+    return all_valid;
+}
+
+bool EcdhGroup::decrypt_keys(
+        const Byte* encrypted_keys, std::size_t count, std::size_t tag_byte_count, Byte* tags) const {
+    bool all_valid = true;
+    for (std::size_t item_idx = 0; item_idx < count; ++item_idx) {
+        if (!decrypt_key(
+                    encrypted_keys + item_idx * point_byte_count(), tag_byte_count, tags + item_idx * tag_byte_count)) {
+            all_valid = false;
+        }
+    }
+    return all_valid;
+}
+
+std::unique_ptr<EcdhGroup> EcdhGroup::create(int curve_id) {
+    if (curve_id == kP256CurveId) {
+        return std::make_unique<EcdhGroupP256>();
+    }
+    if (curve_id == kCurve25519CurveId) {
+        return std::make_unique<EcdhGroupRistretto255>();
+    }
+    throw std::invalid_argument("curve_id(" + std::to_string(curve_id) + ") is not supported.");
+}
+
+std::vector<int> EcdhGroup::supported_curve_ids() {
+    return {kP256CurveId, kCurve25519CurveId};
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,164 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "solo/prng.h"
+
+#include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+
+namespace petace {
+namespace setops {
+
+// The curve ID of NIST P-256 in OpenSSL (NID_X9_62_prime256v1).
+const int kP256CurveId = 415;
+// The curve ID of Curve25519 in OpenSSL (NID_X25519), which selects the Ristretto255 group.
+const int kCurve25519CurveId = 1034;
+
+/**
+ * @brief A prime-order group with a secret key, which provides the two encryptions of ECDH-PSI.
+ *
+ * Encryption of a key hashes it to a group element and multiplies the element by the secret key. Double encryption
+ * multiplies an encrypted key of the other party by the secret key and keeps the bytes of the result at tag_offset as
+ * the compare tag. Decryption multiplies by the inverse of the secret key, which removes the secret key from a key
+ * encrypted by both parties. All are thread safe once the secret key is created.
+ */
+class EcdhGroup {
+public:
+    virtual ~EcdhGroup() = default;
+
+    /**
+     * @brief Creates the group of a curve.
+     *
+     * @param[in] curve_id The curve ID, kP256CurveId or kCurve25519CurveId.
+     * @throws std::invalid_argument if the curve is not supported.
+     */
+    static std::unique_ptr<EcdhGroup> create(int curve_id);
+
+    /**
+     * @brief Returns the IDs of supported curves.
+     */
+    static std::vector<int> supported_curve_ids();
+
+    /**
+     * @brief Returns the byte length of an encrypted key.
+     */
+    virtual std::size_t point_byte_count() const = 0;
+
+    /**
+     * @brief Returns the offset in an encrypted key of its compare tag of tag_byte_count bytes.
+     *
+     * A compare tag is tag_byte_count bytes of an encoding that are uniformly random across group elements, so that
+     * every byte of the tag counts towards the statistical security. The tag of point_byte_count() bytes is a complete
+     * encrypted key.
+     *
+     * @param[in] tag_byte_count The byte length of the compare tag, at most point_byte_count().
+     */
+    virtual std::size_t tag_offset(std::size_t tag_byte_count) const = 0;
+
+    /**
+     * @brief Creates the secret key from random bytes of a PRNG.
+     */
+    virtual void create_secret_key(const std::shared_ptr<petace::solo::PRNG>& prng) = 0;
+
+    /**
+     * @brief Hashes a key to the group and encrypts it with the secret key.
+     *
+     * @param[in] key The key.
+     * @param[out] encrypted_key The point_byte_count() bytes of the encrypted key.
+     */
+    virtual void encrypt_key(const std::string& key, Byte* encrypted_key) const = 0;
+
+    /**
+     * @brief Hashes a batch of keys to the group and encrypts them with the secret key.
+     *
+     * Groups override this to share work across the batch, which is faster than calling encrypt_key on every key.
+     *
+     * @param[in] keys The keys.
+     * @param[out] encrypted_keys The keys.size() * point_byte_count() bytes of encrypted keys in the order of keys.
+     */
+    virtual void encrypt_keys(Span<const std::string> keys, Byte* encrypted_keys) const;
+
+    /**
+     * @brief Hashes a batch of keys selected by indices to the group and encrypts them with the secret key.
+     *
+     * This encrypts keys in a shuffled order without copying them.
+     *
+     * @param[in] keys The keys.
+     * @param[in] indices The indices of keys to encrypt, each below keys.size().
+     * @param[out] encrypted_keys The indices.size() * point_byte_count() bytes of encrypted keys in the order of
+     * indices.
+     */
+    virtual void encrypt_keys(
+            Span<const std::string> keys, Span<const std::size_t> indices, Byte* encrypted_keys) const;
+
+    /**
+     * @brief Encrypts an encrypted key of the other party with the secret key.
+     *
+     * @param[in] encrypted_key The point_byte_count() bytes of the encrypted key.
+     * @param[in] tag_byte_count The byte length of the compare tag, at most point_byte_count(). The tag of
+     * point_byte_count() bytes is a complete encrypted key.
+     * @param[out] tag The tag_byte_count bytes of the compare tag.
+     * @return False if encrypted_key is not a valid group element, in which case tag is not written.
+     */
+    virtual bool doublely_encrypt_key(const Byte* encrypted_key, std::size_t tag_byte_count, Byte* tag) const = 0;
+
+    /**
+     * @brief Removes the secret key from a key encrypted by both parties.
+     *
+     * If a key k is encrypted to H(k)^(ab) with self secret key a and the other party's secret key b, decryption gives
+     * the tag of H(k)^b, which the other party can compute alone.
+     *
+     * @param[in] encrypted_key The point_byte_count() bytes of the key encrypted by both parties.
+     * @param[in] tag_byte_count The byte length of the compare tag, at most point_byte_count().
+     * @param[out] tag The tag_byte_count bytes of the compare tag.
+     * @return False if encrypted_key is not a valid group element, in which case tag is not written.
+     */
+    virtual bool decrypt_key(const Byte* encrypted_key, std::size_t tag_byte_count, Byte* tag) const = 0;
+
+    /**
+     * @brief Encrypts a batch of encrypted keys of the other party with the secret key, as doublely_encrypt_key.
+     *
+     * Groups override this to reuse per-thread scratch state, so that parallel callers do not allocate per key or
+     * batch.
+     *
+     * @param[in] encrypted_keys The count * point_byte_count() bytes of encrypted keys.
+     * @param[in] count The number of encrypted keys.
+     * @param[in] tag_byte_count The byte length of every compare tag, at most point_byte_count().
+     * @param[out] tags The count * tag_byte_count bytes of compare tags.
+     * @return False if any encrypted key is not a valid group element, in which case its tag is not written.
+     */
+    virtual bool doublely_encrypt_keys(
+            const Byte* encrypted_keys, std::size_t count, std::size_t tag_byte_count, Byte* tags) const;
+
+    /**
+     * @brief Removes the secret key from a batch of keys encrypted by both parties, as decrypt_key.
+     *
+     * @param[in] encrypted_keys The count * point_byte_count() bytes of keys encrypted by both parties.
+     * @param[in] count The number of encrypted keys.
+     * @param[in] tag_byte_count The byte length of every compare tag, at most point_byte_count().
+     * @param[out] tags The count * tag_byte_count bytes of compare tags.
+     * @return False if any encrypted key is not a valid group element, in which case its tag is not written.
+     */
+    virtual bool decrypt_keys(
+            const Byte* encrypted_keys, std::size_t count, std::size_t tag_byte_count, Byte* tags) const;
+};
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,375 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/psi/ecdh_incremental_state.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <numeric>
+#include <utility>
+
+#include "solo/hash.h"
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+const char kIncrementalStateFileMagic[8] = {'E', 'C', 'D', 'H', 'I', 'N', 'C', '2'};
+// Key digests of different states are separated by the seed of the secret key and this prefix.
+const char kIncrementalKeyDigestPrefix[] = "PETAce-SetOps-incremental-key";
+// Guards against allocating for a corrupted header.
+const std::size_t kMaxPointBytesLen = 256;
+
+// A state file holds this header, followed by the digests and the encrypted keys of self keys, compare tags of self
+// keys and compare tags of the other party, all in native byte order.
+struct IncrementalStateFileHeader {
+    char magic[8];
+    std::int32_t curve_id;
+    std::uint32_t obtain_result;
+    Byte key_seed[kRandSeedBytesLen];
+    Byte state_id[kIncrementalStateIdBytesLen];
+    std::uint64_t key_count;
+    std::uint64_t point_byte_count;
+    std::uint64_t tag_byte_count;
+    std::uint64_t remote_tag_count;
+};
+
+inline int compare_tags(const Byte* lhs, const Byte* rhs) {
+    return std::memcmp(lhs, rhs, kIncrementalTagBytesLen);
+}
+
+// Merges two buffers of sorted tags into one buffer of sorted tags.
+void merge_tags(const PointBuffer& lhs, const PointBuffer& rhs, PointBuffer& merged) {
+    merged.resize(lhs.size() + rhs.size(), kIncrementalTagBytesLen);
+    std::size_t lhs_idx = 0;
+    std::size_t rhs_idx = 0;
+    for (std::size_t item_idx = 0; item_idx < merged.size(); ++item_idx) {
+        bool take_lhs = rhs_idx == rhs.size() ||
+                        (lhs_idx < lhs.size() && compare_tags(lhs.point_data(lhs_idx), rhs.point_data(rhs_idx)) <= 0);
+        const Byte* tag = take_lhs ? lhs.point_data(lhs_idx++) : rhs.point_data(rhs_idx++);
+        std::memcpy(merged.point_data(item_idx), tag, kIncrementalTagBytesLen);
+    }
+}
+
+// Removes one occurrence of every tag of sorted removed tags from sorted tags.
+void subtract_tags(const PointBuffer& tags, const PointBuffer& removed_tags, PointBuffer& remaining) {
+    if (removed_tags.size() > tags.size()) {
+        throw std::invalid_argument("removed tags are not in the incremental state.");
+    }
+    remaining.resize(tags.size() - removed_tags.size(), kIncrementalTagBytesLen);
+    std::size_t removed_idx = 0;
+    std::size_t remaining_idx = 0;
+    for (std::size_t item_idx = 0; item_idx < tags.size(); ++item_idx) {
+        if (removed_idx < removed_tags.size() &&
+                compare_tags(tags.point_data(item_idx), removed_tags.point_data(removed_idx)) == 0) {
+            ++removed_idx;
+            continue;
+        }
+        if (remaining_idx == remaining.size()) {
+            break;
+        }
+        std::memcpy(remaining.point_data(remaining_idx++), tags.point_data(item_idx), kIncrementalTagBytesLen);
+    }
+    if (removed_idx != removed_tags.size()) {
+        throw std::invalid_argument("removed tags are not in the incremental state.");
+    }
+}
+
+void check_points(const PointBuffer& points, std::size_t size, std::size_t point_byte_count, const std::string& name) {
+    if (points.size() != size || (size != 0 && points.point_byte_count() != point_byte_count)) {
+        throw std::invalid_argument(name + " do not match the incremental state.");
+    }
+}
+
+void check_tags(const PointBuffer& tags, std::size_t size) {
+    check_points(tags, size, kIncrementalTagBytesLen, "tags");
+}
+
+inline int compare_digests(const Byte* lhs, const Byte* rhs) {
+    return std::memcmp(lhs, rhs, kIncrementalKeyDigestBytesLen);
+}
+
+// Returns the indices of points in lexicographical order of their first kIncrementalKeyDigestBytesLen bytes.
+std::vector<std::size_t> sort_digest_order(const PointBuffer& digests) {
+    std::vector<std::size_t> order(digests.size());
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::sort(order.begin(), order.end(), [&digests](std::size_t lhs, std::size_t rhs) {
+        return compare_digests(digests.point_data(lhs), digests.point_data(rhs)) < 0;
+    });
+    return order;
+}
+
+}  // namespace
+
+EcdhIncrementalState::EcdhIncrementalState(
+        int curve_id, const ByteVector& key_seed, std::size_t point_byte_count, bool obtain_result)
+        : curve_id_(curve_id), obtain_result_(obtain_result), key_seed_(key_seed) {
+    if (key_seed.size() != kRandSeedBytesLen) {
+        throw std::invalid_argument("key_seed size is not " + std::to_string(kRandSeedBytesLen) + ".");
+    }
+    if (point_byte_count == 0) {
+        throw std::invalid_argument("point_byte_count is 0.");
+    }
+    key_digests_.resize(0, kIncrementalKeyDigestBytesLen);
+    encrypted_keys_.resize(0, point_byte_count);
+    tags_.resize(0, kIncrementalTagBytesLen);
+    remote_tags_.resize(0, kIncrementalTagBytesLen);
+}
+
+std::shared_ptr<EcdhIncrementalState> EcdhIncrementalState::load(const std::string& file_path) {
+    std::ifstream in(file_path, std::ios::binary);
+    IncrementalStateFileHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || !std::equal(header.magic, header.magic + sizeof(header.magic), kIncrementalStateFileMagic)) {
+        throw std::invalid_argument("file " + file_path + " is not an incremental state.");
+    }
+    if (header.tag_byte_count != kIncrementalTagBytesLen) {
+        throw std::invalid_argument("file " + file_path + " has unexpected tag length.");
+    }
+    if (header.point_byte_count == 0 || header.point_byte_count > kMaxPointBytesLen) {
+        throw std::invalid_argument("file " + file_path + " has unexpected point length.");
+    }
+
+    std::shared_ptr<EcdhIncrementalState> state(new EcdhIncrementalState());
+    state->curve_id_ = header.curve_id;
+    state->obtain_result_ = header.obtain_result != 0;
+    state->key_seed_.assign(header.key_seed, header.key_seed + kRandSeedBytesLen);
+    std::copy_n(header.state_id, kIncrementalStateIdBytesLen, state->state_id_.data());
+    auto key_count = static_cast<std::size_t>(header.key_count);
+    state->key_digests_.resize(key_count, kIncrementalKeyDigestBytesLen);
+    in.read(reinterpret_cast<char*>(state->key_digests_.data()),
+            static_cast<std::streamsize>(state->key_digests_.byte_count()));
+    state->encrypted_keys_.resize(key_count, static_cast<std::size_t>(header.point_byte_count));
+    in.read(reinterpret_cast<char*>(state->encrypted_keys_.data()),
+            static_cast<std::streamsize>(state->encrypted_keys_.byte_count()));
+    state->tags_.resize(state->obtain_result_ ? key_count : 0, kIncrementalTagBytesLen);
+    in.read(reinterpret_cast<char*>(state->tags_.data()), static_cast<std::streamsize>(state->tags_.byte_count()));
+    state->remote_tags_.resize(static_cast<std::size_t>(header.remote_tag_count), kIncrementalTagBytesLen);
+    in.read(reinterpret_cast<char*>(state->remote_tags_.data()),
+            static_cast<std::streamsize>(state->remote_tags_.byte_count()));
+    if (!in) {
+        throw std::runtime_error("file " + file_path + " read failed.");
+    }
+    return state;
+}
+
+void EcdhIncrementalState::save(const std::string& file_path) const {
+    IncrementalStateFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::copy_n(kIncrementalStateFileMagic, sizeof(header.magic), header.magic);
+    header.curve_id = curve_id_;
+    header.obtain_result = obtain_result_ ? 1 : 0;
+    std::copy_n(key_seed_.data(), kRandSeedBytesLen, header.key_seed);
+    std::copy_n(state_id_.data(), kIncrementalStateIdBytesLen, header.state_id);
+    header.key_count = key_digests_.size();
+    header.point_byte_count = encrypted_keys_.point_byte_count();
+    header.tag_byte_count = kIncrementalTagBytesLen;
+    header.remote_tag_count = remote_tags_.size();
+
+    std::string temp_path = file_path + ".tmp";
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(key_digests_.data()),
+            static_cast<std::streamsize>(key_digests_.byte_count()));
+    out.write(reinterpret_cast<const char*>(encrypted_keys_.data()),
+            static_cast<std::streamsize>(encrypted_keys_.byte_count()));
+    out.write(reinterpret_cast<const char*>(tags_.data()), static_cast<std::streamsize>(tags_.byte_count()));
+    out.write(reinterpret_cast<const char*>(remote_tags_.data()),
+            static_cast<std::streamsize>(remote_tags_.byte_count()));
+    out.close();
+    if (!out || std::rename(temp_path.c_str(), file_path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        throw std::runtime_error("file " + file_path + " write failed.");
+    }
+}
+
+void EcdhIncrementalState::digest_keys(
+        const std::vector<std::string>& keys, std::size_t num_threads, PointBuffer& digests) const {
+    digests.resize(keys.size(), kIncrementalKeyDigestBytesLen);
+#pragma omp parallel num_threads(num_threads)
+    {
+        auto hash = petace::solo::Hash::create(petace::solo::HashScheme::SHA_256);
+        ByteVector input(
+                kIncrementalKeyDigestPrefix, kIncrementalKeyDigestPrefix + sizeof(kIncrementalKeyDigestPrefix) - 1);
+        input.insert(input.end(), key_seed_.begin(), key_seed_.end());
+        std::size_t key_begin = input.size();
+#pragma omp for
+        for (std::size_t item_idx = 0; item_idx < keys.size(); ++item_idx) {
+            input.resize(key_begin);
+            input.insert(input.end(), keys[item_idx].begin(), keys[item_idx].end());
+            hash->compute(input.data(), input.size(), digests.point_data(item_idx), kIncrementalKeyDigestBytesLen);
+        }
+    }
+}
+
+void EcdhIncrementalState::diff(const PointBuffer& input_digests, std::vector<std::size_t>& added_indices,
+        PointBuffer& removed_digests, PointBuffer& removed_encrypted_keys) const {
+    check_points(input_digests, input_digests.size(), kIncrementalKeyDigestBytesLen, "digests");
+    std::vector<std::size_t> input_order = sort_digest_order(input_digests);
+    input_order.erase(std::unique(input_order.begin(), input_order.end(),
+                              [&input_digests](std::size_t lhs, std::size_t rhs) {
+                                  return compare_digests(input_digests.point_data(lhs),
+                                                 input_digests.point_data(rhs)) == 0;
+                              }),
+            input_order.end());
+
+    added_indices.clear();
+    std::vector<std::size_t> removed_indices;
+    std::size_t input_idx = 0;
+    std::size_t state_idx = 0;
+    while (input_idx < input_order.size() || state_idx < size()) {
+        int cmp = 0;
+        if (state_idx == size()) {
+            cmp = -1;
+        } else if (input_idx == input_order.size()) {
+            cmp = 1;
+        } else {
+            cmp = compare_digests(input_digests.point_data(input_order[input_idx]), key_digests_.point_data(state_idx));
+        }
+        if (cmp < 0) {
+            added_indices.emplace_back(input_order[input_idx++]);
+        } else if (cmp > 0) {
+            removed_indices.emplace_back(state_idx++);
+        } else {
+            ++input_idx;
+            ++state_idx;
+        }
+    }
+    removed_digests.resize(removed_indices.size(), kIncrementalKeyDigestBytesLen);
+    removed_encrypted_keys.resize(removed_indices.size(), encrypted_keys_.point_byte_count());
+    for (std::size_t item_idx = 0; item_idx < removed_indices.size(); ++item_idx) {
+        std::memcpy(removed_digests.point_data(item_idx), key_digests_.point_data(removed_indices[item_idx]),
+                kIncrementalKeyDigestBytesLen);
+        std::memcpy(removed_encrypted_keys.point_data(item_idx), encrypted_keys_.point_data(removed_indices[item_idx]),
+                encrypted_keys_.point_byte_count());
+    }
+}
+
+void EcdhIncrementalState::update(const PointBuffer& added_digests, const PointBuffer& added_encrypted_keys,
+        const PointBuffer& added_tags, const PointBuffer& removed_digests, const PointBuffer& remote_added_tags,
+        const PointBuffer& remote_removed_tags, const std::array<Byte, kIncrementalStateIdBytesLen>& state_id) {
+    check_points(added_digests, added_digests.size(), kIncrementalKeyDigestBytesLen, "digests");
+    check_points(removed_digests, removed_digests.size(), kIncrementalKeyDigestBytesLen, "digests");
+    check_points(added_encrypted_keys, added_digests.size(), encrypted_keys_.point_byte_count(), "encrypted keys");
+    if (obtain_result_) {
+        check_tags(added_tags, added_digests.size());
+        check_tags(remote_added_tags, remote_added_tags.size());
+        check_tags(remote_removed_tags, remote_removed_tags.size());
+    }
+
+    // The change is checked before anything is modified, so that a failed update leaves the state as it was.
+    std::vector<std::size_t> removed_order = sort_digest_order(removed_digests);
+    for (std::size_t item_idx = 0; item_idx < removed_order.size(); ++item_idx) {
+        const Byte* digest = removed_digests.point_data(removed_order[item_idx]);
+        bool repeated =
+                item_idx > 0 && compare_digests(removed_digests.point_data(removed_order[item_idx - 1]), digest) == 0;
+        if (find_key(digest) == size() || repeated) {
+            throw std::invalid_argument("removed keys are not in the incremental state.");
+        }
+    }
+    std::vector<std::size_t> added_order = sort_digest_order(added_digests);
+    for (std::size_t item_idx = 0; item_idx < added_order.size(); ++item_idx) {
+        const Byte* digest = added_digests.point_data(added_order[item_idx]);
+        bool repeated =
+                item_idx > 0 && compare_digests(added_digests.point_data(added_order[item_idx - 1]), digest) == 0;
+        if (find_key(digest) != size() || repeated) {
+            throw std::invalid_argument("added keys are already in the incremental state.");
+        }
+    }
+    PointBuffer remote_tags;
+    if (obtain_result_) {
+        PointBuffer merged_tags;
+        merge_tags(remote_tags_, remote_added_tags, merged_tags);
+        subtract_tags(merged_tags, remote_removed_tags, remote_tags);
+    }
+
+    // Self keys and their tags are rebuilt by one merge of kept keys and added keys sorted by digest.
+    std::size_t key_count = size() - removed_order.size() + added_order.size();
+    PointBuffer key_digests(key_count, kIncrementalKeyDigestBytesLen);
+    PointBuffer encrypted_keys(key_count, encrypted_keys_.point_byte_count());
+    PointBuffer tags(obtain_result_ ? key_count : 0, kIncrementalTagBytesLen);
+    std::size_t key_idx = 0;
+    auto append_key = [&](const Byte* digest, const Byte* encrypted_key, const Byte* tag) {
+        std::memcpy(key_digests.point_data(key_idx), digest, kIncrementalKeyDigestBytesLen);
+        std::memcpy(encrypted_keys.point_data(key_idx), encrypted_key, encrypted_keys.point_byte_count());
+        if (obtain_result_) {
+            std::memcpy(tags.point_data(key_idx), tag, kIncrementalTagBytesLen);
+        }
+        ++key_idx;
+    };
+    auto append_added_key = [&](std::size_t added_idx) {
+        append_key(added_digests.point_data(added_idx), added_encrypted_keys.point_data(added_idx),
+                obtain_result_ ? added_tags.point_data(added_idx) : nullptr);
+    };
+    std::size_t removed_idx = 0;
+    std::size_t added_idx = 0;
+    for (std::size_t state_idx = 0; state_idx < size(); ++state_idx) {
+        const Byte* digest = key_digests_.point_data(state_idx);
+        while (added_idx < added_order.size() &&
+                compare_digests(added_digests.point_data(added_order[added_idx]), digest) < 0) {
+            append_added_key(added_order[added_idx++]);
+        }
+        if (removed_idx < removed_order.size() &&
+                compare_digests(removed_digests.point_data(removed_order[removed_idx]), digest) == 0) {
+            ++removed_idx;
+            continue;
+        }
+        append_key(digest, encrypted_keys_.point_data(state_idx),
+                obtain_result_ ? tags_.point_data(state_idx) : nullptr);
+    }
+    for (; added_idx < added_order.size(); ++added_idx) {
+        append_added_key(added_order[added_idx]);
+    }
+
+    key_digests_.swap(key_digests);
+    encrypted_keys_.swap(encrypted_keys);
+    tags_.swap(tags);
+    if (obtain_result_) {
+        remote_tags_.swap(remote_tags);
+    }
+    state_id_ = state_id;
+}
+
+bool EcdhIncrementalState::matches(const Byte* key_digest) const {
+    if (!obtain_result_) {
+        return false;
+    }
+    std::size_t key_idx = find_key(key_digest);
+    return key_idx != size() && binary_search_point(remote_tags_, tags_.point_data(key_idx));
+}
+
+std::size_t EcdhIncrementalState::find_key(const Byte* key_digest) const {
+    std::size_t low = 0;
+    std::size_t high = size();
+    while (low < high) {
+        std::size_t mid = low + (high - low) / 2;
+        if (compare_digests(key_digests_.point_data(mid), key_digest) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == size() || compare_digests(key_digests_.point_data(low), key_digest) != 0) {
+        return size();
+    }
+    return low;
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,178 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+
+namespace petace {
+namespace setops {
+
+// The byte length of compare tags kept in an incremental state, which stays fixed as sets grow across runs.
+const std::size_t kIncrementalTagBytesLen = kECCMaxCompareBytesLen;
+// The byte length of the digest an incremental state keeps of every self key in place of the key.
+const std::size_t kIncrementalKeyDigestBytesLen = 32;
+// The byte length of the ID both parties assign to their states after every run.
+const std::size_t kIncrementalStateIdBytesLen = 16;
+
+/**
+ * @brief The state one party of incremental ECDH-PSI keeps between runs.
+ *
+ * The state holds the seed of a long-lived secret key, the self keys of the last run without duplicates, and an ID
+ * shared with the state of the other party. Self keys are not stored as they are. Every self key is kept as its digest
+ * keyed by the seed, by which input keys are matched, and its encrypted key, which is sent again once the key is
+ * removed. Self keys are sorted by digest. If the party obtains result, the state also holds the compare tag of every
+ * self key and the sorted compare tags of the other party's keys, so that a run only needs to exchange and encrypt
+ * added and removed keys.
+ */
+class EcdhIncrementalState {
+public:
+    /**
+     * @brief Creates an empty state, which has the all-zero ID.
+     *
+     * @param[in] curve_id The ECC curve ID.
+     * @param[in] key_seed The seed of the secret key.
+     * @param[in] point_byte_count The byte length of an encrypted key.
+     * @param[in] obtain_result Whether the party obtains result.
+     * @throws std::invalid_argument if the size of key_seed is not kRandSeedBytesLen or point_byte_count is 0.
+     */
+    EcdhIncrementalState(int curve_id, const ByteVector& key_seed, std::size_t point_byte_count, bool obtain_result);
+
+    /**
+     * @brief Loads a state saved by save.
+     *
+     * @param[in] file_path The file path.
+     * @throws std::invalid_argument if the file is not a saved state.
+     * @throws std::runtime_error if the file cannot be read.
+     */
+    static std::shared_ptr<EcdhIncrementalState> load(const std::string& file_path);
+
+    /**
+     * @brief Saves the state, including its secret key, to a binary file in native byte order.
+     *
+     * The state is written to a temporary file next to file_path, which then replaces file_path, so that a failed save
+     * never leaves a partial state behind.
+     *
+     * @param[in] file_path The file path.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void save(const std::string& file_path) const;
+
+    /**
+     * @brief Computes the digests of keys keyed by the seed of the state.
+     *
+     * @param[in] keys The keys.
+     * @param[in] num_threads The number of threads.
+     * @param[out] digests The digests of kIncrementalKeyDigestBytesLen bytes in the order of keys.
+     */
+    void digest_keys(const std::vector<std::string>& keys, std::size_t num_threads, PointBuffer& digests) const;
+
+    /**
+     * @brief Computes the change from self keys of the state to input keys.
+     *
+     * @param[in] input_digests The digests of input keys by digest_keys, which may contain duplicates.
+     * @param[out] added_indices The indices of input keys not in the state, one for every distinct key.
+     * @param[out] removed_digests The digests of keys in the state not in input keys.
+     * @param[out] removed_encrypted_keys The encrypted keys of keys in the state not in input keys, in the order of
+     * removed_digests.
+     */
+    void diff(const PointBuffer& input_digests, std::vector<std::size_t>& added_indices, PointBuffer& removed_digests,
+            PointBuffer& removed_encrypted_keys) const;
+
+    /**
+     * @brief Applies a change of both parties and assigns a new ID.
+     *
+     * @param[in] added_digests The digests of added self keys in any order.
+     * @param[in] added_encrypted_keys The encrypted keys of added self keys in the order of added_digests.
+     * @param[in] added_tags The compare tags of added self keys in the order of added_digests, which are ignored
+     * unless the party obtains result.
+     * @param[in] removed_digests The digests of removed self keys in any order.
+     * @param[in] remote_added_tags The compare tags of keys the other party added, sorted by sort_points.
+     * @param[in] remote_removed_tags The compare tags of keys the other party removed, sorted by sort_points.
+     * @param[in] state_id The new ID.
+     * @throws std::invalid_argument if a removed key or tag is not in the state, an added key is already in the state,
+     * or digests, encrypted keys or tags have unexpected length.
+     */
+    void update(const PointBuffer& added_digests, const PointBuffer& added_encrypted_keys,
+            const PointBuffer& added_tags, const PointBuffer& removed_digests, const PointBuffer& remote_added_tags,
+            const PointBuffer& remote_removed_tags, const std::array<Byte, kIncrementalStateIdBytesLen>& state_id);
+
+    /**
+     * @brief Returns whether a self key of the state has its compare tag among the compare tags of the other party.
+     *
+     * @param[in] key_digest The kIncrementalKeyDigestBytesLen bytes of the digest of the key by digest_keys.
+     * @return False if the key is not in the state or the party does not obtain result.
+     */
+    bool matches(const Byte* key_digest) const;
+
+    int curve_id() const {
+        return curve_id_;
+    }
+
+    const ByteVector& key_seed() const {
+        return key_seed_;
+    }
+
+    bool obtain_result() const {
+        return obtain_result_;
+    }
+
+    const std::array<Byte, kIncrementalStateIdBytesLen>& state_id() const {
+        return state_id_;
+    }
+
+    std::size_t size() const {
+        return key_digests_.size();
+    }
+
+    const PointBuffer& key_digests() const {
+        return key_digests_;
+    }
+
+    const PointBuffer& encrypted_keys() const {
+        return encrypted_keys_;
+    }
+
+    const PointBuffer& tags() const {
+        return tags_;
+    }
+
+    const PointBuffer& remote_tags() const {
+        return remote_tags_;
+    }
+
+private:
+    EcdhIncrementalState() = default;
+
+    // Returns the index of a digest among sorted key digests, or size() if it is not in the state.
+    std::size_t find_key(const Byte* key_digest) const;
+
+    int curve_id_ = 0;
+    bool obtain_result_ = false;
+    ByteVector key_seed_{};
+    std::array<Byte, kIncrementalStateIdBytesLen> state_id_{};
+    PointBuffer key_digests_{};
+    PointBuffer encrypted_keys_{};
+    PointBuffer tags_{};
+    PointBuffer remote_tags_{};
+};
+
+}  // namespace setops
+}  // namespace petace
@@ -14,23 +14,178 @@
 
 #include "setops/psi/ecdh_psi.h"
 
-#include <omp.h>
-
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <numeric>
+#include <utility>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "glog/logging.h"
 
+#include "solo/hash.h"
 #include "solo/prng.h"
 
+#include "setops/util/cuckoo_filter.h"
+#include "setops/util/elias_fano.h"
+#include "setops/util/external_sort.h"
+#include "setops/util/hash_join.h"
 #include "setops/util/parameter_check.h"
 #include "setops/util/permutation.h"
+#include "setops/util/radix_sort.h"
+#include "setops/util/ristretto255.h"
 
 namespace petace {
 namespace setops {
 
-void EcdhPSI::init(const std::shared_ptr<network::Network>& net, const json& params) {
-    auto defalut_config = R"({
+namespace {
+
+// The version of encrypted key encodings and hashing to the group, which both parties must agree on. Version 3 sends
+// P-256 encrypted keys as compressed points and hashes keys to P-256 by the simplified SWU map of RFC 9380.
+const std::uint32_t kEcdhProtocolVersion = 3;
+// A shuffle record holds random bytes to sort by, followed by an input index.
+const std::size_t kShuffleRandomBytesLen = 8;
+const std::size_t kIndexBytesLen = 8;
+const std::size_t kShuffleRecordLen = kShuffleRandomBytesLen + kIndexBytesLen;
+// Keys are encrypted in batches of this many keys, which share work such as one field inversion.
+const std::size_t kEncryptBatchSize = 64;
+// A filter is identified by random bytes drawn when it is built.
+const std::size_t kFilterIdBytesLen = 16;
+// The encryption of this key identifies the secret key of a filter without revealing the secret key.
+const char kFilterKeyCheckKey[] = "PETAce-SetOps-filter-key-check";
+const char kFilterFileMagic[8] = {'E', 'C', 'D', 'H', 'F', 'L', 'T', '2'};
+// Payload key streams of a session are separated from other sessions by a random nonce.
+const std::size_t kPayloadNonceBytesLen = 16;
+// A payload key stream block is a SHA3-256 digest of a 32-bit block counter, the nonce and an encrypted key of at most
+// kEccPointLen bytes.
+const std::size_t kPayloadKeyStreamBlockBytesLen = 32;
+const std::size_t kPayloadKeyStreamInputMaxBytesLen = sizeof(std::uint32_t) + kPayloadNonceBytesLen + kEccPointLen;
+// An exponential ElGamal ciphertext (r * G, v * G + r * X) of a value v under the public key X.
+const std::size_t kElGamalCiphertextBytesLen = 2 * kRistretto255PointBytesLen;
+
+// A filter file holds this header, followed by the slots of the filter.
+// The key check, key count and input keys hash identify the encrypted set of the filter and are only set by the party
+// that builds the filter.
+struct FilterFileHeader {
+    char magic[8];
+    Byte filter_id[kFilterIdBytesLen];
+    Byte key_check[kECCMaxCompareBytesLen];
+    std::uint64_t bucket_count;
+    std::uint64_t size;
+    std::uint64_t fingerprint_bytes_len;
+    std::uint64_t key_count;
+    Byte input_keys_hash[kInputKeysHashBytesLen];
+};
+
+// Indices are stored in big endian, so that sorting records by bytes also sorts them by index.
+inline void store_index(std::size_t index, Byte* out) {
+    for (std::size_t byte_idx = 0; byte_idx < kIndexBytesLen; ++byte_idx) {
+        out[kIndexBytesLen - 1 - byte_idx] = static_cast<Byte>(index >> (8 * byte_idx));
+    }
+}
+
+inline std::size_t load_index(const Byte* in) {
+    std::size_t index = 0;
+    for (std::size_t byte_idx = 0; byte_idx < kIndexBytesLen; ++byte_idx) {
+        index = (index << 8) | in[byte_idx];
+    }
+    return index;
+}
+
+// Returns the smallest bit count b such that 2^b >= value.
+inline std::size_t ceil_log2(std::size_t value) {
+    std::size_t bit_count = 0;
+    while (bit_count < 64 && (std::size_t(1) << bit_count) < value) {
+        ++bit_count;
+    }
+    return bit_count;
+}
+
+// Encrypts or decrypts a payload in place by a key stream, whose blocks are SHA3-256 digests of a block counter, the
+// session nonce and the whole encrypted key. Callers reuse one hash per thread, and the digest input is on the stack.
+void xor_payload_key_stream(const petace::solo::Hash& hash, const Byte* nonce, ConstByteSpan encrypted_key,
+        Byte* payload, std::size_t payload_byte_count) {
+    std::array<Byte, kPayloadKeyStreamInputMaxBytesLen> input;
+    std::size_t input_byte_count = sizeof(std::uint32_t) + kPayloadNonceBytesLen + encrypted_key.size();
+    std::copy_n(nonce, kPayloadNonceBytesLen, input.begin() + sizeof(std::uint32_t));
+    std::copy(encrypted_key.begin(), encrypted_key.end(),
+            input.begin() + sizeof(std::uint32_t) + kPayloadNonceBytesLen);
+    std::array<Byte, kPayloadKeyStreamBlockBytesLen> block;
+    std::uint32_t block_idx = 0;
+    for (std::size_t begin = 0; begin < payload_byte_count; begin += block.size(), ++block_idx) {
+        for (std::size_t byte_idx = 0; byte_idx < sizeof(std::uint32_t); ++byte_idx) {
+            input[byte_idx] = static_cast<Byte>(block_idx >> (8 * byte_idx));
+        }
+        hash.compute(input.data(), input_byte_count, block.data(), block.size());
+        std::size_t end = std::min(begin + block.size(), payload_byte_count);
+        for (std::size_t byte_idx = begin; byte_idx < end; ++byte_idx) {
+            payload[byte_idx] ^= block[byte_idx - begin];
+        }
+    }
+}
+
+// Draws a uniform non-zero scalar below 2^252, which is statistically close to uniform modulo the group order.
+void generate_ristretto255_scalar(petace::solo::PRNG& prng, Byte* scalar) {
+    bool is_zero = true;
+    while (is_zero) {
+        prng.generate(kRistretto255ScalarBytesLen, scalar);
+        scalar[kRistretto255ScalarBytesLen - 1] &= 0x0f;
+        is_zero = std::all_of(scalar, scalar + kRistretto255ScalarBytesLen, [](Byte byte) { return byte == 0; });
+    }
+}
+
+void scalar_from_value(std::uint64_t value, Byte* scalar) {
+    std::fill_n(scalar, kRistretto255ScalarBytesLen, Byte(0));
+    for (std::size_t byte_idx = 0; byte_idx < sizeof(value); ++byte_idx) {
+        scalar[byte_idx] = static_cast<Byte>(value >> (8 * byte_idx));
+    }
+}
+
+// Encrypts a value with exponential ElGamal under a public key and the given randomness.
+// Returns false if public_key is not a valid point.
+bool encrypt_value(const Byte* public_key, std::uint64_t value, const Byte* randomness, Byte* ciphertext) {
+    std::array<Byte, kRistretto255ScalarBytesLen> value_scalar;
+    std::array<Byte, 2 * kRistretto255PointBytesLen> terms;
+    scalar_from_value(value, value_scalar.data());
+    ristretto255_base_mul(randomness, ciphertext);
+    ristretto255_base_mul(value_scalar.data(), terms.data());
+    return ristretto255_scalar_mul(public_key, randomness, terms.data() + kRistretto255PointBytesLen) &&
+           ristretto255_sum(terms.data(), 2, ciphertext + kRistretto255PointBytesLen);
+}
+
+// Adds up ciphertexts component by component. Returns false if any ciphertext is not valid.
+bool sum_ciphertexts(const PointBuffer& ciphertexts, const std::size_t* indices, std::size_t count, Byte* sum) {
+    PointBuffer terms(count, kRistretto255PointBytesLen);
+    for (std::size_t part_idx = 0; part_idx < 2; ++part_idx) {
+        for (std::size_t item_idx = 0; item_idx < count; ++item_idx) {
+            std::copy_n(ciphertexts.point_data(indices[item_idx]) + part_idx * kRistretto255PointBytesLen,
+                    kRistretto255PointBytesLen, terms.point_data(item_idx));
+        }
+        if (!ristretto255_sum(terms.data(), count, sum + part_idx * kRistretto255PointBytesLen)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Copies the points at positions of a range of points into a buffer, in the order of positions.
+void gather_points(const PointBuffer& points, std::size_t offset, const std::vector<std::size_t>& positions,
+        PointBuffer& gathered_points) {
+    gathered_points.resize(positions.size(), points.point_byte_count());
+    for (std::size_t item_idx = 0; item_idx < positions.size(); ++item_idx) {
+        std::copy_n(points.point_data(offset + positions[item_idx]), points.point_byte_count(),
+                gathered_points.point_data(item_idx));
+    }
+}
+
+json default_config() {
+    return R"({
         "network": {
             "address": "127.0.0.1",
             "remote_port": 30330,
@@ -50,20 +205,113 @@ void EcdhPSI::init(const std::shared_ptr<network::Network>& net, const json& par
             "has_header": false,
             "output_file": "/data/receiver_output_file.csv"
         },
+        "threads": {
+            "num_threads": 0,
+            "cpu_affinity": [],
+            "numa_node": -1
+        },
         "ecdh_params": {
             "curve_id": 415,
-            "obtain_result": true
+            "obtain_result": true,
+            "chunk_size": 65536,
+            "intersection_scheme": "hash_join",
+            "spill_dir": "",
+            "memory_limit_mb": 1024,
+            "secret_key_file": "",
+            "precomputed_file": "",
+            "num_threads": 0,
+            "statistical_security_bits": 40,
+            "unbalanced": false,
+            "filter_file": "",
+            "filter_max_lookups": 1048576,
+            "incremental": false,
+            "state_file": "",
+            "compress_tags": false
         }
     })"_json;
+}
+
+ByteVector read_key_seed(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    ByteVector key_seed(kRandSeedBytesLen);
+    in.read(reinterpret_cast<char*>(key_seed.data()), static_cast<std::streamsize>(key_seed.size()));
+    if (!in) {
+        throw std::runtime_error("file " + path + " read failed.");
+    }
+    return key_seed;
+}
+
+void write_key_seed(const std::string& path, const ByteVector& key_seed) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(key_seed.data()), static_cast<std::streamsize>(key_seed.size()));
+    if (!out) {
+        throw std::runtime_error("file " + path + " write failed.");
+    }
+}
+
+void save_filter_file(const std::string& path, const FilterFileHeader& header, const CuckooFilter& filter) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(filter.data()), static_cast<std::streamsize>(filter.byte_count()));
+    out.close();
+    if (!out) {
+        throw std::runtime_error("file " + path + " write failed.");
+    }
+}
+
+void load_filter_file(const std::string& path, FilterFileHeader& header, CuckooFilter& filter) {
+    std::ifstream in(path, std::ios::binary);
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || !std::equal(header.magic, header.magic + sizeof(header.magic), kFilterFileMagic)) {
+        throw std::invalid_argument("file " + path + " is not a filter.");
+    }
+    if (header.fingerprint_bytes_len == 0 || header.fingerprint_bytes_len > kCuckooFilterMaxFingerprintBytesLen) {
+        throw std::invalid_argument("file " + path + " has unexpected fingerprint length.");
+    }
+    filter.resize(static_cast<std::size_t>(header.bucket_count), static_cast<std::size_t>(header.size),
+            static_cast<std::size_t>(header.fingerprint_bytes_len));
+    in.read(reinterpret_cast<char*>(filter.data()), static_cast<std::streamsize>(filter.byte_count()));
+    if (!in) {
+        throw std::runtime_error("file " + path + " read failed.");
+    }
+}
 
+}  // namespace
+
+void EcdhPSI::init(const std::shared_ptr<network::Network>& net, const json& params) {
+    init(net, params, nullptr);
+}
+
+void EcdhPSI::init(const std::shared_ptr<network::Network>& net, const json& params,
+        std::shared_ptr<const EcdhEncryptedSet> encrypted_set, bool input_keys_verified) {
+    auto defalut_config = default_config();
     defalut_config.merge_patch(params);
     params_ = defalut_config;
 
     verbose_ = params_["common"]["verbose"];
     is_sender_ = params_["common"]["is_sender"];
 
+    incremental_ = params_["ecdh_params"]["incremental"];
     check_params(net);
 
+    // Only one party may hold an encrypted set, so both parties learn whether it is usable before either one throws.
+    std::string spill_dir = params_["ecdh_params"]["spill_dir"];
+    bool encrypted_set_unsupported = encrypted_set != nullptr && (!spill_dir.empty() || incremental_);
+    bool remote_encrypted_set_unsupported = false;
+    if (is_sender_) {
+        net->send_data(&encrypted_set_unsupported, sizeof(encrypted_set_unsupported));
+        net->recv_data(&remote_encrypted_set_unsupported, sizeof(remote_encrypted_set_unsupported));
+    } else {
+        net->recv_data(&remote_encrypted_set_unsupported, sizeof(remote_encrypted_set_unsupported));
+        net->send_data(&encrypted_set_unsupported, sizeof(encrypted_set_unsupported));
+    }
+    if (encrypted_set_unsupported) {
+        throw std::invalid_argument("encrypted set is not supported with spill_dir or incremental.");
+    }
+    if (remote_encrypted_set_unsupported) {
+        throw std::invalid_argument("encrypted set of the peer is not supported with spill_dir or incremental.");
+    }
+
     LOG_IF(INFO, verbose_) << "\nECDH PSI parameters: \n" << params_.dump(4);
 
     obtain_result_ = params_["ecdh_params"]["obtain_result"];
@@ -74,16 +322,83 @@ void EcdhPSI::init(const std::shared_ptr<network::Network>& net, const json& par
         net->recv_data(&remote_obtain_result_, sizeof(remote_obtain_result_));
         net->send_data(&obtain_result_, sizeof(obtain_result_));
     }
+    unbalanced_ = params_["ecdh_params"]["unbalanced"];
+    if (unbalanced_ && obtain_result_ == remote_obtain_result_) {
+        throw std::invalid_argument("unbalanced mode requires exactly one party to obtain result.");
+    }
 
     int curve_id = params_["ecdh_params"]["curve_id"];
-    ecc_cipher_ = std::make_unique<petace::solo::ECOpenSSL>(curve_id, petace::solo::HashScheme::SHA3_256);
+    group_ = EcdhGroup::create(curve_id);
     LOG_IF(INFO, verbose_) << "ecc curve id is " << curve_id;
 
+    // A persisted key is derived from a seed, so that the key can be restored across sessions.
+    encrypted_set_ = encrypted_set;
+    encrypted_set_verified_ = encrypted_set_ != nullptr && input_keys_verified;
+    std::string precomputed_file = params_["ecdh_params"]["precomputed_file"];
+    if (encrypted_set_ == nullptr && !precomputed_file.empty()) {
+        encrypted_set_ = EcdhEncryptedSet::load(precomputed_file);
+        LOG_IF(INFO, verbose_) << "encrypted set is loaded from " << precomputed_file;
+    }
+    std::string secret_key_file = params_["ecdh_params"]["secret_key_file"];
+    state_file_ = params_["ecdh_params"]["state_file"];
     auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
-    auto prng = prng_factory.create();
-    ecc_cipher_->create_secret_key(prng, sk_);
+    ByteVector key_seed;
+    if (encrypted_set_ != nullptr) {
+        if (encrypted_set_->curve_id() != curve_id) {
+            throw std::invalid_argument("curve_id of encrypted set does not match.");
+        }
+        if (encrypted_set_->encrypted_keys().point_byte_count() != group_->point_byte_count()) {
+            throw std::invalid_argument("encrypted set has unexpected point length.");
+        }
+        key_seed = encrypted_set_->key_seed();
+    } else if (incremental_ && std::ifstream(state_file_).good()) {
+        incremental_state_ = EcdhIncrementalState::load(state_file_);
+        if (incremental_state_->curve_id() != curve_id) {
+            throw std::invalid_argument("curve_id of incremental state does not match.");
+        }
+        if (incremental_state_->obtain_result() != obtain_result_) {
+            throw std::invalid_argument("obtain_result of incremental state does not match.");
+        }
+        if (incremental_state_->encrypted_keys().point_byte_count() != group_->point_byte_count()) {
+            throw std::invalid_argument("incremental state has unexpected point length.");
+        }
+        key_seed = incremental_state_->key_seed();
+        LOG_IF(INFO, verbose_) << "incremental state of " << incremental_state_->size()
+                               << " keys is loaded from " << state_file_;
+    } else if (!secret_key_file.empty()) {
+        key_seed = read_key_seed(secret_key_file);
+        LOG_IF(INFO, verbose_) << "secret key is loaded from " << secret_key_file;
+    }
+    if (incremental_ && incremental_state_ == nullptr) {
+        if (key_seed.empty()) {
+            key_seed.resize(kRandSeedBytesLen);
+            prng_factory.create()->generate(key_seed.size(), key_seed.data());
+        }
+        incremental_state_ = std::make_shared<EcdhIncrementalState>(
+                curve_id, key_seed, group_->point_byte_count(), obtain_result_);
+    }
+    auto prng = key_seed.empty() ? prng_factory.create() : prng_factory.create(key_seed);
+    group_->create_secret_key(prng);
 
-    num_threads_ = omp_get_max_threads();
+    worker_pool_ = WorkerPool::get(WorkerPoolOptions::from_params(params_));
+    std::size_t num_threads = params_["ecdh_params"]["num_threads"];
+    num_threads_ = num_threads == 0 ? worker_pool_->num_threads() : num_threads;
+    // Workers are pinned only within init and every process call, so that the affinity of the caller is restored.
+    ScopedWorkerBinding binding(*worker_pool_, num_threads_);
+    chunk_size_ = params_["ecdh_params"]["chunk_size"];
+    std::string intersection_scheme = params_["ecdh_params"]["intersection_scheme"];
+    intersection_scheme_ = intersection_scheme == "sort" ? IntersectionScheme::SORT : IntersectionScheme::HASH_JOIN;
+    spill_dir_ = params_["ecdh_params"]["spill_dir"];
+    std::size_t memory_limit_mb = params_["ecdh_params"]["memory_limit_mb"];
+    memory_limit_bytes_ = memory_limit_mb << 20;
+    statistical_security_bits_ = params_["ecdh_params"]["statistical_security_bits"];
+    filter_max_lookups_ = params_["ecdh_params"]["filter_max_lookups"];
+    compress_tags_ = params_["ecdh_params"]["compress_tags"];
+
+    if (unbalanced_) {
+        exchange_filter(net);
+        LOG_IF(INFO, verbose_) << "exchange filter done.";
+    }
 }
 
 void EcdhPSI::preprocess_data(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
@@ -96,33 +411,74 @@ void EcdhPSI::preprocess_data(const std::shared_ptr<network::Network>& net, cons
 
 void EcdhPSI::process(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
         std::vector<std::string>& output_keys) const {
+    ScopedWorkerBinding binding(*worker_pool_, num_threads_);
+    if (unbalanced_) {
+        process_unbalanced(net, input_keys, &output_keys);
+        return;
+    }
+    if (incremental_) {
+        process_incremental(net, input_keys, &output_keys);
+        return;
+    }
+    if (!spill_dir_.empty()) {
+        process_out_of_core(net, input_keys, &output_keys);
+        return;
+    }
+    std::vector<std::uint8_t> matched;
+    match_keys(net, input_keys, matched);
+    output_keys.clear();
+    output_keys.reserve(static_cast<std::size_t>(std::count(matched.begin(), matched.end(), 1)));
+    for (std::size_t item_idx = 0; item_idx < matched.size(); ++item_idx) {
+        if (matched[item_idx]) {
+            output_keys.push_back(input_keys[item_idx]);
+        }
+    }
+}
+
+void EcdhPSI::process_bitmap(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
+        std::vector<std::uint8_t>& output_bitmap) const {
+    ScopedWorkerBinding binding(*worker_pool_, num_threads_);
+    if (unbalanced_ || incremental_ || !spill_dir_.empty()) {
+        throw std::invalid_argument("bitmap output is not supported with unbalanced, incremental or spill_dir.");
+    }
+    match_keys(net, input_keys, output_bitmap);
+}
+
+void EcdhPSI::process_indices(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
+        std::vector<std::size_t>& output_indices) const {
+    std::vector<std::uint8_t> matched;
+    process_bitmap(net, input_keys, matched);
+    output_indices.clear();
+    for (std::size_t item_idx = 0; item_idx < matched.size(); ++item_idx) {
+        if (matched[item_idx]) {
+            output_indices.push_back(item_idx);
+        }
+    }
+}
+
+void EcdhPSI::match_keys(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
+        std::vector<std::uint8_t>& matched) const {
     auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
     auto prng = prng_factory.create();
+    // Only indices are shuffled, and keys are encrypted through them, so that no key is copied.
     std::vector<std::size_t> permutation;
     generate_permutation(prng, input_keys.size(), permutation);
-    output_keys.assign(input_keys.begin(), input_keys.end());
-    permute_and_undo(permutation, true, output_keys);
-    LOG_IF(INFO, verbose_) << "shuffle input keys done.";
-
-    std::size_t self_data_size = input_keys.size();
-    std::vector<ByteVector> encrypted_keys(self_data_size, ByteVector(kEccPointLen));
 
-    encrypt_keys(output_keys, encrypted_keys);
-    LOG_IF(INFO, verbose_) << "encrypt keys done.";
-
-    std::vector<ByteVector> exchanged_encrypted_keys;
-    exchange_encrypted_keys(net, encrypted_keys, exchanged_encrypted_keys, kEccPointLen);
-    encrypted_keys.clear();
-    LOG_IF(INFO, verbose_) << "send and receive encryptd keys done.";
-
-    doublely_encrypt_keys(exchanged_encrypted_keys);
-    LOG_IF(INFO, verbose_) << "doublely encrypt keys done.";
+    PointBuffer exchanged_encrypted_keys;
+    if (encrypted_set_ == nullptr) {
+        encrypt_and_exchange_keys(net, input_keys, permutation, exchanged_encrypted_keys);
+        LOG_IF(INFO, verbose_) << "shuffle, encrypt, send and receive, and doublely encrypt keys done.";
+    } else {
+        exchange_shared_encrypted_keys(net, input_keys, permutation, exchanged_encrypted_keys);
+        LOG_IF(INFO, verbose_) << "shuffle, send and receive, and doublely encrypt keys done.";
+    }
 
-    std::vector<ByteVector> self_doublely_encrypt_keys;
+    std::size_t tag_byte_count = compare_bytes_len(input_keys.size(), exchanged_encrypted_keys.size());
+    PointBuffer self_doublely_encrypt_keys;
     if (remote_obtain_result_) {
-        exchange_encrypted_keys(net, exchanged_encrypted_keys, self_doublely_encrypt_keys, kECCCompareBytesLen);
+        exchange_encrypted_keys(net, exchanged_encrypted_keys, self_doublely_encrypt_keys, tag_byte_count);
     } else {
-        exchange_encrypted_keys(net, std::vector<ByteVector>(), self_doublely_encrypt_keys, kECCCompareBytesLen);
+        exchange_encrypted_keys(net, PointBuffer(), self_doublely_encrypt_keys, tag_byte_count);
     }
     LOG_IF(INFO, verbose_) << "send and receive doublely encrypt keys done.";
 
@@ -131,56 +487,63 @@ void EcdhPSI::process(const std::shared_ptr<network::Network>& net, const std::v
         permute_and_undo(permutation, false, self_doublely_encrypt_keys);
         LOG_IF(INFO, verbose_) << "remove doublely encrypt keys' shuffle done.";
 
-        std::sort(exchanged_encrypted_keys.begin(), exchanged_encrypted_keys.end());
-        calculate_intersection(exchanged_encrypted_keys, self_doublely_encrypt_keys, input_keys, output_keys);
+        calculate_intersection(exchanged_encrypted_keys, self_doublely_encrypt_keys, matched);
         LOG_IF(INFO, verbose_) << "calculate intersection done.";
     } else {
         LOG_IF(INFO, verbose_) << "self can not obtain result.";
-        output_keys.clear();
+        matched.clear();
     }
-    exchanged_encrypted_keys.clear();
-    self_doublely_encrypt_keys.clear();
 }
 
 std::size_t EcdhPSI::process_cardinality_only(
         const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys) const {
+    ScopedWorkerBinding binding(*worker_pool_, num_threads_);
+    if (unbalanced_) {
+        return process_unbalanced(net, input_keys, nullptr);
+    }
+    if (incremental_) {
+        return process_incremental(net, input_keys, nullptr);
+    }
+    if (!spill_dir_.empty()) {
+        return process_out_of_core(net, input_keys, nullptr);
+    }
     auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
     auto prng = prng_factory.create();
     std::vector<std::size_t> permutation;
     generate_permutation(prng, input_keys.size(), permutation);
 
-    std::vector<std::string> shuffled_keys;
-    shuffled_keys.assign(input_keys.begin(), input_keys.end());
-    permute_and_undo(permutation, true, shuffled_keys);
-    LOG_IF(INFO, verbose_) << "shuffle input keys done.";
-
-    std::size_t self_data_size = input_keys.size();
-    std::vector<ByteVector> encrypted_keys(self_data_size, ByteVector(kEccPointLen));
-
-    encrypt_keys(shuffled_keys, encrypted_keys);
-    shuffled_keys.clear();
-    LOG_IF(INFO, verbose_) << "encrypt keys done.";
-
-    std::vector<ByteVector> exchanged_encrypted_keys;
-    exchange_encrypted_keys(net, encrypted_keys, exchanged_encrypted_keys, kEccPointLen);
-    encrypted_keys.clear();
-    LOG_IF(INFO, verbose_) << "send and receive encryptd keys done.";
-
-    doublely_encrypt_keys(exchanged_encrypted_keys);
-    LOG_IF(INFO, verbose_) << "doublely encrypt keys done.";
+    PointBuffer exchanged_encrypted_keys;
+    if (encrypted_set_ == nullptr) {
+        encrypt_and_exchange_keys(net, input_keys, permutation, exchanged_encrypted_keys);
+        LOG_IF(INFO, verbose_) << "shuffle, encrypt, send and receive, and doublely encrypt keys done.";
+    } else {
+        exchange_shared_encrypted_keys(net, input_keys, permutation, exchanged_encrypted_keys);
+        LOG_IF(INFO, verbose_) << "shuffle, send and receive, and doublely encrypt keys done.";
+    }
 
-    std::vector<ByteVector> self_doublely_encrypted_keys;
-    if (remote_obtain_result_) {
-        exchange_encrypted_keys(net, exchanged_encrypted_keys, self_doublely_encrypted_keys, kECCCompareBytesLen);
+    std::size_t tag_byte_count = compare_bytes_len(input_keys.size(), exchanged_encrypted_keys.size());
+    PointBuffer self_doublely_encrypted_keys;
+    if (compress_tags_) {
+        // Only the cardinality is computed, so that doublely encrypted keys are exchanged as sets.
+        PointBuffer no_keys(0, tag_byte_count);
+        PointBuffer& sent_keys = remote_obtain_result_ ? exchanged_encrypted_keys : no_keys;
+        if (is_sender_) {
+            send_compressed_tags(net, sent_keys);
+            recv_compressed_tags(net, tag_byte_count, self_doublely_encrypted_keys);
+        } else {
+            recv_compressed_tags(net, tag_byte_count, self_doublely_encrypted_keys);
+            send_compressed_tags(net, sent_keys);
+        }
+    } else if (remote_obtain_result_) {
+        exchange_encrypted_keys(net, exchanged_encrypted_keys, self_doublely_encrypted_keys, tag_byte_count);
     } else {
-        exchange_encrypted_keys(net, std::vector<ByteVector>(), self_doublely_encrypted_keys, kECCCompareBytesLen);
+        exchange_encrypted_keys(net, PointBuffer(), self_doublely_encrypted_keys, tag_byte_count);
     }
     LOG_IF(INFO, verbose_) << "send and receive doublely encrypt keys done.";
 
     std::size_t cardinality = 0;
     if (obtain_result_) {
         LOG_IF(INFO, verbose_) << "self can obtain result.";
-        std::sort(exchanged_encrypted_keys.begin(), exchanged_encrypted_keys.end());
         cardinality = calculate_cardinality_only(exchanged_encrypted_keys, self_doublely_encrypted_keys);
         LOG_IF(INFO, verbose_) << "calculate cardinality done.";
     } else {
@@ -192,149 +555,1409 @@ std::size_t EcdhPSI::process_cardinality_only(
 }
 
 void EcdhPSI::check_params(const std::shared_ptr<network::Network>& net) {
+    check_consistency(is_sender_, net, "protocol_version", kEcdhProtocolVersion);
+
     int curve_id = params_["ecdh_params"]["curve_id"];
     check_consistency(is_sender_, net, "ecc_curve_id", curve_id);
-    check_equal<int>("curve_id", curve_id, 415);
+    check_equal<int>("curve_id", curve_id, EcdhGroup::supported_curve_ids());
+
+    std::size_t chunk_size = params_["ecdh_params"]["chunk_size"];
+    check_consistency(is_sender_, net, "chunk_size", chunk_size);
+    check_greater_than<std::size_t>("chunk_size", chunk_size, 0);
+
+    std::string intersection_scheme = params_["ecdh_params"]["intersection_scheme"];
+    if (intersection_scheme != "sort" && intersection_scheme != "hash_join") {
+        throw std::invalid_argument("intersection_scheme(" + intersection_scheme + ") is not sort or hash_join.");
+    }
+
+    std::size_t memory_limit_mb = params_["ecdh_params"]["memory_limit_mb"];
+    check_greater_than<std::size_t>("memory_limit_mb", memory_limit_mb, 0);
+
+    std::string spill_dir = params_["ecdh_params"]["spill_dir"];
+    std::string precomputed_file = params_["ecdh_params"]["precomputed_file"];
+    if (!spill_dir.empty() && !precomputed_file.empty()) {
+        throw std::invalid_argument("precomputed_file is not supported with spill_dir.");
+    }
+
+    std::size_t statistical_security_bits = params_["ecdh_params"]["statistical_security_bits"];
+    check_consistency(is_sender_, net, "statistical_security_bits", statistical_security_bits);
+    check_in_range<std::size_t>("statistical_security_bits", statistical_security_bits, 1, 64);
+
+    bool unbalanced = params_["ecdh_params"]["unbalanced"];
+    check_consistency(is_sender_, net, "unbalanced", unbalanced);
+    if (unbalanced && !spill_dir.empty()) {
+        throw std::invalid_argument("unbalanced is not supported with spill_dir.");
+    }
+    std::size_t filter_max_lookups = params_["ecdh_params"]["filter_max_lookups"];
+    check_consistency(is_sender_, net, "filter_max_lookups", filter_max_lookups);
+    if (unbalanced) {
+        check_greater_than<std::size_t>("filter_max_lookups", filter_max_lookups, 0);
+        // Throws if filter fingerprints cannot meet statistical_security_bits.
+        cuckoo_filter_fingerprint_bytes_len(statistical_security_bits, filter_max_lookups);
+    }
+
+    bool incremental = params_["ecdh_params"]["incremental"];
+    check_consistency(is_sender_, net, "incremental", incremental);
+    std::string state_file = params_["ecdh_params"]["state_file"];
+    if (incremental && state_file.empty()) {
+        throw std::invalid_argument("incremental requires state_file.");
+    }
+    if (incremental && (!spill_dir.empty() || !precomputed_file.empty() || unbalanced)) {
+        throw std::invalid_argument("incremental is not supported with spill_dir, precomputed_file or unbalanced.");
+    }
+
+    bool compress_tags = params_["ecdh_params"]["compress_tags"];
+    check_consistency(is_sender_, net, "compress_tags", compress_tags);
 }
 
-void EcdhPSI::encrypt_keys(const std::vector<std::string>& input_keys, std::vector<ByteVector>& encrypted_keys) const {
-#pragma omp parallel for num_threads(num_threads_)
-    for (std::size_t item_idx = 0; item_idx < input_keys.size(); ++item_idx) {
-        petace::solo::ECOpenSSL::Point point(*ecc_cipher_);
-        ecc_cipher_->hash_to_curve(
-                reinterpret_cast<const Byte*>(input_keys[item_idx].data()), input_keys[item_idx].size(), point);
-        ecc_cipher_->encrypt(point, sk_, point);
-        ecc_cipher_->point_to_bytes(point, kEccPointLen, encrypted_keys[item_idx].data());
+void EcdhPSI::encrypt_keys(const std::vector<std::string>& input_keys, std::size_t begin, std::size_t end,
+        PointBuffer& encrypted_keys, std::size_t num_threads) const {
+    std::size_t batch_count = (end - begin + kEncryptBatchSize - 1) / kEncryptBatchSize;
+#pragma omp parallel for num_threads(num_threads == 0 ? num_threads_ : num_threads)
+    for (std::size_t batch_idx = 0; batch_idx < batch_count; ++batch_idx) {
+        std::size_t batch_begin = begin + batch_idx * kEncryptBatchSize;
+        std::size_t batch_end = std::min(batch_begin + kEncryptBatchSize, end);
+        group_->encrypt_keys(Span<const std::string>(input_keys.data() + batch_begin, batch_end - batch_begin),
+                encrypted_keys.point_data(batch_begin));
     }
 }
 
-void EcdhPSI::doublely_encrypt_keys(std::vector<ByteVector>& exchanged_encrypted_keys) const {
-#pragma omp parallel for num_threads(num_threads_)
-    for (std::size_t item_idx = 0; item_idx < exchanged_encrypted_keys.size(); ++item_idx) {
-        petace::solo::ECOpenSSL::Point point(*ecc_cipher_);
-        ecc_cipher_->point_from_bytes(
-                reinterpret_cast<const Byte*>(exchanged_encrypted_keys[item_idx].data()), kEccPointLen, point);
-        ecc_cipher_->encrypt(point, sk_, point);
-        ByteVector point_bytes_buffer(kEccPointLen);
-        ecc_cipher_->point_to_bytes(point, kEccPointLen, point_bytes_buffer.data());
-        exchanged_encrypted_keys[item_idx].resize(kECCCompareBytesLen);
-        std::copy_n(point_bytes_buffer.rbegin(), kECCCompareBytesLen, exchanged_encrypted_keys[item_idx].rbegin());
+void EcdhPSI::encrypt_keys(const std::vector<std::string>& input_keys, const std::vector<std::size_t>& permutation,
+        std::size_t begin, std::size_t end, PointBuffer& encrypted_keys, std::size_t num_threads) const {
+    std::size_t batch_count = (end - begin + kEncryptBatchSize - 1) / kEncryptBatchSize;
+#pragma omp parallel for num_threads(num_threads == 0 ? num_threads_ : num_threads)
+    for (std::size_t batch_idx = 0; batch_idx < batch_count; ++batch_idx) {
+        std::size_t batch_begin = begin + batch_idx * kEncryptBatchSize;
+        std::size_t batch_end = std::min(batch_begin + kEncryptBatchSize, end);
+        group_->encrypt_keys(Span<const std::string>(input_keys.data(), input_keys.size()),
+                Span<const std::size_t>(permutation.data() + batch_begin, batch_end - batch_begin),
+                encrypted_keys.point_data(batch_begin));
     }
 }
 
-void EcdhPSI::calculate_intersection(const std::vector<ByteVector>& remote_doublely_encrypted_keys,
-        const std::vector<ByteVector>& self_doublely_encrypted_keys, const std::vector<std::string>& input_keys,
-        std::vector<std::string>& output_keys) const {
-    if (remote_doublely_encrypted_keys.empty() || self_doublely_encrypted_keys.empty() || input_keys.empty()) {
+void EcdhPSI::doublely_encrypt_keys(const PointBuffer& exchanged_encrypted_keys, std::size_t begin, std::size_t end,
+        PointBuffer& doublely_encrypted_keys, std::size_t num_threads) const {
+    std::size_t batch_count = (end - begin + kEncryptBatchSize - 1) / kEncryptBatchSize;
+    bool all_valid = true;
+#pragma omp parallel for num_threads(num_threads == 0 ? num_threads_ : num_threads) reduction(&& : all_valid)
+    for (std::size_t batch_idx = 0; batch_idx < batch_count; ++batch_idx) {
+        std::size_t batch_begin = begin + batch_idx * kEncryptBatchSize;
+        std::size_t batch_end = std::min(batch_begin + kEncryptBatchSize, end);
+        if (!group_->doublely_encrypt_keys(exchanged_encrypted_keys.point_data(batch_begin), batch_end - batch_begin,
+                    doublely_encrypted_keys.point_byte_count(), doublely_encrypted_keys.point_data(batch_begin))) {
+            all_valid = false;
+        }
+    }
+    if (!all_valid) {
+        throw std::invalid_argument("exchanged encrypted keys are not valid points.");
+    }
+}
+
+void EcdhPSI::encrypt_and_exchange_keys(const std::shared_ptr<network::Network>& net,
+        const std::vector<std::string>& input_keys, const std::vector<std::size_t>& permutation,
+        PointBuffer& doublely_encrypted_keys) const {
+    if (net == nullptr) {
+        throw std::invalid_argument("net is null.");
+    }
+    std::size_t self_data_size = input_keys.size();
+    PointBuffer encrypted_keys(self_data_size, group_->point_byte_count());
+
+    // The sender receives keys only after all of its keys are encrypted and sent, while the receiver doublely
+    // encrypts received keys as its own keys are still being encrypted, so that the two split the threads.
+    std::size_t encrypt_num_threads = is_sender_ ? num_threads_ : std::max<std::size_t>(num_threads_ / 2, 1);
+    std::size_t doublely_encrypt_num_threads =
+            is_sender_ ? num_threads_ : std::max<std::size_t>(num_threads_ - encrypt_num_threads, 1);
+    std::size_t doublely_encrypt_cpu_offset = is_sender_ ? 0 : encrypt_num_threads;
+
+    // Encrypts self keys in background, so that sending a chunk overlaps with encrypting the next one.
+    ChunkProgress encrypt_progress;
+    auto encrypt_future = std::async(std::launch::async, [&]() {
+        try {
+            ScopedWorkerBinding binding(*worker_pool_, encrypt_num_threads);
+            for (std::size_t begin = 0; begin < self_data_size && !encrypt_progress.aborted(); begin += chunk_size_) {
+                std::size_t end = std::min(begin + chunk_size_, self_data_size);
+                if (permutation.empty()) {
+                    encrypt_keys(input_keys, begin, end, encrypted_keys, encrypt_num_threads);
+                } else {
+                    encrypt_keys(input_keys, permutation, begin, end, encrypted_keys, encrypt_num_threads);
+                }
+                encrypt_progress.finish_chunk();
+            }
+        } catch (...) {
+            encrypt_progress.abort();
+            throw;
+        }
+    });
+
+    try {
+        exchange_encrypted_keys_by_chunk(net, encrypted_keys, std::vector<std::size_t>(), encrypt_progress,
+                doublely_encrypt_num_threads, doublely_encrypt_cpu_offset, doublely_encrypted_keys);
+    } catch (...) {
+        encrypt_progress.abort();
+        // A failure of the background encryption is the root cause if any, so it is reported first.
+        encrypt_future.get();
+        throw;
+    }
+    encrypt_future.get();
+}
+
+void EcdhPSI::exchange_encrypted_keys_by_chunk(const std::shared_ptr<network::Network>& net,
+        const PointBuffer& encrypted_keys, const std::vector<std::size_t>& permutation, ChunkProgress& progress,
+        std::size_t num_threads, std::size_t cpu_offset, PointBuffer& doublely_encrypted_keys) const {
+    if (is_sender_) {
+        send_encrypted_keys_by_chunk(net, encrypted_keys, permutation, progress);
+        LOG_IF(INFO, verbose_) << "sender sent encryptd keys.";
+        recv_and_doublely_encrypt_keys_by_chunk(
+                net, encrypted_keys.size(), num_threads, cpu_offset, doublely_encrypted_keys);
+        LOG_IF(INFO, verbose_) << "sender received and doublely encrypted keys.";
+    } else {
+        recv_and_doublely_encrypt_keys_by_chunk(
+                net, encrypted_keys.size(), num_threads, cpu_offset, doublely_encrypted_keys);
+        LOG_IF(INFO, verbose_) << "receiver received and doublely encrypted keys.";
+        send_encrypted_keys_by_chunk(net, encrypted_keys, permutation, progress);
+        LOG_IF(INFO, verbose_) << "receiver sent encryptd keys.";
+    }
+}
+
+void EcdhPSI::check_encrypted_set(const std::vector<std::string>& input_keys) const {
+    bool matched = encrypted_set_verified_ ? input_keys.size() == encrypted_set_->size()
+                                           : encrypted_set_->matches(input_keys);
+    if (!matched) {
+        throw std::invalid_argument("encrypted set does not match input keys.");
+    }
+}
+
+void EcdhPSI::exchange_shared_encrypted_keys(const std::shared_ptr<network::Network>& net,
+        const std::vector<std::string>& input_keys, const std::vector<std::size_t>& permutation,
+        PointBuffer& doublely_encrypted_keys) const {
+    if (net == nullptr) {
+        throw std::invalid_argument("net is null.");
+    }
+    check_encrypted_set(input_keys);
+    const PointBuffer& encrypted_keys = encrypted_set_->encrypted_keys();
+    ChunkProgress progress;
+    progress.finish_chunks((encrypted_keys.size() + chunk_size_ - 1) / chunk_size_);
+    exchange_encrypted_keys_by_chunk(
+            net, encrypted_keys, permutation, progress, num_threads_, 0, doublely_encrypted_keys);
+}
+
+void EcdhPSI::precompute(const json& params, const std::vector<std::string>& input_keys) {
+    auto config = default_config();
+    config.merge_patch(params);
+    std::string secret_key_file = config["ecdh_params"]["secret_key_file"];
+    std::string precomputed_file = config["ecdh_params"]["precomputed_file"];
+    if (secret_key_file.empty()) {
+        throw std::invalid_argument("secret_key_file is empty.");
+    }
+    if (precomputed_file.empty()) {
+        throw std::invalid_argument("precomputed_file is empty.");
+    }
+    encrypt_set(config, input_keys)->save(precomputed_file);
+}
+
+std::shared_ptr<EcdhEncryptedSet> EcdhPSI::encrypt_set(const json& params, const std::vector<std::string>& input_keys) {
+    auto config = default_config();
+    config.merge_patch(params);
+    int curve_id = config["ecdh_params"]["curve_id"];
+    check_equal<int>("curve_id", curve_id, EcdhGroup::supported_curve_ids());
+    std::string secret_key_file = config["ecdh_params"]["secret_key_file"];
+
+    auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
+    ByteVector key_seed;
+    if (!secret_key_file.empty() && std::ifstream(secret_key_file).good()) {
+        key_seed = read_key_seed(secret_key_file);
+    } else {
+        key_seed.resize(kRandSeedBytesLen);
+        prng_factory.create()->generate(key_seed.size(), key_seed.data());
+        if (!secret_key_file.empty()) {
+            write_key_seed(secret_key_file, key_seed);
+        }
+    }
+
+    EcdhPSI psi;
+    psi.verbose_ = config["common"]["verbose"];
+    psi.group_ = EcdhGroup::create(curve_id);
+    psi.group_->create_secret_key(prng_factory.create(key_seed));
+    psi.worker_pool_ = WorkerPool::get(WorkerPoolOptions::from_params(config));
+    std::size_t num_threads = config["ecdh_params"]["num_threads"];
+    psi.num_threads_ = num_threads == 0 ? psi.worker_pool_->num_threads() : num_threads;
+    ScopedWorkerBinding binding(*psi.worker_pool_, psi.num_threads_);
+
+    PointBuffer encrypted_keys(input_keys.size(), psi.group_->point_byte_count(), psi.num_threads_);
+    psi.encrypt_keys(input_keys, 0, input_keys.size(), encrypted_keys);
+    LOG_IF(INFO, psi.verbose_) << "encrypt keys done.";
+    return std::make_shared<EcdhEncryptedSet>(curve_id, key_seed, input_keys, std::move(encrypted_keys));
+}
+
+void EcdhPSI::send_encrypted_keys_by_chunk(const std::shared_ptr<network::Network>& net,
+        const PointBuffer& encrypted_keys, const std::vector<std::size_t>& permutation, ChunkProgress& progress) const {
+    std::size_t self_data_size = encrypted_keys.size();
+    net->send_data(&self_data_size, sizeof(self_data_size));
+
+    PointBuffer chunk_buffer;
+    for (std::size_t chunk_idx = 0, begin = 0; begin < self_data_size; ++chunk_idx, begin += chunk_size_) {
+        if (!progress.wait_for(chunk_idx)) {
+            throw std::runtime_error("encryption of keys is aborted.");
+        }
+        std::size_t end = std::min(begin + chunk_size_, self_data_size);
+        if (permutation.empty()) {
+            net->send_data(encrypted_keys.point_data(begin), (end - begin) * group_->point_byte_count());
+            continue;
+        }
+        chunk_buffer.resize(end - begin, group_->point_byte_count());
+        for (std::size_t item_idx = begin; item_idx < end; ++item_idx) {
+            std::copy_n(encrypted_keys.point_data(permutation[item_idx]), group_->point_byte_count(),
+                    chunk_buffer.point_data(item_idx - begin));
+        }
+        net->send_data(chunk_buffer.data(), chunk_buffer.byte_count());
+    }
+}
+
+void EcdhPSI::recv_and_doublely_encrypt_keys_by_chunk(const std::shared_ptr<network::Network>& net,
+        std::size_t self_data_size, std::size_t num_threads, std::size_t cpu_offset,
+        PointBuffer& doublely_encrypted_keys) const {
+    std::size_t received_data_size = 0;
+    net->recv_data(&received_data_size, sizeof(received_data_size));
+    PointBuffer received_keys(received_data_size, group_->point_byte_count());
+    doublely_encrypted_keys.resize(received_data_size, compare_bytes_len(self_data_size, received_data_size));
+
+    // One worker keeps its pinned OpenMP team for all chunks, and takes chunks in order as soon as they are received.
+    ChunkProgress receive_progress;
+    auto doublely_encrypt_future = std::async(std::launch::async, [&]() {
+        try {
+            ScopedWorkerBinding binding(*worker_pool_, num_threads, cpu_offset);
+            for (std::size_t chunk_idx = 0, begin = 0; begin < received_data_size; ++chunk_idx, begin += chunk_size_) {
+                if (!receive_progress.wait_for(chunk_idx)) {
+                    return;
+                }
+                std::size_t end = std::min(begin + chunk_size_, received_data_size);
+                doublely_encrypt_keys(received_keys, begin, end, doublely_encrypted_keys, num_threads);
+            }
+        } catch (...) {
+            receive_progress.abort();
+            throw;
+        }
+    });
+
+    try {
+        for (std::size_t begin = 0; begin < received_data_size && !receive_progress.aborted(); begin += chunk_size_) {
+            std::size_t end = std::min(begin + chunk_size_, received_data_size);
+            net->recv_data(received_keys.point_data(begin), (end - begin) * group_->point_byte_count());
+            receive_progress.finish_chunk();
+        }
+    } catch (...) {
+        receive_progress.abort();
+        doublely_encrypt_future.get();
+        throw;
+    }
+    doublely_encrypt_future.get();
+}
+
+std::size_t EcdhPSI::process_out_of_core(const std::shared_ptr<network::Network>& net,
+        const std::vector<std::string>& input_keys, std::vector<std::string>* output_keys) const {
+    if (net == nullptr) {
+        throw std::invalid_argument("net is null.");
+    }
+    auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
+    auto prng = prng_factory.create();
+
+    // A random file name prefix keeps concurrent sessions sharing a spill directory apart.
+    Byte session_id[8];
+    prng->generate(sizeof(session_id), session_id);
+    std::string path_prefix = spill_dir_ + "/ecdh_psi_";
+    const char* hex_digits = "0123456789abcdef";
+    for (auto byte : session_id) {
+        path_prefix.push_back(hex_digits[byte >> 4]);
+        path_prefix.push_back(hex_digits[byte & 0xf]);
+    }
+    ScopedFile shuffle_file(path_prefix + "_shuffle.bin");
+    ScopedFile remote_tags_file(path_prefix + "_remote_tags.bin");
+    ScopedFile self_tags_file(path_prefix + "_self_tags.bin");
+    ScopedFile matched_indices_file(path_prefix + "_matched_indices.bin");
+
+    generate_shuffle_file(prng, input_keys.size(), shuffle_file.path());
+    LOG_IF(INFO, verbose_) << "shuffle input keys done.";
+
+    std::size_t tag_byte_count = 0;
+    if (is_sender_) {
+        send_encrypted_keys_from_file(net, input_keys, shuffle_file.path());
+        tag_byte_count = recv_and_doublely_encrypt_keys_to_file(net, input_keys.size(), remote_tags_file.path());
+    } else {
+        tag_byte_count = recv_and_doublely_encrypt_keys_to_file(net, input_keys.size(), remote_tags_file.path());
+        send_encrypted_keys_from_file(net, input_keys, shuffle_file.path());
+    }
+    LOG_IF(INFO, verbose_) << "encrypt, send and receive, and doublely encrypt keys done.";
+
+    if (is_sender_) {
+        send_doublely_encrypted_keys_from_file(net, remote_tags_file.path(), tag_byte_count);
+        recv_doublely_encrypted_keys_to_file(net, shuffle_file.path(), self_tags_file.path(), tag_byte_count);
+    } else {
+        recv_doublely_encrypted_keys_to_file(net, shuffle_file.path(), self_tags_file.path(), tag_byte_count);
+        send_doublely_encrypted_keys_from_file(net, remote_tags_file.path(), tag_byte_count);
+    }
+    LOG_IF(INFO, verbose_) << "send and receive doublely encrypt keys done.";
+
+    if (output_keys != nullptr) {
+        output_keys->clear();
+    }
+    if (!obtain_result_) {
+        LOG_IF(INFO, verbose_) << "self can not obtain result.";
+        return 0;
+    }
+    LOG_IF(INFO, verbose_) << "self can obtain result.";
+
+    external_sort(remote_tags_file.path(), remote_tags_file.path(), tag_byte_count, memory_limit_bytes_);
+    external_sort(self_tags_file.path(), self_tags_file.path(), tag_byte_count + kIndexBytesLen, memory_limit_bytes_);
+    LOG_IF(INFO, verbose_) << "sort doublely encrypt keys done.";
+
+    std::string matched_indices_path = output_keys == nullptr ? "" : matched_indices_file.path();
+    std::size_t cardinality =
+            join_sorted_keys(remote_tags_file.path(), self_tags_file.path(), matched_indices_path, tag_byte_count);
+    if (output_keys != nullptr) {
+        // Intersection is output in the order of input keys.
+        external_sort(matched_indices_path, matched_indices_path, kIndexBytesLen, memory_limit_bytes_);
+        output_keys->reserve(cardinality);
+        RecordReader reader(matched_indices_path, kIndexBytesLen);
+        PointBuffer indices;
+        while (reader.read(indices, chunk_size_) != 0) {
+            for (std::size_t item_idx = 0; item_idx < indices.size(); ++item_idx) {
+                output_keys->emplace_back(input_keys[load_index(indices[item_idx].data())]);
+            }
+        }
+    }
+    LOG_IF(INFO, verbose_) << "calculate intersection done.";
+    return cardinality;
+}
+
+void EcdhPSI::generate_shuffle_file(
+        std::shared_ptr<petace::solo::PRNG> prng, std::size_t input_size, const std::string& shuffle_path) const {
+    RecordWriter writer(shuffle_path, kShuffleRecordLen);
+    PointBuffer records;
+    for (std::size_t begin = 0; begin < input_size; begin += chunk_size_) {
+        std::size_t end = std::min(begin + chunk_size_, input_size);
+        records.resize(end - begin, kShuffleRecordLen);
+        prng->generate(records.byte_count(), records.data());
+        for (std::size_t item_idx = begin; item_idx < end; ++item_idx) {
+            store_index(item_idx, records[item_idx - begin].data() + kShuffleRandomBytesLen);
+        }
+        writer.write(records);
+    }
+    writer.close();
+    external_sort(shuffle_path, shuffle_path, kShuffleRecordLen, memory_limit_bytes_);
+}
+
+void EcdhPSI::send_encrypted_keys_from_file(const std::shared_ptr<network::Network>& net,
+        const std::vector<std::string>& input_keys, const std::string& shuffle_path) const {
+    RecordReader reader(shuffle_path, kShuffleRecordLen);
+    std::size_t self_data_size = reader.size();
+    net->send_data(&self_data_size, sizeof(self_data_size));
+
+    PointBuffer records;
+    std::vector<std::string> chunk_keys;
+    PointBuffer encrypted_keys;
+    while (reader.read(records, chunk_size_) != 0) {
+        chunk_keys.resize(records.size());
+        for (std::size_t item_idx = 0; item_idx < records.size(); ++item_idx) {
+            chunk_keys[item_idx] = input_keys[load_index(records[item_idx].data() + kShuffleRandomBytesLen)];
+        }
+        encrypted_keys.resize(records.size(), group_->point_byte_count());
+        encrypt_keys(chunk_keys, 0, chunk_keys.size(), encrypted_keys);
+        net->send_data(encrypted_keys.data(), encrypted_keys.byte_count());
+    }
+}
+
+std::size_t EcdhPSI::recv_and_doublely_encrypt_keys_to_file(const std::shared_ptr<network::Network>& net,
+        std::size_t self_data_size, const std::string& remote_tags_path) const {
+    std::size_t received_data_size = 0;
+    net->recv_data(&received_data_size, sizeof(received_data_size));
+
+    std::size_t tag_byte_count = compare_bytes_len(self_data_size, received_data_size);
+    RecordWriter writer(remote_tags_path, tag_byte_count);
+    PointBuffer received_keys;
+    PointBuffer doublely_encrypted_keys;
+    for (std::size_t begin = 0; begin < received_data_size; begin += chunk_size_) {
+        std::size_t count = std::min(chunk_size_, received_data_size - begin);
+        received_keys.resize(count, group_->point_byte_count());
+        net->recv_data(received_keys.data(), received_keys.byte_count());
+        doublely_encrypted_keys.resize(count, tag_byte_count);
+        doublely_encrypt_keys(received_keys, 0, count, doublely_encrypted_keys);
+        writer.write(doublely_encrypted_keys);
+    }
+    writer.close();
+    return tag_byte_count;
+}
+
+void EcdhPSI::send_doublely_encrypted_keys_from_file(const std::shared_ptr<network::Network>& net,
+        const std::string& remote_tags_path, std::size_t tag_byte_count) const {
+    if (!remote_obtain_result_) {
+        std::size_t self_data_size = 0;
+        net->send_data(&self_data_size, sizeof(self_data_size));
         return;
     }
-    std::vector<bool> intersection_indices(input_keys.size(), false);
-    std::size_t count = 0;
-    for (std::size_t item_idx = 0; item_idx < self_doublely_encrypted_keys.size(); ++item_idx) {
-        if (std::binary_search(remote_doublely_encrypted_keys.begin(), remote_doublely_encrypted_keys.end(),
-                    self_doublely_encrypted_keys[item_idx])) {
-            intersection_indices[item_idx] = true;
-            ++count;
+    RecordReader reader(remote_tags_path, tag_byte_count);
+    std::size_t self_data_size = reader.size();
+    net->send_data(&self_data_size, sizeof(self_data_size));
+
+    PointBuffer doublely_encrypted_keys;
+    while (reader.read(doublely_encrypted_keys, chunk_size_) != 0) {
+        net->send_data(doublely_encrypted_keys.data(), doublely_encrypted_keys.byte_count());
+    }
+}
+
+void EcdhPSI::recv_doublely_encrypted_keys_to_file(const std::shared_ptr<network::Network>& net,
+        const std::string& shuffle_path, const std::string& self_tags_path, std::size_t tag_byte_count) const {
+    std::size_t received_data_size = 0;
+    net->recv_data(&received_data_size, sizeof(received_data_size));
+
+    RecordReader reader(shuffle_path, kShuffleRecordLen);
+    if (received_data_size != 0 && received_data_size != reader.size()) {
+        throw std::runtime_error("size of received doublely encrypted keys does not match input keys.");
+    }
+    // A self tag record holds a doublely encrypted key, followed by its input index.
+    std::size_t self_tag_record_len = tag_byte_count + kIndexBytesLen;
+    RecordWriter writer(self_tags_path, self_tag_record_len);
+    PointBuffer received_keys;
+    PointBuffer records;
+    PointBuffer self_tags;
+    for (std::size_t begin = 0; begin < received_data_size; begin += chunk_size_) {
+        std::size_t count = std::min(chunk_size_, received_data_size - begin);
+        received_keys.resize(count, tag_byte_count);
+        net->recv_data(received_keys.data(), received_keys.byte_count());
+        reader.read(records, count);
+        self_tags.resize(count, self_tag_record_len);
+        for (std::size_t item_idx = 0; item_idx < count; ++item_idx) {
+            std::copy_n(received_keys[item_idx].data(), tag_byte_count, self_tags[item_idx].data());
+            std::copy_n(records[item_idx].data() + kShuffleRandomBytesLen, kIndexBytesLen,
+                    self_tags[item_idx].data() + tag_byte_count);
         }
+        writer.write(self_tags);
     }
-    output_keys.resize(count);
-    std::size_t result_idx = 0;
-    for (std::size_t item_idx = 0; item_idx < input_keys.size(); ++item_idx) {
-        if (intersection_indices[item_idx]) {
-            output_keys[result_idx++] = input_keys[item_idx];
+    writer.close();
+}
+
+std::size_t EcdhPSI::join_sorted_keys(const std::string& remote_tags_path, const std::string& self_tags_path,
+        const std::string& matched_indices_path, std::size_t tag_byte_count) const {
+    // Both cursors and the output share memory equally.
+    std::size_t buffer_byte_count = memory_limit_bytes_ / 3;
+    std::size_t self_tag_record_len = tag_byte_count + kIndexBytesLen;
+    RecordCursor remote_cursor(remote_tags_path, tag_byte_count, buffer_byte_count / tag_byte_count);
+    RecordCursor self_cursor(self_tags_path, self_tag_record_len, buffer_byte_count / self_tag_record_len);
+    std::unique_ptr<RecordWriter> writer = nullptr;
+    PointBuffer matched_indices;
+    std::size_t matched_count = 0;
+    if (!matched_indices_path.empty()) {
+        writer = std::make_unique<RecordWriter>(matched_indices_path, kIndexBytesLen);
+        std::size_t matched_buffer_size = std::min(buffer_byte_count / kIndexBytesLen, self_cursor.size());
+        matched_indices.resize(std::max<std::size_t>(matched_buffer_size, 1), kIndexBytesLen);
+    }
+
+    std::size_t cardinality = 0;
+    while (remote_cursor.valid() && self_cursor.valid()) {
+        int cmp = std::memcmp(remote_cursor.current(), self_cursor.current(), tag_byte_count);
+        if (cmp < 0) {
+            remote_cursor.next();
+            continue;
         }
+        if (cmp == 0) {
+            ++cardinality;
+            if (writer != nullptr) {
+                std::copy_n(self_cursor.current() + tag_byte_count, kIndexBytesLen,
+                        matched_indices[matched_count++].data());
+                if (matched_count == matched_indices.size()) {
+                    writer->write(matched_indices.data(), matched_count);
+                    matched_count = 0;
+                }
+            }
+        }
+        // Remote cursor stays, since the next self key may be a duplicate of the current one.
+        self_cursor.next();
+    }
+    if (writer != nullptr) {
+        writer->write(matched_indices.data(), matched_count);
+        writer->close();
     }
+    return cardinality;
 }
 
-std::size_t EcdhPSI::calculate_cardinality_only(const std::vector<ByteVector>& remote_doublely_encrypted_keys,
-        const std::vector<ByteVector>& self_doublely_encrypted_keys) const {
+void EcdhPSI::calculate_intersection(PointBuffer& remote_doublely_encrypted_keys,
+        const PointBuffer& self_doublely_encrypted_keys, std::vector<std::uint8_t>& matched) const {
+    matched.assign(self_doublely_encrypted_keys.size(), 0);
+    if (remote_doublely_encrypted_keys.empty() || self_doublely_encrypted_keys.empty()) {
+        return;
+    }
+    if (intersection_scheme_ == IntersectionScheme::HASH_JOIN) {
+        hash_join(remote_doublely_encrypted_keys, self_doublely_encrypted_keys, num_threads_, matched);
+        return;
+    }
+    radix_sort_points(remote_doublely_encrypted_keys, num_threads_);
+#pragma omp parallel for num_threads(num_threads_)
+    for (std::size_t item_idx = 0; item_idx < self_doublely_encrypted_keys.size(); ++item_idx) {
+        if (binary_search_point(remote_doublely_encrypted_keys, self_doublely_encrypted_keys[item_idx].data())) {
+            matched[item_idx] = 1;
+        }
+    }
+}
+
+std::size_t EcdhPSI::calculate_cardinality_only(
+        PointBuffer& remote_doublely_encrypted_keys, const PointBuffer& self_doublely_encrypted_keys) const {
     if (remote_doublely_encrypted_keys.empty() || self_doublely_encrypted_keys.empty()) {
         return 0;
     }
+    if (intersection_scheme_ == IntersectionScheme::HASH_JOIN) {
+        return hash_join_count(remote_doublely_encrypted_keys, self_doublely_encrypted_keys, num_threads_);
+    }
+    radix_sort_points(remote_doublely_encrypted_keys, num_threads_);
     std::size_t count = 0;
+#pragma omp parallel for num_threads(num_threads_) reduction(+ : count)
     for (std::size_t item_idx = 0; item_idx < self_doublely_encrypted_keys.size(); ++item_idx) {
-        if (std::binary_search(remote_doublely_encrypted_keys.begin(), remote_doublely_encrypted_keys.end(),
-                    self_doublely_encrypted_keys[item_idx])) {
+        if (binary_search_point(remote_doublely_encrypted_keys, self_doublely_encrypted_keys[item_idx].data())) {
             ++count;
         }
     }
     return count;
 }
 
-void EcdhPSI::exchange_encrypted_keys(std::shared_ptr<network::Network> net,
-        const std::vector<ByteVector>& encrypted_keys, std::vector<ByteVector>& received_keys,
-        std::size_t point_byte_count) const {
-    std::size_t self_data_size = encrypted_keys.size();
+void EcdhPSI::exchange_filter(const std::shared_ptr<network::Network>& net) {
+    std::string filter_file = params_["ecdh_params"]["filter_file"];
+    bool filter_file_exists = !filter_file.empty() && std::ifstream(filter_file).good();
+    std::size_t fingerprint_bytes_len =
+            cuckoo_filter_fingerprint_bytes_len(statistical_security_bits_, filter_max_lookups_);
+    FilterFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::copy_n(kFilterFileMagic, sizeof(header.magic), header.magic);
+
+    if (obtain_result_) {
+        std::array<Byte, kFilterIdBytesLen> filter_id;
+        net->recv_data(filter_id.data(), filter_id.size());
+        auto filter = std::make_shared<CuckooFilter>();
+        bool filter_needed = true;
+        if (filter_file_exists) {
+            load_filter_file(filter_file, header, *filter);
+            filter_needed = !std::equal(filter_id.begin(), filter_id.end(), header.filter_id);
+        }
+        net->send_data(&filter_needed, sizeof(filter_needed));
+        if (filter_needed) {
+            std::size_t bucket_count = 0;
+            std::size_t size = 0;
+            std::size_t remote_fingerprint_bytes_len = 0;
+            net->recv_data(&bucket_count, sizeof(bucket_count));
+            net->recv_data(&size, sizeof(size));
+            net->recv_data(&remote_fingerprint_bytes_len, sizeof(remote_fingerprint_bytes_len));
+            filter->resize(bucket_count, size, remote_fingerprint_bytes_len);
+            net->recv_data(filter->data(), filter->byte_count());
+            if (!filter_file.empty()) {
+                std::copy_n(filter_id.data(), kFilterIdBytesLen, header.filter_id);
+                std::fill_n(header.key_check, kECCMaxCompareBytesLen, Byte(0));
+                header.bucket_count = filter->bucket_count();
+                header.size = filter->size();
+                header.fingerprint_bytes_len = filter->fingerprint_bytes_len();
+                header.key_count = 0;
+                std::fill_n(header.input_keys_hash, kInputKeysHashBytesLen, Byte(0));
+                save_filter_file(filter_file, header, *filter);
+            }
+        }
+        if (filter->fingerprint_bytes_len() < fingerprint_bytes_len) {
+            throw std::invalid_argument("filter fingerprints are too short for statistical_security_bits.");
+        }
+        LOG_IF(INFO, verbose_) << "filter of " << filter->size() << " keys is "
+                               << (filter_needed ? "received." : "loaded.");
+        remote_filter_ = filter;
+        return;
+    }
+
+    ByteVector encrypted_check_key(group_->point_byte_count());
+    group_->encrypt_key(kFilterKeyCheckKey, encrypted_check_key.data());
+    const Byte* key_check = encrypted_check_key.data() + encrypted_check_key.size() - kECCMaxCompareBytesLen;
+    CuckooFilter filter;
+    bool filter_stale = true;
+    if (filter_file_exists) {
+        load_filter_file(filter_file, header, filter);
+        bool key_matched = std::equal(key_check, key_check + kECCMaxCompareBytesLen, header.key_check);
+        if (encrypted_set_ == nullptr) {
+            // Without the encrypted set, the cached filter is the large set.
+            if (!key_matched) {
+                throw std::invalid_argument("filter_file does not match the secret key.");
+            }
+            if (filter.fingerprint_bytes_len() < fingerprint_bytes_len) {
+                throw std::invalid_argument("filter_file fingerprints are too short for statistical_security_bits.");
+            }
+            filter_stale = false;
+        } else {
+            filter_stale = !key_matched || header.key_count != encrypted_set_->size() ||
+                           !std::equal(encrypted_set_->input_keys_hash().begin(),
+                                   encrypted_set_->input_keys_hash().end(), header.input_keys_hash) ||
+                           header.fingerprint_bytes_len != fingerprint_bytes_len;
+        }
+    } else if (encrypted_set_ == nullptr) {
+        throw std::invalid_argument("unbalanced mode requires precomputed_file or filter_file of the large set.");
+    }
+    if (filter_stale) {
+        const PointBuffer& encrypted_keys = encrypted_set_->encrypted_keys();
+        std::size_t tag_offset = group_->tag_offset(kCuckooFilterTagBytesLen);
+        PointBuffer tags(encrypted_keys.size(), kCuckooFilterTagBytesLen);
+#pragma omp parallel for num_threads(num_threads_)
+        for (std::size_t item_idx = 0; item_idx < encrypted_keys.size(); ++item_idx) {
+            std::copy_n(encrypted_keys[item_idx].data() + tag_offset, kCuckooFilterTagBytesLen, tags[item_idx].data());
+        }
+        filter = CuckooFilter(tags, fingerprint_bytes_len);
+        petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128)
+                .create()
+                ->generate(kFilterIdBytesLen, header.filter_id);
+        std::copy_n(key_check, kECCMaxCompareBytesLen, header.key_check);
+        header.bucket_count = filter.bucket_count();
+        header.size = filter.size();
+        header.fingerprint_bytes_len = filter.fingerprint_bytes_len();
+        header.key_count = encrypted_set_->size();
+        std::copy_n(encrypted_set_->input_keys_hash().data(), kInputKeysHashBytesLen, header.input_keys_hash);
+        if (!filter_file.empty()) {
+            save_filter_file(filter_file, header, filter);
+        }
+        LOG_IF(INFO, verbose_) << "filter of " << filter.size() << " keys is built.";
+    }
+
+    net->send_data(header.filter_id, kFilterIdBytesLen);
+    bool filter_needed = false;
+    net->recv_data(&filter_needed, sizeof(filter_needed));
+    if (filter_needed) {
+        std::size_t bucket_count = filter.bucket_count();
+        std::size_t size = filter.size();
+        std::size_t filter_fingerprint_bytes_len = filter.fingerprint_bytes_len();
+        net->send_data(&bucket_count, sizeof(bucket_count));
+        net->send_data(&size, sizeof(size));
+        net->send_data(&filter_fingerprint_bytes_len, sizeof(filter_fingerprint_bytes_len));
+        net->send_data(filter.data(), filter.byte_count());
+    }
+}
+
+std::size_t EcdhPSI::process_unbalanced(const std::shared_ptr<network::Network>& net,
+        const std::vector<std::string>& input_keys, std::vector<std::string>* output_keys) const {
     if (net == nullptr) {
         throw std::invalid_argument("net is null.");
     }
-    if (point_byte_count == 0) {
-        throw std::invalid_argument("Length of an Ecc point is 0.");
+    if (output_keys != nullptr) {
+        output_keys->clear();
+    }
+    if (!obtain_result_) {
+        LOG_IF(INFO, verbose_) << "self can not obtain result.";
+        doublely_encrypt_and_send_back_keys(net, filter_max_lookups_);
+        return 0;
     }
 
-    if (is_sender_) {
-        ByteVector encrypted_keys_buffer;
-        encrypted_keys_buffer.reserve(self_data_size * point_byte_count);
-        for (const auto& key : encrypted_keys) {
-            encrypted_keys_buffer.insert(encrypted_keys_buffer.end(), key.begin(), key.end());
+    LOG_IF(INFO, verbose_) << "self can obtain result.";
+    // Both parties throw on too many lookups for the filter fingerprints, once the other party has the key count.
+    std::size_t self_data_size = input_keys.size();
+    net->send_data(&self_data_size, sizeof(self_data_size));
+    if (self_data_size > filter_max_lookups_) {
+        throw std::invalid_argument("input keys exceed filter_max_lookups.");
+    }
+    PointBuffer encrypted_keys(self_data_size, group_->point_byte_count(), num_threads_);
+    encrypt_keys(input_keys, 0, self_data_size, encrypted_keys);
+    LOG_IF(INFO, verbose_) << "encrypt keys done.";
+
+    std::vector<std::uint8_t> matched(self_data_size, 0);
+    PointBuffer doublely_encrypted_keys;
+    for (std::size_t begin = 0; begin < self_data_size; begin += chunk_size_) {
+        std::size_t end = std::min(begin + chunk_size_, self_data_size);
+        net->send_data(encrypted_keys.point_data(begin), (end - begin) * group_->point_byte_count());
+        doublely_encrypted_keys.resize(end - begin, group_->point_byte_count());
+        net->recv_data(doublely_encrypted_keys.data(), doublely_encrypted_keys.byte_count());
+
+        std::size_t batch_count = (end - begin + kEncryptBatchSize - 1) / kEncryptBatchSize;
+        bool all_valid = true;
+#pragma omp parallel for num_threads(num_threads_) reduction(&& : all_valid)
+        for (std::size_t batch_idx = 0; batch_idx < batch_count; ++batch_idx) {
+            std::size_t batch_begin = begin + batch_idx * kEncryptBatchSize;
+            std::size_t batch_end = std::min(batch_begin + kEncryptBatchSize, end);
+            std::array<Byte, kEncryptBatchSize * kCuckooFilterTagBytesLen> tags;
+            if (!group_->decrypt_keys(doublely_encrypted_keys.point_data(batch_begin - begin), batch_end - batch_begin,
+                        kCuckooFilterTagBytesLen, tags.data())) {
+                all_valid = false;
+                continue;
+            }
+            for (std::size_t item_idx = batch_begin; item_idx < batch_end; ++item_idx) {
+                const Byte* tag = tags.data() + (item_idx - batch_begin) * kCuckooFilterTagBytesLen;
+                matched[item_idx] = remote_filter_->contains(tag) ? 1 : 0;
+            }
+        }
+        if (!all_valid) {
+            throw std::invalid_argument("doublely encrypted keys are not valid points.");
+        }
+    }
+    LOG_IF(INFO, verbose_) << "send, receive and look up keys done.";
+
+    auto cardinality = static_cast<std::size_t>(std::count(matched.begin(), matched.end(), 1));
+    if (output_keys != nullptr) {
+        output_keys->reserve(cardinality);
+        for (std::size_t item_idx = 0; item_idx < self_data_size; ++item_idx) {
+            if (matched[item_idx]) {
+                output_keys->emplace_back(input_keys[item_idx]);
+            }
+        }
+    }
+    LOG_IF(INFO, verbose_) << "calculate intersection done.";
+    return cardinality;
+}
+
+void EcdhPSI::process_with_payloads(const std::shared_ptr<network::Network>& net,
+        const std::vector<std::string>& input_keys, const PointBuffer& input_payloads,
+        std::vector<std::string>& output_keys, PointBuffer& output_payloads) const {
+    ScopedWorkerBinding binding(*worker_pool_, num_threads_);
+    if (net == nullptr) {
+        throw std::invalid_argument("net is null.");
+    }
+    if (obtain_result_ == remote_obtain_result_) {
+        throw std::invalid_argument("payload transfer requires exactly one party to obtain result.");
+    }
+    if (unbalanced_ || incremental_ || !spill_dir_.empty()) {
+        throw std::invalid_argument("payload transfer is not supported with unbalanced, incremental or spill_dir.");
+    }
+    output_keys.clear();
+    output_payloads.clear();
+
+    if (!obtain_result_) {
+        if (input_payloads.size() != input_keys.size() || input_payloads.point_byte_count() == 0) {
+            throw std::invalid_argument("input_payloads do not match input_keys.");
         }
+        LOG_IF(INFO, verbose_) << "self can not obtain result.";
+        std::size_t remote_data_size = doublely_encrypt_and_send_back_keys(net);
 
+        PointBuffer encrypted_keys_buffer;
+        const PointBuffer& encrypted_keys = encrypt_self_keys(input_keys, encrypted_keys_buffer);
+        LOG_IF(INFO, verbose_) << "encrypt keys done.";
+        std::size_t self_data_size = input_keys.size();
+        std::size_t tag_byte_count = compare_bytes_len(self_data_size, remote_data_size);
+        std::size_t payload_byte_count = input_payloads.point_byte_count();
+        std::array<Byte, kPayloadNonceBytesLen> nonce;
+        auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+        prng->generate(nonce.size(), nonce.data());
+        std::vector<std::size_t> permutation;
+        generate_permutation(prng, self_data_size, permutation);
+
+        // Every record is a compare tag followed by an encrypted payload.
+        PointBuffer records(self_data_size, tag_byte_count + payload_byte_count);
+#pragma omp parallel num_threads(num_threads_)
+        {
+            auto hash = petace::solo::Hash::create(petace::solo::HashScheme::SHA3_256);
+#pragma omp for
+            for (std::size_t item_idx = 0; item_idx < self_data_size; ++item_idx) {
+                ConstByteSpan encrypted_key(
+                        encrypted_keys.point_data(permutation[item_idx]), group_->point_byte_count());
+                Byte* record = records.point_data(item_idx);
+                std::copy_n(encrypted_key.begin() + group_->tag_offset(tag_byte_count), tag_byte_count, record);
+                std::copy_n(
+                        input_payloads.point_data(permutation[item_idx]), payload_byte_count, record + tag_byte_count);
+                xor_payload_key_stream(*hash, nonce.data(), encrypted_key, record + tag_byte_count, payload_byte_count);
+            }
+        }
+        net->send_data(nonce.data(), nonce.size());
         net->send_data(&self_data_size, sizeof(self_data_size));
-        if (self_data_size != 0) {
-            net->send_data(
-                    reinterpret_cast<const unsigned char*>(encrypted_keys_buffer.data()), encrypted_keys_buffer.size());
+        net->send_data(&payload_byte_count, sizeof(payload_byte_count));
+        net->send_data(records.data(), records.byte_count());
+        LOG_IF(INFO, verbose_) << "send tags and encrypted payloads done.";
+        return;
+    }
+
+    LOG_IF(INFO, verbose_) << "self can obtain result.";
+    std::size_t self_data_size = input_keys.size();
+    PointBuffer encrypted_keys_buffer;
+    const PointBuffer& encrypted_keys = encrypt_self_keys(input_keys, encrypted_keys_buffer);
+    LOG_IF(INFO, verbose_) << "encrypt keys done.";
+
+    // Self keys encrypted by the other party alone are recovered chunk by chunk.
+    net->send_data(&self_data_size, sizeof(self_data_size));
+    PointBuffer remote_encrypted_keys(self_data_size, group_->point_byte_count());
+    PointBuffer doublely_encrypted_keys;
+    for (std::size_t begin = 0; begin < self_data_size; begin += chunk_size_) {
+        std::size_t end = std::min(begin + chunk_size_, self_data_size);
+        net->send_data(encrypted_keys.point_data(begin), (end - begin) * group_->point_byte_count());
+        doublely_encrypted_keys.resize(end - begin, group_->point_byte_count());
+        net->recv_data(doublely_encrypted_keys.data(), doublely_encrypted_keys.byte_count());
+
+        std::size_t batch_count = (end - begin + kEncryptBatchSize - 1) / kEncryptBatchSize;
+        bool all_valid = true;
+#pragma omp parallel for num_threads(num_threads_) reduction(&& : all_valid)
+        for (std::size_t batch_idx = 0; batch_idx < batch_count; ++batch_idx) {
+            std::size_t batch_begin = begin + batch_idx * kEncryptBatchSize;
+            std::size_t batch_end = std::min(batch_begin + kEncryptBatchSize, end);
+            if (!group_->decrypt_keys(doublely_encrypted_keys.point_data(batch_begin - begin), batch_end - batch_begin,
+                        group_->point_byte_count(), remote_encrypted_keys.point_data(batch_begin))) {
+                all_valid = false;
+            }
         }
-        encrypted_keys_buffer.clear();
-        LOG_IF(INFO, verbose_) << "sender sent encryptd keys.";
+        if (!all_valid) {
+            throw std::invalid_argument("doublely encrypted keys are not valid points.");
+        }
+    }
+    encrypted_keys_buffer.clear();
+    LOG_IF(INFO, verbose_) << "send, receive and decrypt keys done.";
 
-        std::size_t received_data_size = 0;
-        net->recv_data(&received_data_size, sizeof(received_data_size));
+    std::array<Byte, kPayloadNonceBytesLen> nonce;
+    std::size_t remote_data_size = 0;
+    std::size_t payload_byte_count = 0;
+    net->recv_data(nonce.data(), nonce.size());
+    net->recv_data(&remote_data_size, sizeof(remote_data_size));
+    net->recv_data(&payload_byte_count, sizeof(payload_byte_count));
+    std::size_t tag_byte_count = compare_bytes_len(self_data_size, remote_data_size);
+    PointBuffer records(remote_data_size, tag_byte_count + payload_byte_count);
+    net->recv_data(records.data(), records.byte_count());
+    LOG_IF(INFO, verbose_) << "receive tags and encrypted payloads done.";
 
-        ByteVector received_keys_buffer;
-        received_keys_buffer.resize(received_data_size * point_byte_count);
-        if (received_data_size != 0) {
-            net->recv_data(reinterpret_cast<unsigned char*>(received_keys_buffer.data()),
-                    received_data_size * point_byte_count);
+    // Tags are sorted with their record indices, so that a matched tag leads to its payload.
+    PointBuffer sorted_tags(remote_data_size, tag_byte_count + kIndexBytesLen);
+#pragma omp parallel for num_threads(num_threads_)
+    for (std::size_t item_idx = 0; item_idx < remote_data_size; ++item_idx) {
+        std::copy_n(records.point_data(item_idx), tag_byte_count, sorted_tags.point_data(item_idx));
+        store_index(item_idx, sorted_tags.point_data(item_idx) + tag_byte_count);
+    }
+    radix_sort_points(sorted_tags, num_threads_);
+
+    std::vector<std::uint8_t> matched(self_data_size, 0);
+    PointBuffer payloads(self_data_size, payload_byte_count);
+#pragma omp parallel num_threads(num_threads_)
+    {
+        auto hash = petace::solo::Hash::create(petace::solo::HashScheme::SHA3_256);
+#pragma omp for
+        for (std::size_t item_idx = 0; item_idx < self_data_size; ++item_idx) {
+            ConstByteSpan remote_encrypted_key(
+                    remote_encrypted_keys.point_data(item_idx), group_->point_byte_count());
+            const Byte* tag = remote_encrypted_key.begin() + group_->tag_offset(tag_byte_count);
+            std::size_t low = 0;
+            std::size_t high = remote_data_size;
+            while (low < high) {
+                std::size_t mid = low + (high - low) / 2;
+                if (std::memcmp(sorted_tags.point_data(mid), tag, tag_byte_count) < 0) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            if (low == remote_data_size || std::memcmp(sorted_tags.point_data(low), tag, tag_byte_count) != 0) {
+                continue;
+            }
+            std::size_t record_idx = load_index(sorted_tags.point_data(low) + tag_byte_count);
+            std::copy_n(
+                    records.point_data(record_idx) + tag_byte_count, payload_byte_count, payloads.point_data(item_idx));
+            xor_payload_key_stream(
+                    *hash, nonce.data(), remote_encrypted_key, payloads.point_data(item_idx), payload_byte_count);
+            matched[item_idx] = 1;
         }
+    }
 
-        received_keys.reserve(received_data_size);
-        for (std::size_t item_idx = 0; item_idx < received_data_size; ++item_idx) {
-            received_keys.emplace_back(received_keys_buffer.begin() + item_idx * point_byte_count,
-                    received_keys_buffer.begin() + (item_idx + 1) * point_byte_count);
+    auto cardinality = static_cast<std::size_t>(std::count(matched.begin(), matched.end(), 1));
+    output_keys.reserve(cardinality);
+    output_payloads.resize(cardinality, payload_byte_count);
+    for (std::size_t item_idx = 0; item_idx < self_data_size; ++item_idx) {
+        if (matched[item_idx]) {
+            std::copy_n(payloads.point_data(item_idx), payload_byte_count,
+                    output_payloads.point_data(output_keys.size()));
+            output_keys.emplace_back(input_keys[item_idx]);
+        }
+    }
+    LOG_IF(INFO, verbose_) << "calculate intersection and decrypt payloads done.";
+}
+
+std::size_t EcdhPSI::process_intersection_sum(const std::shared_ptr<network::Network>& net,
+        const std::vector<std::string>& input_keys, const std::vector<std::uint64_t>& input_values,
+        std::uint64_t& sum) const {
+    ScopedWorkerBinding binding(*worker_pool_, num_threads_);
+    if (net == nullptr) {
+        throw std::invalid_argument("net is null.");
+    }
+    if (obtain_result_ == remote_obtain_result_) {
+        throw std::invalid_argument("intersection sum requires exactly one party to obtain result.");
+    }
+    if (unbalanced_ || incremental_ || !spill_dir_.empty()) {
+        throw std::invalid_argument("intersection sum is not supported with unbalanced, incremental or spill_dir.");
+    }
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    std::size_t self_data_size = input_keys.size();
+    std::size_t cardinality = 0;
+    sum = 0;
+
+    if (!obtain_result_) {
+        if (input_values.size() != self_data_size) {
+            throw std::invalid_argument("input_values do not match input_keys.");
+        }
+        LOG_IF(INFO, verbose_) << "self can not obtain result.";
+        std::size_t remote_data_size = 0;
+        net->recv_data(&remote_data_size, sizeof(remote_data_size));
+        PointBuffer remote_encrypted_keys(remote_data_size, group_->point_byte_count());
+        net->recv_data(remote_encrypted_keys.data(), remote_encrypted_keys.byte_count());
+        PointBuffer remote_tags(remote_data_size, compare_bytes_len(self_data_size, remote_data_size));
+        doublely_encrypt_keys(remote_encrypted_keys, 0, remote_data_size, remote_tags);
+        remote_encrypted_keys.clear();
+        std::vector<std::size_t> permutation;
+        generate_permutation(prng, remote_data_size, permutation);
+        permute_and_undo(permutation, true, remote_tags);
+        LOG_IF(INFO, verbose_) << "receive and doublely encrypt keys done.";
+
+        std::array<Byte, kRistretto255ScalarBytesLen> secret_key;
+        std::array<Byte, kRistretto255PointBytesLen> public_key;
+        generate_ristretto255_scalar(*prng, secret_key.data());
+        ristretto255_base_mul(secret_key.data(), public_key.data());
+        // Randomness of every ciphertext is drawn up front, since the PRNG is not shared across threads.
+        PointBuffer randomness(self_data_size, kRistretto255ScalarBytesLen);
+        for (std::size_t item_idx = 0; item_idx < self_data_size; ++item_idx) {
+            generate_ristretto255_scalar(*prng, randomness.point_data(item_idx));
+        }
+        generate_permutation(prng, self_data_size, permutation);
+        PointBuffer encrypted_keys;
+        {
+            PointBuffer encrypted_keys_buffer;
+            gather_points(encrypt_self_keys(input_keys, encrypted_keys_buffer), 0, permutation, encrypted_keys);
+        }
+        PointBuffer ciphertexts(self_data_size, kElGamalCiphertextBytesLen);
+#pragma omp parallel for num_threads(num_threads_)
+        for (std::size_t item_idx = 0; item_idx < self_data_size; ++item_idx) {
+            encrypt_value(public_key.data(), input_values[permutation[item_idx]], randomness.point_data(item_idx),
+                    ciphertexts.point_data(item_idx));
+        }
+        randomness.clear();
+        LOG_IF(INFO, verbose_) << "encrypt keys and values done.";
+
+        net->send_data(public_key.data(), public_key.size());
+        net->send_data(&self_data_size, sizeof(self_data_size));
+        if (compress_tags_) {
+            send_compressed_tags(net, remote_tags);
+        } else {
+            net->send_data(remote_tags.data(), remote_tags.byte_count());
+        }
+        net->send_data(encrypted_keys.data(), encrypted_keys.byte_count());
+        net->send_data(ciphertexts.data(), ciphertexts.byte_count());
+        LOG_IF(INFO, verbose_) << "send tags, encrypted keys and encrypted values done.";
+
+        std::array<Byte, kElGamalCiphertextBytesLen> sum_ciphertext;
+        net->recv_data(&cardinality, sizeof(cardinality));
+        net->recv_data(sum_ciphertext.data(), sum_ciphertext.size());
+        std::array<Byte, kRistretto255PointBytesLen> shared_secret;
+        std::array<Byte, kRistretto255PointBytesLen> sum_point;
+        bool sum_found = ristretto255_scalar_mul(sum_ciphertext.data(), secret_key.data(), shared_secret.data()) &&
+                         ristretto255_sub(sum_ciphertext.data() + kRistretto255PointBytesLen, shared_secret.data(),
+                                 sum_point.data()) &&
+                         ristretto255_small_log(sum_point.data(), kIntersectionSumMaxBits, sum);
+        net->send_data(&sum_found, sizeof(sum_found));
+        net->send_data(&sum, sizeof(sum));
+        if (!sum_found) {
+            throw std::runtime_error(
+                    "intersection sum is not below 2^" + std::to_string(kIntersectionSumMaxBits) + ".");
+        }
+        LOG_IF(INFO, verbose_) << "decrypt intersection sum done.";
+        return cardinality;
+    }
+
+    LOG_IF(INFO, verbose_) << "self can obtain result.";
+    PointBuffer encrypted_keys_buffer;
+    const PointBuffer& encrypted_keys = encrypt_self_keys(input_keys, encrypted_keys_buffer);
+    net->send_data(&self_data_size, sizeof(self_data_size));
+    net->send_data(encrypted_keys.data(), encrypted_keys.byte_count());
+    encrypted_keys_buffer.clear();
+    LOG_IF(INFO, verbose_) << "encrypt and send keys done.";
+
+    std::array<Byte, kRistretto255PointBytesLen> public_key;
+    std::size_t remote_data_size = 0;
+    net->recv_data(public_key.data(), public_key.size());
+    net->recv_data(&remote_data_size, sizeof(remote_data_size));
+    std::size_t tag_byte_count = compare_bytes_len(self_data_size, remote_data_size);
+    PointBuffer self_tags(self_data_size, tag_byte_count);
+    PointBuffer remote_encrypted_keys(remote_data_size, group_->point_byte_count());
+    PointBuffer ciphertexts(remote_data_size, kElGamalCiphertextBytesLen);
+    if (compress_tags_) {
+        recv_compressed_tags(net, tag_byte_count, self_tags);
+        if (self_tags.size() != self_data_size) {
+            throw std::invalid_argument("received tags do not match input keys.");
         }
-        received_keys_buffer.clear();
-        LOG_IF(INFO, verbose_) << "receiver received encryptd keys.";
     } else {
-        std::size_t received_data_size = 0;
-        net->recv_data(&received_data_size, sizeof(received_data_size));
+        net->recv_data(self_tags.data(), self_tags.byte_count());
+    }
+    net->recv_data(remote_encrypted_keys.data(), remote_encrypted_keys.byte_count());
+    net->recv_data(ciphertexts.data(), ciphertexts.byte_count());
+    LOG_IF(INFO, verbose_) << "receive tags, encrypted keys and encrypted values done.";
 
-        ByteVector received_keys_buffer;
-        received_keys_buffer.resize(received_data_size * point_byte_count);
-        if (received_data_size != 0) {
-            net->recv_data(reinterpret_cast<unsigned char*>(received_keys_buffer.data()),
-                    received_data_size * point_byte_count);
+    PointBuffer remote_tags(remote_data_size, tag_byte_count);
+    doublely_encrypt_keys(remote_encrypted_keys, 0, remote_data_size, remote_tags);
+    remote_encrypted_keys.clear();
+    std::vector<std::uint8_t> matched(remote_data_size, 0);
+    if (!self_tags.empty() && !remote_tags.empty()) {
+        hash_join(self_tags, remote_tags, num_threads_, matched);
+    }
+    std::vector<std::size_t> matched_indices;
+    for (std::size_t item_idx = 0; item_idx < remote_data_size; ++item_idx) {
+        if (matched[item_idx]) {
+            matched_indices.push_back(item_idx);
         }
+    }
+    cardinality = matched_indices.size();
+    LOG_IF(INFO, verbose_) << "doublely encrypt and match keys done.";
 
-        received_keys.reserve(received_data_size);
-        for (std::size_t item_idx = 0; item_idx < received_data_size; ++item_idx) {
-            received_keys.emplace_back(received_keys_buffer.begin() + item_idx * point_byte_count,
-                    received_keys_buffer.begin() + (item_idx + 1) * point_byte_count);
+    // Every thread adds up a part of matched ciphertexts, and the partial sums are added up at last.
+    std::size_t part_count = std::max<std::size_t>(std::min(num_threads_, cardinality), 1);
+    PointBuffer partial_sums(part_count, kElGamalCiphertextBytesLen);
+    bool all_valid = true;
+#pragma omp parallel for num_threads(num_threads_) reduction(&& : all_valid)
+    for (std::size_t part_idx = 0; part_idx < part_count; ++part_idx) {
+        std::size_t begin = cardinality * part_idx / part_count;
+        std::size_t end = cardinality * (part_idx + 1) / part_count;
+        if (!sum_ciphertexts(ciphertexts, matched_indices.data() + begin, end - begin,
+                    partial_sums.point_data(part_idx))) {
+            all_valid = false;
         }
-        received_keys_buffer.clear();
-        LOG_IF(INFO, verbose_) << "receiver received encryptd keys.";
+    }
+    if (!all_valid) {
+        throw std::invalid_argument("encrypted values are not valid ciphertexts.");
+    }
+    std::vector<std::size_t> part_indices(part_count);
+    std::iota(part_indices.begin(), part_indices.end(), std::size_t(0));
+    std::array<Byte, kElGamalCiphertextBytesLen> sum_ciphertext;
+    sum_ciphertexts(partial_sums, part_indices.data(), part_count, sum_ciphertext.data());
+
+    // The sum is rerandomized, so that the other party cannot tell which of its ciphertexts were added up.
+    std::array<Byte, kRistretto255ScalarBytesLen> randomness;
+    std::array<Byte, kElGamalCiphertextBytesLen> zero_ciphertext;
+    generate_ristretto255_scalar(*prng, randomness.data());
+    if (!encrypt_value(public_key.data(), 0, randomness.data(), zero_ciphertext.data())) {
+        throw std::invalid_argument("public key is not a valid point.");
+    }
+    PointBuffer terms(2, kElGamalCiphertextBytesLen);
+    std::copy_n(sum_ciphertext.data(), kElGamalCiphertextBytesLen, terms.point_data(0));
+    std::copy_n(zero_ciphertext.data(), kElGamalCiphertextBytesLen, terms.point_data(1));
+    std::array<std::size_t, 2> term_indices = {0, 1};
+    sum_ciphertexts(terms, term_indices.data(), term_indices.size(), sum_ciphertext.data());
+    LOG_IF(INFO, verbose_) << "add up encrypted values done.";
+
+    net->send_data(&cardinality, sizeof(cardinality));
+    net->send_data(sum_ciphertext.data(), sum_ciphertext.size());
+    bool sum_found = false;
+    net->recv_data(&sum_found, sizeof(sum_found));
+    net->recv_data(&sum, sizeof(sum));
+    if (!sum_found) {
+        throw std::runtime_error("intersection sum is not below 2^" + std::to_string(kIntersectionSumMaxBits) + ".");
+    }
+    LOG_IF(INFO, verbose_) << "receive intersection sum done.";
+    return cardinality;
+}
+
+void EcdhPSI::process_multi_id(const std::shared_ptr<network::Network>& net,
+        const std::vector<std::vector<std::string>>& input_keys, std::vector<std::vector<std::string>>& output_keys,
+        std::vector<std::size_t>& output_id_indices) const {
+    ScopedWorkerBinding binding(*worker_pool_, num_threads_);
+    if (net == nullptr) {
+        throw std::invalid_argument("net is null.");
+    }
+    if (unbalanced_ || incremental_ || !spill_dir_.empty() || encrypted_set_ != nullptr) {
+        throw std::invalid_argument(
+                "multi-id intersection is not supported with unbalanced, incremental, spill_dir or an encrypted set.");
+    }
+    if (input_keys.empty()) {
+        throw std::invalid_argument("input_keys have no id column.");
+    }
+    std::size_t id_count = input_keys.size();
+    std::size_t self_data_size = input_keys[0].size();
+    for (const auto& id_keys : input_keys) {
+        if (id_keys.size() != self_data_size) {
+            throw std::invalid_argument("id columns of input_keys are not of the same size.");
+        }
+    }
+    check_consistency(is_sender_, net, "ids_num", id_count);
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    std::vector<std::size_t> permutation;
+    generate_permutation(prng, self_data_size, permutation);
+
+    // Rows are shuffled by one permutation and id columns are laid out one after another, so that all ids go through
+    // one pass of encryption and one exchange. A missing id is replaced by random bytes, which match nothing.
+    std::vector<std::string> shuffled_keys(id_count * self_data_size);
+    for (std::size_t id_idx = 0; id_idx < id_count; ++id_idx) {
+        for (std::size_t item_idx = 0; item_idx < self_data_size; ++item_idx) {
+            std::string& key = shuffled_keys[id_idx * self_data_size + item_idx];
+            key = input_keys[id_idx][permutation[item_idx]];
+            if (key.empty()) {
+                key.resize(kRandSeedBytesLen);
+                prng->generate(key.size(), reinterpret_cast<Byte*>(&key[0]));
+            }
+        }
+    }
+    LOG_IF(INFO, verbose_) << "shuffle input keys of " << id_count << " id columns done.";
+
+    PointBuffer remote_tags;
+    encrypt_and_exchange_keys(net, shuffled_keys, std::vector<std::size_t>(), remote_tags);
+    shuffled_keys.clear();
+    LOG_IF(INFO, verbose_) << "encrypt, send and receive, and doublely encrypt keys done.";
+
+    if (remote_tags.size() % id_count != 0) {
+        throw std::invalid_argument("received keys do not form rows of " + std::to_string(id_count) + " ids.");
+    }
+    std::size_t remote_data_size = remote_tags.size() / id_count;
+    std::size_t tag_byte_count = compare_bytes_len(id_count * self_data_size, remote_tags.size());
+    PointBuffer self_tags;
+    if (remote_obtain_result_) {
+        exchange_encrypted_keys(net, remote_tags, self_tags, tag_byte_count);
+    } else {
+        exchange_encrypted_keys(net, PointBuffer(), self_tags, tag_byte_count);
+    }
+    LOG_IF(INFO, verbose_) << "send and receive doublely encrypt keys done.";
+
+    output_keys.assign(id_count, std::vector<std::string>());
+    output_id_indices.clear();
+    if (!obtain_result_) {
+        LOG_IF(INFO, verbose_) << "self can not obtain result.";
+        return;
+    }
+    LOG_IF(INFO, verbose_) << "self can obtain result.";
+
+    // Id columns are matched in priority order among rows of both parties that are not matched yet.
+    // Matched id indices are kept by shuffled rows, and id_count marks a row that is not matched.
+    std::vector<std::size_t> self_id_indices(self_data_size, id_count);
+    std::vector<std::uint8_t> remote_row_matched(remote_data_size, 0);
+    std::vector<std::size_t> self_positions;
+    std::vector<std::size_t> remote_positions;
+    PointBuffer self_id_tags;
+    PointBuffer remote_id_tags;
+    std::vector<std::uint8_t> self_matched;
+    std::vector<std::uint8_t> remote_matched;
+    for (std::size_t id_idx = 0; id_idx < id_count; ++id_idx) {
+        self_positions.clear();
+        for (std::size_t item_idx = 0; item_idx < self_data_size; ++item_idx) {
+            if (self_id_indices[item_idx] == id_count && !input_keys[id_idx][permutation[item_idx]].empty()) {
+                self_positions.push_back(item_idx);
+            }
+        }
+        remote_positions.clear();
+        for (std::size_t item_idx = 0; item_idx < remote_data_size; ++item_idx) {
+            if (!remote_row_matched[item_idx]) {
+                remote_positions.push_back(item_idx);
+            }
+        }
+        if (self_positions.empty() || remote_positions.empty()) {
+            continue;
+        }
+        gather_points(self_tags, id_idx * self_data_size, self_positions, self_id_tags);
+        gather_points(remote_tags, id_idx * remote_data_size, remote_positions, remote_id_tags);
+        hash_join(remote_id_tags, self_id_tags, num_threads_, self_matched);
+        hash_join(self_id_tags, remote_id_tags, num_threads_, remote_matched);
+        for (std::size_t item_idx = 0; item_idx < self_positions.size(); ++item_idx) {
+            if (self_matched[item_idx]) {
+                self_id_indices[self_positions[item_idx]] = id_idx;
+            }
+        }
+        for (std::size_t item_idx = 0; item_idx < remote_positions.size(); ++item_idx) {
+            if (remote_matched[item_idx]) {
+                remote_row_matched[remote_positions[item_idx]] = 1;
+            }
+        }
+        LOG_IF(INFO, verbose_) << "match id column " << id_idx << " done.";
+    }
+    permute_and_undo(permutation, false, self_id_indices);
+
+    for (std::size_t item_idx = 0; item_idx < self_data_size; ++item_idx) {
+        if (self_id_indices[item_idx] == id_count) {
+            continue;
+        }
+        for (std::size_t id_idx = 0; id_idx < id_count; ++id_idx) {
+            output_keys[id_idx].push_back(input_keys[id_idx][item_idx]);
+        }
+        output_id_indices.push_back(self_id_indices[item_idx]);
+    }
+    LOG_IF(INFO, verbose_) << "calculate intersection done.";
+}
+
+std::size_t EcdhPSI::doublely_encrypt_and_send_back_keys(
+        const std::shared_ptr<network::Network>& net, std::size_t max_data_size) const {
+    std::size_t received_data_size = 0;
+    net->recv_data(&received_data_size, sizeof(received_data_size));
+    if (received_data_size > max_data_size) {
+        throw std::invalid_argument("remote keys exceed filter_max_lookups.");
+    }
+    PointBuffer received_keys;
+    PointBuffer doublely_encrypted_keys;
+    for (std::size_t begin = 0; begin < received_data_size; begin += chunk_size_) {
+        std::size_t count = std::min(chunk_size_, received_data_size - begin);
+        received_keys.resize(count, group_->point_byte_count());
+        net->recv_data(received_keys.data(), received_keys.byte_count());
+        doublely_encrypted_keys.resize(count, group_->point_byte_count());
+        doublely_encrypt_keys(received_keys, 0, count, doublely_encrypted_keys);
+        net->send_data(doublely_encrypted_keys.data(), doublely_encrypted_keys.byte_count());
+    }
+    LOG_IF(INFO, verbose_) << "receive, doublely encrypt and send back keys done.";
+    return received_data_size;
+}
+
+const PointBuffer& EcdhPSI::encrypt_self_keys(const std::vector<std::string>& input_keys, PointBuffer& buffer) const {
+    if (encrypted_set_ != nullptr) {
+        check_encrypted_set(input_keys);
+        return encrypted_set_->encrypted_keys();
+    }
+    buffer = PointBuffer(input_keys.size(), group_->point_byte_count(), num_threads_);
+    encrypt_keys(input_keys, 0, input_keys.size(), buffer);
+    return buffer;
+}
+
+std::size_t EcdhPSI::process_incremental(const std::shared_ptr<network::Network>& net,
+        const std::vector<std::string>& input_keys, std::vector<std::string>* output_keys) const {
+    if (net == nullptr) {
+        throw std::invalid_argument("net is null.");
+    }
+    // Both states must be saved by the same run. The sender draws the ID of the states saved by this run.
+    std::array<Byte, kIncrementalStateIdBytesLen> remote_state_id;
+    std::array<Byte, kIncrementalStateIdBytesLen> state_id;
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    if (is_sender_) {
+        net->send_data(incremental_state_->state_id().data(), kIncrementalStateIdBytesLen);
+        net->recv_data(remote_state_id.data(), kIncrementalStateIdBytesLen);
+        prng->generate(state_id.size(), state_id.data());
+        net->send_data(state_id.data(), state_id.size());
+    } else {
+        net->recv_data(remote_state_id.data(), kIncrementalStateIdBytesLen);
+        net->send_data(incremental_state_->state_id().data(), kIncrementalStateIdBytesLen);
+        net->recv_data(state_id.data(), state_id.size());
+    }
+    if (remote_state_id != incremental_state_->state_id()) {
+        throw std::invalid_argument("incremental state does not match the other party.");
+    }
+
+    // Changes are shuffled, since they come out of diff in the order of key digests.
+    PointBuffer input_digests;
+    incremental_state_->digest_keys(input_keys, num_threads_, input_digests);
+    std::vector<std::size_t> added_indices;
+    PointBuffer removed_digests;
+    PointBuffer removed_encrypted_keys;
+    incremental_state_->diff(input_digests, added_indices, removed_digests, removed_encrypted_keys);
+    std::vector<std::size_t> permutation;
+    generate_permutation(prng, added_indices.size(), permutation);
+    permute_and_undo(permutation, true, added_indices);
+    generate_permutation(prng, removed_encrypted_keys.size(), permutation);
+    permute_and_undo(permutation, true, removed_encrypted_keys);
+    LOG_IF(INFO, verbose_) << added_indices.size() << " keys are added and " << removed_encrypted_keys.size()
+                           << " keys are removed.";
 
-        ByteVector encrypted_keys_buffer;
-        encrypted_keys_buffer.reserve(self_data_size * point_byte_count);
-        for (const auto& key : encrypted_keys) {
-            encrypted_keys_buffer.insert(encrypted_keys_buffer.end(), key.begin(), key.end());
+    // Removed keys are not in the input any more, so their encrypted keys come from the state.
+    PointBuffer added_digests;
+    gather_points(input_digests, 0, added_indices, added_digests);
+    PointBuffer added_encrypted_keys(added_indices.size(), group_->point_byte_count());
+    encrypt_keys(input_keys, added_indices, 0, added_indices.size(), added_encrypted_keys);
+    PointBuffer remote_added_keys;
+    PointBuffer remote_removed_keys;
+    exchange_encrypted_keys(net, added_encrypted_keys, remote_added_keys, group_->point_byte_count());
+    exchange_encrypted_keys(net, removed_encrypted_keys, remote_removed_keys, group_->point_byte_count());
+    PointBuffer remote_added_tags(remote_added_keys.size(), kIncrementalTagBytesLen);
+    PointBuffer remote_removed_tags(remote_removed_keys.size(), kIncrementalTagBytesLen);
+    doublely_encrypt_keys(remote_added_keys, 0, remote_added_keys.size(), remote_added_tags);
+    doublely_encrypt_keys(remote_removed_keys, 0, remote_removed_keys.size(), remote_removed_tags);
+    LOG_IF(INFO, verbose_) << "encrypt, send and receive, and doublely encrypt changes done.";
+
+    // Only tags of added keys are sent back, since tags of removed keys are already in the state.
+    PointBuffer added_tags;
+    if (remote_obtain_result_) {
+        exchange_encrypted_keys(net, remote_added_tags, added_tags, kIncrementalTagBytesLen);
+    } else {
+        exchange_encrypted_keys(net, PointBuffer(), added_tags, kIncrementalTagBytesLen);
+    }
+    if (obtain_result_ && added_tags.size() != added_indices.size()) {
+        throw std::invalid_argument("doublely encrypted keys do not match added keys.");
+    }
+    LOG_IF(INFO, verbose_) << "send and receive doublely encrypted changes done.";
+
+    if (obtain_result_) {
+        radix_sort_points(remote_added_tags, num_threads_);
+        radix_sort_points(remote_removed_tags, num_threads_);
+    }
+    incremental_state_->update(added_digests, added_encrypted_keys, added_tags, removed_digests, remote_added_tags,
+            remote_removed_tags, state_id);
+    incremental_state_->save(state_file_);
+    LOG_IF(INFO, verbose_) << "incremental state of " << incremental_state_->size() << " keys is saved to "
+                           << state_file_;
+
+    if (output_keys != nullptr) {
+        output_keys->clear();
+    }
+    if (!obtain_result_) {
+        LOG_IF(INFO, verbose_) << "self can not obtain result.";
+        return 0;
+    }
+    LOG_IF(INFO, verbose_) << "self can obtain result.";
+    std::vector<std::uint8_t> matched(input_keys.size(), 0);
+#pragma omp parallel for num_threads(num_threads_)
+    for (std::size_t item_idx = 0; item_idx < input_keys.size(); ++item_idx) {
+        matched[item_idx] = incremental_state_->matches(input_digests.point_data(item_idx)) ? 1 : 0;
+    }
+    auto cardinality = static_cast<std::size_t>(std::count(matched.begin(), matched.end(), 1));
+    if (output_keys != nullptr) {
+        output_keys->reserve(cardinality);
+        for (std::size_t item_idx = 0; item_idx < input_keys.size(); ++item_idx) {
+            if (matched[item_idx]) {
+                output_keys->emplace_back(input_keys[item_idx]);
+            }
         }
+    }
+    LOG_IF(INFO, verbose_) << "calculate intersection done.";
+    return cardinality;
+}
 
+void EcdhPSI::send_compressed_tags(const std::shared_ptr<network::Network>& net, PointBuffer& tags) const {
+    radix_sort_points(tags, num_threads_);
+    std::vector<std::uint64_t> encoded;
+    elias_fano_encode_points(tags, num_threads_, encoded);
+    std::size_t word_count = encoded.size();
+    net->send_data(&word_count, sizeof(word_count));
+    net->send_data(encoded.data(), word_count * sizeof(std::uint64_t));
+    LOG_IF(INFO, verbose_) << "compress " << tags.byte_count() << " bytes of tags to "
+                           << word_count * sizeof(std::uint64_t) << " bytes.";
+}
+
+void EcdhPSI::recv_compressed_tags(
+        const std::shared_ptr<network::Network>& net, std::size_t tag_byte_count, PointBuffer& tags) const {
+    std::size_t word_count = 0;
+    net->recv_data(&word_count, sizeof(word_count));
+    std::vector<std::uint64_t> encoded(word_count);
+    net->recv_data(encoded.data(), word_count * sizeof(std::uint64_t));
+    elias_fano_decode_points(encoded, num_threads_, tags);
+    if (tags.empty()) {
+        tags.resize(0, tag_byte_count);
+    } else if (tags.point_byte_count() != tag_byte_count) {
+        throw std::invalid_argument("received tags have unexpected length.");
+    }
+}
+
+std::size_t EcdhPSI::compare_bytes_len(std::size_t self_size, std::size_t remote_size) const {
+    std::size_t bit_count = statistical_security_bits_ + ceil_log2(self_size) + ceil_log2(remote_size);
+    return std::min((bit_count + 7) / 8, kECCMaxCompareBytesLen);
+}
+
+void EcdhPSI::exchange_encrypted_keys(std::shared_ptr<network::Network> net, const PointBuffer& encrypted_keys,
+        PointBuffer& received_keys, std::size_t point_byte_count) const {
+    std::size_t self_data_size = encrypted_keys.size();
+    if (net == nullptr) {
+        throw std::invalid_argument("net is null.");
+    }
+    if (point_byte_count == 0) {
+        throw std::invalid_argument("Length of an Ecc point is 0.");
+    }
+    if (self_data_size != 0 && encrypted_keys.point_byte_count() != point_byte_count) {
+        throw std::invalid_argument("Length of encrypted keys does not match.");
+    }
+
+    auto send_keys = [&]() {
         net->send_data(&self_data_size, sizeof(self_data_size));
         if (self_data_size != 0) {
-            net->send_data(
-                    reinterpret_cast<const unsigned char*>(encrypted_keys_buffer.data()), encrypted_keys_buffer.size());
+            net->send_data(encrypted_keys.data(), encrypted_keys.byte_count());
+        }
+    };
+    auto recv_keys = [&]() {
+        std::size_t received_data_size = 0;
+        net->recv_data(&received_data_size, sizeof(received_data_size));
+        received_keys.resize(received_data_size, point_byte_count);
+        if (received_data_size != 0) {
+            net->recv_data(received_keys.data(), received_keys.byte_count());
         }
-        encrypted_keys_buffer.clear();
+    };
+
+    if (is_sender_) {
+        send_keys();
+        LOG_IF(INFO, verbose_) << "sender sent encryptd keys.";
+        recv_keys();
+        LOG_IF(INFO, verbose_) << "sender received encryptd keys.";
+    } else {
+        recv_keys();
+        LOG_IF(INFO, verbose_) << "receiver received encryptd keys.";
+        send_keys();
         LOG_IF(INFO, verbose_) << "receiver sent encryptd keys.";
     }
 }
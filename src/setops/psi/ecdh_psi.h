@@ -14,19 +14,38 @@
 
 #pragma once
 
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "network/network.h"
-#include "solo/ec_openssl.h"
+#include "solo/prng.h"
 
+#include "setops/psi/ecdh_encrypted_set.h"
+#include "setops/psi/ecdh_group.h"
+#include "setops/psi/ecdh_incremental_state.h"
 #include "setops/psi/psi.h"
+#include "setops/util/chunk_progress.h"
+#include "setops/util/cuckoo_filter.h"
 #include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+#include "setops/util/worker_pool.h"
 
 namespace petace {
 namespace setops {
 
+/**
+ * @brief Algorithms to match doublely encrypted keys of both parties.
+ *
+ * SORT sorts the remote keys with a parallel radix sort and binary searches every self key in parallel.
+ * HASH_JOIN scatters keys of both parties into cache-sized partitions, then builds and probes partitions in parallel.
+ */
+enum class IntersectionScheme : std::uint32_t { SORT = 0, HASH_JOIN = 1 };
+
+// The bound in bits of an intersection sum, which is decrypted by a discrete logarithm of 2^20 steps at most.
+const std::size_t kIntersectionSumMaxBits = 40;
+
 /**
  * @brief Implementation of PSI protocol based on Elliptic-Curve Diffie-Hellman (ECDH-PSI).
  *
@@ -64,17 +83,94 @@ class EcdhPSI : public PSI {
      *         "has_header": false,
      *         "output_file": "/data/receiver_output_file.csv"
      *     },
+     *     "threads": {
+     *         "num_threads": 0,
+     *         "cpu_affinity": [],
+     *         "numa_node": -1
+     *     },
      *     "ecdh_params": {
      *         "curve_id": 415,
-     *         "obtain_result": true
+     *         "obtain_result": true,
+     *         "chunk_size": 65536,
+     *         "intersection_scheme": "hash_join",
+     *         "spill_dir": "",
+     *         "memory_limit_mb": 1024,
+     *         "secret_key_file": "",
+     *         "precomputed_file": "",
+     *         "num_threads": 0,
+     *         "statistical_security_bits": 40,
+     *         "unbalanced": false,
+     *         "filter_file": "",
+     *         "filter_max_lookups": 1048576,
+     *         "incremental": false,
+     *         "state_file": "",
+     *         "compress_tags": false
      *     }
      * }
      *
+     * "threads" configures the shared worker pool, see WorkerPoolOptions. Workers are pinned to the CPUs of
+     * "cpu_affinity" and "numa_node" if either is set, and by default there is one worker per such CPU, capped by the
+     * cgroup CPU quota. A nonzero "num_threads" of "ecdh_params" overrides the number of threads of this instance,
+     * such as a share of the pool for one of many concurrent sessions. Workers are only pinned while init and process
+     * calls run, and the affinity of the calling thread is restored when they return.
+     *
+     * "curve_id" selects the group: kP256CurveId for NIST P-256 through OpenSSL, whose encrypted keys are 33-byte
+     * compressed points, or kCurve25519CurveId for Ristretto255, whose scalar multiplication is faster.
+     * Both parties check that they run the same protocol version, since encodings of encrypted keys and hashing to the
+     * group differ across versions.
+     *
+     * Doublely encrypted keys are compared by truncated tags of statistical_security_bits + log2(m) + log2(n) bits
+     * rounded up to bytes, for set sizes m and n, and at most kECCMaxCompareBytesLen bytes. The probability of a false
+     * match is then at most 2^-statistical_security_bits.
+     *
+     * The secret key is loaded from "precomputed_file" if it is set, otherwise from "state_file" if it exists in
+     * incremental mode, otherwise from "secret_key_file" if it is set, otherwise it is randomly generated.
+     *
+     * "unbalanced" runs the unbalanced mode for a small set against a large one, where exactly one party obtains
+     * result. The party not obtaining result holds the large set under a long-lived secret key and publishes a cuckoo
+     * filter of its encrypted keys during init. Its "filter_file" caches the filter; if the file does not exist or was
+     * built from another secret key, set of keys or statistical_security_bits, the filter is built from
+     * "precomputed_file" or the given encrypted set and saved. The party obtaining result keeps the filter for all
+     * later calls of process, and its "filter_file" caches the filter across sessions, so that the filter is only
+     * transferred again after the other party rebuilds it. Filter fingerprints are sized so that any of the at most
+     * "filter_max_lookups" keys of the small set in one run falsely matches with probability at most
+     * 2^-statistical_security_bits, which needs statistical_security_bits + log2("filter_max_lookups") of at most 60.
+     * process throws on both parties if the small set has more keys.
+     *
+     * "incremental" runs the incremental mode for sets that change little between runs. Every party keeps its secret
+     * key, a digest keyed by its secret key and the encrypted key of each of its keys instead of the keys themselves,
+     * and, if it obtains result, the compare tags of both parties in its "state_file", which is created by the first
+     * run. Later runs only encrypt and exchange keys added or removed since the last run. Both parties must run on
+     * state files saved by the same run, otherwise process throws; deleting both state files starts over.
+     * Since the secret key is reused, the other party learns which of its keys matched in earlier runs, and the sizes
+     * of changes.
+     *
+     * "compress_tags" sorts compare tags that the other party only needs as a set, in process_cardinality_only and
+     * process_intersection_sum, and sends them in Elias-Fano encoding, which saves about log2(n) - 2 of the bits of
+     * every tag for n tags. Tags sent back by process keep their order and are never compressed.
+     *
      * @param[in] net The network interface (e.g., PETAce-Network interface).
      * @param[in] params The PSI parameters configuration.
      */
     void init(const std::shared_ptr<network::Network>& net, const json& params) override;
 
+    /**
+     * @brief Initializes parameters and variables to run on a shared encrypted set of self keys.
+     *
+     * The secret key is the one of the encrypted set, and process and process_cardinality_only skip encrypting self
+     * keys. Many instances may share one encrypted set and run concurrently, each on its own network.
+     *
+     * @param[in] net The network interface (e.g., PETAce-Network interface).
+     * @param[in] params The PSI parameters configuration.
+     * @param[in] encrypted_set The encrypted set of self keys, or nullptr to behave as init(net, params).
+     * @param[in] input_keys_verified Whether the caller has checked that the encrypted set matches the input keys of
+     * every run, so that runs only compare their sizes instead of hashing all input keys again.
+     * @throws std::invalid_argument if the curve of the encrypted set mismatches params, or on both parties if the
+     * party holding the encrypted set runs with "spill_dir" or "incremental".
+     */
+    void init(const std::shared_ptr<network::Network>& net, const json& params,
+            std::shared_ptr<const EcdhEncryptedSet> encrypted_set, bool input_keys_verified = false);
+
     /**
      * @brief Preprocess data and stores results in preprocessed_keys.
      *
@@ -93,9 +189,27 @@ class EcdhPSI : public PSI {
      * In details, the workflow of ecdh-psi:
      *   1. Shuffles and encrypts keys of every row on both parties' side. Exchanges keys with the other party.
      *   2. Doublely encrypts the exchanged keys.
+     *   Steps 1 and 2 are pipelined in chunks of "chunk_size" keys: a chunk is sent while the next one is being
+     *   encrypted, and the other party doublely encrypts a chunk while the next one is being received.
      *   3. Sends back keys to the other party if the other party can obtain result.
      *   4. Computes intersection on the exchanged keys and saves intersection corresponding to input keys.
      *
+     * If "spill_dir" is not empty, encrypted and doublely encrypted keys are spilled to temporary files in that
+     * directory, intersection is computed by external sort and merge, and memory of them is bounded by
+     * "memory_limit_mb". Input keys and output keys are still kept in memory.
+     *
+     * If "precomputed_file" is set or an encrypted set is given to init, encrypted keys are taken from it instead of
+     * being encrypted online.
+     *
+     * In unbalanced mode, the party obtaining result sends its encrypted keys, the other party encrypts them again and
+     * sends them back, and the party obtaining result decrypts them with its own secret key and looks them up in the
+     * filter of the other party. Communication and computation scale with the small set only. Input keys of the party
+     * not obtaining result are not read, since its keys are in the filter.
+     *
+     * In incremental mode, both parties exchange encrypted keys added and removed since the last run, update their
+     * state files by merging doublely encrypted keys of the changes, and match input keys against the updated state.
+     * Duplicated input keys are all kept in output keys, while the state keeps every key once.
+     *
      * @param[in] net The network interface (e.g., PETAce-Network interface).
      * @param[in] input_keys The input keys  to perform intersection, such as phone numbers and emails.
      * @param[out] output_keys The intersection corresponding to input keys.
@@ -112,6 +226,132 @@ class EcdhPSI : public PSI {
     std::size_t process_cardinality_only(
             const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys) const override;
 
+    /**
+     * @brief Performs intersection and transfers a fixed-width payload of every key the other party matched.
+     *
+     * Exactly one party obtains result, and the other party provides a payload for every input key. The workflow:
+     *   1. The party obtaining result sends its encrypted keys, and the other party encrypts them again and sends them
+     *   back, so that the party obtaining result can decrypt them into keys encrypted by the other party alone.
+     *   2. The other party sends the compare tag of every encrypted key of its own in shuffled order, together with
+     *   its payload encrypted by a key stream derived from the whole encrypted key and a session nonce.
+     *   3. The party obtaining result matches its decrypted keys against the tags, and derives the key stream of
+     *   matched keys only, since compare tags do not reveal the rest of encrypted keys.
+     * Payloads come in the same pass as keys, so there is no second exchange or second round of encryption.
+     *
+     * @param[in] net The network interface (e.g., PETAce-Network interface).
+     * @param[in] input_keys The input keys to perform intersection, such as phone numbers and emails.
+     * @param[in] input_payloads The payload of every input key if self does not obtain result, otherwise ignored.
+     * @param[out] output_keys The intersection corresponding to input keys if self obtains result, otherwise empty.
+     * @param[out] output_payloads The payloads of the other party for output keys in the same order.
+     * @throws std::invalid_argument if not exactly one party obtains result, the mode is not supported, or payloads
+     * do not match input keys.
+     */
+    void process_with_payloads(const std::shared_ptr<network::Network>& net,
+            const std::vector<std::string>& input_keys, const PointBuffer& input_payloads,
+            std::vector<std::string>& output_keys, PointBuffer& output_payloads) const;
+
+    /**
+     * @brief Performs intersection and returns it as a bitmap over input keys, without copying any key.
+     *
+     * @param[in] net The network interface (e.g., PETAce-Network interface).
+     * @param[in] input_keys The input keys to perform intersection, such as phone numbers and emails.
+     * @param[out] output_bitmap 1 at the index of every input key in the intersection and 0 elsewhere if self obtains
+     * result, otherwise empty.
+     * @throws std::invalid_argument in unbalanced, incremental or out-of-core mode.
+     */
+    void process_bitmap(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
+            std::vector<std::uint8_t>& output_bitmap) const;
+
+    /**
+     * @brief Performs intersection and returns the indices of input keys in the intersection, without copying any key.
+     *
+     * @param[in] net The network interface (e.g., PETAce-Network interface).
+     * @param[in] input_keys The input keys to perform intersection, such as phone numbers and emails.
+     * @param[out] output_indices The ascending indices of input keys in the intersection if self obtains result,
+     * otherwise empty.
+     * @throws std::invalid_argument in unbalanced, incremental or out-of-core mode.
+     */
+    void process_indices(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
+            std::vector<std::size_t>& output_indices) const;
+
+    /**
+     * @brief Performs intersection and sums values of the other party over the intersection.
+     *
+     * Exactly one party obtains result, and the other party provides a value for every input key. The workflow:
+     *   1. The party obtaining result sends its encrypted keys, and the other party sends back their doublely
+     *   encrypted tags in shuffled order.
+     *   2. The other party sends its own encrypted keys in shuffled order, each with its value encrypted by
+     *   exponential ElGamal on Ristretto255 under a key pair drawn for the session.
+     *   3. The party obtaining result doublely encrypts them, matches them against the tags, adds up ciphertexts of
+     *   matched keys, rerandomizes the sum and sends it back with the cardinality.
+     *   4. The other party decrypts only the summed ciphertext and sends the sum back.
+     * Both parties learn the cardinality and the sum, but neither learns which keys matched. Ciphertexts are created
+     * and added in parallel, and cost about one more scalar multiplication per value than ECDH-PSI.
+     *
+     * @param[in] net The network interface (e.g., PETAce-Network interface).
+     * @param[in] input_keys The input keys to perform intersection, such as phone numbers and emails.
+     * @param[in] input_values The value of every input key if self does not obtain result, otherwise ignored.
+     * @param[out] sum The sum of values over the intersection, which must be below 2^kIntersectionSumMaxBits.
+     * @return The cardinality of intersection.
+     * @throws std::invalid_argument if not exactly one party obtains result, the mode is not supported, or values do
+     * not match input keys.
+     * @throws std::runtime_error if the sum is not below 2^kIntersectionSumMaxBits.
+     */
+    std::size_t process_intersection_sum(const std::shared_ptr<network::Network>& net,
+            const std::vector<std::string>& input_keys, const std::vector<std::uint64_t>& input_values,
+            std::uint64_t& sum) const;
+
+    /**
+     * @brief Performs waterfall intersection on several id columns, such as emails, phone numbers and device IDs.
+     *
+     * Every row holds one key of each id column, and columns are given in priority order. All columns are encrypted
+     * in one parallel pass over a single shuffle of rows and exchanged in one stream, so that the session setup and
+     * the network transfer are shared by all columns. Columns are then matched in priority order, and a row of either
+     * party matched on a column is excluded from all columns after it. An empty key is a missing id and never matches.
+     * The party obtaining result learns which ids of the other party belong to the same row, but not the ids.
+     *
+     * @param[in] net The network interface (e.g., PETAce-Network interface).
+     * @param[in] input_keys The id columns of input rows in priority order, where input_keys[i][j] is the i-th id of
+     * the j-th row, as read by CsvDataProvider::get_next_batch_2d.
+     * @param[out] output_keys The matched rows in the same layout as input_keys and in the order of input rows.
+     * @param[out] output_id_indices The index of the id column every matched row is matched on.
+     * @throws std::invalid_argument if the mode is not supported, or id columns are empty, of different sizes or not
+     * as many as those of the other party.
+     */
+    void process_multi_id(const std::shared_ptr<network::Network>& net,
+            const std::vector<std::vector<std::string>>& input_keys, std::vector<std::vector<std::string>>& output_keys,
+            std::vector<std::size_t>& output_id_indices) const;
+
+    /**
+     * @brief Encrypts input keys offline and writes them to a precomputed file for later online PSI.
+     *
+     * Hashing keys to the curve and encrypting them does not depend on the other party, so it can be done before the
+     * network is up. The file stores the secret key, a hash of input keys and the encrypted keys in native byte order.
+     * Passing the file as "precomputed_file" to init makes process and process_cardinality_only skip encrypting the
+     * same input keys. Note that reusing a secret key in several sessions lets the other party link the keys across
+     * those sessions.
+     *
+     * @param[in] params The PSI parameters configuration, where "ecdh_params" gives "curve_id", "secret_key_file" and
+     * "precomputed_file". A new secret key is generated and saved if "secret_key_file" does not exist.
+     * @param[in] input_keys The input keys to perform intersection later.
+     * @throws std::invalid_argument if params are invalid.
+     * @throws std::runtime_error if any file cannot be read or written.
+     */
+    static void precompute(const json& params, const std::vector<std::string>& input_keys);
+
+    /**
+     * @brief Encrypts input keys into an encrypted set that ECDH-PSI sessions can share.
+     *
+     * @param[in] params The PSI parameters configuration, where "ecdh_params" gives "curve_id" and optionally
+     * "secret_key_file". A new secret key is generated if "secret_key_file" is empty, and also saved if the file does
+     * not exist.
+     * @param[in] input_keys The input keys.
+     * @throws std::invalid_argument if params are invalid.
+     * @throws std::runtime_error if the secret key file cannot be read or written.
+     */
+    static std::shared_ptr<EcdhEncryptedSet> encrypt_set(
+            const json& params, const std::vector<std::string>& input_keys);
+
 protected:
     EcdhPSI(const EcdhPSI& copy) = delete;
 
@@ -125,28 +365,155 @@ class EcdhPSI : public PSI {
     // Checks the validity and consistency of JSON params of both parties.
     void check_params(const std::shared_ptr<network::Network>& net) override;
 
-    // Encrypts inpute keys with its ECC secret key.
-    // Stores results in encrypted_keys.
-    void encrypt_keys(const std::vector<std::string>& input_keys, std::vector<ByteVector>& encrypted_keys) const;
+    // Encrypts inpute keys in range [begin, end) with its ECC secret key on num_threads threads, or num_threads_ if 0.
+    // Stores results in the same range of encrypted_keys.
+    void encrypt_keys(const std::vector<std::string>& input_keys, std::size_t begin, std::size_t end,
+            PointBuffer& encrypted_keys, std::size_t num_threads = 0) const;
+
+    // Encrypts input_keys[permutation[i]] for i in range [begin, end) with its ECC secret key, without copying keys,
+    // on num_threads threads, or num_threads_ if 0.
+    // Stores results in the same range of encrypted_keys.
+    void encrypt_keys(const std::vector<std::string>& input_keys, const std::vector<std::size_t>& permutation,
+            std::size_t begin, std::size_t end, PointBuffer& encrypted_keys, std::size_t num_threads = 0) const;
+
+    // Doublely encrypts exchanged encryted keys in range [begin, end) with its ECC secret key on num_threads threads,
+    // or num_threads_ if 0.
+    // Stores compare tags of doublely_encrypted_keys.point_byte_count() bytes of results in the same range of
+    // doublely_encrypted_keys.
+    void doublely_encrypt_keys(const PointBuffer& exchanged_encrypted_keys, std::size_t begin, std::size_t end,
+            PointBuffer& doublely_encrypted_keys, std::size_t num_threads = 0) const;
 
-    // Doublely encrypts exchanged encryted keys with its ECC secret key.
-    // Restore results in exchanged_encrypted_keys.
-    void doublely_encrypt_keys(std::vector<ByteVector>& exchanged_encrypted_keys) const;
+    // Encrypts input keys and exchanges them with the other party chunk by chunk, so that encryption, network transfer
+    // and the other party's double encryption overlap. Encryption and double encryption split num_threads_ threads
+    // when they run at the same time.
+    // If permutation is not empty, the i-th sent key is input_keys[permutation[i]].
+    // Stores the doublely encrypted keys of the other party in doublely_encrypted_keys.
+    void encrypt_and_exchange_keys(const std::shared_ptr<network::Network>& net,
+            const std::vector<std::string>& input_keys, const std::vector<std::size_t>& permutation,
+            PointBuffer& doublely_encrypted_keys) const;
+
+    // Sends encrypted keys to the other party, and receives and doublely encrypts keys of the other party by chunk.
+    // A chunk of encrypted keys is sent as soon as it is marked finished in progress.
+    // If permutation is not empty, the i-th sent key is encrypted_keys[permutation[i]].
+    // Double encryption runs on num_threads threads pinned from cpu_offset of the worker pool.
+    void exchange_encrypted_keys_by_chunk(const std::shared_ptr<network::Network>& net,
+            const PointBuffer& encrypted_keys, const std::vector<std::size_t>& permutation, ChunkProgress& progress,
+            std::size_t num_threads, std::size_t cpu_offset, PointBuffer& doublely_encrypted_keys) const;
+
+    // Checks that the shared encrypted set matches input keys, which only compares sizes if the caller verified them.
+    void check_encrypted_set(const std::vector<std::string>& input_keys) const;
+
+    // Checks that the shared encrypted set matches input keys, and exchanges its keys shuffled by permutation.
+    // The shared set is only read, so that concurrent sessions need not copy it.
+    void exchange_shared_encrypted_keys(const std::shared_ptr<network::Network>& net,
+            const std::vector<std::string>& input_keys, const std::vector<std::size_t>& permutation,
+            PointBuffer& doublely_encrypted_keys) const;
+
+    // Sends encrypted keys to the other party chunk by chunk as soon as each chunk is marked finished in progress.
+    // If permutation is not empty, each chunk is gathered by permutation before it is sent.
+    void send_encrypted_keys_by_chunk(const std::shared_ptr<network::Network>& net, const PointBuffer& encrypted_keys,
+            const std::vector<std::size_t>& permutation, ChunkProgress& progress) const;
+
+    // Receives encrypted keys from the other party chunk by chunk.
+    // One worker doublely encrypts received chunks in order on num_threads threads pinned from cpu_offset of the worker
+    // pool, while later chunks are being received.
+    // Doublely encrypted keys are truncated to compare_bytes_len(self_data_size, received data size).
+    void recv_and_doublely_encrypt_keys_by_chunk(const std::shared_ptr<network::Network>& net,
+            std::size_t self_data_size, std::size_t num_threads, std::size_t cpu_offset,
+            PointBuffer& doublely_encrypted_keys) const;
+
+    // Returns the byte length of doublely encrypted keys compared between sets of self_size and remote_size keys.
+    // Both parties derive the same length, since it is symmetric in the set sizes.
+    std::size_t compare_bytes_len(std::size_t self_size, std::size_t remote_size) const;
+
+    // Publishes the filter of self encrypted keys if self does not obtain result, otherwise takes the filter of the
+    // other party from filter_file if it is up to date and receives it if not.
+    void exchange_filter(const std::shared_ptr<network::Network>& net);
+
+    // Runs the unbalanced mode with the filter exchanged during init.
+    // Stores the intersection corresponding to input keys in output keys unless output_keys is nullptr.
+    // Returns the cardinality of intersection.
+    std::size_t process_unbalanced(const std::shared_ptr<network::Network>& net,
+            const std::vector<std::string>& input_keys, std::vector<std::string>* output_keys) const;
+
+    // Receives encrypted keys chunk by chunk, encrypts them again with full point length and sends them back.
+    // Returns the number of received keys, and throws if they are more than max_data_size.
+    std::size_t doublely_encrypt_and_send_back_keys(const std::shared_ptr<network::Network>& net,
+            std::size_t max_data_size = std::numeric_limits<std::size_t>::max()) const;
+
+    // Returns self encrypted keys of input keys, which are the shared encrypted set if any, without a copy, or
+    // otherwise encrypted into buffer.
+    const PointBuffer& encrypt_self_keys(const std::vector<std::string>& input_keys, PointBuffer& buffer) const;
+
+    // Runs the incremental mode on the state loaded or created during init, and saves the updated state.
+    // Stores the intersection corresponding to input keys in output keys unless output_keys is nullptr.
+    // Returns the cardinality of intersection.
+    std::size_t process_incremental(const std::shared_ptr<network::Network>& net,
+            const std::vector<std::string>& input_keys, std::vector<std::string>* output_keys) const;
 
     // Exchanges encrypted keys or doublely encrypted keys with the other party.
-    void exchange_encrypted_keys(std::shared_ptr<network::Network> net, const std::vector<ByteVector>& encrypted_keys,
-            std::vector<ByteVector>& received_keys, std::size_t point_len) const;
+    void exchange_encrypted_keys(std::shared_ptr<network::Network> net, const PointBuffer& encrypted_keys,
+            PointBuffer& received_keys, std::size_t point_byte_count) const;
+
+    // Sorts doublely encrypted keys and sends them in Elias-Fano encoding.
+    void send_compressed_tags(const std::shared_ptr<network::Network>& net, PointBuffer& tags) const;
+
+    // Receives doublely encrypted keys of tag_byte_count bytes sent by send_compressed_tags, in sorted order.
+    void recv_compressed_tags(
+            const std::shared_ptr<network::Network>& net, std::size_t tag_byte_count, PointBuffer& tags) const;
+
+    // Runs the protocol with encrypted and doublely encrypted keys spilled to temporary files under spill_dir.
+    // Stores the intersection corresponding to input keys in output keys unless output_keys is nullptr.
+    // Returns the cardinality of intersection.
+    std::size_t process_out_of_core(const std::shared_ptr<network::Network>& net,
+            const std::vector<std::string>& input_keys, std::vector<std::string>* output_keys) const;
+
+    // Writes the random shuffle of input keys to a file of records, each holding random bytes and an input index.
+    // Records are sorted by their random bytes, so that the shuffle never needs to be in memory as a whole.
+    void generate_shuffle_file(std::shared_ptr<petace::solo::PRNG> prng, std::size_t input_size,
+            const std::string& shuffle_path) const;
+
+    // Encrypts input keys in the shuffled order of the shuffle file and sends them chunk by chunk.
+    void send_encrypted_keys_from_file(const std::shared_ptr<network::Network>& net,
+            const std::vector<std::string>& input_keys, const std::string& shuffle_path) const;
+
+    // Receives encrypted keys chunk by chunk, doublely encrypts them and writes them to a file.
+    // Returns the byte length of doublely encrypted keys, which is compare_bytes_len(self_data_size, received data
+    // size).
+    std::size_t recv_and_doublely_encrypt_keys_to_file(const std::shared_ptr<network::Network>& net,
+            std::size_t self_data_size, const std::string& remote_tags_path) const;
+
+    // Sends doublely encrypted keys of the other party stored in a file if the other party can obtain result.
+    void send_doublely_encrypted_keys_from_file(const std::shared_ptr<network::Network>& net,
+            const std::string& remote_tags_path, std::size_t tag_byte_count) const;
+
+    // Receives self doublely encrypted keys in the shuffled order and writes them with their input indices to a file.
+    void recv_doublely_encrypted_keys_to_file(const std::shared_ptr<network::Network>& net,
+            const std::string& shuffle_path, const std::string& self_tags_path, std::size_t tag_byte_count) const;
+
+    // Merges sorted remote doublely encrypted keys and sorted self doublely encrypted keys with input indices.
+    // Writes input indices of the intersection to a file unless matched_indices_path is empty.
+    // Returns the cardinality of intersection.
+    std::size_t join_sorted_keys(const std::string& remote_tags_path, const std::string& self_tags_path,
+            const std::string& matched_indices_path, std::size_t tag_byte_count) const;
+
+    // Runs the in-memory protocol on input keys shuffled through a permutation of their indices.
+    // Stores 1 for input keys in the intersection and 0 for the others in matched if self obtains result, otherwise
+    // clears matched.
+    void match_keys(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
+            std::vector<std::uint8_t>& matched) const;
 
     // Computes intersection between remote doublely encrypted keys and self doublely encrypted keys.
-    // Stores the intersection corresponding to input keys in output keys.
-    void calculate_intersection(const std::vector<ByteVector>& remote_doublely_encrypted_keys,
-            const std::vector<ByteVector>& self_doublely_encrypted_keys, const std::vector<std::string>& input_keys,
-            std::vector<std::string>& output_keys) const;
+    // Stores 1 for self doublely encrypted keys in the intersection and 0 for the others in matched.
+    // Remote doublely encrypted keys may be reordered.
+    void calculate_intersection(PointBuffer& remote_doublely_encrypted_keys,
+            const PointBuffer& self_doublely_encrypted_keys, std::vector<std::uint8_t>& matched) const;
 
     // Computes intersection between remote doublely encrypted keys and self doublely encrypted keys.
     // Retures the cardinality of intersection.
-    std::size_t calculate_cardinality_only(const std::vector<ByteVector>& remote_doublely_encrypted_keys,
-            const std::vector<ByteVector>& self_doublely_encrypted_keys) const;
+    // Remote doublely encrypted keys may be reordered.
+    std::size_t calculate_cardinality_only(
+            PointBuffer& remote_doublely_encrypted_keys, const PointBuffer& self_doublely_encrypted_keys) const;
 
     bool is_sender_ = false;
     bool obtain_result_ = false;
@@ -155,9 +522,24 @@ class EcdhPSI : public PSI {
     json params_ = "";
     bool verbose_ = false;
 
-    std::unique_ptr<petace::solo::ECOpenSSL> ecc_cipher_ = nullptr;
-    petace::solo::ECOpenSSL::SecretKey sk_{};
+    std::unique_ptr<EcdhGroup> group_ = nullptr;
+    std::shared_ptr<WorkerPool> worker_pool_ = nullptr;
     std::size_t num_threads_ = 0;
+    std::size_t chunk_size_ = 0;
+    IntersectionScheme intersection_scheme_ = IntersectionScheme::HASH_JOIN;
+    std::string spill_dir_ = "";
+    std::size_t memory_limit_bytes_ = 0;
+    std::size_t statistical_security_bits_ = 0;
+    std::size_t filter_max_lookups_ = 0;
+    bool compress_tags_ = false;
+    bool unbalanced_ = false;
+    std::shared_ptr<const CuckooFilter> remote_filter_ = nullptr;
+    bool incremental_ = false;
+    std::string state_file_ = "";
+    // Updated in place by every run, so that later runs of the same instance start from the saved state.
+    std::shared_ptr<EcdhIncrementalState> incremental_state_ = nullptr;
+    std::shared_ptr<const EcdhEncryptedSet> encrypted_set_ = nullptr;
+    bool encrypted_set_verified_ = false;
 };
 
 }  // namespace setops
@@ -0,0 +1,95 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/psi/ecdh_psi_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "setops/psi/ecdh_psi.h"
+
+namespace petace {
+namespace setops {
+
+EcdhPSIServer::EcdhPSIServer(std::shared_ptr<const EcdhEncryptedSet> encrypted_set,
+        std::size_t max_concurrent_sessions, const WorkerPoolOptions& options)
+        : encrypted_set_(encrypted_set), max_concurrent_sessions_(max_concurrent_sessions) {
+    if (encrypted_set_ == nullptr) {
+        throw std::invalid_argument("encrypted_set is null.");
+    }
+    if (max_concurrent_sessions_ == 0) {
+        throw std::invalid_argument("max_concurrent_sessions is 0.");
+    }
+    worker_pool_ = WorkerPool::get(options);
+}
+
+void EcdhPSIServer::run(const std::vector<std::string>& input_keys, std::vector<EcdhPSISession>& sessions) const {
+    // Input keys are hashed once here rather than by every session.
+    if (!encrypted_set_->matches(input_keys)) {
+        throw std::invalid_argument("encrypted set does not match input keys.");
+    }
+    std::size_t worker_count = std::min(max_concurrent_sessions_, sessions.size());
+    if (worker_count == 0) {
+        return;
+    }
+    // Every running session gets an equal share of threads for its OpenMP regions, and sessions of one worker are
+    // pinned to the same slice of CPUs, which is disjoint from slices of other workers if there are enough CPUs.
+    std::size_t session_num_threads = std::max<std::size_t>(worker_pool_->num_threads() / worker_count, 1);
+    const std::vector<int>& cpus = worker_pool_->cpus();
+
+    std::atomic<std::size_t> next_session_idx(0);
+    auto run_sessions = [&](std::size_t worker_idx) {
+        json threads = {{"num_threads", session_num_threads}};
+        if (!cpus.empty()) {
+            std::vector<int> slice;
+            for (std::size_t thread_idx = 0; thread_idx < std::min(session_num_threads, cpus.size()); ++thread_idx) {
+                slice.push_back(cpus[(worker_idx * session_num_threads + thread_idx) % cpus.size()]);
+            }
+            threads["cpu_affinity"] = slice;
+        }
+        for (std::size_t session_idx = next_session_idx++; session_idx < sessions.size();
+                session_idx = next_session_idx++) {
+            EcdhPSISession& session = sessions[session_idx];
+            try {
+                json params = session.params;
+                params["threads"] = threads;
+                params["ecdh_params"]["num_threads"] = session_num_threads;
+                EcdhPSI psi;
+                psi.init(session.net, params, encrypted_set_, true);
+                if (session.cardinality_only) {
+                    session.cardinality = psi.process_cardinality_only(session.net, input_keys);
+                } else {
+                    psi.process(session.net, input_keys, session.output_keys);
+                }
+            } catch (...) {
+                session.error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t worker_idx = 1; worker_idx < worker_count; ++worker_idx) {
+        workers.emplace_back(run_sessions, worker_idx);
+    }
+    run_sessions(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+}  // namespace setops
+}  // namespace petace
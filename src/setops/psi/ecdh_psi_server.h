@@ -0,0 +1,93 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "network/network.h"
+
+#include "setops/psi/ecdh_encrypted_set.h"
+#include "setops/util/worker_pool.h"
+
+namespace petace {
+namespace setops {
+
+using json = nlohmann::json;
+
+/**
+ * @brief One ECDH-PSI session of EcdhPSIServer with one partner.
+ */
+struct EcdhPSISession {
+    // The network interface to the partner.
+    std::shared_ptr<network::Network> net = nullptr;
+    // The PSI parameters configuration of this session.
+    json params{};
+    // Whether only the cardinality of intersection is computed.
+    bool cardinality_only = false;
+    // The intersection, if cardinality_only is false.
+    std::vector<std::string> output_keys{};
+    // The cardinality of intersection, if cardinality_only is true.
+    std::size_t cardinality = 0;
+    // The exception thrown by this session, or nullptr if it succeeded.
+    std::exception_ptr error = nullptr;
+};
+
+/**
+ * @brief Runs ECDH-PSI with many partners concurrently on one encrypted set of self keys.
+ *
+ * Self keys are encrypted only once into the shared set. Every session only doublely encrypts keys of its partner and
+ * computes the intersection. Threads are split evenly among concurrent sessions so that OpenMP is not oversubscribed,
+ * and if the worker pool pins threads, every concurrent session is pinned to its own slice of the pool CPUs.
+ */
+class EcdhPSIServer {
+public:
+    /**
+     * @brief Creates a server.
+     *
+     * @param[in] encrypted_set The encrypted set of self keys shared by all sessions.
+     * @param[in] max_concurrent_sessions The maximum number of sessions that run at the same time.
+     * @param[in] options The worker threads for all sessions, e.g., read by WorkerPoolOptions::from_params from the
+     * "threads" block of params. The "threads" block and "num_threads" of session params are replaced by a share of
+     * these threads.
+     * @throws std::invalid_argument if encrypted_set is null or max_concurrent_sessions is 0.
+     */
+    EcdhPSIServer(std::shared_ptr<const EcdhEncryptedSet> encrypted_set, std::size_t max_concurrent_sessions,
+            const WorkerPoolOptions& options = WorkerPoolOptions());
+
+    /**
+     * @brief Runs all sessions and returns when all of them finish.
+     *
+     * An exception of a session is stored in its error and does not stop other sessions. Input keys are checked
+     * against the encrypted set once for all sessions.
+     *
+     * @param[in] input_keys The input keys that the encrypted set is encrypted from.
+     * @param[in,out] sessions The sessions to run, whose results are stored in place.
+     * @throws std::invalid_argument if the encrypted set does not match input keys.
+     */
+    void run(const std::vector<std::string>& input_keys, std::vector<EcdhPSISession>& sessions) const;
+
+private:
+    std::shared_ptr<const EcdhEncryptedSet> encrypted_set_ = nullptr;
+    std::size_t max_concurrent_sessions_ = 1;
+    std::shared_ptr<WorkerPool> worker_pool_ = nullptr;
+};
+
+}  // namespace setops
+}  // namespace petace
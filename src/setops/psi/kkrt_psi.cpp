@@ -15,20 +15,54 @@
 #include "setops/psi/kkrt_psi.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 #include "glog/logging.h"
 
 #include "solo/prng.h"
 
+#include "setops/util/cuckoo_stash.h"
+#include "setops/util/hash_join.h"
 #include "setops/util/parameter_check.h"
 #include "setops/util/permutation.h"
+#include "setops/util/point_buffer.h"
 #include "setops/util/serialize.h"
+#include "setops/util/simple_hashing_table.h"
 
 namespace petace {
 namespace setops {
 
+namespace {
+
+// The default number of bins per batch of OT extension.
+const std::size_t kDefaultBinBatchSize = std::size_t(1) << 20;
+// The default bits of the probability that the stash of the receiver overflows.
+const std::size_t kDefaultStashFailureBits = 40;
+// A batch of bins holds more entries of a hash function than its mask count with probability below 2^-40.
+const double kBatchOverflowBits = 40.0;
+
+// Returns the number of masks per hash function sent for a batch of bins. A batch of all bins holds one entry per
+// sender key and function. Otherwise the entries of a function in a batch follow a binomial distribution, and every
+// batch is padded to a bound from Bernstein's inequality, so that the receiver does not learn how sender keys spread
+// over bins.
+std::size_t batch_mask_count(std::size_t sender_data_size, std::size_t batch_bin_count, std::size_t num_of_bins) {
+    if (batch_bin_count == num_of_bins) {
+        return sender_data_size;
+    }
+    double mean = static_cast<double>(sender_data_size) * static_cast<double>(batch_bin_count) /
+                  static_cast<double>(num_of_bins);
+    double log_overflow = kBatchOverflowBits * std::log(2.0);
+    double bound = mean + log_overflow / 3.0 + std::sqrt(log_overflow * log_overflow / 9.0 + 2.0 * log_overflow * mean);
+    return std::min(sender_data_size, static_cast<std::size_t>(std::ceil(bound)));
+}
+
+}  // namespace
+
 void KkrtPSI::init(const std::shared_ptr<network::Network>& net, const json& params) {
     // set parameter
     verbose_ = params["common"]["verbose"];
@@ -36,9 +70,15 @@ void KkrtPSI::init(const std::shared_ptr<network::Network>& net, const json& par
     epsilon_ = params["kkrt_psi_params"]["epsilon"];
     num_of_fun_ = params["kkrt_psi_params"]["fun_num"];
     sender_obtain_result_ = params["kkrt_psi_params"]["sender_obtain_result"];
+    bin_batch_size_ = params["kkrt_psi_params"].value("bin_batch_size", kDefaultBinBatchSize);
+    stash_failure_bits_ = params["kkrt_psi_params"].value("stash_failure_bits", kDefaultStashFailureBits);
 
     check_params(net);
 
+    worker_pool_ = WorkerPool::get(WorkerPoolOptions::from_params(params));
+    // Workers are pinned only within init and every process call, so that the affinity of the caller is restored.
+    ScopedWorkerBinding binding(*worker_pool_);
+
     LOG_IF(INFO, verbose_) << "\nKKRT PSI parameters: \n" << params.dump(4);
 
     // prng
@@ -93,6 +133,7 @@ void KkrtPSI::preprocess_data(const std::shared_ptr<network::Network>& /*net*/,
 
 void KkrtPSI::process(const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys,
         std::vector<std::string>& output_keys) const {
+    ScopedWorkerBinding binding(*worker_pool_);
     std::size_t sender_data_size;
     std::size_t receiver_data_size;
     if (is_sender_) {
@@ -106,6 +147,7 @@ void KkrtPSI::process(const std::shared_ptr<network::Network>& net, const std::v
     }
 
     std::size_t num_of_bins = static_cast<std::size_t>(std::ceil(static_cast<double>(receiver_data_size) * epsilon_));
+    std::size_t stash_size = max_stash_size(receiver_data_size, epsilon_, num_of_fun_, stash_failure_bits_);
 
     std::vector<Item> keys(input_keys.size());
     auto hash = solo::Hash::create(solo::HashScheme::SHA_256);
@@ -118,65 +160,25 @@ void KkrtPSI::process(const std::shared_ptr<network::Network>& net, const std::v
     if (is_sender_) {
         std::vector<Byte> simple_table_seed(kRandSeedBytesLen);
         common_prng_->generate(kRandSeedBytesLen, simple_table_seed.data());
-        auto simple_table = std::make_shared<solo::SimpleHashing<kItemBytesLen>>(num_of_bins, simple_table_seed);
 
         // Hashing Phase
-        simple_table->set_num_of_hash_functions(num_of_fun_);
-        simple_table->insert(keys);
-        simple_table->map_elements();
-
-        std::size_t stash_size;
-        net->recv_data(&stash_size, sizeof(std::size_t));
-        if (stash_size > 0u) {
-            LOG_IF(INFO, verbose_) << "stash of size is not zero.";
-            throw std::invalid_argument("stash of size is not zero.");
+        SimpleHashingTable simple_table(
+                keys, num_of_bins, num_of_fun_, simple_table_seed, worker_pool_->num_threads(), stash_size);
+
+        std::size_t stash_overflow;
+        net->recv_data(&stash_overflow, sizeof(std::size_t));
+        if (stash_overflow > 0u) {
+            LOG_IF(INFO, verbose_) << "stash of size exceeds its bound.";
+            throw std::invalid_argument("stash of size exceeds its bound.");
         }
 
-        auto simple_table_values = simple_table->obtain_bin_entry_values();
-        auto simple_table_source_values = simple_table->obtain_bin_entry_function_ids();
-
         LOG_IF(INFO, verbose_) << "simple hash done.";
 
         // OPRF
-        std::vector<std::vector<block>> masks(num_of_bins);
-        std::vector<std::vector<block>> simple_table_values_block(num_of_bins);
-        for (std::size_t i = 0; i < simple_table_values.size(); i++) {
-            for (std::size_t j = 0; j < simple_table_values[i].size(); j++) {
-                simple_table_values_block[i].emplace_back(
-                        *(reinterpret_cast<block*>(simple_table_values[i][j].data())));
-            }
-        }
-        nco_ot_ext_sender_->send(net, num_of_bins);
-        std::vector<std::vector<block>> sender_enc_data(num_of_fun_);
-        for (std::size_t i = 0; i < num_of_bins; i++) {
-            masks[i].resize(simple_table_values_block[i].size());
-            for (std::size_t j = 0; j < simple_table_values_block[i].size(); j++) {
-                nco_ot_ext_sender_->encode(i, simple_table_values_block[i][j], masks[i][j]);
-                sender_enc_data[simple_table_source_values[i][j]].push_back(masks[i][j]);
-            }
-        }
+        send_masks_by_batch(net, simple_table, mask_batches(sender_data_size, num_of_bins, stash_size));
 
         LOG_IF(INFO, verbose_) << "oprf done.";
 
-        std::vector<std::size_t> permutation;
-        std::vector<std::vector<block>> shuffled_sender_enc_data(num_of_fun_);
-        for (std::size_t i = 0; i < num_of_fun_; i++) {
-            generate_permutation(prng_, sender_data_size, permutation);
-            shuffled_sender_enc_data[i].assign(sender_enc_data[i].begin(), sender_enc_data[i].end());
-            permute_and_undo(permutation, true, shuffled_sender_enc_data[i]);
-        }
-
-        ByteVector reduced_shuffled_sender_enc_data;
-        reduced_shuffled_sender_enc_data.reserve(num_of_fun_ * sender_data_size * kReduceStatisticsLen);
-        for (std::size_t i = 0; i < num_of_fun_; i++) {
-            for (std::size_t j = 0; j < sender_data_size; j++) {
-                reduced_shuffled_sender_enc_data.insert(reduced_shuffled_sender_enc_data.end(),
-                        reinterpret_cast<Byte*>(&shuffled_sender_enc_data[i][j]),
-                        reinterpret_cast<Byte*>(&shuffled_sender_enc_data[i][j]) + kReduceStatisticsLen);
-            }
-        }
-        net->send_data(reduced_shuffled_sender_enc_data.data(), reduced_shuffled_sender_enc_data.size());
-
         if (sender_obtain_result_) {
             LOG_IF(INFO, verbose_) << "sender can obtain result.";
             std::size_t count;
@@ -199,61 +201,36 @@ void KkrtPSI::process(const std::shared_ptr<network::Network>& net, const std::v
         cuckoo_table->set_num_of_hash_functions(num_of_fun_);
         cuckoo_table->insert(keys);
         cuckoo_table->map_elements();
-        auto stash_size = cuckoo_table->get_stash_size();
-        net->send_data(&stash_size, sizeof(std::size_t));
-        if (stash_size > 0u) {
-            LOG_IF(INFO, verbose_) << "stash of size is not zero.";
-            throw std::invalid_argument("stash of size is not zero.");
-        }
         auto cuckoo_table_values = cuckoo_table->obtain_entry_values();
         auto cuckoo_table_source_values = cuckoo_table->obtain_entry_ids();
         auto cuckoo_table_function_ids = cuckoo_table->obtain_entry_function_ids();
 
+        // A stash key takes a stash slot, which is matched against a stash bin of the sender holding all sender keys.
+        auto stash_ids = find_stash_ids(cuckoo_table->obtain_bin_occupancy(), cuckoo_table_source_values, keys.size());
+        std::size_t stash_overflow = stash_ids.size() > stash_size ? stash_ids.size() : 0;
+        net->send_data(&stash_overflow, sizeof(std::size_t));
+        if (stash_overflow > 0u) {
+            LOG_IF(INFO, verbose_) << "stash of size exceeds its bound.";
+            throw std::invalid_argument("stash of size exceeds its bound.");
+        }
+        append_stash_entries(keys, stash_ids, num_of_fun_, stash_size, cuckoo_table_values, cuckoo_table_function_ids,
+                cuckoo_table_source_values);
+
         LOG_IF(INFO, verbose_) << "cuckoo hash done.";
 
         // OPRF
-        std::vector<block> masks_with_dummies_block;
-        std::vector<block> masks_with_dummies;
-        for (std::size_t i = 0; i < cuckoo_table_values.size(); i++) {
-            masks_with_dummies_block.emplace_back(*(reinterpret_cast<block*>(cuckoo_table_values[i].data())));
-        }
-        nco_ot_ext_recver_->receive(net, masks_with_dummies_block, masks_with_dummies);
+        std::vector<std::uint8_t> matched(receiver_data_size, 0);
+        match_masks_by_batch(net, mask_batches(sender_data_size, num_of_bins, stash_size), cuckoo_table_values,
+                cuckoo_table_function_ids, cuckoo_table_source_values, matched);
 
         LOG_IF(INFO, verbose_) << "oprf done.";
 
-        ByteVector reduced_receiver_enc_data;
-        reduced_receiver_enc_data.resize(num_of_fun_ * sender_data_size * kReduceStatisticsLen);
-        net->recv_data(reduced_receiver_enc_data.data(), reduced_receiver_enc_data.size());
-
-        std::vector<ByteVector> unpacked_reduced_receiver_enc_data;
-        unpacked_reduced_receiver_enc_data.reserve(num_of_fun_ * sender_data_size);
-        for (std::size_t item_idx = 0; item_idx < sender_data_size * num_of_fun_; ++item_idx) {
-            unpacked_reduced_receiver_enc_data.emplace_back(
-                    reduced_receiver_enc_data.begin() + item_idx * kReduceStatisticsLen,
-                    reduced_receiver_enc_data.begin() + (item_idx + 1) * kReduceStatisticsLen);
-        }
-
-        std::vector<bool> intersection_indices(num_of_bins, false);
-        std::size_t count = 0;
-        for (std::size_t item_idx = 0; item_idx < num_of_bins; ++item_idx) {
-            auto index = cuckoo_table_function_ids[item_idx];
-            if (index >= num_of_fun_) {
-                continue;
-            }
-            ByteVector search_data(reinterpret_cast<Byte*>(&masks_with_dummies[item_idx]),
-                    reinterpret_cast<Byte*>(&masks_with_dummies[item_idx]) + kReduceStatisticsLen);
-            if (std::find(unpacked_reduced_receiver_enc_data.begin() + index * sender_data_size,
-                        unpacked_reduced_receiver_enc_data.begin() + (index + 1) * sender_data_size,
-                        search_data) != (unpacked_reduced_receiver_enc_data.begin() + (index + 1) * sender_data_size)) {
-                intersection_indices[cuckoo_table_source_values[item_idx]] = true;
-                ++count;
-            }
-        }
+        std::size_t count = static_cast<std::size_t>(std::count(matched.begin(), matched.end(), std::uint8_t(1)));
 
         output_keys.resize(count);
         std::size_t result_idx = 0;
         for (std::size_t item_idx = 0; item_idx < input_keys.size(); ++item_idx) {
-            if (intersection_indices[item_idx]) {
+            if (matched[item_idx]) {
                 output_keys[result_idx++] = input_keys[item_idx];
             }
         }
@@ -276,6 +253,7 @@ void KkrtPSI::process(const std::shared_ptr<network::Network>& net, const std::v
 
 std::size_t KkrtPSI::process_cardinality_only(
         const std::shared_ptr<network::Network>& net, const std::vector<std::string>& input_keys) const {
+    ScopedWorkerBinding binding(*worker_pool_);
     std::size_t sender_data_size;
     std::size_t receiver_data_size;
     if (is_sender_) {
@@ -289,6 +267,7 @@ std::size_t KkrtPSI::process_cardinality_only(
     }
 
     std::size_t num_of_bins = static_cast<std::size_t>(std::ceil(static_cast<double>(receiver_data_size) * epsilon_));
+    std::size_t stash_size = max_stash_size(receiver_data_size, epsilon_, num_of_fun_, stash_failure_bits_);
 
     std::vector<Item> keys(input_keys.size());
     auto hash = solo::Hash::create(solo::HashScheme::SHA_256);
@@ -301,65 +280,25 @@ std::size_t KkrtPSI::process_cardinality_only(
     if (is_sender_) {
         std::vector<Byte> simple_table_seed(kRandSeedBytesLen);
         common_prng_->generate(kRandSeedBytesLen, simple_table_seed.data());
-        auto simple_table = std::make_shared<solo::SimpleHashing<kItemBytesLen>>(num_of_bins, simple_table_seed);
 
         // Hashing Phase
-        simple_table->set_num_of_hash_functions(num_of_fun_);
-        simple_table->insert(keys);
-        simple_table->map_elements();
-
-        std::size_t stash_size;
-        net->recv_data(&stash_size, sizeof(std::size_t));
-        if (stash_size > 0u) {
-            LOG_IF(INFO, verbose_) << "stash of size is not zero.";
-            throw std::invalid_argument("stash of size is not zero.");
+        SimpleHashingTable simple_table(
+                keys, num_of_bins, num_of_fun_, simple_table_seed, worker_pool_->num_threads(), stash_size);
+
+        std::size_t stash_overflow;
+        net->recv_data(&stash_overflow, sizeof(std::size_t));
+        if (stash_overflow > 0u) {
+            LOG_IF(INFO, verbose_) << "stash of size exceeds its bound.";
+            throw std::invalid_argument("stash of size exceeds its bound.");
         }
 
-        auto simple_table_values = simple_table->obtain_bin_entry_values();
-        auto simple_table_source_values = simple_table->obtain_bin_entry_function_ids();
-
         LOG_IF(INFO, verbose_) << "simple hash done.";
 
         // OPRF
-        std::vector<std::vector<block>> masks(num_of_bins);
-        std::vector<std::vector<block>> simple_table_values_block(num_of_bins);
-        for (std::size_t i = 0; i < simple_table_values.size(); i++) {
-            for (std::size_t j = 0; j < simple_table_values[i].size(); j++) {
-                simple_table_values_block[i].emplace_back(
-                        *(reinterpret_cast<block*>(simple_table_values[i][j].data())));
-            }
-        }
-        nco_ot_ext_sender_->send(net, num_of_bins);
-        std::vector<std::vector<block>> sender_enc_data(num_of_fun_);
-        for (std::size_t i = 0; i < num_of_bins; i++) {
-            masks[i].resize(simple_table_values_block[i].size());
-            for (std::size_t j = 0; j < simple_table_values_block[i].size(); j++) {
-                nco_ot_ext_sender_->encode(i, simple_table_values_block[i][j], masks[i][j]);
-                sender_enc_data[simple_table_source_values[i][j]].push_back(masks[i][j]);
-            }
-        }
+        send_masks_by_batch(net, simple_table, mask_batches(sender_data_size, num_of_bins, stash_size));
 
         LOG_IF(INFO, verbose_) << "oprf done.";
 
-        std::vector<std::size_t> permutation;
-        std::vector<std::vector<block>> shuffled_sender_enc_data(num_of_fun_);
-        for (std::size_t i = 0; i < num_of_fun_; i++) {
-            generate_permutation(prng_, sender_data_size, permutation);
-            shuffled_sender_enc_data[i].assign(sender_enc_data[i].begin(), sender_enc_data[i].end());
-            permute_and_undo(permutation, true, shuffled_sender_enc_data[i]);
-        }
-
-        ByteVector reduced_shuffled_sender_enc_data;
-        reduced_shuffled_sender_enc_data.reserve(num_of_fun_ * sender_data_size * kReduceStatisticsLen);
-        for (std::size_t i = 0; i < num_of_fun_; i++) {
-            for (std::size_t j = 0; j < sender_data_size; j++) {
-                reduced_shuffled_sender_enc_data.insert(reduced_shuffled_sender_enc_data.end(),
-                        reinterpret_cast<Byte*>(&shuffled_sender_enc_data[i][j]),
-                        reinterpret_cast<Byte*>(&shuffled_sender_enc_data[i][j]) + kReduceStatisticsLen);
-            }
-        }
-        net->send_data(reduced_shuffled_sender_enc_data.data(), reduced_shuffled_sender_enc_data.size());
-
         std::size_t count = 0;
         if (sender_obtain_result_) {
             LOG_IF(INFO, verbose_) << "sender can obtain result.";
@@ -378,57 +317,31 @@ std::size_t KkrtPSI::process_cardinality_only(
         cuckoo_table->set_num_of_hash_functions(num_of_fun_);
         cuckoo_table->insert(keys);
         cuckoo_table->map_elements();
-        auto stash_size = cuckoo_table->get_stash_size();
-        net->send_data(&stash_size, sizeof(std::size_t));
-        if (stash_size > 0u) {
-            LOG_IF(INFO, verbose_) << "stash of size is not zero.";
-            throw std::invalid_argument("stash of size is not zero.");
-        }
-
         auto cuckoo_table_values = cuckoo_table->obtain_entry_values();
         auto cuckoo_table_source_values = cuckoo_table->obtain_entry_ids();
         auto cuckoo_table_function_ids = cuckoo_table->obtain_entry_function_ids();
 
+        // A stash key takes a stash slot, which is matched against a stash bin of the sender holding all sender keys.
+        auto stash_ids = find_stash_ids(cuckoo_table->obtain_bin_occupancy(), cuckoo_table_source_values, keys.size());
+        std::size_t stash_overflow = stash_ids.size() > stash_size ? stash_ids.size() : 0;
+        net->send_data(&stash_overflow, sizeof(std::size_t));
+        if (stash_overflow > 0u) {
+            LOG_IF(INFO, verbose_) << "stash of size exceeds its bound.";
+            throw std::invalid_argument("stash of size exceeds its bound.");
+        }
+        append_stash_entries(keys, stash_ids, num_of_fun_, stash_size, cuckoo_table_values, cuckoo_table_function_ids,
+                cuckoo_table_source_values);
+
         LOG_IF(INFO, verbose_) << "cuckoo hash done.";
 
         // OPRF
-        std::vector<block> masks_with_dummies_block;
-        std::vector<block> masks_with_dummies;
-        for (std::size_t i = 0; i < cuckoo_table_values.size(); i++) {
-            masks_with_dummies_block.emplace_back(*(reinterpret_cast<block*>(cuckoo_table_values[i].data())));
-        }
-        nco_ot_ext_recver_->receive(net, masks_with_dummies_block, masks_with_dummies);
+        std::vector<std::uint8_t> matched(receiver_data_size, 0);
+        match_masks_by_batch(net, mask_batches(sender_data_size, num_of_bins, stash_size), cuckoo_table_values,
+                cuckoo_table_function_ids, cuckoo_table_source_values, matched);
 
         LOG_IF(INFO, verbose_) << "oprf done.";
 
-        ByteVector reduced_receiver_enc_data;
-        reduced_receiver_enc_data.resize(num_of_fun_ * sender_data_size * kReduceStatisticsLen);
-        net->recv_data(reduced_receiver_enc_data.data(), reduced_receiver_enc_data.size());
-
-        std::vector<ByteVector> unpacked_reduced_receiver_enc_data;
-        unpacked_reduced_receiver_enc_data.reserve(num_of_fun_ * sender_data_size);
-        for (std::size_t item_idx = 0; item_idx < sender_data_size * num_of_fun_; ++item_idx) {
-            unpacked_reduced_receiver_enc_data.emplace_back(
-                    reduced_receiver_enc_data.begin() + item_idx * kReduceStatisticsLen,
-                    reduced_receiver_enc_data.begin() + (item_idx + 1) * kReduceStatisticsLen);
-        }
-
-        std::vector<bool> intersection_indices(num_of_bins, false);
-        std::size_t count = 0;
-        for (std::size_t item_idx = 0; item_idx < num_of_bins; ++item_idx) {
-            auto index = cuckoo_table_function_ids[item_idx];
-            if (index >= num_of_fun_) {
-                continue;
-            }
-            ByteVector search_data(reinterpret_cast<Byte*>(&masks_with_dummies[item_idx]),
-                    reinterpret_cast<Byte*>(&masks_with_dummies[item_idx]) + kReduceStatisticsLen);
-            if (std::find(unpacked_reduced_receiver_enc_data.begin() + index * sender_data_size,
-                        unpacked_reduced_receiver_enc_data.begin() + (index + 1) * sender_data_size,
-                        search_data) != (unpacked_reduced_receiver_enc_data.begin() + (index + 1) * sender_data_size)) {
-                intersection_indices[cuckoo_table_source_values[item_idx]] = true;
-                ++count;
-            }
-        }
+        std::size_t count = static_cast<std::size_t>(std::count(matched.begin(), matched.end(), std::uint8_t(1)));
 
         LOG_IF(INFO, verbose_) << "receiver calculate cardinality done.";
 
@@ -443,9 +356,192 @@ std::size_t KkrtPSI::process_cardinality_only(
     }
 }
 
+std::vector<KkrtPSI::MaskBatch> KkrtPSI::mask_batches(
+        std::size_t sender_data_size, std::size_t num_of_bins, std::size_t stash_size) const {
+    std::vector<MaskBatch> batches;
+    for (std::size_t bin_begin = 0; bin_begin < num_of_bins; bin_begin += bin_batch_size_) {
+        std::size_t bin_end = std::min(bin_begin + bin_batch_size_, num_of_bins);
+        std::size_t mask_count = batch_mask_count(sender_data_size, bin_end - bin_begin, num_of_bins);
+        batches.push_back(MaskBatch{bin_begin, bin_end, 0, std::vector<std::size_t>(num_of_fun_, mask_count)});
+    }
+    // Every stash bin holds all sender keys, so that stash bins always form the last batch.
+    if (stash_size > 0) {
+        batches.push_back(MaskBatch{num_of_bins, num_of_bins + stash_size, num_of_fun_,
+                std::vector<std::size_t>(stash_size, sender_data_size)});
+    }
+    return batches;
+}
+
+void KkrtPSI::send_masks_by_batch(const std::shared_ptr<network::Network>& net,
+        const SimpleHashingTable& simple_table, const std::vector<MaskBatch>& batches) const {
+    // The sender runs the OT extension, encoding and sending of a batch strictly in order. The next send() overwrites
+    // the OT state that encoding reads, and a second OT extension instance would need its own base OTs on both sides.
+    // Masks and OT messages also share one channel, so sending them from two threads would interleave their bytes.
+    std::vector<std::vector<block>> masks;
+    for (const auto& batch : batches) {
+        nco_ot_ext_sender_->send(net, batch.bin_end - batch.bin_begin);
+        encode_by_function(simple_table, batch, masks);
+        send_shuffled_masks(net, masks);
+    }
+}
+
+void KkrtPSI::encode_by_function(
+        const SimpleHashingTable& simple_table, const MaskBatch& batch, std::vector<std::vector<block>>& masks) const {
+    std::size_t fun_count = batch.mask_counts.size();
+    const auto& values = simple_table.values();
+    const auto& function_ids = simple_table.function_ids();
+    std::size_t entry_begin = simple_table.bin_begin(batch.bin_begin);
+    std::size_t entry_count = simple_table.bin_begin(batch.bin_end) - entry_begin;
+    std::size_t num_threads = worker_pool_->num_threads();
+    std::size_t range_count = std::max<std::size_t>(std::min(num_threads, entry_count), 1);
+    std::size_t range_size = (entry_count + range_count - 1) / range_count;
+
+    // Counts the entries of every hash function in every range of entries, so that every range writes its own slice of
+    // the masks of each function without synchronization. Ranges split entries rather than bins, since a stash bin
+    // holds all sender keys.
+    std::vector<std::size_t> offsets(range_count * fun_count, 0);
+#pragma omp parallel for num_threads(num_threads)
+    for (std::size_t range_idx = 0; range_idx < range_count; ++range_idx) {
+        std::size_t* range_offsets = offsets.data() + range_idx * fun_count;
+        std::size_t end = entry_begin + std::min((range_idx + 1) * range_size, entry_count);
+        for (std::size_t entry_idx = entry_begin + std::min(range_idx * range_size, entry_count); entry_idx < end;
+                ++entry_idx) {
+            ++range_offsets[function_ids[entry_idx] - batch.fun_begin];
+        }
+    }
+    masks.resize(fun_count);
+    for (std::size_t fun_idx = 0; fun_idx < fun_count; ++fun_idx) {
+        std::size_t total = 0;
+        for (std::size_t range_idx = 0; range_idx < range_count; ++range_idx) {
+            std::size_t count = offsets[range_idx * fun_count + fun_idx];
+            offsets[range_idx * fun_count + fun_idx] = total;
+            total += count;
+        }
+        std::size_t mask_count = batch.mask_counts[fun_idx];
+        if (total > mask_count) {
+            throw std::runtime_error("a batch of bins holds more entries of a hash function than its masks.");
+        }
+        // Random masks pad the batch, which match no receiver mask but with negligible probability.
+        masks[fun_idx].resize(mask_count);
+        if (mask_count > total) {
+            prng_->generate((mask_count - total) * sizeof(block), reinterpret_cast<Byte*>(&masks[fun_idx][total]));
+        }
+    }
+
+#pragma omp parallel for num_threads(num_threads)
+    for (std::size_t range_idx = 0; range_idx < range_count; ++range_idx) {
+        std::size_t* cursors = offsets.data() + range_idx * fun_count;
+        std::size_t begin = entry_begin + std::min(range_idx * range_size, entry_count);
+        std::size_t end = entry_begin + std::min((range_idx + 1) * range_size, entry_count);
+        if (begin == end) {
+            continue;
+        }
+        std::size_t bin_idx = simple_table.bin_of(begin);
+        for (std::size_t entry_idx = begin; entry_idx < end; ++entry_idx) {
+            while (entry_idx >= simple_table.bin_end(bin_idx)) {
+                ++bin_idx;
+            }
+            std::size_t fun_idx = function_ids[entry_idx] - batch.fun_begin;
+            block value;
+            std::memcpy(&value, values[entry_idx].data(), sizeof(block));
+            nco_ot_ext_sender_->encode(bin_idx - batch.bin_begin, value, masks[fun_idx][cursors[fun_idx]++]);
+        }
+    }
+}
+
+void KkrtPSI::send_shuffled_masks(
+        const std::shared_ptr<network::Network>& net, std::vector<std::vector<block>>& masks) const {
+    std::size_t total_count = 0;
+    for (const auto& fun_masks : masks) {
+        total_count += fun_masks.size();
+    }
+    ByteVector reduced_masks(total_count * kReduceStatisticsLen);
+    std::vector<std::size_t> permutation;
+    Byte* fun_reduced_masks = reduced_masks.data();
+    for (auto& fun_masks : masks) {
+        std::size_t mask_count = fun_masks.size();
+        generate_permutation(prng_, mask_count, permutation);
+        permute_and_undo(permutation, true, fun_masks);
+#pragma omp parallel for num_threads(worker_pool_->num_threads())
+        for (std::size_t mask_idx = 0; mask_idx < mask_count; ++mask_idx) {
+            std::memcpy(fun_reduced_masks + mask_idx * kReduceStatisticsLen, &fun_masks[mask_idx],
+                    kReduceStatisticsLen);
+        }
+        fun_reduced_masks += mask_count * kReduceStatisticsLen;
+    }
+    net->send_data(reduced_masks.data(), reduced_masks.size());
+}
+
+void KkrtPSI::match_masks_by_batch(const std::shared_ptr<network::Network>& net,
+        const std::vector<MaskBatch>& batches, const std::vector<Item>& bin_values,
+        const std::vector<std::size_t>& function_ids, const std::vector<std::size_t>& key_ids,
+        std::vector<std::uint8_t>& matched) const {
+    // Matching a batch runs in background, so that it overlaps with the OT extension of the next batch. At most one
+    // batch is matched at a time, and a failure of it is reported by get().
+    std::future<void> match_future;
+    for (const auto& batch : batches) {
+        std::vector<block> choices(batch.bin_end - batch.bin_begin);
+        for (std::size_t bin_idx = batch.bin_begin; bin_idx < batch.bin_end; ++bin_idx) {
+            std::memcpy(&choices[bin_idx - batch.bin_begin], bin_values[bin_idx].data(), sizeof(block));
+        }
+        std::vector<block> bin_masks;
+        nco_ot_ext_recver_->receive(net, choices, bin_masks);
+
+        std::vector<PointBuffer> sender_masks(batch.mask_counts.size());
+        for (std::size_t fun_idx = 0; fun_idx < batch.mask_counts.size(); ++fun_idx) {
+            sender_masks[fun_idx].resize(batch.mask_counts[fun_idx], kReduceStatisticsLen);
+            net->recv_data(sender_masks[fun_idx].data(), sender_masks[fun_idx].byte_count());
+        }
+
+        if (match_future.valid()) {
+            match_future.get();
+        }
+        match_future = std::async(std::launch::async,
+                [this, &batch, &function_ids, &key_ids, &matched, bin_masks = std::move(bin_masks),
+                        sender_masks = std::move(sender_masks)]() {
+                    ScopedWorkerBinding binding(*worker_pool_);
+                    match_masks(sender_masks, batch, bin_masks, function_ids, key_ids, matched);
+                });
+    }
+    if (match_future.valid()) {
+        match_future.get();
+    }
+}
+
+void KkrtPSI::match_masks(const std::vector<PointBuffer>& sender_masks, const MaskBatch& batch,
+        const std::vector<block>& bin_masks, const std::vector<std::size_t>& function_ids,
+        const std::vector<std::size_t>& key_ids, std::vector<std::uint8_t>& matched) const {
+    // A bin only matches masks of the hash function that placed its key there, so every function gets its own join.
+    std::size_t num_threads = worker_pool_->num_threads();
+    for (std::size_t fun_idx = 0; fun_idx < sender_masks.size(); ++fun_idx) {
+        std::vector<std::size_t> bins;
+        for (std::size_t bin_idx = batch.bin_begin; bin_idx < batch.bin_end; ++bin_idx) {
+            if (function_ids[bin_idx] == batch.fun_begin + fun_idx) {
+                bins.push_back(bin_idx);
+            }
+        }
+        PointBuffer function_bin_masks(bins.size(), kReduceStatisticsLen);
+        for (std::size_t idx = 0; idx < bins.size(); ++idx) {
+            std::memcpy(function_bin_masks.point_data(idx), &bin_masks[bins[idx] - batch.bin_begin],
+                    kReduceStatisticsLen);
+        }
+        std::vector<std::uint8_t> bin_matched;
+        hash_join(sender_masks[fun_idx], function_bin_masks, num_threads, bin_matched);
+        for (std::size_t idx = 0; idx < bins.size(); ++idx) {
+            if (bin_matched[idx]) {
+                matched[key_ids[bins[idx]]] = 1;
+            }
+        }
+    }
+}
+
 void KkrtPSI::check_params(const std::shared_ptr<network::Network>& net) {
     check_consistency(is_sender_, net, "epsilon", epsilon_);
     check_consistency(is_sender_, net, "number of function", num_of_fun_);
+    check_consistency(is_sender_, net, "bin batch size", bin_batch_size_);
+    check_greater_than<std::size_t>("bin_batch_size", bin_batch_size_, 0);
+    check_consistency(is_sender_, net, "stash failure bits", stash_failure_bits_);
+    check_stash_params(epsilon_, num_of_fun_, stash_failure_bits_);
 }
 
 template <>
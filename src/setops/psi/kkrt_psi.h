@@ -20,11 +20,13 @@
 
 #include "network/network.h"
 #include "solo/cuckoo_hashing.h"
-#include "solo/simple_hashing.h"
 #include "verse/verse_factory.h"
 
 #include "setops/psi/psi.h"
 #include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+#include "setops/util/simple_hashing_table.h"
+#include "setops/util/worker_pool.h"
 
 namespace petace {
 namespace setops {
@@ -67,13 +69,28 @@ class KkrtPSI : public PSI {
      *         "has_header": false,
      *         "output_file": "/data/receiver_output_file.csv"
      *     },
+     *      "threads": {
+     *          "num_threads": 0,
+     *          "cpu_affinity": [],
+     *          "numa_node": -1
+     *      },
      *      "kkrt_psi_params": {
      *          "epsilon": 1.27,
      *          "fun_num": 3,
-     *          "sender_obtain_result": true
+     *          "sender_obtain_result": true,
+     *          "bin_batch_size": 1048576,
+     *          "stash_failure_bits": 40
      *      }
      * }
      *
+     * The optional "threads" block configures the shared worker pool, see WorkerPoolOptions. The optional
+     * "bin_batch_size" is the number of bins per batch of OT extension, which bounds the memory of masks. Batches run
+     * one after another, and only the receiver matches a batch while the OT extension of the next one runs. Receiver
+     * keys that overflow cuckoo hashing go to a stash of max_stash_size(receiver keys, "epsilon", "fun_num",
+     * "stash_failure_bits") slots, each matched against all sender keys. The optional "stash_failure_bits" defaults to
+     * 40, and 0 allows no stash. The default "epsilon" and "fun_num" are stashless and reserve no stash slot. Both
+     * parties throw std::invalid_argument before any OT if check_stash_params rejects "epsilon" and "fun_num".
+     *
      * @param[in] net The network interface (e.g., PETAce-Network interface).
      * @param[in] params The PSI parameters configuration.
      */
@@ -124,6 +141,46 @@ class KkrtPSI : public PSI {
     // Checks the validity and consistency of JSON params of both parties.
     void check_params(const std::shared_ptr<network::Network>& net) override;
 
+    // A batch of bins in one OT extension, with the number of masks of every hash function from fun_begin in it.
+    struct MaskBatch {
+        std::size_t bin_begin;
+        std::size_t bin_end;
+        std::size_t fun_begin;
+        std::vector<std::size_t> mask_counts;
+    };
+
+    // Splits bins into batches of bin_batch_size_ bins, followed by one batch of stash bins if there are any. Stash bin
+    // j holds the entries of function num_of_fun_ + j, one per sender key.
+    std::vector<MaskBatch> mask_batches(std::size_t sender_data_size, std::size_t num_of_bins,
+            std::size_t stash_size) const;
+
+    // Runs the OPRF over batches. Every batch is encoded and its shuffled masks are sent right after its OT extension,
+    // which bounds the memory of masks.
+    void send_masks_by_batch(const std::shared_ptr<network::Network>& net, const SimpleHashingTable& simple_table,
+            const std::vector<MaskBatch>& batches) const;
+
+    // Encodes every entry of the simple hashing table in a batch with the OPRF of its bin, in parallel over ranges of
+    // entries. Masks are grouped by the hash function that placed the entry, and every group is padded with random
+    // masks to its mask count.
+    void encode_by_function(const SimpleHashingTable& simple_table, const MaskBatch& batch,
+            std::vector<std::vector<block>>& masks) const;
+
+    // Shuffles the masks of every hash function and sends their first kReduceStatisticsLen bytes.
+    void send_shuffled_masks(
+            const std::shared_ptr<network::Network>& net, std::vector<std::vector<block>>& masks) const;
+
+    // Runs the OPRF over batches, receives the masks of sender keys of every batch and marks receiver keys found among
+    // them. A batch is matched while the OT extension of the next batch runs.
+    void match_masks_by_batch(const std::shared_ptr<network::Network>& net, const std::vector<MaskBatch>& batches,
+            const std::vector<Item>& bin_values, const std::vector<std::size_t>& function_ids,
+            const std::vector<std::size_t>& key_ids, std::vector<std::uint8_t>& matched) const;
+
+    // Marks receiver keys in bins of a batch whose bin mask is among the sender masks of the hash function that placed
+    // the key, by a hash join per function.
+    void match_masks(const std::vector<PointBuffer>& sender_masks, const MaskBatch& batch,
+            const std::vector<block>& bin_masks, const std::vector<std::size_t>& function_ids,
+            const std::vector<std::size_t>& key_ids, std::vector<std::uint8_t>& matched) const;
+
     bool is_sender_ = false;
 
     bool sender_obtain_result_ = false;
@@ -142,9 +199,15 @@ class KkrtPSI : public PSI {
 
     std::shared_ptr<verse::NcoOtExtReceiver> nco_ot_ext_recver_ = nullptr;
 
+    std::shared_ptr<WorkerPool> worker_pool_ = nullptr;
+
     double epsilon_ = 0.0;
 
     std::size_t num_of_fun_ = 0;
+
+    std::size_t bin_batch_size_ = 0;
+
+    std::size_t stash_failure_bits_ = 0;
 };
 
 }  // namespace setops
@@ -0,0 +1,103 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+namespace petace {
+namespace setops {
+
+/**
+ * @brief Tracks how many chunks a producer thread has finished, so that a consumer thread can start working on a chunk
+ * as soon as it is ready.
+ *
+ * Either side may abort the pipeline, which wakes up every waiting thread.
+ */
+class ChunkProgress {
+public:
+    ChunkProgress() = default;
+
+    ~ChunkProgress() = default;
+
+    /**
+     * @brief Marks the next chunk as finished and wakes up the waiting consumer.
+     */
+    void finish_chunk() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++finished_chunks_;
+        }
+        cond_.notify_all();
+    }
+
+    /**
+     * @brief Marks the next count chunks as finished at once, e.g., when they are loaded rather than produced.
+     *
+     * @param[in] count The number of chunks.
+     */
+    void finish_chunks(std::size_t count) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished_chunks_ += count;
+        }
+        cond_.notify_all();
+    }
+
+    /**
+     * @brief Aborts the pipeline and wakes up all waiting threads.
+     */
+    void abort() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            aborted_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    /**
+     * @brief Returns whether the pipeline has been aborted.
+     */
+    bool aborted() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return aborted_;
+    }
+
+    /**
+     * @brief Blocks until the chunk of the given index is finished.
+     *
+     * @param[in] chunk_idx The index of the chunk to wait for.
+     * @return Returns false if the pipeline is aborted before the chunk is finished.
+     */
+    bool wait_for(std::size_t chunk_idx) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this, chunk_idx]() { return aborted_ || finished_chunks_ > chunk_idx; });
+        return finished_chunks_ > chunk_idx;
+    }
+
+private:
+    ChunkProgress(const ChunkProgress& copy) = delete;
+
+    ChunkProgress& operator=(const ChunkProgress& assign) = delete;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::size_t finished_chunks_ = 0;
+    bool aborted_ = false;
+};
+
+}  // namespace setops
+}  // namespace petace
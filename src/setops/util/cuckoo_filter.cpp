@@ -0,0 +1,210 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/cuckoo_filter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+// A filter that cannot take all tags is rebuilt with kBucketCountGrowth times as many buckets.
+const double kMaxLoadFactor = 0.94;
+const double kBucketCountGrowth = 1.0625;
+const std::size_t kMaxKicks = 1024;
+// A fingerprint of 0 marks an empty slot.
+const std::uint64_t kEmptySlot = 0;
+// A lookup compares a fingerprint with the 2^kLookupSlotsBits slots of two buckets.
+const std::size_t kLookupSlotsBits = 3;
+
+inline std::uint64_t mix64(std::uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Maps a 64-bit hash to [0, range) without division.
+inline std::size_t reduce(std::uint64_t hash, std::size_t range) {
+    return static_cast<std::size_t>((static_cast<unsigned __int128>(hash) * range) >> 64);
+}
+
+// The two words overlap, so that all kCuckooFilterTagBytesLen bytes of a tag take part.
+inline void hash_tag(const Byte* tag, std::size_t bucket_count, std::size_t fingerprint_bytes_len, std::size_t& bucket,
+        std::uint64_t& fingerprint) {
+    std::uint64_t lo = 0;
+    std::uint64_t hi = 0;
+    std::memcpy(&lo, tag, sizeof(lo));
+    std::memcpy(&hi, tag + kCuckooFilterTagBytesLen - sizeof(hi), sizeof(hi));
+    bucket = reduce(mix64(lo), bucket_count);
+    fingerprint = mix64(hi ^ 0x9e3779b97f4a7c15ULL) >> (64 - 8 * fingerprint_bytes_len);
+    if (fingerprint == kEmptySlot) {
+        fingerprint = 1;
+    }
+}
+
+// Returns (hash(fingerprint) - bucket) mod bucket_count, which maps either candidate bucket to the other one for any
+// number of buckets.
+inline std::size_t alternate_bucket(std::size_t bucket, std::uint64_t fingerprint, std::size_t bucket_count) {
+    std::size_t offset = reduce(mix64(fingerprint), bucket_count);
+    return offset >= bucket ? offset - bucket : offset + bucket_count - bucket;
+}
+
+inline std::uint64_t next_random(std::uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+inline void check_fingerprint_bytes_len(std::size_t fingerprint_bytes_len) {
+    if (fingerprint_bytes_len == 0 || fingerprint_bytes_len > kCuckooFilterMaxFingerprintBytesLen) {
+        throw std::invalid_argument("fingerprint_bytes_len is not in [1, " +
+                                    std::to_string(kCuckooFilterMaxFingerprintBytesLen) + "].");
+    }
+}
+
+// Returns the smallest bit count b such that 2^b >= value.
+inline std::size_t ceil_log2(std::size_t value) {
+    std::size_t bit_count = 0;
+    while (bit_count < 64 && (std::size_t(1) << bit_count) < value) {
+        ++bit_count;
+    }
+    return bit_count;
+}
+
+}  // namespace
+
+std::size_t cuckoo_filter_fingerprint_bytes_len(std::size_t statistical_security_bits, std::size_t lookup_count) {
+    // Nonzero fingerprints of f bits match a given one with probability 1 / (2^f - 1), so f is one bit longer than
+    // statistical_security_bits + kLookupSlotsBits, plus log2(lookup_count) bits for all lookups of a run.
+    std::size_t fingerprint_bytes_len =
+            (statistical_security_bits + ceil_log2(lookup_count) + kLookupSlotsBits + 1 + 7) / 8;
+    if (fingerprint_bytes_len > kCuckooFilterMaxFingerprintBytesLen) {
+        throw std::invalid_argument("statistical_security_bits(" + std::to_string(statistical_security_bits) +
+                                    ") is too large for cuckoo filter fingerprints of " +
+                                    std::to_string(lookup_count) + " lookups.");
+    }
+    return std::max(fingerprint_bytes_len, std::size_t(1));
+}
+
+CuckooFilter::CuckooFilter(const PointBuffer& tags, std::size_t fingerprint_bytes_len) {
+    if (!tags.empty() && tags.point_byte_count() != kCuckooFilterTagBytesLen) {
+        throw std::invalid_argument("tags are not of " + std::to_string(kCuckooFilterTagBytesLen) + " bytes.");
+    }
+    std::size_t bucket_count = static_cast<std::size_t>(
+            static_cast<double>(tags.size()) / (kMaxLoadFactor * kCuckooFilterBucketSlots)) + 1;
+    bool built = false;
+    while (!built) {
+        resize(bucket_count, 0, fingerprint_bytes_len);
+        // Kicks are pseudorandom but deterministic, so that the same tags always give the same filter.
+        std::uint64_t random_state = 0x2545f4914f6cdd1dULL;
+        built = true;
+        for (std::size_t item_idx = 0; item_idx < tags.size() && built; ++item_idx) {
+            built = insert(tags.point_data(item_idx), random_state);
+        }
+        bucket_count = static_cast<std::size_t>(static_cast<double>(bucket_count) * kBucketCountGrowth) + 1;
+    }
+}
+
+void CuckooFilter::resize(std::size_t bucket_count, std::size_t size, std::size_t fingerprint_bytes_len) {
+    check_fingerprint_bytes_len(fingerprint_bytes_len);
+    bucket_count_ = bucket_count;
+    size_ = size;
+    fingerprint_bytes_len_ = fingerprint_bytes_len;
+    slots_.assign(bucket_count * kCuckooFilterBucketSlots * fingerprint_bytes_len, 0);
+}
+
+bool CuckooFilter::contains(const Byte* tag) const {
+    if (bucket_count_ == 0) {
+        return false;
+    }
+    std::size_t bucket = 0;
+    std::uint64_t fingerprint = 0;
+    hash_tag(tag, bucket_count_, fingerprint_bytes_len_, bucket, fingerprint);
+    std::size_t other_bucket = alternate_bucket(bucket, fingerprint, bucket_count_);
+    return bucket_contains(bucket, fingerprint) | bucket_contains(other_bucket, fingerprint);
+}
+
+bool CuckooFilter::insert(const Byte* tag, std::uint64_t& random_state) {
+    std::size_t bucket = 0;
+    std::uint64_t fingerprint = 0;
+    hash_tag(tag, bucket_count_, fingerprint_bytes_len_, bucket, fingerprint);
+    std::size_t other_bucket = alternate_bucket(bucket, fingerprint, bucket_count_);
+    if (bucket_contains(bucket, fingerprint) || bucket_contains(other_bucket, fingerprint)) {
+        return true;
+    }
+    ++size_;
+    if (bucket_insert(bucket, fingerprint) || bucket_insert(other_bucket, fingerprint)) {
+        return true;
+    }
+    // Evicts a random fingerprint of a full bucket to its other candidate bucket until one has room.
+    bucket = (next_random(random_state) & 1) ? bucket : other_bucket;
+    for (std::size_t kick = 0; kick < kMaxKicks; ++kick) {
+        std::size_t victim_idx =
+                bucket * kCuckooFilterBucketSlots + next_random(random_state) % kCuckooFilterBucketSlots;
+        std::uint64_t victim = load_slot(victim_idx);
+        store_slot(victim_idx, fingerprint);
+        fingerprint = victim;
+        bucket = alternate_bucket(bucket, fingerprint, bucket_count_);
+        if (bucket_insert(bucket, fingerprint)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::uint64_t CuckooFilter::load_slot(std::size_t slot_idx) const {
+    const Byte* slot = slots_.data() + slot_idx * fingerprint_bytes_len_;
+    std::uint64_t fingerprint = 0;
+    for (std::size_t byte_idx = 0; byte_idx < fingerprint_bytes_len_; ++byte_idx) {
+        fingerprint |= static_cast<std::uint64_t>(slot[byte_idx]) << (8 * byte_idx);
+    }
+    return fingerprint;
+}
+
+void CuckooFilter::store_slot(std::size_t slot_idx, std::uint64_t fingerprint) {
+    Byte* slot = slots_.data() + slot_idx * fingerprint_bytes_len_;
+    for (std::size_t byte_idx = 0; byte_idx < fingerprint_bytes_len_; ++byte_idx) {
+        slot[byte_idx] = static_cast<Byte>(fingerprint >> (8 * byte_idx));
+    }
+}
+
+bool CuckooFilter::bucket_contains(std::size_t bucket, std::uint64_t fingerprint) const {
+    bool found = false;
+    for (std::size_t slot_idx = 0; slot_idx < kCuckooFilterBucketSlots; ++slot_idx) {
+        found |= load_slot(bucket * kCuckooFilterBucketSlots + slot_idx) == fingerprint;
+    }
+    return found;
+}
+
+bool CuckooFilter::bucket_insert(std::size_t bucket, std::uint64_t fingerprint) {
+    for (std::size_t slot_idx = 0; slot_idx < kCuckooFilterBucketSlots; ++slot_idx) {
+        if (load_slot(bucket * kCuckooFilterBucketSlots + slot_idx) == kEmptySlot) {
+            store_slot(bucket * kCuckooFilterBucketSlots + slot_idx, fingerprint);
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,128 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+
+namespace petace {
+namespace setops {
+
+// The byte length of a tag in a cuckoo filter.
+const std::size_t kCuckooFilterTagBytesLen = 12;
+// The number of fingerprints in a bucket of a cuckoo filter.
+const std::size_t kCuckooFilterBucketSlots = 4;
+// The maximum byte length of a fingerprint in a cuckoo filter.
+const std::size_t kCuckooFilterMaxFingerprintBytesLen = 8;
+
+/**
+ * @brief Returns the fingerprint byte length of a cuckoo filter in which any of lookup_count lookups of tags not in the
+ * filter reports one as present with probability at most 2^-statistical_security_bits.
+ *
+ * A single lookup is a false positive with probability at most 2^-(statistical_security_bits + log2(lookup_count)),
+ * so that the bound holds for a run of lookup_count lookups by the union bound.
+ *
+ * @param[in] statistical_security_bits The statistical security parameter.
+ * @param[in] lookup_count The number of lookups in one run.
+ * @throws std::invalid_argument if fingerprints of kCuckooFilterMaxFingerprintBytesLen bytes are too short.
+ */
+std::size_t cuckoo_filter_fingerprint_bytes_len(std::size_t statistical_security_bits, std::size_t lookup_count);
+
+/**
+ * @brief A static cuckoo filter of tags, such as truncated ECDH encrypted keys.
+ *
+ * Every tag is stored as a fingerprint of fingerprint_bytes_len bytes in one of its two candidate buckets of
+ * kCuckooFilterBucketSlots slots. Buckets are about 94% full, so the filter takes about 8.5 * fingerprint_bytes_len
+ * bits per tag. A lookup reads two buckets, and a tag not in the filter is reported as present with probability about
+ * 2^(3 - 8 * fingerprint_bytes_len).
+ */
+class CuckooFilter {
+public:
+    CuckooFilter() = default;
+
+    /**
+     * @brief Builds a filter of tags. Duplicate tags are stored once.
+     *
+     * @param[in] tags The tags, each of kCuckooFilterTagBytesLen bytes.
+     * @param[in] fingerprint_bytes_len The byte length of fingerprints, from 1 to kCuckooFilterMaxFingerprintBytesLen.
+     * @throws std::invalid_argument if tags are not of kCuckooFilterTagBytesLen bytes or fingerprint_bytes_len is out
+     * of range.
+     */
+    CuckooFilter(const PointBuffer& tags, std::size_t fingerprint_bytes_len);
+
+    /**
+     * @brief Returns whether a tag is possibly in the filter. A tag in the filter is always reported as present.
+     *
+     * @param[in] tag The kCuckooFilterTagBytesLen bytes of the tag.
+     */
+    bool contains(const Byte* tag) const;
+
+    /**
+     * @brief Sets the number of buckets, stored tags and fingerprint bytes, and clears all slots, e.g., before slots
+     * are received.
+     *
+     * @throws std::invalid_argument if fingerprint_bytes_len is out of range.
+     */
+    void resize(std::size_t bucket_count, std::size_t size, std::size_t fingerprint_bytes_len);
+
+    std::size_t bucket_count() const {
+        return bucket_count_;
+    }
+
+    // Returns the number of stored tags.
+    std::size_t size() const {
+        return size_;
+    }
+
+    std::size_t fingerprint_bytes_len() const {
+        return fingerprint_bytes_len_;
+    }
+
+    Byte* data() {
+        return slots_.data();
+    }
+
+    const Byte* data() const {
+        return slots_.data();
+    }
+
+    std::size_t byte_count() const {
+        return slots_.size();
+    }
+
+private:
+    // Inserts a tag, returns false if the filter is too full, in which case some fingerprint is dropped.
+    bool insert(const Byte* tag, std::uint64_t& random_state);
+
+    std::uint64_t load_slot(std::size_t slot_idx) const;
+
+    void store_slot(std::size_t slot_idx, std::uint64_t fingerprint);
+
+    bool bucket_contains(std::size_t bucket, std::uint64_t fingerprint) const;
+
+    bool bucket_insert(std::size_t bucket, std::uint64_t fingerprint);
+
+    std::size_t bucket_count_ = 0;
+    std::size_t size_ = 0;
+    std::size_t fingerprint_bytes_len_ = 0;
+    // Fingerprints of fingerprint_bytes_len_ bytes each in little endian.
+    std::vector<Byte> slots_{};
+};
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,144 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/cuckoo_stash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+// Cuckoo hashing with at least this number of hash functions is stashless at kStashlessEpsilon bins per key.
+constexpr std::size_t kStashlessMinFunctions = 3;
+constexpr double kStashlessEpsilon = 1.27;
+
+// The failure bits that the tabulated stash sizes achieve.
+constexpr std::size_t kTabulatedFailureBits = 40;
+
+// The bins per key of cuckoo hashing with 2 hash functions that the tabulated stash sizes are for.
+constexpr double kTabulatedEpsilon = 2.4;
+
+// Stash sizes of cuckoo hashing with 2 hash functions and 2.4 bins per key for 2^8, 2^12, 2^16, 2^20 and 2^24 keys.
+constexpr std::size_t kTabulatedStashSizes[] = {12, 6, 4, 3, 2};
+
+// Load thresholds of cuckoo hashing with 2, 3, 4, 5 and at least 6 hash functions, which a stash of O(log n) slots
+// covers only below.
+constexpr double kLoadThresholds[] = {0.5, 0.9179, 0.9768, 0.9924, 0.9974};
+
+// The most failure bits that a stash is sized for, which keeps stash slots and hash functions within the 256 function
+// IDs of SimpleHashingTable.
+constexpr std::size_t kMaxFailureBits = 128;
+
+// The number of function IDs of SimpleHashingTable.
+constexpr std::size_t kMaxFunctionIds = 256;
+
+std::size_t tail_stash_size(std::size_t key_count, std::size_t failure_bits) {
+    double log_key_count = std::log2(static_cast<double>(key_count));
+    std::size_t table_idx = 0;
+    if (log_key_count > 8.0) {
+        table_idx = std::min(static_cast<std::size_t>(std::ceil((log_key_count - 8.0) / 4.0)),
+                sizeof(kTabulatedStashSizes) / sizeof(kTabulatedStashSizes[0]) - 1);
+    }
+    return static_cast<std::size_t>(std::ceil(static_cast<double>(kTabulatedStashSizes[table_idx]) *
+                                              static_cast<double>(failure_bits) /
+                                              static_cast<double>(kTabulatedFailureBits)));
+}
+
+}  // namespace
+
+void check_stash_params(double epsilon, std::size_t num_of_fun, std::size_t failure_bits) {
+    if (failure_bits == 0) {
+        return;
+    }
+    if (num_of_fun < 2) {
+        throw std::invalid_argument("a stash needs at least 2 hash functions.");
+    }
+    if (failure_bits > kMaxFailureBits) {
+        throw std::invalid_argument("stash failure bits exceed 128.");
+    }
+    // The largest tail is that of the fewest keys.
+    if (num_of_fun + tail_stash_size(1, failure_bits) > kMaxFunctionIds) {
+        throw std::invalid_argument("hash functions and stash slots exceed 256.");
+    }
+    if (num_of_fun == 2 && epsilon < kTabulatedEpsilon) {
+        throw std::invalid_argument("epsilon of 2 hash functions is below 2.4.");
+    }
+    std::size_t threshold_idx = std::min(num_of_fun, std::size_t(6)) - 2;
+    if (epsilon * kLoadThresholds[threshold_idx] < 1.0) {
+        throw std::invalid_argument("epsilon is below the load threshold of the hash functions.");
+    }
+}
+
+std::size_t max_stash_size(std::size_t key_count, double epsilon, std::size_t num_of_fun, std::size_t failure_bits) {
+    check_stash_params(epsilon, num_of_fun, failure_bits);
+    if (failure_bits == 0 || key_count == 0) {
+        return 0;
+    }
+    if (num_of_fun >= kStashlessMinFunctions && epsilon >= kStashlessEpsilon &&
+            failure_bits <= kTabulatedFailureBits) {
+        return 0;
+    }
+    return tail_stash_size(key_count, failure_bits);
+}
+
+std::vector<std::size_t> find_stash_ids(
+        const std::vector<bool>& bin_occupancy, const std::vector<std::size_t>& entry_ids, std::size_t key_count) {
+    std::vector<bool> placed(key_count, false);
+    for (std::size_t bin_idx = 0; bin_idx < bin_occupancy.size(); ++bin_idx) {
+        if (bin_occupancy[bin_idx]) {
+            placed[entry_ids[bin_idx]] = true;
+        }
+    }
+    std::vector<std::size_t> stash_ids;
+    for (std::size_t key_idx = 0; key_idx < key_count; ++key_idx) {
+        if (!placed[key_idx]) {
+            stash_ids.push_back(key_idx);
+        }
+    }
+    return stash_ids;
+}
+
+void append_stash_entries(const std::vector<Item>& keys, const std::vector<std::size_t>& stash_ids,
+        std::size_t num_of_fun, std::size_t stash_size, std::vector<Item>& values,
+        std::vector<std::size_t>& function_ids, std::vector<std::size_t>& entry_ids) {
+    if (stash_ids.size() > stash_size) {
+        throw std::invalid_argument("stash of size exceeds its bound.");
+    }
+    for (std::size_t slot_idx = 0; slot_idx < stash_size; ++slot_idx) {
+        std::size_t function_id = num_of_fun + slot_idx;
+        if (slot_idx < stash_ids.size()) {
+            Item value = keys[stash_ids[slot_idx]];
+            value[0] ^= static_cast<Byte>(function_id);
+            values.push_back(value);
+            function_ids.push_back(function_id);
+            entry_ids.push_back(stash_ids[slot_idx]);
+        } else {
+            // The dummy matches a sender entry only if a hashed key equals it, which happens with negligible
+            // probability.
+            Item value{};
+            value[0] = static_cast<Byte>(function_id);
+            values.push_back(value);
+            function_ids.push_back(std::numeric_limits<std::size_t>::max());
+            entry_ids.push_back(0);
+        }
+    }
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,88 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "setops/util/defines.h"
+
+namespace petace {
+namespace setops {
+
+/**
+ * @brief Checks that a stash of O(log n) slots covers cuckoo hashing with the given parameters.
+ *
+ * The stash of max_stash_size only holds the tail of keys that a cuckoo hashing table below its load threshold fails
+ * to place, so that epsilon bins per key must exceed the inverse of the load threshold of num_of_fun hash functions,
+ * and 2 hash functions need the tabulated 2.4 bins per key. Both parties call it before any OT, so that they fail
+ * alike. 0 failure_bits reserves no stash and accepts any parameters, since an overflow is then detected at run time.
+ *
+ * @param[in] epsilon The number of bins per key.
+ * @param[in] num_of_fun The number of hash functions.
+ * @param[in] failure_bits The stash overflows with probability about 2^-failure_bits, which is at most 128.
+ * @throws std::invalid_argument if the parameters need a stash beyond the tabulated tail.
+ */
+void check_stash_params(double epsilon, std::size_t num_of_fun, std::size_t failure_bits);
+
+/**
+ * @brief Returns the number of stash slots that a PSI reserves for cuckoo hashing of keys.
+ *
+ * Cuckoo hashing with at least 3 hash functions and 1.27 bins per key is stashless up to a failure probability of
+ * 2^-40 (Ref: Efficient Circuit-based PSI with Linear Communication), so that no slot is reserved for it. Otherwise,
+ * the stash is the stash size for 2^-40 of cuckoo hashing with 2 hash functions and 2.4 bins per key (Ref: Phasing:
+ * Private Set Intersection using Permutation-based Hashing), which is scaled to failure_bits. It is O(log n) and at
+ * most 39 slots.
+ *
+ * @param[in] key_count The number of keys.
+ * @param[in] epsilon The number of bins per key.
+ * @param[in] num_of_fun The number of hash functions.
+ * @param[in] failure_bits The stash overflows with probability about 2^-failure_bits. 0 reserves no stash.
+ * @throws std::invalid_argument if check_stash_params rejects the parameters.
+ */
+std::size_t max_stash_size(std::size_t key_count, double epsilon, std::size_t num_of_fun, std::size_t failure_bits);
+
+/**
+ * @brief Returns the IDs of keys that cuckoo hashing left in its stash, in increasing order.
+ *
+ * @param[in] bin_occupancy Whether every bin holds a key.
+ * @param[in] entry_ids The ID of the key in every bin, which is ignored for empty bins.
+ * @param[in] key_count The number of keys inserted.
+ */
+std::vector<std::size_t> find_stash_ids(
+        const std::vector<bool>& bin_occupancy, const std::vector<std::size_t>& entry_ids, std::size_t key_count);
+
+/**
+ * @brief Appends stash_size stash slots to the entries of a cuckoo hashing table.
+ *
+ * Slot j holds the j-th stash key with its first byte XORed by num_of_fun + j and that function ID, which is the entry
+ * of the key in stash bin j of SimpleHashingTable. Slots without a stash key hold a dummy value and function ID
+ * SIZE_MAX.
+ *
+ * @param[in] keys The keys inserted.
+ * @param[in] stash_ids The IDs of keys in the stash, at most stash_size.
+ * @param[in] num_of_fun The number of hash functions.
+ * @param[in] stash_size The number of stash slots.
+ * @param[in,out] values The entry values of bins.
+ * @param[in,out] function_ids The function IDs of bins.
+ * @param[in,out] entry_ids The key IDs of bins.
+ * @throws std::invalid_argument if there are more stash keys than stash slots.
+ */
+void append_stash_entries(const std::vector<Item>& keys, const std::vector<std::size_t>& stash_ids,
+        std::size_t num_of_fun, std::size_t stash_size, std::vector<Item>& values,
+        std::vector<std::size_t>& function_ids, std::vector<std::size_t>& entry_ids);
+
+}  // namespace setops
+}  // namespace petace
@@ -26,6 +26,7 @@ namespace setops {
 
 const std::size_t kEccPointLen = 33;
 const std::size_t kECCCompareBytesLen = 12;
+const std::size_t kECCMaxCompareBytesLen = 16;
 const std::size_t kRandSeedBytesLen = 16;
 const std::size_t kItemBytesLen = 16;
 const std::size_t kReduceStatisticsLen = 12;
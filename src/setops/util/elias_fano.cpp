@@ -0,0 +1,332 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/elias_fano.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+// Points are coded in independent blocks of this many points.
+const std::size_t kEliasFanoBlockSize = std::size_t(1) << 16;
+// The header holds the point count, the point byte count, the high bit count and the block count.
+const std::size_t kEliasFanoHeaderWordCount = 4;
+// A block starts with the high bits of its first point and the word count of its unary-coded high bits.
+const std::size_t kEliasFanoBlockHeaderWordCount = 2;
+const std::size_t kWordBitCount = 64;
+
+inline std::size_t ceil_log2(std::size_t value) {
+    std::size_t log = 0;
+    while ((std::size_t(1) << log) < value) {
+        ++log;
+    }
+    return log;
+}
+
+inline std::size_t count_trailing_zeros(std::uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<std::size_t>(__builtin_ctzll(value));
+#else
+    std::size_t count = 0;
+    while ((value & 1) == 0) {
+        value >>= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Appends bits to 64-bit words, from the least significant bit of every word.
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<std::uint64_t>& words) : words_(words) {
+    }
+
+    // Writes the low bit_count bits of value, where bit_count is 1 to 64 and higher bits of value are zero.
+    void write(std::uint64_t value, std::size_t bit_count) {
+        std::size_t offset = bit_count_ % kWordBitCount;
+        if (offset == 0) {
+            words_.push_back(0);
+        }
+        words_.back() |= value << offset;
+        if (offset + bit_count > kWordBitCount) {
+            words_.push_back(value >> (kWordBitCount - offset));
+        }
+        bit_count_ += bit_count;
+    }
+
+    // Writes value zeros followed by a one.
+    void write_unary(std::uint64_t value) {
+        for (; value >= kWordBitCount; value -= kWordBitCount) {
+            write(0, kWordBitCount);
+        }
+        write(std::uint64_t(1) << value, static_cast<std::size_t>(value) + 1);
+    }
+
+private:
+    std::vector<std::uint64_t>& words_;
+    std::size_t bit_count_ = 0;
+};
+
+// Reads bits written by BitWriter, and returns false once bits run out.
+class BitReader {
+public:
+    BitReader(const std::uint64_t* words, std::size_t word_count)
+            : words_(words), bit_limit_(word_count * kWordBitCount) {
+    }
+
+    bool read(std::size_t bit_count, std::uint64_t& value) {
+        if (bit_count > bit_limit_ - bit_idx_) {
+            return false;
+        }
+        std::size_t word_idx = bit_idx_ / kWordBitCount;
+        std::size_t offset = bit_idx_ % kWordBitCount;
+        value = words_[word_idx] >> offset;
+        if (offset + bit_count > kWordBitCount) {
+            value |= words_[word_idx + 1] << (kWordBitCount - offset);
+        }
+        if (bit_count < kWordBitCount) {
+            value &= (std::uint64_t(1) << bit_count) - 1;
+        }
+        bit_idx_ += bit_count;
+        return true;
+    }
+
+    bool read_unary(std::uint64_t& value) {
+        value = 0;
+        while (bit_idx_ < bit_limit_) {
+            std::size_t offset = bit_idx_ % kWordBitCount;
+            std::uint64_t bits = words_[bit_idx_ / kWordBitCount] >> offset;
+            if (bits == 0) {
+                value += kWordBitCount - offset;
+                bit_idx_ += kWordBitCount - offset;
+                continue;
+            }
+            std::size_t zero_count = count_trailing_zeros(bits);
+            value += zero_count;
+            bit_idx_ += zero_count + 1;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    const std::uint64_t* words_;
+    std::size_t bit_limit_;
+    std::size_t bit_idx_ = 0;
+};
+
+// A point of at most 16 bytes as a big-endian integer, left-aligned in two words.
+struct PointWords {
+    std::uint64_t high = 0;
+    std::uint64_t low = 0;
+};
+
+PointWords load_point(const Byte* point, std::size_t point_byte_count) {
+    PointWords words;
+    for (std::size_t byte_idx = 0; byte_idx < point_byte_count; ++byte_idx) {
+        std::uint64_t& word = byte_idx < 8 ? words.high : words.low;
+        word |= static_cast<std::uint64_t>(point[byte_idx]) << (56 - 8 * (byte_idx % 8));
+    }
+    return words;
+}
+
+void store_point(const PointWords& words, std::size_t point_byte_count, Byte* point) {
+    for (std::size_t byte_idx = 0; byte_idx < point_byte_count; ++byte_idx) {
+        std::uint64_t word = byte_idx < 8 ? words.high : words.low;
+        point[byte_idx] = static_cast<Byte>(word >> (56 - 8 * (byte_idx % 8)));
+    }
+}
+
+// Encodes points in range [begin, end) as a block. Returns false if their high bits decrease.
+bool encode_block(const PointBuffer& points, std::size_t begin, std::size_t end, std::size_t high_bit_count,
+        std::vector<std::uint64_t>& block) {
+    std::size_t low_bit_count = 8 * points.point_byte_count() - high_bit_count;
+    std::vector<std::uint64_t> high_words;
+    std::vector<std::uint64_t> low_words;
+    BitWriter high_writer(high_words);
+    BitWriter low_writer(low_words);
+    std::uint64_t previous_high = load_point(points.point_data(begin), points.point_byte_count()).high >>
+                                  (kWordBitCount - high_bit_count);
+    block.assign({previous_high, 0});
+    for (std::size_t item_idx = begin; item_idx < end; ++item_idx) {
+        PointWords words = load_point(points.point_data(item_idx), points.point_byte_count());
+        std::uint64_t high = words.high >> (kWordBitCount - high_bit_count);
+        if (high < previous_high) {
+            return false;
+        }
+        high_writer.write_unary(high - previous_high);
+        previous_high = high;
+        // The bits after the high bits, left-aligned in two words.
+        std::uint64_t rest_high = (words.high << high_bit_count) | (words.low >> (kWordBitCount - high_bit_count));
+        std::uint64_t rest_low = words.low << high_bit_count;
+        if (low_bit_count > kWordBitCount) {
+            low_writer.write(rest_high, kWordBitCount);
+            low_writer.write(rest_low >> (2 * kWordBitCount - low_bit_count), low_bit_count - kWordBitCount);
+        } else if (low_bit_count > 0) {
+            low_writer.write(rest_high >> (kWordBitCount - low_bit_count), low_bit_count);
+        }
+    }
+    block[1] = high_words.size();
+    block.insert(block.end(), high_words.begin(), high_words.end());
+    block.insert(block.end(), low_words.begin(), low_words.end());
+    return true;
+}
+
+// Decodes a block of words into points in range [begin, end). Returns false if the block is malformed.
+bool decode_block(const std::uint64_t* block, std::size_t word_count, std::size_t begin, std::size_t end,
+        std::size_t high_bit_count, PointBuffer& points) {
+    if (word_count < kEliasFanoBlockHeaderWordCount ||
+            block[1] > word_count - kEliasFanoBlockHeaderWordCount) {
+        return false;
+    }
+    std::size_t low_bit_count = 8 * points.point_byte_count() - high_bit_count;
+    std::size_t high_word_count = static_cast<std::size_t>(block[1]);
+    BitReader high_reader(block + kEliasFanoBlockHeaderWordCount, high_word_count);
+    BitReader low_reader(block + kEliasFanoBlockHeaderWordCount + high_word_count,
+            word_count - kEliasFanoBlockHeaderWordCount - high_word_count);
+    std::uint64_t high = block[0];
+    for (std::size_t item_idx = begin; item_idx < end; ++item_idx) {
+        std::uint64_t gap = 0;
+        if (!high_reader.read_unary(gap)) {
+            return false;
+        }
+        high += gap;
+        if (high >> high_bit_count != 0) {
+            return false;
+        }
+        std::uint64_t rest_high = 0;
+        std::uint64_t rest_low = 0;
+        if (low_bit_count > kWordBitCount) {
+            if (!low_reader.read(kWordBitCount, rest_high) ||
+                    !low_reader.read(low_bit_count - kWordBitCount, rest_low)) {
+                return false;
+            }
+            rest_low <<= 2 * kWordBitCount - low_bit_count;
+        } else if (low_bit_count > 0) {
+            if (!low_reader.read(low_bit_count, rest_high)) {
+                return false;
+            }
+            rest_high <<= kWordBitCount - low_bit_count;
+        }
+        PointWords words;
+        words.high = (high << (kWordBitCount - high_bit_count)) | (rest_high >> high_bit_count);
+        words.low = (rest_high << (kWordBitCount - high_bit_count)) | (rest_low >> high_bit_count);
+        store_point(words, points.point_byte_count(), points.point_data(item_idx));
+    }
+    return true;
+}
+
+}  // namespace
+
+void elias_fano_encode_points(
+        const PointBuffer& sorted_points, std::size_t num_threads, std::vector<std::uint64_t>& encoded) {
+    std::size_t point_count = sorted_points.size();
+    std::size_t point_byte_count = sorted_points.point_byte_count();
+    if (point_byte_count > kECCMaxCompareBytesLen) {
+        throw std::invalid_argument("points are longer than " + std::to_string(kECCMaxCompareBytesLen) + " bytes.");
+    }
+    // About log2(n) high bits leave about two bits per point for unary gaps of uniformly random points.
+    std::size_t high_bit_count = 0;
+    if (point_count != 0) {
+        high_bit_count = std::min(std::max<std::size_t>(ceil_log2(point_count), 1),
+                std::min(kWordBitCount - 1, 8 * point_byte_count));
+    }
+    std::size_t block_count = (point_count + kEliasFanoBlockSize - 1) / kEliasFanoBlockSize;
+    std::vector<std::vector<std::uint64_t>> blocks(block_count);
+    bool all_sorted = true;
+#pragma omp parallel for num_threads(std::max<std::size_t>(num_threads, 1)) reduction(&& : all_sorted)
+    for (std::size_t block_idx = 0; block_idx < block_count; ++block_idx) {
+        std::size_t begin = block_idx * kEliasFanoBlockSize;
+        std::size_t end = std::min(begin + kEliasFanoBlockSize, point_count);
+        if (!encode_block(sorted_points, begin, end, high_bit_count, blocks[block_idx])) {
+            all_sorted = false;
+        }
+    }
+    if (!all_sorted) {
+        throw std::invalid_argument("points are not sorted.");
+    }
+
+    // Block offsets follow the header, so that blocks are decoded independently.
+    encoded.assign({point_count, point_byte_count, high_bit_count, block_count});
+    std::uint64_t offset = 0;
+    encoded.push_back(offset);
+    for (const auto& block : blocks) {
+        offset += block.size();
+        encoded.push_back(offset);
+    }
+    encoded.reserve(encoded.size() + offset);
+    for (auto& block : blocks) {
+        encoded.insert(encoded.end(), block.begin(), block.end());
+        std::vector<std::uint64_t>().swap(block);
+    }
+}
+
+void elias_fano_decode_points(
+        const std::vector<std::uint64_t>& encoded, std::size_t num_threads, PointBuffer& sorted_points) {
+    const std::string malformed = "Elias-Fano encoding is malformed.";
+    if (encoded.size() < kEliasFanoHeaderWordCount) {
+        throw std::invalid_argument(malformed);
+    }
+    std::uint64_t point_count = encoded[0];
+    std::uint64_t point_byte_count = encoded[1];
+    std::uint64_t high_bit_count = encoded[2];
+    std::uint64_t block_count = encoded[3];
+    // Every point takes at least one bit, which bounds the point count before any allocation.
+    if (point_byte_count > kECCMaxCompareBytesLen || point_count > kWordBitCount * encoded.size() ||
+            block_count != (point_count + kEliasFanoBlockSize - 1) / kEliasFanoBlockSize) {
+        throw std::invalid_argument(malformed);
+    }
+    if (point_count != 0 && (high_bit_count == 0 || high_bit_count > kWordBitCount - 1 ||
+                                    high_bit_count > 8 * point_byte_count)) {
+        throw std::invalid_argument(malformed);
+    }
+    std::size_t blocks_begin = kEliasFanoHeaderWordCount + block_count + 1;
+    if (blocks_begin > encoded.size()) {
+        throw std::invalid_argument(malformed);
+    }
+    const std::uint64_t* offsets = encoded.data() + kEliasFanoHeaderWordCount;
+    if (offsets[0] != 0 || offsets[block_count] != encoded.size() - blocks_begin) {
+        throw std::invalid_argument(malformed);
+    }
+    for (std::size_t block_idx = 0; block_idx < block_count; ++block_idx) {
+        if (offsets[block_idx] > offsets[block_idx + 1]) {
+            throw std::invalid_argument(malformed);
+        }
+    }
+
+    sorted_points.resize(static_cast<std::size_t>(point_count), static_cast<std::size_t>(point_byte_count));
+    bool all_valid = true;
+#pragma omp parallel for num_threads(std::max<std::size_t>(num_threads, 1)) reduction(&& : all_valid)
+    for (std::size_t block_idx = 0; block_idx < block_count; ++block_idx) {
+        std::size_t begin = block_idx * kEliasFanoBlockSize;
+        std::size_t end = std::min<std::size_t>(begin + kEliasFanoBlockSize, point_count);
+        if (!decode_block(encoded.data() + blocks_begin + offsets[block_idx],
+                    static_cast<std::size_t>(offsets[block_idx + 1] - offsets[block_idx]), begin, end,
+                    static_cast<std::size_t>(high_bit_count), sorted_points)) {
+            all_valid = false;
+        }
+    }
+    if (!all_valid) {
+        throw std::invalid_argument(malformed);
+    }
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,54 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+
+namespace petace {
+namespace setops {
+
+/**
+ * @brief Encodes sorted points of at most kECCMaxCompareBytesLen bytes with Elias-Fano coding.
+ *
+ * A point is read as a big-endian integer. Its leading bits, as many as ceil(log2(n)) for n points, are coded as unary
+ * gaps to those of the previous point, and its remaining bits are packed as they are. Uniformly random points then
+ * take about two bits more than the remaining bits, which saves about log2(n) - 2 bits per point. Points are coded in
+ * independent blocks in parallel, so that they are also decoded in parallel.
+ *
+ * @param[in] sorted_points The points in lexicographical order of their bytes, such as sorted by radix_sort_points.
+ * @param[in] num_threads The number of threads.
+ * @param[out] encoded The 64-bit words of the encoding in native byte order.
+ * @throws std::invalid_argument if points are longer than kECCMaxCompareBytesLen bytes or not sorted.
+ */
+void elias_fano_encode_points(
+        const PointBuffer& sorted_points, std::size_t num_threads, std::vector<std::uint64_t>& encoded);
+
+/**
+ * @brief Decodes points encoded by elias_fano_encode_points.
+ *
+ * @param[in] encoded The 64-bit words of the encoding.
+ * @param[in] num_threads The number of threads.
+ * @param[out] sorted_points The decoded points, which are sorted and searchable by binary_search_point.
+ * @throws std::invalid_argument if the encoding is malformed.
+ */
+void elias_fano_decode_points(
+        const std::vector<std::uint64_t>& encoded, std::size_t num_threads, PointBuffer& sorted_points);
+
+}  // namespace setops
+}  // namespace petace
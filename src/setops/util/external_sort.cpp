@@ -0,0 +1,216 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/external_sort.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+namespace petace {
+namespace setops {
+
+ScopedFile::ScopedFile(const std::string& path) : path_(path) {
+}
+
+ScopedFile::~ScopedFile() {
+    std::remove(path_.c_str());
+}
+
+RecordWriter::RecordWriter(const std::string& path, std::size_t record_byte_count)
+        : path_(path), record_byte_count_(record_byte_count) {
+    out_.open(path, std::ios::binary | std::ios::trunc);
+    if (!out_.is_open()) {
+        throw std::runtime_error("file " + path + " open failed.");
+    }
+}
+
+void RecordWriter::write(const Byte* records, std::size_t count) {
+    out_.write(reinterpret_cast<const char*>(records), static_cast<std::streamsize>(count * record_byte_count_));
+    if (!out_) {
+        throw std::runtime_error("file " + path_ + " write failed.");
+    }
+    size_ += count;
+}
+
+void RecordWriter::close() {
+    out_.close();
+    if (!out_) {
+        throw std::runtime_error("file " + path_ + " write failed.");
+    }
+}
+
+RecordReader::RecordReader(const std::string& path, std::size_t record_byte_count)
+        : path_(path), record_byte_count_(record_byte_count) {
+    in_.open(path, std::ios::binary | std::ios::ate);
+    if (!in_.is_open()) {
+        throw std::runtime_error("file " + path + " read failed.");
+    }
+    auto byte_count = static_cast<std::size_t>(in_.tellg());
+    if (byte_count % record_byte_count_ != 0) {
+        throw std::runtime_error("file " + path + " is truncated.");
+    }
+    size_ = byte_count / record_byte_count_;
+    in_.seekg(0);
+}
+
+std::size_t RecordReader::read(Byte* records, std::size_t max_count) {
+    max_count = std::min(max_count, size_ - read_count_);
+    in_.read(reinterpret_cast<char*>(records), static_cast<std::streamsize>(max_count * record_byte_count_));
+    auto byte_count = static_cast<std::size_t>(in_.gcount());
+    if (in_.bad() || byte_count % record_byte_count_ != 0) {
+        throw std::runtime_error("file " + path_ + " read failed.");
+    }
+    read_count_ += byte_count / record_byte_count_;
+    return byte_count / record_byte_count_;
+}
+
+std::size_t RecordReader::read(PointBuffer& records, std::size_t max_count) {
+    // Buffers are not grown beyond what is left in the file.
+    max_count = std::min(max_count, size_ - read_count_);
+    records.resize(max_count, record_byte_count_);
+    std::size_t count = read(records.data(), max_count);
+    records.resize(count, record_byte_count_);
+    return count;
+}
+
+RecordCursor::RecordCursor(const std::string& path, std::size_t record_byte_count, std::size_t buffer_record_count)
+        : reader_(path, record_byte_count), buffer_record_count_(std::max<std::size_t>(buffer_record_count, 1)) {
+    reader_.read(buffer_, buffer_record_count_);
+}
+
+void RecordCursor::next() {
+    if (++position_ == buffer_.size()) {
+        reader_.read(buffer_, buffer_record_count_);
+        position_ = 0;
+    }
+}
+
+namespace {
+
+// Every merged run keeps at least this many bytes buffered, so that reads stay large and sequential.
+const std::size_t kMinMergeBufferBytes = std::size_t(1) << 16;
+
+std::string run_path(const std::string& output_path, std::size_t pass, std::size_t run_idx) {
+    return output_path + ".run" + std::to_string(pass) + "_" + std::to_string(run_idx);
+}
+
+void rename_file(const std::string& from, const std::string& to) {
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+        throw std::runtime_error("file " + from + " rename failed.");
+    }
+}
+
+void merge_runs(const std::vector<std::unique_ptr<ScopedFile>>& runs, std::size_t begin, std::size_t end,
+        const std::string& output_path, std::size_t record_byte_count, std::size_t buffer_record_count) {
+    std::vector<std::unique_ptr<RecordCursor>> cursors;
+    for (std::size_t run_idx = begin; run_idx < end; ++run_idx) {
+        cursors.emplace_back(
+                std::make_unique<RecordCursor>(runs[run_idx]->path(), record_byte_count, buffer_record_count));
+    }
+    auto greater = [&cursors, record_byte_count](std::size_t lhs, std::size_t rhs) {
+        return std::memcmp(cursors[lhs]->current(), cursors[rhs]->current(), record_byte_count) > 0;
+    };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(greater)> heap(greater);
+    for (std::size_t cursor_idx = 0; cursor_idx < cursors.size(); ++cursor_idx) {
+        if (cursors[cursor_idx]->valid()) {
+            heap.push(cursor_idx);
+        }
+    }
+
+    std::size_t record_count = 0;
+    for (const auto& cursor : cursors) {
+        record_count += cursor->size();
+    }
+    buffer_record_count = std::max<std::size_t>(std::min(buffer_record_count, record_count), 1);
+    RecordWriter writer(output_path, record_byte_count);
+    PointBuffer output_buffer(buffer_record_count, record_byte_count);
+    std::size_t output_count = 0;
+    while (!heap.empty()) {
+        std::size_t cursor_idx = heap.top();
+        heap.pop();
+        std::memcpy(output_buffer.point_data(output_count++), cursors[cursor_idx]->current(), record_byte_count);
+        if (output_count == buffer_record_count) {
+            writer.write(output_buffer.data(), output_count);
+            output_count = 0;
+        }
+        cursors[cursor_idx]->next();
+        if (cursors[cursor_idx]->valid()) {
+            heap.push(cursor_idx);
+        }
+    }
+    writer.write(output_buffer.data(), output_count);
+    writer.close();
+}
+
+}  // namespace
+
+void external_sort(const std::string& input_path, const std::string& output_path, std::size_t record_byte_count,
+        std::size_t memory_limit_bytes) {
+    if (record_byte_count == 0) {
+        throw std::invalid_argument("record_byte_count is 0.");
+    }
+    // sort_points keeps a run, its sorted copy and an index per record in memory.
+    std::size_t run_record_count = memory_limit_bytes / (2 * record_byte_count + sizeof(std::size_t));
+    if (run_record_count < 2) {
+        throw std::invalid_argument("memory_limit_bytes is too small.");
+    }
+
+    std::vector<std::unique_ptr<ScopedFile>> runs;
+    {
+        RecordReader reader(input_path, record_byte_count);
+        PointBuffer run;
+        while (reader.read(run, run_record_count) != 0) {
+            sort_points(run);
+            runs.emplace_back(std::make_unique<ScopedFile>(run_path(output_path, 0, runs.size())));
+            RecordWriter writer(runs.back()->path(), record_byte_count);
+            writer.write(run);
+            writer.close();
+        }
+    }
+    if (runs.empty()) {
+        RecordWriter(output_path, record_byte_count).close();
+        return;
+    }
+
+    std::size_t max_fan_in = std::max<std::size_t>(memory_limit_bytes / kMinMergeBufferBytes, 3) - 1;
+    for (std::size_t pass = 1; runs.size() > 1; ++pass) {
+        std::size_t fan_in = std::min(max_fan_in, runs.size());
+        // Every merged run and the output get an equal share of memory.
+        std::size_t buffer_record_count = memory_limit_bytes / ((fan_in + 1) * record_byte_count);
+        std::vector<std::unique_ptr<ScopedFile>> merged_runs;
+        for (std::size_t begin = 0; begin < runs.size(); begin += fan_in) {
+            std::size_t end = std::min(begin + fan_in, runs.size());
+            merged_runs.emplace_back(std::make_unique<ScopedFile>(run_path(output_path, pass, merged_runs.size())));
+            if (end - begin == 1) {
+                rename_file(runs[begin]->path(), merged_runs.back()->path());
+            } else {
+                merge_runs(runs, begin, end, merged_runs.back()->path(), record_byte_count, buffer_record_count);
+            }
+            // Merged runs are removed right away to bound disk usage.
+            for (std::size_t run_idx = begin; run_idx < end; ++run_idx) {
+                runs[run_idx].reset();
+            }
+        }
+        runs.swap(merged_runs);
+    }
+    rename_file(runs.front()->path(), output_path);
+}
+
+}  // namespace setops
+}  // namespace petace
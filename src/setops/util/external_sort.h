@@ -0,0 +1,207 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <fstream>
+#include <string>
+
+#include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+
+namespace petace {
+namespace setops {
+
+/**
+ * @brief Owns a temporary file path and removes the file on destruction.
+ */
+class ScopedFile {
+public:
+    explicit ScopedFile(const std::string& path);
+
+    ~ScopedFile();
+
+    const std::string& path() const {
+        return path_;
+    }
+
+private:
+    ScopedFile(const ScopedFile& copy) = delete;
+
+    ScopedFile& operator=(const ScopedFile& assign) = delete;
+
+    std::string path_;
+};
+
+/**
+ * @brief Appends fixed-length records to a binary file.
+ */
+class RecordWriter {
+public:
+    /**
+     * @brief Creates or truncates the file.
+     *
+     * @param[in] path The file path.
+     * @param[in] record_byte_count The number of bytes of every record.
+     * @throws std::runtime_error if the file cannot be opened.
+     */
+    RecordWriter(const std::string& path, std::size_t record_byte_count);
+
+    /**
+     * @brief Appends records.
+     *
+     * @param[in] records The bytes of records stored back to back.
+     * @param[in] count The number of records.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void write(const Byte* records, std::size_t count);
+
+    /**
+     * @brief Appends all points of a buffer whose point length is the record length.
+     */
+    void write(const PointBuffer& records) {
+        write(records.data(), records.size());
+    }
+
+    /**
+     * @brief Flushes and closes the file.
+     *
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    void close();
+
+    /**
+     * @brief Returns the number of records written.
+     */
+    std::size_t size() const {
+        return size_;
+    }
+
+private:
+    std::string path_;
+    std::size_t record_byte_count_ = 0;
+    std::size_t size_ = 0;
+    std::ofstream out_;
+};
+
+/**
+ * @brief Reads fixed-length records from a binary file in order.
+ */
+class RecordReader {
+public:
+    /**
+     * @brief Opens the file.
+     *
+     * @param[in] path The file path.
+     * @param[in] record_byte_count The number of bytes of every record.
+     * @throws std::runtime_error if the file cannot be opened.
+     */
+    RecordReader(const std::string& path, std::size_t record_byte_count);
+
+    /**
+     * @brief Reads up to max_count records.
+     *
+     * @param[out] records The bytes of read records stored back to back.
+     * @param[in] max_count The maximum number of records to read.
+     * @return The number of records read, which is less than max_count only at the end of the file.
+     */
+    std::size_t read(Byte* records, std::size_t max_count);
+
+    /**
+     * @brief Reads up to max_count records into a buffer whose point length is the record length.
+     *
+     * @return The number of records read, which is also the new size of records.
+     */
+    std::size_t read(PointBuffer& records, std::size_t max_count);
+
+    /**
+     * @brief Returns the number of records in the file.
+     */
+    std::size_t size() const {
+        return size_;
+    }
+
+private:
+    std::string path_;
+    std::size_t record_byte_count_ = 0;
+    std::size_t size_ = 0;
+    std::size_t read_count_ = 0;
+    std::ifstream in_;
+};
+
+/**
+ * @brief Iterates records of a file one by one through a fixed-size read buffer.
+ */
+class RecordCursor {
+public:
+    /**
+     * @brief Opens the file and moves to the first record.
+     *
+     * @param[in] path The file path.
+     * @param[in] record_byte_count The number of bytes of every record.
+     * @param[in] buffer_record_count The number of records buffered in memory.
+     */
+    RecordCursor(const std::string& path, std::size_t record_byte_count, std::size_t buffer_record_count);
+
+    /**
+     * @brief Returns whether the cursor points to a record.
+     */
+    bool valid() const {
+        return position_ < buffer_.size();
+    }
+
+    /**
+     * @brief Returns the bytes of the current record.
+     */
+    const Byte* current() const {
+        return buffer_.point_data(position_);
+    }
+
+    /**
+     * @brief Moves to the next record.
+     */
+    void next();
+
+    /**
+     * @brief Returns the number of records in the file.
+     */
+    std::size_t size() const {
+        return reader_.size();
+    }
+
+private:
+    RecordReader reader_;
+    std::size_t buffer_record_count_ = 0;
+    PointBuffer buffer_{};
+    std::size_t position_ = 0;
+};
+
+/**
+ * @brief Sorts fixed-length records of a file in lexicographical order of their bytes with bounded memory.
+ *
+ * Records are cut into runs that fit in memory, every run is sorted and spilled to a file next to output_path, then
+ * runs are merged in as many passes as memory_limit_bytes requires.
+ *
+ * @param[in] input_path The file of records to sort.
+ * @param[in] output_path The file to store sorted records, which may be the same as input_path.
+ * @param[in] record_byte_count The number of bytes of every record.
+ * @param[in] memory_limit_bytes The approximate limit of memory used by sorting.
+ * @throws std::invalid_argument if memory_limit_bytes cannot hold a few records.
+ * @throws std::runtime_error if any file cannot be read or written.
+ */
+void external_sort(const std::string& input_path, const std::string& output_path, std::size_t record_byte_count,
+        std::size_t memory_limit_bytes);
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,239 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/hash_join.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+// About 8K build entries per partition, so that a partition and its hash table stay in L2 cache.
+const std::size_t kPartitionEntriesLog2 = 13;
+const std::size_t kMaxPartitionBits = 16;
+
+struct PackedTag {
+    std::uint64_t lo;
+    std::uint64_t hi;
+};
+
+inline bool operator==(const PackedTag& lhs, const PackedTag& rhs) {
+    return lhs.lo == rhs.lo && lhs.hi == rhs.hi;
+}
+
+struct ProbeEntry {
+    PackedTag tag;
+    std::size_t index;
+};
+
+inline PackedTag pack_tag(ConstByteSpan bytes) {
+    PackedTag tag{0, 0};
+    std::memcpy(&tag, bytes.data(), bytes.size());
+    return tag;
+}
+
+// Tags are outputs of the ECDH cipher and thus already look uniform, a cheap mixer is enough to spread both words.
+inline std::uint64_t tag_hash(const PackedTag& tag) {
+    std::uint64_t x = tag.lo ^ (tag.hi * 0x9e3779b97f4a7c15ULL);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline const PackedTag& entry_tag(const PackedTag& entry) {
+    return entry;
+}
+
+inline const PackedTag& entry_tag(const ProbeEntry& entry) {
+    return entry.tag;
+}
+
+inline std::size_t partition_of(const PackedTag& tag, std::size_t partition_bits) {
+    return partition_bits == 0 ? 0 : static_cast<std::size_t>(tag_hash(tag) >> (64 - partition_bits));
+}
+
+std::size_t choose_partition_bits(std::size_t build_size, std::size_t num_threads) {
+    std::size_t bits = 0;
+    while (bits < kMaxPartitionBits && (build_size >> (bits + kPartitionEntriesLog2)) > 0) {
+        ++bits;
+    }
+    // Large inputs get enough partitions to balance threads.
+    if (build_size >> kPartitionEntriesLog2 > 0) {
+        while (bits < kMaxPartitionBits && (std::size_t(1) << bits) < 4 * num_threads) {
+            ++bits;
+        }
+    }
+    return bits;
+}
+
+// Scatters make_entry(0), ..., make_entry(size - 1) into partitions.
+// Entries of partition p are stored in entries[offsets[p], offsets[p + 1]).
+template <typename Entry, typename MakeEntry>
+void scatter(std::size_t size, std::size_t partition_bits, std::size_t num_threads, MakeEntry make_entry,
+        std::vector<Entry>& entries, std::vector<std::size_t>& offsets) {
+    std::size_t num_partitions = std::size_t(1) << partition_bits;
+    std::vector<std::vector<std::size_t>> histograms(num_threads, std::vector<std::size_t>(num_partitions, 0));
+    entries.resize(size);
+    offsets.assign(num_partitions + 1, 0);
+
+#pragma omp parallel num_threads(num_threads)
+    {
+        std::size_t team_size = omp_get_num_threads();
+        std::size_t thread_idx = omp_get_thread_num();
+        std::size_t begin = size * thread_idx / team_size;
+        std::size_t end = size * (thread_idx + 1) / team_size;
+        auto& histogram = histograms[thread_idx];
+        for (std::size_t item_idx = begin; item_idx < end; ++item_idx) {
+            ++histogram[partition_of(entry_tag(make_entry(item_idx)), partition_bits)];
+        }
+
+#pragma omp barrier
+#pragma omp single
+        {
+            std::size_t offset = 0;
+            for (std::size_t partition_idx = 0; partition_idx < num_partitions; ++partition_idx) {
+                offsets[partition_idx] = offset;
+                for (std::size_t idx = 0; idx < team_size; ++idx) {
+                    std::size_t count = histograms[idx][partition_idx];
+                    histograms[idx][partition_idx] = offset;
+                    offset += count;
+                }
+            }
+            offsets[num_partitions] = offset;
+        }
+
+        for (std::size_t item_idx = begin; item_idx < end; ++item_idx) {
+            Entry entry = make_entry(item_idx);
+            entries[histogram[partition_of(entry_tag(entry), partition_bits)]++] = entry;
+        }
+    }
+}
+
+// Builds a hash table per partition on build entries and calls on_match(thread_idx, probe_index) for every probe
+// entry found in the table.
+template <typename OnMatch>
+void join_partitions(const std::vector<PackedTag>& build_entries, const std::vector<std::size_t>& build_offsets,
+        const std::vector<ProbeEntry>& probe_entries, const std::vector<std::size_t>& probe_offsets,
+        std::size_t num_threads, OnMatch on_match) {
+    std::size_t num_partitions = build_offsets.size() - 1;
+#pragma omp parallel num_threads(num_threads)
+    {
+        std::size_t thread_idx = omp_get_thread_num();
+        // Slot stores the position of a build entry inside its partition plus one, zero marks an empty slot.
+        std::vector<std::uint32_t> slots;
+#pragma omp for schedule(dynamic)
+        for (std::size_t partition_idx = 0; partition_idx < num_partitions; ++partition_idx) {
+            std::size_t build_begin = build_offsets[partition_idx];
+            std::size_t build_count = build_offsets[partition_idx + 1] - build_begin;
+            std::size_t probe_begin = probe_offsets[partition_idx];
+            std::size_t probe_end = probe_offsets[partition_idx + 1];
+            if (build_count == 0 || probe_begin == probe_end) {
+                continue;
+            }
+            std::size_t capacity = 1;
+            while (capacity < 2 * build_count) {
+                capacity <<= 1;
+            }
+            std::size_t mask = capacity - 1;
+            slots.assign(capacity, 0);
+            for (std::size_t entry_idx = 0; entry_idx < build_count; ++entry_idx) {
+                std::size_t slot = tag_hash(build_entries[build_begin + entry_idx]) & mask;
+                while (slots[slot] != 0) {
+                    slot = (slot + 1) & mask;
+                }
+                slots[slot] = static_cast<std::uint32_t>(entry_idx + 1);
+            }
+            for (std::size_t probe_idx = probe_begin; probe_idx < probe_end; ++probe_idx) {
+                const ProbeEntry& probe = probe_entries[probe_idx];
+                std::size_t slot = tag_hash(probe.tag) & mask;
+                while (slots[slot] != 0) {
+                    if (build_entries[build_begin + slots[slot] - 1] == probe.tag) {
+                        on_match(thread_idx, probe.index);
+                        break;
+                    }
+                    slot = (slot + 1) & mask;
+                }
+            }
+        }
+    }
+}
+
+void check_tags(const PointBuffer& build_tags, const PointBuffer& probe_tags) {
+    if (build_tags.point_byte_count() > kHashJoinMaxTagBytesLen) {
+        throw std::invalid_argument("tag is too long to be joined.");
+    }
+    if (build_tags.point_byte_count() != probe_tags.point_byte_count()) {
+        throw std::invalid_argument("tags of different lengths cannot be joined.");
+    }
+}
+
+template <typename OnMatch>
+void hash_join_impl(
+        const PointBuffer& build_tags, const PointBuffer& probe_tags, std::size_t num_threads, OnMatch on_match) {
+    check_tags(build_tags, probe_tags);
+    num_threads = std::max<std::size_t>(num_threads, 1);
+    std::size_t partition_bits = choose_partition_bits(build_tags.size(), num_threads);
+
+    std::vector<PackedTag> build_entries;
+    std::vector<std::size_t> build_offsets;
+    scatter(
+            build_tags.size(), partition_bits, num_threads,
+            [&build_tags](std::size_t idx) { return pack_tag(build_tags[idx]); }, build_entries, build_offsets);
+
+    std::vector<ProbeEntry> probe_entries;
+    std::vector<std::size_t> probe_offsets;
+    scatter(
+            probe_tags.size(), partition_bits, num_threads,
+            [&probe_tags](std::size_t idx) { return ProbeEntry{pack_tag(probe_tags[idx]), idx}; }, probe_entries,
+            probe_offsets);
+
+    join_partitions(build_entries, build_offsets, probe_entries, probe_offsets, num_threads, on_match);
+}
+
+}  // namespace
+
+void hash_join(const PointBuffer& build_tags, const PointBuffer& probe_tags, std::size_t num_threads,
+        std::vector<std::uint8_t>& matched) {
+    matched.assign(probe_tags.size(), 0);
+    if (build_tags.empty() || probe_tags.empty()) {
+        return;
+    }
+    hash_join_impl(build_tags, probe_tags, num_threads,
+            [&matched](std::size_t /*thread_idx*/, std::size_t probe_index) { matched[probe_index] = 1; });
+}
+
+std::size_t hash_join_count(const PointBuffer& build_tags, const PointBuffer& probe_tags, std::size_t num_threads) {
+    if (build_tags.empty() || probe_tags.empty()) {
+        return 0;
+    }
+    num_threads = std::max<std::size_t>(num_threads, 1);
+    std::vector<std::size_t> counts(num_threads, 0);
+    hash_join_impl(build_tags, probe_tags, num_threads,
+            [&counts](std::size_t thread_idx, std::size_t /*probe_index*/) { ++counts[thread_idx]; });
+    std::size_t count = 0;
+    for (auto thread_count : counts) {
+        count += thread_count;
+    }
+    return count;
+}
+
+}  // namespace setops
+}  // namespace petace
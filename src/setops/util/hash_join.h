@@ -0,0 +1,56 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+
+namespace petace {
+namespace setops {
+
+// The maximum byte length of a tag that can be joined.
+const std::size_t kHashJoinMaxTagBytesLen = 16;
+
+/**
+ * @brief Marks which probe tags also appear in build tags with a partitioned, multi-threaded hash join.
+ *
+ * Both sides are scattered by the high bits of the tags' hash into cache-sized partitions, then every partition is
+ * built into a small open-addressing hash table and probed independently in parallel.
+ *
+ * @param[in] build_tags The tags to build hash tables on, usually the larger side.
+ * @param[in] probe_tags The tags to look up in hash tables.
+ * @param[in] num_threads The number of threads.
+ * @param[out] matched A flag per probe tag, set to 1 if the probe tag appears in build tags and 0 otherwise.
+ * @throws std::invalid_argument if tags are longer than kHashJoinMaxTagBytesLen or of different lengths on both sides.
+ */
+void hash_join(const PointBuffer& build_tags, const PointBuffer& probe_tags, std::size_t num_threads,
+        std::vector<std::uint8_t>& matched);
+
+/**
+ * @brief Counts the probe tags that also appear in build tags with a partitioned, multi-threaded hash join.
+ *
+ * @param[in] build_tags The tags to build hash tables on, usually the larger side.
+ * @param[in] probe_tags The tags to look up in hash tables.
+ * @param[in] num_threads The number of threads.
+ * @return The number of probe tags that appear in build tags.
+ * @throws std::invalid_argument if tags are longer than kHashJoinMaxTagBytesLen or of different lengths on both sides.
+ */
+std::size_t hash_join_count(const PointBuffer& build_tags, const PointBuffer& probe_tags, std::size_t num_threads);
+
+}  // namespace setops
+}  // namespace petace
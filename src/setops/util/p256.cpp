@@ -0,0 +1,406 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/p256.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "solo/hash.h"
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+using uint128_t = unsigned __int128;
+
+// The byte length of a field element and of a SHA-256 digest.
+const std::size_t kFieldBytesLen = 32;
+// The byte length of uniform bytes that are reduced to a field element, which is L in RFC 9380.
+const std::size_t kHashToFieldBytesLen = 48;
+// The byte length of a SHA-256 input block.
+const std::size_t kSha256BlockBytesLen = 64;
+// The leading byte of an uncompressed point.
+const Byte kUncompressedPointTag = 0x04;
+
+// An element of GF(p) for p = 2^256 - 2^224 + 2^192 + 2^96 - 1 in Montgomery form a * 2^256 mod p.
+// Limbs are little-endian and always fully reduced.
+struct Fe {
+    std::uint64_t v[4];
+};
+
+// A point in homogeneous projective coordinates (X : Y : Z), where x = X / Z and y = Y / Z.
+struct Ge {
+    Fe x;
+    Fe y;
+    Fe z;
+};
+
+const Fe kP = {{0xffffffffffffffff, 0x00000000ffffffff, 0x0000000000000000, 0xffffffff00000001}};
+const Fe kZero = {{0, 0, 0, 0}};
+// Constants below are in Montgomery form.
+const Fe kOne = {{0x0000000000000001, 0xffffffff00000000, 0xffffffffffffffff, 0x00000000fffffffe}};
+const Fe kR2 = {{0x0000000000000003, 0xfffffffbffffffff, 0xfffffffffffffffe, 0x00000004fffffffd}};
+const Fe kA = {{0xfffffffffffffffc, 0x00000003ffffffff, 0x0000000000000000, 0xfffffffc00000004}};
+const Fe kB = {{0xd89cdf6229c4bddf, 0xacf005cd78843090, 0xe5a220abf7212ed6, 0xdc30061d04874834}};
+// Z = -10 of the simplified SWU map for P-256 and a square root of -Z.
+const Fe kZ = {{0xfffffffffffffff5, 0x0000000affffffff, 0x0000000000000000, 0xfffffff50000000b}};
+const Fe kSqrtMinusZ = {{0xa1fd38ee98a195fd, 0x78400ad7423dcf70, 0x6913c88f9ea8dfee, 0x9051d26e12a8f304}};
+
+// Subtracts p from top * 2^256 + (t3, t2, t1, t0) if the value is at least p, which holds for any value below 2p.
+// Limbs are handled one by one, since compilers do not unroll loops of 128-bit borrows well.
+Fe fe_reduce_once(std::uint64_t t0, std::uint64_t t1, std::uint64_t t2, std::uint64_t t3, std::uint64_t top) {
+    Fe r;
+    uint128_t diff = uint128_t(t0) - kP.v[0];
+    r.v[0] = static_cast<std::uint64_t>(diff);
+    diff = uint128_t(t1) - kP.v[1] - (static_cast<std::uint64_t>(diff >> 64) & 1);
+    r.v[1] = static_cast<std::uint64_t>(diff);
+    diff = uint128_t(t2) - (static_cast<std::uint64_t>(diff >> 64) & 1);
+    r.v[2] = static_cast<std::uint64_t>(diff);
+    diff = uint128_t(t3) - kP.v[3] - (static_cast<std::uint64_t>(diff >> 64) & 1);
+    r.v[3] = static_cast<std::uint64_t>(diff);
+    std::uint64_t borrow = static_cast<std::uint64_t>(diff >> 64) & 1;
+    std::uint64_t keep_mask = 0 - (borrow & (top ^ 1));
+    r.v[0] ^= keep_mask & (r.v[0] ^ t0);
+    r.v[1] ^= keep_mask & (r.v[1] ^ t1);
+    r.v[2] ^= keep_mask & (r.v[2] ^ t2);
+    r.v[3] ^= keep_mask & (r.v[3] ^ t3);
+    return r;
+}
+
+// Interleaves schoolbook multiplication with Montgomery reduction, which returns a * b / 2^256 mod p.
+// Since p = -1 mod 2^64, the multiple of p to add at each step is just the lowest limb m, and adding m * p shifts the
+// sum down by one limb with m * 2^32 added to the new lowest limb.
+Fe fe_mul(const Fe& a, const Fe& b) {
+    std::uint64_t t0 = 0;
+    std::uint64_t t1 = 0;
+    std::uint64_t t2 = 0;
+    std::uint64_t t3 = 0;
+    std::uint64_t t4 = 0;
+    for (std::size_t idx = 0; idx < 4; ++idx) {
+        std::uint64_t b_limb = b.v[idx];
+        uint128_t carry = uint128_t(a.v[0]) * b_limb + t0;
+        t0 = static_cast<std::uint64_t>(carry);
+        carry = (carry >> 64) + uint128_t(a.v[1]) * b_limb + t1;
+        t1 = static_cast<std::uint64_t>(carry);
+        carry = (carry >> 64) + uint128_t(a.v[2]) * b_limb + t2;
+        t2 = static_cast<std::uint64_t>(carry);
+        carry = (carry >> 64) + uint128_t(a.v[3]) * b_limb + t3;
+        t3 = static_cast<std::uint64_t>(carry);
+        carry = (carry >> 64) + t4;
+        t4 = static_cast<std::uint64_t>(carry);
+        std::uint64_t t5 = static_cast<std::uint64_t>(carry >> 64);
+
+        std::uint64_t m = t0;
+        carry = uint128_t(t1) + (uint128_t(m) << 32);
+        t0 = static_cast<std::uint64_t>(carry);
+        carry = (carry >> 64) + t2;
+        t1 = static_cast<std::uint64_t>(carry);
+        carry = (carry >> 64) + uint128_t(m) * kP.v[3] + t3;
+        t2 = static_cast<std::uint64_t>(carry);
+        carry = (carry >> 64) + t4;
+        t3 = static_cast<std::uint64_t>(carry);
+        t4 = t5 + static_cast<std::uint64_t>(carry >> 64);
+    }
+    return fe_reduce_once(t0, t1, t2, t3, t4);
+}
+
+// A dedicated squaring is not faster than the interleaved multiplication.
+Fe fe_sq(const Fe& a) {
+    return fe_mul(a, a);
+}
+
+Fe fe_sq_times(Fe a, std::size_t count) {
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        a = fe_sq(a);
+    }
+    return a;
+}
+
+Fe fe_add(const Fe& a, const Fe& b) {
+    uint128_t carry = uint128_t(a.v[0]) + b.v[0];
+    std::uint64_t t0 = static_cast<std::uint64_t>(carry);
+    carry = (carry >> 64) + a.v[1] + b.v[1];
+    std::uint64_t t1 = static_cast<std::uint64_t>(carry);
+    carry = (carry >> 64) + a.v[2] + b.v[2];
+    std::uint64_t t2 = static_cast<std::uint64_t>(carry);
+    carry = (carry >> 64) + a.v[3] + b.v[3];
+    std::uint64_t t3 = static_cast<std::uint64_t>(carry);
+    return fe_reduce_once(t0, t1, t2, t3, static_cast<std::uint64_t>(carry >> 64));
+}
+
+Fe fe_sub(const Fe& a, const Fe& b) {
+    Fe r;
+    uint128_t diff = uint128_t(a.v[0]) - b.v[0];
+    r.v[0] = static_cast<std::uint64_t>(diff);
+    diff = uint128_t(a.v[1]) - b.v[1] - (static_cast<std::uint64_t>(diff >> 64) & 1);
+    r.v[1] = static_cast<std::uint64_t>(diff);
+    diff = uint128_t(a.v[2]) - b.v[2] - (static_cast<std::uint64_t>(diff >> 64) & 1);
+    r.v[2] = static_cast<std::uint64_t>(diff);
+    diff = uint128_t(a.v[3]) - b.v[3] - (static_cast<std::uint64_t>(diff >> 64) & 1);
+    r.v[3] = static_cast<std::uint64_t>(diff);
+    // Adds p back if the difference is negative.
+    std::uint64_t add_mask = 0 - (static_cast<std::uint64_t>(diff >> 64) & 1);
+    uint128_t carry = uint128_t(r.v[0]) + (kP.v[0] & add_mask);
+    r.v[0] = static_cast<std::uint64_t>(carry);
+    carry = (carry >> 64) + r.v[1] + (kP.v[1] & add_mask);
+    r.v[1] = static_cast<std::uint64_t>(carry);
+    carry = (carry >> 64) + r.v[2];
+    r.v[2] = static_cast<std::uint64_t>(carry);
+    carry = (carry >> 64) + r.v[3] + (kP.v[3] & add_mask);
+    r.v[3] = static_cast<std::uint64_t>(carry);
+    return r;
+}
+
+Fe fe_neg(const Fe& a) {
+    return fe_sub(kZero, a);
+}
+
+std::uint64_t fe_is_zero(const Fe& a) {
+    std::uint64_t acc = a.v[0] | a.v[1] | a.v[2] | a.v[3];
+    return ((acc | (0 - acc)) >> 63) ^ 1;
+}
+
+std::uint64_t fe_equal(const Fe& a, const Fe& b) {
+    return fe_is_zero(fe_sub(a, b));
+}
+
+// Sets a to b if flag is 1 and keeps a if flag is 0, in constant time.
+void fe_cmov(Fe& a, const Fe& b, std::uint64_t flag) {
+    std::uint64_t mask = 0 - flag;
+    for (std::size_t idx = 0; idx < 4; ++idx) {
+        a.v[idx] ^= mask & (a.v[idx] ^ b.v[idx]);
+    }
+}
+
+// Converts out of Montgomery form.
+Fe fe_to_canonical(const Fe& a) {
+    return fe_mul(a, Fe{{1, 0, 0, 0}});
+}
+
+// The sign of RFC 9380, which is the parity of the canonical value.
+std::uint64_t fe_sgn0(const Fe& a) {
+    return fe_to_canonical(a).v[0] & 1;
+}
+
+// Returns a^((p - 3) / 4) = a^(2^254 - 2^222 + 2^190 + 2^94 - 1).
+Fe fe_pow_p34(const Fe& a) {
+    Fe a_2_0 = fe_mul(fe_sq(a), a);
+    Fe a_4_0 = fe_mul(fe_sq_times(a_2_0, 2), a_2_0);
+    Fe a_8_0 = fe_mul(fe_sq_times(a_4_0, 4), a_4_0);
+    Fe a_16_0 = fe_mul(fe_sq_times(a_8_0, 8), a_8_0);
+    Fe a_32_0 = fe_mul(fe_sq_times(a_16_0, 16), a_16_0);
+    Fe a_64_32 = fe_sq_times(a_32_0, 32);
+    Fe a_64_0 = fe_mul(a_64_32, a_32_0);
+    Fe a_80_0 = fe_mul(fe_sq_times(a_64_0, 16), a_16_0);
+    Fe a_88_0 = fe_mul(fe_sq_times(a_80_0, 8), a_8_0);
+    Fe a_92_0 = fe_mul(fe_sq_times(a_88_0, 4), a_4_0);
+    Fe a_94_0 = fe_mul(fe_sq_times(a_92_0, 2), a_2_0);
+    return fe_mul(fe_sq_times(fe_mul(a_64_32, a), 190), a_94_0);
+}
+
+// Returns a^(p - 2), which is the inverse of a nonzero a and zero otherwise.
+Fe fe_invert(const Fe& a) {
+    return fe_mul(fe_sq_times(fe_pow_p34(a), 2), a);
+}
+
+// Computes a square root of u / v if u / v is square, and of Z * u / v otherwise, as in RFC 9380, appendix F.2.1.2.
+// Returns 1 if u / v is square and 0 otherwise.
+std::uint64_t fe_sqrt_ratio(const Fe& u, const Fe& v, Fe& r) {
+    Fe uv = fe_mul(u, v);
+    Fe y1 = fe_mul(fe_pow_p34(fe_mul(fe_sq(v), uv)), uv);
+    Fe y2 = fe_mul(y1, kSqrtMinusZ);
+    std::uint64_t is_square = fe_equal(fe_mul(fe_sq(y1), v), u);
+    r = y2;
+    fe_cmov(r, y1, is_square);
+    return is_square;
+}
+
+// Loads 32 big-endian bytes, which may exceed p, and reduces them into canonical limbs.
+Fe fe_load_be(const Byte* bytes) {
+    std::uint64_t t[4];
+    for (std::size_t word_idx = 0; word_idx < 4; ++word_idx) {
+        t[word_idx] = 0;
+        for (std::size_t byte_idx = 0; byte_idx < 8; ++byte_idx) {
+            t[word_idx] |= std::uint64_t(bytes[kFieldBytesLen - 1 - word_idx * 8 - byte_idx]) << (8 * byte_idx);
+        }
+    }
+    return fe_reduce_once(t[0], t[1], t[2], t[3], 0);
+}
+
+// Stores the canonical value of a in 32 big-endian bytes.
+void fe_to_bytes(const Fe& a, Byte* bytes) {
+    Fe canonical = fe_to_canonical(a);
+    for (std::size_t word_idx = 0; word_idx < 4; ++word_idx) {
+        for (std::size_t byte_idx = 0; byte_idx < 8; ++byte_idx) {
+            bytes[kFieldBytesLen - 1 - word_idx * 8 - byte_idx] =
+                    static_cast<Byte>(canonical.v[word_idx] >> (8 * byte_idx));
+        }
+    }
+}
+
+// Reduces kHashToFieldBytesLen big-endian bytes modulo p into Montgomery form.
+Fe fe_from_uniform_bytes(const Byte* bytes) {
+    const std::size_t high_bytes_len = kHashToFieldBytesLen - kFieldBytesLen;
+    Byte high[kFieldBytesLen] = {0};
+    std::copy_n(bytes, high_bytes_len, high + kFieldBytesLen - high_bytes_len);
+    // high * 2^256 + low in Montgomery form is high * R^2 + low * R.
+    Fe high_r = fe_mul(fe_load_be(high), kR2);
+    Fe low_r = fe_mul(fe_load_be(bytes + high_bytes_len), kR2);
+    return fe_add(fe_mul(high_r, kR2), low_r);
+}
+
+// The simplified SWU map of RFC 9380, appendix F.2, without the final division of x.
+Ge ge_map_to_curve(const Fe& u) {
+    Fe tv1 = fe_mul(kZ, fe_sq(u));
+    Fe tv2 = fe_add(fe_sq(tv1), tv1);
+    Fe tv3 = fe_mul(kB, fe_add(tv2, kOne));
+    Fe tv4 = kZ;
+    fe_cmov(tv4, fe_neg(tv2), fe_is_zero(tv2) ^ 1);
+    tv4 = fe_mul(kA, tv4);
+    Fe tv6 = fe_sq(tv4);
+    Fe gx_num = fe_mul(fe_add(fe_sq(tv3), fe_mul(kA, tv6)), tv3);
+    tv6 = fe_mul(tv6, tv4);
+    gx_num = fe_add(gx_num, fe_mul(kB, tv6));
+    Fe x = fe_mul(tv1, tv3);
+    Fe y1;
+    std::uint64_t is_gx1_square = fe_sqrt_ratio(gx_num, tv6, y1);
+    Fe y = fe_mul(fe_mul(tv1, u), y1);
+    fe_cmov(x, tv3, is_gx1_square);
+    fe_cmov(y, y1, is_gx1_square);
+    fe_cmov(y, fe_neg(y), fe_sgn0(u) ^ fe_sgn0(y));
+    return Ge{x, fe_mul(y, tv4), tv4};
+}
+
+// The complete addition for a = -3 (Renes, Costello and Batina, 2016, algorithm 4).
+Ge ge_add(const Ge& p, const Ge& q) {
+    Fe t0 = fe_mul(p.x, q.x);
+    Fe t1 = fe_mul(p.y, q.y);
+    Fe t2 = fe_mul(p.z, q.z);
+    Fe t3 = fe_sub(fe_mul(fe_add(p.x, p.y), fe_add(q.x, q.y)), fe_add(t0, t1));
+    Fe t4 = fe_sub(fe_mul(fe_add(p.y, p.z), fe_add(q.y, q.z)), fe_add(t1, t2));
+    Fe y3 = fe_sub(fe_mul(fe_add(p.x, p.z), fe_add(q.x, q.z)), fe_add(t0, t2));
+    Fe x3 = fe_sub(y3, fe_mul(kB, t2));
+    x3 = fe_add(fe_add(x3, x3), x3);
+    Fe z3 = fe_sub(t1, x3);
+    x3 = fe_add(t1, x3);
+    Fe t2_3 = fe_add(fe_add(t2, t2), t2);
+    y3 = fe_sub(fe_sub(fe_mul(kB, y3), t2_3), t0);
+    y3 = fe_add(fe_add(y3, y3), y3);
+    t0 = fe_sub(fe_add(fe_add(t0, t0), t0), t2_3);
+    Ge r;
+    r.x = fe_sub(fe_mul(t3, x3), fe_mul(t4, y3));
+    r.y = fe_add(fe_mul(x3, z3), fe_mul(t0, y3));
+    r.z = fe_add(fe_mul(t4, z3), fe_mul(t3, t0));
+    return r;
+}
+
+// Computes expand_message_xmd of RFC 9380 with SHA-256 for two field elements, reusing buffer across messages.
+void expand_message(const petace::solo::Hash& hash, const std::string& message, const ByteVector& dst_prime,
+        ByteVector& buffer, Byte* uniform_bytes) {
+    const std::size_t uniform_bytes_len = 2 * kHashToFieldBytesLen;
+    buffer.assign(kSha256BlockBytesLen, 0);
+    buffer.insert(buffer.end(), message.begin(), message.end());
+    buffer.push_back(static_cast<Byte>(uniform_bytes_len >> 8));
+    buffer.push_back(static_cast<Byte>(uniform_bytes_len));
+    buffer.push_back(0);
+    buffer.insert(buffer.end(), dst_prime.begin(), dst_prime.end());
+    Byte b0[kFieldBytesLen];
+    hash.compute(buffer.data(), buffer.size(), b0, kFieldBytesLen);
+
+    buffer.assign(b0, b0 + kFieldBytesLen);
+    buffer.push_back(1);
+    buffer.insert(buffer.end(), dst_prime.begin(), dst_prime.end());
+    for (std::size_t block_idx = 0; block_idx * kFieldBytesLen < uniform_bytes_len; ++block_idx) {
+        Byte* block = uniform_bytes + block_idx * kFieldBytesLen;
+        if (block_idx > 0) {
+            for (std::size_t byte_idx = 0; byte_idx < kFieldBytesLen; ++byte_idx) {
+                buffer[byte_idx] = b0[byte_idx] ^ block[byte_idx - kFieldBytesLen];
+            }
+            buffer[kFieldBytesLen] = static_cast<Byte>(block_idx + 1);
+        }
+        hash.compute(buffer.data(), buffer.size(), block, kFieldBytesLen);
+    }
+}
+
+// Hashes message_at(0), ..., message_at(message_count - 1) to points, as p256_hash_to_curve_batch.
+template <typename MessageAt>
+void hash_to_curve_batch(
+        std::size_t message_count, MessageAt message_at, const std::string& dst, PointBuffer& points) {
+    if (dst.empty() || dst.size() > 255) {
+        throw std::invalid_argument("dst size is not in [1, 255].");
+    }
+    ByteVector dst_prime(dst.begin(), dst.end());
+    dst_prime.push_back(static_cast<Byte>(dst.size()));
+    auto hash = petace::solo::Hash::create(petace::solo::HashScheme::SHA_256);
+    ByteVector buffer;
+
+    std::vector<Ge> results(message_count);
+    // z_products[i] is the product of Z of results[0..i].
+    std::vector<Fe> z_products(message_count);
+    for (std::size_t item_idx = 0; item_idx < message_count; ++item_idx) {
+        Byte uniform_bytes[2 * kHashToFieldBytesLen];
+        expand_message(*hash, message_at(item_idx), dst_prime, buffer, uniform_bytes);
+        Ge q0 = ge_map_to_curve(fe_from_uniform_bytes(uniform_bytes));
+        Ge q1 = ge_map_to_curve(fe_from_uniform_bytes(uniform_bytes + kHashToFieldBytesLen));
+        results[item_idx] = ge_add(q0, q1);
+        // The point at infinity, which happens with negligible probability, would zero every inverse of the batch.
+        // It is output as (0, 1), which is not on the curve.
+        fe_cmov(results[item_idx].z, kOne, fe_is_zero(results[item_idx].z));
+        z_products[item_idx] =
+                item_idx == 0 ? results[item_idx].z : fe_mul(z_products[item_idx - 1], results[item_idx].z);
+    }
+    if (message_count == 0) {
+        points.resize(0, kP256UncompressedPointBytesLen);
+        return;
+    }
+
+    points.resize(message_count, kP256UncompressedPointBytesLen);
+    Fe z_products_inverse = fe_invert(z_products.back());
+    for (std::size_t item_idx = message_count; item_idx-- > 0;) {
+        Fe z_inverse = z_products_inverse;
+        if (item_idx > 0) {
+            z_inverse = fe_mul(z_inverse, z_products[item_idx - 1]);
+            z_products_inverse = fe_mul(z_products_inverse, results[item_idx].z);
+        }
+        Byte* point = points.point_data(item_idx);
+        point[0] = kUncompressedPointTag;
+        fe_to_bytes(fe_mul(results[item_idx].x, z_inverse), point + 1);
+        fe_to_bytes(fe_mul(results[item_idx].y, z_inverse), point + 1 + kFieldBytesLen);
+    }
+}
+
+}  // namespace
+
+void p256_hash_to_curve_batch(Span<const std::string> messages, const std::string& dst, PointBuffer& points) {
+    hash_to_curve_batch(
+            messages.size(), [&](std::size_t idx) -> const std::string& { return messages[idx]; }, dst, points);
+}
+
+void p256_hash_to_curve_batch(Span<const std::string> messages, Span<const std::size_t> indices, const std::string& dst,
+        PointBuffer& points) {
+    for (std::size_t index : indices) {
+        if (index >= messages.size()) {
+            throw std::invalid_argument("index of messages is out of range.");
+        }
+    }
+    hash_to_curve_batch(
+            indices.size(), [&](std::size_t idx) -> const std::string& { return messages[indices[idx]]; }, dst, points);
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,56 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+
+#include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+
+namespace petace {
+namespace setops {
+
+// The byte length of an uncompressed NIST P-256 point (SEC 1, section 2.3.3).
+const std::size_t kP256UncompressedPointBytesLen = 65;
+
+/**
+ * @brief Hashes messages to NIST P-256 points with the P256_XMD:SHA-256_SSWU_RO_ suite of RFC 9380.
+ *
+ * Mapping to the curve is constant time. All points of the batch are converted to affine coordinates with one shared
+ * field inversion, so hashing a batch is faster than hashing every message alone.
+ *
+ * @param[in] messages The messages.
+ * @param[in] dst The domain separation tag, which is 1 to 255 bytes.
+ * @param[out] points The uncompressed points in the order of messages, resized to kP256UncompressedPointBytesLen bytes
+ * per point.
+ * @throws std::invalid_argument if dst is empty or longer than 255 bytes.
+ */
+void p256_hash_to_curve_batch(Span<const std::string> messages, const std::string& dst, PointBuffer& points);
+
+/**
+ * @brief Hashes messages selected by indices to NIST P-256 points, as p256_hash_to_curve_batch on the selected
+ * messages.
+ *
+ * @param[in] messages The messages.
+ * @param[in] indices The indices of messages to hash, in the order of output points.
+ * @param[in] dst The domain separation tag, which is 1 to 255 bytes.
+ * @param[out] points The uncompressed points in the order of indices.
+ * @throws std::invalid_argument if dst is empty or longer than 255 bytes, or an index is out of range.
+ */
+void p256_hash_to_curve_batch(Span<const std::string> messages, Span<const std::size_t> indices, const std::string& dst,
+        PointBuffer& points);
+
+}  // namespace setops
+}  // namespace petace
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <cstring>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -21,6 +22,8 @@
 #include "solo/prng.h"
 #include "solo/sampling.h"
 
+#include "setops/util/point_buffer.h"
+
 namespace petace {
 namespace setops {
 
@@ -65,5 +68,28 @@ inline void permute_and_undo(const std::vector<std::size_t>& permutation, bool i
     std::swap(output, data);
 }
 
+/**
+ * @brief Applies or un-applies permutation given points, permutation and is_permute flag.
+ *
+ * @param[in] permutation The permutation to permute points.
+ * @param[in] is A bool indicates applies or un-applies permutation.
+ * @param[in] points The points need to be permuted.
+ * @param[out] points The permuted points.
+ */
+inline void permute_and_undo(const std::vector<std::size_t>& permutation, bool is_permute, PointBuffer& points) {
+    std::size_t point_byte_count = points.point_byte_count();
+    PointBuffer output(points.size(), point_byte_count);
+    if (is_permute) {
+        for (std::size_t i = 0; i < permutation.size(); ++i) {
+            std::memcpy(output.point_data(i), points.point_data(permutation[i]), point_byte_count);
+        }
+    } else {
+        for (std::size_t i = 0; i < permutation.size(); ++i) {
+            std::memcpy(output.point_data(permutation[i]), points.point_data(i), point_byte_count);
+        }
+    }
+    points.swap(output);
+}
+
 }  // namespace setops
 }  // namespace petace
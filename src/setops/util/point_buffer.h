@@ -0,0 +1,304 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "setops/util/defines.h"
+
+namespace petace {
+namespace setops {
+
+/**
+ * @brief A non-owning view of a contiguous sequence of elements.
+ */
+template <typename T>
+class Span {
+public:
+    Span() = default;
+
+    Span(T* data, std::size_t size) : data_(data), size_(size) {
+    }
+
+    T* data() const {
+        return data_;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    T* begin() const {
+        return data_;
+    }
+
+    T* end() const {
+        return data_ + size_;
+    }
+
+    T& operator[](std::size_t idx) const {
+        return data_[idx];
+    }
+
+private:
+    T* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+using ByteSpan = Span<Byte>;
+using ConstByteSpan = Span<const Byte>;
+
+/**
+ * @brief An allocator that default-initializes elements, which leaves bytes uninitialized on resize.
+ *
+ * This lets a buffer choose which threads first touch, and thereby place, its pages.
+ */
+template <typename T>
+class DefaultInitAllocator : public std::allocator<T> {
+public:
+    template <typename U>
+    struct rebind {
+        using other = DefaultInitAllocator<U>;
+    };
+
+    DefaultInitAllocator() = default;
+
+    template <typename U>
+    DefaultInitAllocator(const DefaultInitAllocator<U>& /*other*/) noexcept {
+    }
+
+    template <typename U>
+    void construct(U* ptr) noexcept(std::is_nothrow_default_constructible<U>::value) {
+        ::new (static_cast<void*>(ptr)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* ptr, Args&&... args) {
+        ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+    }
+};
+
+/**
+ * @brief A contiguous buffer of points, where every point takes the same number of bytes.
+ *
+ * Compared with std::vector<ByteVector>, points are stored back to back without per-point allocation, and the whole
+ * buffer or a range of it can be sent or received over the network as is.
+ */
+class PointBuffer {
+public:
+    PointBuffer() = default;
+
+    /**
+     * @brief Creates a zero-filled buffer.
+     *
+     * @param[in] size The number of points.
+     * @param[in] point_byte_count The number of bytes of every point.
+     */
+    PointBuffer(std::size_t size, std::size_t point_byte_count)
+            : point_byte_count_(point_byte_count), bytes_(size * point_byte_count, 0) {
+    }
+
+    /**
+     * @brief Creates a zero-filled buffer whose pages are first touched by a team of OpenMP threads.
+     *
+     * Every thread zeroes an equal contiguous share of points, which is what OpenMP loops over points or batches of
+     * points with the default static schedule process. When threads are pinned to a NUMA node, the memory is then
+     * allocated on the node of the threads that process it.
+     *
+     * @param[in] size The number of points.
+     * @param[in] point_byte_count The number of bytes of every point.
+     * @param[in] num_threads The number of threads.
+     */
+    PointBuffer(std::size_t size, std::size_t point_byte_count, std::size_t num_threads)
+            : point_byte_count_(point_byte_count) {
+        bytes_.resize(size * point_byte_count);
+        std::size_t team_size = std::max<std::size_t>(num_threads, 1);
+        std::size_t share = (size + team_size - 1) / team_size;
+#pragma omp parallel for num_threads(team_size) schedule(static, 1)
+        for (std::size_t thread_idx = 0; thread_idx < team_size; ++thread_idx) {
+            std::size_t begin = std::min(thread_idx * share, size);
+            std::size_t end = std::min(begin + share, size);
+            std::memset(bytes_.data() + begin * point_byte_count, 0, (end - begin) * point_byte_count);
+        }
+    }
+
+    /**
+     * @brief Resizes the buffer to hold the given number of points of the given length.
+     *
+     * Existing bytes are kept only if the point length is unchanged.
+     *
+     * @param[in] size The number of points.
+     * @param[in] point_byte_count The number of bytes of every point.
+     */
+    void resize(std::size_t size, std::size_t point_byte_count) {
+        if (point_byte_count != point_byte_count_) {
+            bytes_.clear();
+            point_byte_count_ = point_byte_count;
+        }
+        bytes_.resize(size * point_byte_count, 0);
+    }
+
+    /**
+     * @brief Releases all points and their memory.
+     */
+    void clear() {
+        std::vector<Byte, DefaultInitAllocator<Byte>>().swap(bytes_);
+    }
+
+    /**
+     * @brief Returns the number of points.
+     */
+    std::size_t size() const {
+        return point_byte_count_ == 0 ? 0 : bytes_.size() / point_byte_count_;
+    }
+
+    /**
+     * @brief Returns whether the buffer holds no point.
+     */
+    bool empty() const {
+        return bytes_.empty();
+    }
+
+    /**
+     * @brief Returns the number of bytes of every point.
+     */
+    std::size_t point_byte_count() const {
+        return point_byte_count_;
+    }
+
+    /**
+     * @brief Returns the number of bytes of all points.
+     */
+    std::size_t byte_count() const {
+        return bytes_.size();
+    }
+
+    /**
+     * @brief Returns a pointer to the bytes of the first point.
+     */
+    Byte* data() {
+        return bytes_.data();
+    }
+
+    /**
+     * @brief Returns a pointer to the bytes of the first point.
+     */
+    const Byte* data() const {
+        return bytes_.data();
+    }
+
+    /**
+     * @brief Returns a view of the bytes of the point at the given index.
+     */
+    ByteSpan operator[](std::size_t idx) {
+        return ByteSpan(bytes_.data() + idx * point_byte_count_, point_byte_count_);
+    }
+
+    /**
+     * @brief Returns a view of the bytes of the point at the given index.
+     */
+    ConstByteSpan operator[](std::size_t idx) const {
+        return ConstByteSpan(bytes_.data() + idx * point_byte_count_, point_byte_count_);
+    }
+
+    /**
+     * @brief Returns a pointer to the bytes of the point at the given index.
+     *
+     * Unlike operator[], the index may be equal to size(), so that ranges [begin, end) can be addressed.
+     */
+    Byte* point_data(std::size_t idx) {
+        return bytes_.data() + idx * point_byte_count_;
+    }
+
+    /**
+     * @brief Returns a pointer to the bytes of the point at the given index.
+     *
+     * Unlike operator[], the index may be equal to size(), so that ranges [begin, end) can be addressed.
+     */
+    const Byte* point_data(std::size_t idx) const {
+        return bytes_.data() + idx * point_byte_count_;
+    }
+
+    /**
+     * @brief Swaps contents with another buffer.
+     */
+    void swap(PointBuffer& other) {
+        std::swap(point_byte_count_, other.point_byte_count_);
+        bytes_.swap(other.bytes_);
+    }
+
+private:
+    std::size_t point_byte_count_ = 0;
+    std::vector<Byte, DefaultInitAllocator<Byte>> bytes_{};
+};
+
+/**
+ * @brief Sorts points in lexicographical order of their bytes.
+ *
+ * @param[in] points The points to sort.
+ * @param[out] points The sorted points.
+ */
+inline void sort_points(PointBuffer& points) {
+    std::size_t point_byte_count = points.point_byte_count();
+    std::vector<std::size_t> order(points.size());
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::sort(order.begin(), order.end(), [&points, point_byte_count](std::size_t lhs, std::size_t rhs) {
+        return std::memcmp(points.point_data(lhs), points.point_data(rhs), point_byte_count) < 0;
+    });
+    PointBuffer sorted(points.size(), point_byte_count);
+    for (std::size_t idx = 0; idx < order.size(); ++idx) {
+        std::memcpy(sorted.point_data(idx), points.point_data(order[idx]), point_byte_count);
+    }
+    points.swap(sorted);
+}
+
+/**
+ * @brief Checks whether a point appears in points sorted by sort_points.
+ *
+ * @param[in] sorted_points The points sorted in lexicographical order of their bytes.
+ * @param[in] point The bytes of the point to search, of length sorted_points.point_byte_count().
+ */
+inline bool binary_search_point(const PointBuffer& sorted_points, const Byte* point) {
+    std::size_t point_byte_count = sorted_points.point_byte_count();
+    std::size_t low = 0;
+    std::size_t high = sorted_points.size();
+    while (low < high) {
+        std::size_t mid = low + (high - low) / 2;
+        int cmp = std::memcmp(sorted_points.point_data(mid), point, point_byte_count);
+        if (cmp == 0) {
+            return true;
+        } else if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return false;
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,94 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/radix_sort.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+const std::size_t kRadixBucketCount = 256;
+
+}  // namespace
+
+void radix_sort_points(PointBuffer& points, std::size_t num_threads) {
+    std::size_t size = points.size();
+    std::size_t point_byte_count = points.point_byte_count();
+    if (size < 2) {
+        return;
+    }
+    num_threads = std::max<std::size_t>(num_threads, 1);
+    PointBuffer buffer(size, point_byte_count);
+    Byte* src = points.data();
+    Byte* dst = buffer.data();
+    bool sorted_in_buffer = false;
+    std::vector<std::array<std::size_t, kRadixBucketCount>> histograms(num_threads);
+
+    for (std::size_t byte_idx = point_byte_count; byte_idx-- > 0;) {
+        bool trivial_pass = false;
+#pragma omp parallel num_threads(num_threads)
+        {
+            std::size_t team_size = omp_get_num_threads();
+            std::size_t thread_idx = omp_get_thread_num();
+            std::size_t begin = size * thread_idx / team_size;
+            std::size_t end = size * (thread_idx + 1) / team_size;
+            auto& histogram = histograms[thread_idx];
+            histogram.fill(0);
+            for (std::size_t item_idx = begin; item_idx < end; ++item_idx) {
+                ++histogram[src[item_idx * point_byte_count + byte_idx]];
+            }
+
+#pragma omp barrier
+#pragma omp single
+            {
+                std::size_t offset = 0;
+                for (std::size_t bucket_idx = 0; bucket_idx < kRadixBucketCount; ++bucket_idx) {
+                    std::size_t bucket_begin = offset;
+                    for (std::size_t idx = 0; idx < team_size; ++idx) {
+                        std::size_t count = histograms[idx][bucket_idx];
+                        histograms[idx][bucket_idx] = offset;
+                        offset += count;
+                    }
+                    trivial_pass = trivial_pass || offset - bucket_begin == size;
+                }
+            }
+
+            if (!trivial_pass) {
+                for (std::size_t item_idx = begin; item_idx < end; ++item_idx) {
+                    const Byte* point = src + item_idx * point_byte_count;
+                    std::memcpy(dst + histogram[point[byte_idx]]++ * point_byte_count, point, point_byte_count);
+                }
+            }
+        }
+        if (!trivial_pass) {
+            std::swap(src, dst);
+            sorted_in_buffer = !sorted_in_buffer;
+        }
+    }
+    if (sorted_in_buffer) {
+        points.swap(buffer);
+    }
+}
+
+}  // namespace setops
+}  // namespace petace
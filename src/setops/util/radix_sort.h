@@ -0,0 +1,38 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "setops/util/defines.h"
+#include "setops/util/point_buffer.h"
+
+namespace petace {
+namespace setops {
+
+/**
+ * @brief Sorts points in lexicographical order of their bytes with a parallel LSD radix sort.
+ *
+ * Every pass sorts by one byte, from the last byte to the first. In a pass, every thread counts the bytes of its own
+ * range of points, then scatters the range to positions derived from all threads' counts, which keeps the sort stable.
+ * A pass is skipped if all points share the byte. The result is the same as sort_points, and takes one extra copy of
+ * points in memory.
+ *
+ * @param[in] points The points to sort.
+ * @param[in] num_threads The number of threads.
+ * @param[out] points The sorted points.
+ */
+void radix_sort_points(PointBuffer& points, std::size_t num_threads);
+
+}  // namespace setops
+}  // namespace petace
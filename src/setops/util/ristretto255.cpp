@@ -0,0 +1,679 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/ristretto255.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+using uint128_t = unsigned __int128;
+
+const std::uint64_t kLimbMask = (std::uint64_t(1) << 51) - 1;
+
+// An element of GF(2^255 - 19) in five 51-bit limbs, little-endian.
+// Limbs may exceed 51 bits by a few bits between operations.
+struct Fe {
+    std::uint64_t v[5];
+};
+
+// A point of the twisted Edwards curve -x^2 + y^2 = 1 + d x^2 y^2 in extended coordinates (X : Y : Z : T).
+struct Ge {
+    Fe x;
+    Fe y;
+    Fe z;
+    Fe t;
+};
+
+// A point prepared for repeated additions as (Y + X, Y - X, 2Z, 2dT).
+struct GeCached {
+    Fe y_plus_x;
+    Fe y_minus_x;
+    Fe z2;
+    Fe t2d;
+};
+
+const Fe kZero = {{0, 0, 0, 0, 0}};
+const Fe kOne = {{1, 0, 0, 0, 0}};
+const Fe kD = {{0x34dca135978a3, 0x1a8283b156ebd, 0x5e7a26001c029, 0x739c663a03cbb, 0x52036cee2b6ff}};
+const Fe kD2 = {{0x69b9426b2f159, 0x35050762add7a, 0x3cf44c0038052, 0x6738cc7407977, 0x2406d9dc56dff}};
+const Fe kSqrtM1 = {{0x61b274a0ea0b0, 0x0d5a5fc8f189d, 0x7ef5e9cbd0c60, 0x78595a6804c9e, 0x2b8324804fc1d}};
+const Fe kSqrtAdMinusOne = {{0x7f6a0497b2e1b, 0x1836f0a97afd2, 0x7d747f6be7638, 0x456079e7e6498, 0x376931bf2b834}};
+const Fe kInvSqrtAMinusD = {{0x0fdaa805d40ea, 0x2eb482e57d339, 0x007610274bc58, 0x6510b613dc8ff, 0x786c8905cfaff}};
+const Fe kOneMinusDSq = {{0x409c1945fc176, 0x719abc6a1fc4f, 0x1c37f90b20684, 0x06bccca55eedf, 0x029072a8b2b3e}};
+const Fe kDMinusOneSq = {{0x55aaa44ed4d20, 0x59603c3332635, 0x26d3baf4a7928, 0x120a66e6997a9, 0x5968b37af66c2}};
+
+// The group order l = 2^252 + 27742317777372353535851937790883648493 in four 64-bit limbs, little-endian.
+const std::uint64_t kOrder[4] = {0x5812631a5cf5d3ed, 0x14def9dea2f79cd6, 0, 0x1000000000000000};
+// -l^-1 mod 2^64.
+const std::uint64_t kOrderMontgomeryFactor = 0xd2b51da312547e1b;
+// 2^512 mod l, which converts a scalar into the Montgomery form.
+const std::uint64_t kOrderMontgomeryR2[4] = {
+        0xa40611e3449c0f01, 0xd00e1ba768859347, 0xceec73d217f5be65, 0x0399411b7c309a3d};
+
+Fe fe_carry(Fe a) {
+    std::uint64_t carry = 0;
+    for (std::size_t idx = 0; idx < 4; ++idx) {
+        carry = a.v[idx] >> 51;
+        a.v[idx] &= kLimbMask;
+        a.v[idx + 1] += carry;
+    }
+    carry = a.v[4] >> 51;
+    a.v[4] &= kLimbMask;
+    a.v[0] += carry * 19;
+    return a;
+}
+
+// Leaves limbs uncarried, which fe_mul, fe_sq and fe_sub tolerate for a sum of a few reduced elements.
+Fe fe_add(const Fe& a, const Fe& b) {
+    Fe r;
+    for (std::size_t idx = 0; idx < 5; ++idx) {
+        r.v[idx] = a.v[idx] + b.v[idx];
+    }
+    return r;
+}
+
+// Adds 4p before subtracting, so that no limb underflows as long as b is reduced or a sum of two reduced elements.
+// Leaves limbs uncarried, so the result can only be the first operand of another subtraction.
+Fe fe_sub(const Fe& a, const Fe& b) {
+    Fe r;
+    r.v[0] = a.v[0] + 0x1fffffffffffb4 - b.v[0];
+    for (std::size_t idx = 1; idx < 5; ++idx) {
+        r.v[idx] = a.v[idx] + 0x1ffffffffffffc - b.v[idx];
+    }
+    return r;
+}
+
+// Returns a reduced result that can be the second operand of a subtraction.
+Fe fe_neg(const Fe& a) {
+    return fe_carry(fe_sub(kZero, a));
+}
+
+// Carries five 128-bit column sums of a product into reduced limbs.
+Fe fe_reduce_product(uint128_t t0, uint128_t t1, uint128_t t2, uint128_t t3, uint128_t t4) {
+    Fe r;
+    t1 += t0 >> 51;
+    t2 += t1 >> 51;
+    t3 += t2 >> 51;
+    t4 += t3 >> 51;
+    uint128_t r0 = (static_cast<std::uint64_t>(t0) & kLimbMask) + (t4 >> 51) * 19;
+    r.v[0] = static_cast<std::uint64_t>(r0) & kLimbMask;
+    r.v[1] = (static_cast<std::uint64_t>(t1) & kLimbMask) + static_cast<std::uint64_t>(r0 >> 51);
+    r.v[2] = static_cast<std::uint64_t>(t2) & kLimbMask;
+    r.v[3] = static_cast<std::uint64_t>(t3) & kLimbMask;
+    r.v[4] = static_cast<std::uint64_t>(t4) & kLimbMask;
+    return r;
+}
+
+Fe fe_mul(const Fe& a, const Fe& b) {
+    const std::uint64_t* x = a.v;
+    const std::uint64_t* y = b.v;
+    std::uint64_t y1_19 = y[1] * 19;
+    std::uint64_t y2_19 = y[2] * 19;
+    std::uint64_t y3_19 = y[3] * 19;
+    std::uint64_t y4_19 = y[4] * 19;
+    uint128_t t0 = (uint128_t)x[0] * y[0] + (uint128_t)x[1] * y4_19 + (uint128_t)x[2] * y3_19 +
+                   (uint128_t)x[3] * y2_19 + (uint128_t)x[4] * y1_19;
+    uint128_t t1 = (uint128_t)x[0] * y[1] + (uint128_t)x[1] * y[0] + (uint128_t)x[2] * y4_19 +
+                   (uint128_t)x[3] * y3_19 + (uint128_t)x[4] * y2_19;
+    uint128_t t2 = (uint128_t)x[0] * y[2] + (uint128_t)x[1] * y[1] + (uint128_t)x[2] * y[0] +
+                   (uint128_t)x[3] * y4_19 + (uint128_t)x[4] * y3_19;
+    uint128_t t3 = (uint128_t)x[0] * y[3] + (uint128_t)x[1] * y[2] + (uint128_t)x[2] * y[1] +
+                   (uint128_t)x[3] * y[0] + (uint128_t)x[4] * y4_19;
+    uint128_t t4 = (uint128_t)x[0] * y[4] + (uint128_t)x[1] * y[3] + (uint128_t)x[2] * y[2] +
+                   (uint128_t)x[3] * y[1] + (uint128_t)x[4] * y[0];
+    return fe_reduce_product(t0, t1, t2, t3, t4);
+}
+
+Fe fe_sq(const Fe& a) {
+    const std::uint64_t* x = a.v;
+    std::uint64_t x0_2 = x[0] * 2;
+    std::uint64_t x1_2 = x[1] * 2;
+    std::uint64_t x2_2 = x[2] * 2;
+    std::uint64_t x3_19 = x[3] * 19;
+    std::uint64_t x4_19 = x[4] * 19;
+    uint128_t t0 = (uint128_t)x[0] * x[0] + (uint128_t)x1_2 * x4_19 + (uint128_t)x2_2 * x3_19;
+    uint128_t t1 = (uint128_t)x0_2 * x[1] + (uint128_t)x2_2 * x4_19 + (uint128_t)x[3] * x3_19;
+    uint128_t t2 = (uint128_t)x0_2 * x[2] + (uint128_t)x[1] * x[1] + (uint128_t)(x[3] * 2) * x4_19;
+    uint128_t t3 = (uint128_t)x0_2 * x[3] + (uint128_t)x1_2 * x[2] + (uint128_t)x[4] * x4_19;
+    uint128_t t4 = (uint128_t)x0_2 * x[4] + (uint128_t)x1_2 * x[3] + (uint128_t)x[2] * x[2];
+    return fe_reduce_product(t0, t1, t2, t3, t4);
+}
+
+Fe fe_sq_times(Fe a, std::size_t count) {
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        a = fe_sq(a);
+    }
+    return a;
+}
+
+// Returns a^((p - 5) / 8) = a^(2^252 - 3).
+Fe fe_pow_p58(const Fe& a) {
+    Fe a2 = fe_sq(a);
+    Fe a9 = fe_mul(fe_sq_times(a2, 2), a);
+    Fe a11 = fe_mul(a9, a2);
+    Fe a_5_0 = fe_mul(fe_sq(a11), a9);
+    Fe a_10_0 = fe_mul(fe_sq_times(a_5_0, 5), a_5_0);
+    Fe a_20_0 = fe_mul(fe_sq_times(a_10_0, 10), a_10_0);
+    Fe a_40_0 = fe_mul(fe_sq_times(a_20_0, 20), a_20_0);
+    Fe a_50_0 = fe_mul(fe_sq_times(a_40_0, 10), a_10_0);
+    Fe a_100_0 = fe_mul(fe_sq_times(a_50_0, 50), a_50_0);
+    Fe a_200_0 = fe_mul(fe_sq_times(a_100_0, 100), a_100_0);
+    Fe a_250_0 = fe_mul(fe_sq_times(a_200_0, 50), a_50_0);
+    return fe_mul(fe_sq_times(a_250_0, 2), a);
+}
+
+// Returns a^(p - 2) = (a^((p - 5) / 8))^8 * a^3, which is the inverse of a non-zero a.
+Fe fe_invert(const Fe& a) {
+    return fe_mul(fe_sq_times(fe_pow_p58(a), 3), fe_mul(fe_sq(a), a));
+}
+
+// Loads 32 little-endian bytes and ignores the top bit.
+Fe fe_from_bytes(const Byte* bytes) {
+    std::uint64_t words[4];
+    for (std::size_t word_idx = 0; word_idx < 4; ++word_idx) {
+        words[word_idx] = 0;
+        for (std::size_t byte_idx = 0; byte_idx < 8; ++byte_idx) {
+            words[word_idx] |= std::uint64_t(bytes[word_idx * 8 + byte_idx]) << (8 * byte_idx);
+        }
+    }
+    Fe r;
+    r.v[0] = words[0] & kLimbMask;
+    r.v[1] = ((words[0] >> 51) | (words[1] << 13)) & kLimbMask;
+    r.v[2] = ((words[1] >> 38) | (words[2] << 26)) & kLimbMask;
+    r.v[3] = ((words[2] >> 25) | (words[3] << 39)) & kLimbMask;
+    r.v[4] = (words[3] >> 12) & kLimbMask;
+    return r;
+}
+
+// Stores the canonical encoding in 32 little-endian bytes.
+void fe_to_bytes(const Fe& a, Byte* bytes) {
+    Fe r = fe_carry(fe_carry(a));
+    // Now r < 2^255 + 19 * 2; subtract p if r >= p.
+    std::uint64_t q = (r.v[0] + 19) >> 51;
+    for (std::size_t idx = 1; idx < 5; ++idx) {
+        q = (r.v[idx] + q) >> 51;
+    }
+    r.v[0] += 19 * q;
+    for (std::size_t idx = 0; idx < 4; ++idx) {
+        r.v[idx + 1] += r.v[idx] >> 51;
+        r.v[idx] &= kLimbMask;
+    }
+    r.v[4] &= kLimbMask;
+
+    std::uint64_t words[4];
+    words[0] = r.v[0] | (r.v[1] << 51);
+    words[1] = (r.v[1] >> 13) | (r.v[2] << 38);
+    words[2] = (r.v[2] >> 26) | (r.v[3] << 25);
+    words[3] = (r.v[3] >> 39) | (r.v[4] << 12);
+    for (std::size_t word_idx = 0; word_idx < 4; ++word_idx) {
+        for (std::size_t byte_idx = 0; byte_idx < 8; ++byte_idx) {
+            bytes[word_idx * 8 + byte_idx] = static_cast<Byte>(words[word_idx] >> (8 * byte_idx));
+        }
+    }
+}
+
+std::uint64_t fe_is_negative(const Fe& a) {
+    Byte bytes[32];
+    fe_to_bytes(a, bytes);
+    return bytes[0] & 1;
+}
+
+std::uint64_t fe_is_zero(const Fe& a) {
+    Byte bytes[32];
+    fe_to_bytes(a, bytes);
+    std::uint64_t acc = 0;
+    for (Byte byte : bytes) {
+        acc |= byte;
+    }
+    return ((acc - 1) >> 63) & 1;
+}
+
+std::uint64_t fe_equal(const Fe& a, const Fe& b) {
+    return fe_is_zero(fe_sub(a, b));
+}
+
+// Sets a to b if flag is 1 and keeps a if flag is 0, in constant time.
+void fe_cmov(Fe& a, const Fe& b, std::uint64_t flag) {
+    std::uint64_t mask = 0 - flag;
+    for (std::size_t idx = 0; idx < 5; ++idx) {
+        a.v[idx] ^= mask & (a.v[idx] ^ b.v[idx]);
+    }
+}
+
+Fe fe_abs(const Fe& a) {
+    Fe r = a;
+    fe_cmov(r, fe_neg(a), fe_is_negative(a));
+    return r;
+}
+
+// Computes the non-negative square root of u / v, or of SQRT_M1 * u / v if u / v is not square.
+// Returns 1 if u / v is square and 0 otherwise.
+std::uint64_t fe_sqrt_ratio_m1(const Fe& u, const Fe& v, Fe& r) {
+    Fe v3 = fe_mul(fe_sq(v), v);
+    Fe v7 = fe_mul(fe_sq(v3), v);
+    r = fe_mul(fe_mul(u, v3), fe_pow_p58(fe_mul(u, v7)));
+    Fe check = fe_mul(v, fe_sq(r));
+
+    Fe u_neg = fe_neg(u);
+    std::uint64_t correct_sign_sqrt = fe_equal(check, u);
+    std::uint64_t flipped_sign_sqrt = fe_equal(check, u_neg);
+    std::uint64_t flipped_sign_sqrt_i = fe_equal(check, fe_mul(u_neg, kSqrtM1));
+
+    fe_cmov(r, fe_mul(kSqrtM1, r), flipped_sign_sqrt | flipped_sign_sqrt_i);
+    r = fe_abs(r);
+    return correct_sign_sqrt | flipped_sign_sqrt;
+}
+
+Ge ge_identity() {
+    return Ge{kZero, kOne, kOne, kZero};
+}
+
+GeCached ge_to_cached(const Ge& p) {
+    return GeCached{fe_add(p.y, p.x), fe_sub(p.y, p.x), fe_add(p.z, p.z), fe_mul(p.t, kD2)};
+}
+
+Ge ge_add(const Ge& p, const GeCached& q) {
+    Fe a = fe_mul(fe_sub(p.y, p.x), q.y_minus_x);
+    Fe b = fe_mul(fe_add(p.y, p.x), q.y_plus_x);
+    Fe c = fe_mul(p.t, q.t2d);
+    Fe d = fe_mul(p.z, q.z2);
+    Fe e = fe_sub(b, a);
+    Fe f = fe_sub(d, c);
+    Fe g = fe_add(d, c);
+    Fe h = fe_add(b, a);
+    return Ge{fe_mul(e, f), fe_mul(g, h), fe_mul(f, g), fe_mul(e, h)};
+}
+
+Ge ge_neg(const Ge& p) {
+    return Ge{fe_neg(p.x), p.y, p.z, fe_neg(p.t)};
+}
+
+// Doubles p. T of the result is only computed if need_t is true, since doubling does not read T.
+Ge ge_double(const Ge& p, bool need_t = true) {
+    Fe a = fe_sq(p.x);
+    Fe b = fe_sq(p.y);
+    Fe c = fe_sq(p.z);
+    c = fe_add(c, c);
+    Fe e = fe_sub(fe_sub(fe_sq(fe_add(p.x, p.y)), a), b);
+    Fe g = fe_sub(b, a);
+    Fe f = fe_sub(g, c);
+    Fe h = fe_sub(kZero, fe_add(a, b));
+    return Ge{fe_mul(e, f), fe_mul(g, h), fe_mul(f, g), need_t ? fe_mul(e, h) : kZero};
+}
+
+void ge_cached_cmov(GeCached& p, const GeCached& q, std::uint64_t flag) {
+    fe_cmov(p.y_plus_x, q.y_plus_x, flag);
+    fe_cmov(p.y_minus_x, q.y_minus_x, flag);
+    fe_cmov(p.z2, q.z2, flag);
+    fe_cmov(p.t2d, q.t2d, flag);
+}
+
+// Multiplies by a 256-bit little-endian scalar with signed 4-bit windows and constant-time table lookups.
+Ge ge_scalar_mul(const Ge& p, const Byte* scalar) {
+    // Recodes the scalar into 65 digits in [-8, 8).
+    const std::size_t digit_count = 2 * kRistretto255ScalarBytesLen + 1;
+    std::int64_t digits[digit_count];
+    for (std::size_t byte_idx = 0; byte_idx < kRistretto255ScalarBytesLen; ++byte_idx) {
+        digits[2 * byte_idx] = scalar[byte_idx] & 0xf;
+        digits[2 * byte_idx + 1] = scalar[byte_idx] >> 4;
+    }
+    digits[digit_count - 1] = 0;
+    for (std::size_t digit_idx = 0; digit_idx + 1 < digit_count; ++digit_idx) {
+        std::int64_t carry = (digits[digit_idx] + 8) >> 4;
+        digits[digit_idx] -= carry * 16;
+        digits[digit_idx + 1] += carry;
+    }
+
+    // table[i] = (i + 1) * p.
+    Ge multiples[8];
+    GeCached table[8];
+    multiples[0] = p;
+    table[0] = ge_to_cached(p);
+    for (std::size_t idx = 1; idx < 8; ++idx) {
+        multiples[idx] = (idx % 2 == 1) ? ge_double(multiples[idx / 2]) : ge_add(multiples[idx - 1], table[0]);
+        table[idx] = ge_to_cached(multiples[idx]);
+    }
+
+    Ge r = ge_identity();
+    for (std::size_t digit_idx = digit_count; digit_idx-- > 0;) {
+        if (digit_idx + 1 < digit_count) {
+            r = ge_double(ge_double(ge_double(ge_double(r, false), false), false));
+        }
+        std::int64_t digit = digits[digit_idx];
+        std::uint64_t negative = static_cast<std::uint64_t>(digit) >> 63;
+        std::uint64_t magnitude = static_cast<std::uint64_t>((digit ^ -static_cast<std::int64_t>(negative)) +
+                                                             static_cast<std::int64_t>(negative));
+        GeCached selected{kOne, kOne, fe_add(kOne, kOne), kZero};
+        for (std::uint64_t entry_idx = 0; entry_idx < 8; ++entry_idx) {
+            ge_cached_cmov(selected, table[entry_idx], (((entry_idx + 1) ^ magnitude) - 1) >> 63);
+        }
+        GeCached negated{selected.y_minus_x, selected.y_plus_x, selected.z2, fe_neg(selected.t2d)};
+        ge_cached_cmov(selected, negated, negative);
+        r = ge_add(r, selected);
+    }
+    return r;
+}
+
+// Decodes an element, returns 0 if bytes are not a valid encoding.
+std::uint64_t ge_decode(const Byte* bytes, Ge& p) {
+    Fe s = fe_from_bytes(bytes);
+    Byte canonical[32];
+    fe_to_bytes(s, canonical);
+    std::uint64_t diff = 0;
+    for (std::size_t idx = 0; idx < 32; ++idx) {
+        diff |= canonical[idx] ^ bytes[idx];
+    }
+    std::uint64_t is_canonical = ((diff - 1) >> 63) & 1;
+
+    Fe ss = fe_sq(s);
+    Fe u1 = fe_sub(kOne, ss);
+    Fe u2 = fe_add(kOne, ss);
+    Fe u2_sqr = fe_sq(u2);
+    Fe v = fe_sub(fe_neg(fe_mul(kD, fe_sq(u1))), u2_sqr);
+    Fe invsqrt;
+    std::uint64_t was_square = fe_sqrt_ratio_m1(kOne, fe_mul(v, u2_sqr), invsqrt);
+    Fe den_x = fe_mul(invsqrt, u2);
+    Fe den_y = fe_mul(fe_mul(invsqrt, den_x), v);
+    p.x = fe_abs(fe_mul(fe_add(s, s), den_x));
+    p.y = fe_mul(u1, den_y);
+    p.z = kOne;
+    p.t = fe_mul(p.x, p.y);
+    return is_canonical & (fe_is_negative(s) ^ 1) & was_square & (fe_is_negative(p.t) ^ 1) & (fe_is_zero(p.y) ^ 1);
+}
+
+void ge_encode(const Ge& p, Byte* bytes) {
+    Fe u1 = fe_mul(fe_add(p.z, p.y), fe_sub(p.z, p.y));
+    Fe u2 = fe_mul(p.x, p.y);
+    Fe invsqrt;
+    fe_sqrt_ratio_m1(kOne, fe_mul(u1, fe_sq(u2)), invsqrt);
+    Fe den1 = fe_mul(invsqrt, u1);
+    Fe den2 = fe_mul(invsqrt, u2);
+    Fe z_inv = fe_mul(fe_mul(den1, den2), p.t);
+
+    std::uint64_t rotate = fe_is_negative(fe_mul(p.t, z_inv));
+    Fe x = p.x;
+    Fe y = p.y;
+    Fe den_inv = den2;
+    fe_cmov(x, fe_mul(p.y, kSqrtM1), rotate);
+    fe_cmov(y, fe_mul(p.x, kSqrtM1), rotate);
+    fe_cmov(den_inv, fe_mul(den1, kInvSqrtAMinusD), rotate);
+    fe_cmov(y, fe_neg(y), fe_is_negative(fe_mul(x, z_inv)));
+    fe_to_bytes(fe_abs(fe_mul(den_inv, fe_sub(p.z, y))), bytes);
+}
+
+// The encoding of the generator, from RFC 9496, Appendix A.1.
+const Byte kGeneratorBytes[kRistretto255PointBytesLen] = {0xe2, 0xf2, 0xae, 0x0a, 0x6a, 0xbc, 0x4e, 0x71, 0xa8, 0x84,
+        0xa9, 0x61, 0xc5, 0x00, 0x51, 0x5f, 0x58, 0xe3, 0x0b, 0x6a, 0xa5, 0x82, 0xdd, 0x8d, 0xb6, 0xa6, 0x59, 0x45,
+        0xe0, 0x8d, 0x2d, 0x76};
+
+Ge ge_generator() {
+    Ge generator;
+    ge_decode(kGeneratorBytes, generator);
+    return generator;
+}
+
+// Small logarithms are found by fingerprints of (xy)^2, which is the same for the four Edwards points an element
+// stands for, and is cheap to compute for a batch of points with one field inversion.
+// A fingerprint can also match other elements, such as the negation, so every match is verified.
+const std::size_t kLogBatchSize = 1024;
+
+struct LogTableEntry {
+    std::uint64_t fingerprint;
+    std::uint64_t baby_step;
+
+    bool operator<(const LogTableEntry& other) const {
+        return fingerprint < other.fingerprint;
+    }
+};
+
+// Writes the fingerprints of points, whose Z are overwritten by the batch inversion.
+void ge_fingerprints(std::vector<Ge>& points, std::uint64_t* fingerprints) {
+    std::vector<Fe> prefix(points.size());
+    Fe acc = kOne;
+    for (std::size_t idx = 0; idx < points.size(); ++idx) {
+        prefix[idx] = acc;
+        acc = fe_mul(acc, points[idx].z);
+    }
+    Fe inv = fe_invert(acc);
+    for (std::size_t idx = points.size(); idx-- > 0;) {
+        Fe z_inv = fe_mul(inv, prefix[idx]);
+        inv = fe_mul(inv, points[idx].z);
+        Byte bytes[32];
+        fe_to_bytes(fe_sq(fe_mul(points[idx].t, z_inv)), bytes);
+        std::uint64_t fingerprint = 0;
+        for (std::size_t byte_idx = 0; byte_idx < 8; ++byte_idx) {
+            fingerprint |= std::uint64_t(bytes[byte_idx]) << (8 * byte_idx);
+        }
+        fingerprints[idx] = fingerprint;
+    }
+}
+
+// The Elligator map from a field element to an element.
+Ge ge_map(const Fe& t) {
+    Fe r = fe_mul(kSqrtM1, fe_sq(t));
+    Fe u = fe_mul(fe_add(r, kOne), kOneMinusDSq);
+    Fe v = fe_mul(fe_sub(fe_neg(kOne), fe_mul(r, kD)), fe_add(r, kD));
+    Fe s;
+    std::uint64_t was_square = fe_sqrt_ratio_m1(u, v, s);
+    Fe s_prime = fe_neg(fe_abs(fe_mul(s, t)));
+    fe_cmov(s, s_prime, was_square ^ 1);
+    Fe c = fe_neg(kOne);
+    fe_cmov(c, r, was_square ^ 1);
+    Fe n = fe_sub(fe_mul(fe_mul(c, fe_sub(r, kOne)), kDMinusOneSq), v);
+
+    Fe s_sq = fe_sq(s);
+    Fe w0 = fe_mul(fe_add(s, s), v);
+    Fe w1 = fe_mul(n, kSqrtAdMinusOne);
+    Fe w2 = fe_sub(kOne, s_sq);
+    Fe w3 = fe_add(kOne, s_sq);
+    return Ge{fe_mul(w0, w3), fe_mul(w2, w1), fe_mul(w1, w3), fe_mul(w0, w2)};
+}
+
+Ge ge_from_uniform_bytes(const Byte* uniform_bytes) {
+    return ge_add(ge_map(fe_from_bytes(uniform_bytes)), ge_to_cached(ge_map(fe_from_bytes(uniform_bytes + 32))));
+}
+
+// Computes a * b / 2^256 mod l of a, b < l by the CIOS Montgomery multiplication, in constant time.
+void sc_mont_mul(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* r) {
+    std::uint64_t t[6] = {0, 0, 0, 0, 0, 0};
+    for (std::size_t i = 0; i < 4; ++i) {
+        std::uint64_t carry = 0;
+        for (std::size_t j = 0; j < 4; ++j) {
+            uint128_t product = static_cast<uint128_t>(a[j]) * b[i] + t[j] + carry;
+            t[j] = static_cast<std::uint64_t>(product);
+            carry = static_cast<std::uint64_t>(product >> 64);
+        }
+        uint128_t sum = static_cast<uint128_t>(t[4]) + carry;
+        t[4] = static_cast<std::uint64_t>(sum);
+        t[5] = static_cast<std::uint64_t>(sum >> 64);
+
+        std::uint64_t m = t[0] * kOrderMontgomeryFactor;
+        uint128_t product = static_cast<uint128_t>(m) * kOrder[0] + t[0];
+        carry = static_cast<std::uint64_t>(product >> 64);
+        for (std::size_t j = 1; j < 4; ++j) {
+            product = static_cast<uint128_t>(m) * kOrder[j] + t[j] + carry;
+            t[j - 1] = static_cast<std::uint64_t>(product);
+            carry = static_cast<std::uint64_t>(product >> 64);
+        }
+        sum = static_cast<uint128_t>(t[4]) + carry;
+        t[3] = static_cast<std::uint64_t>(sum);
+        t[4] = t[5] + static_cast<std::uint64_t>(sum >> 64);
+    }
+    // t < 2l, so at most one subtraction of l is needed.
+    std::uint64_t reduced[4];
+    std::uint64_t borrow = 0;
+    for (std::size_t j = 0; j < 4; ++j) {
+        uint128_t diff = static_cast<uint128_t>(t[j]) - kOrder[j] - borrow;
+        reduced[j] = static_cast<std::uint64_t>(diff);
+        borrow = static_cast<std::uint64_t>(diff >> 64) & 1;
+    }
+    // Keeps t if the subtraction borrowed out of t[4].
+    std::uint64_t keep = 0 - ((borrow > t[4]) ? std::uint64_t(1) : std::uint64_t(0));
+    for (std::size_t j = 0; j < 4; ++j) {
+        r[j] = (t[j] & keep) | (reduced[j] & ~keep);
+    }
+}
+
+}  // namespace
+
+void ristretto255_from_uniform_bytes(const Byte* uniform_bytes, Byte* point) {
+    ge_encode(ge_from_uniform_bytes(uniform_bytes), point);
+}
+
+void ristretto255_from_uniform_bytes_mul(const Byte* uniform_bytes, const Byte* scalar, Byte* result) {
+    ge_encode(ge_scalar_mul(ge_from_uniform_bytes(uniform_bytes), scalar), result);
+}
+
+bool ristretto255_scalar_mul(const Byte* point, const Byte* scalar, Byte* result) {
+    Ge p;
+    if (ge_decode(point, p) == 0) {
+        return false;
+    }
+    ge_encode(ge_scalar_mul(p, scalar), result);
+    return true;
+}
+
+void ristretto255_base_mul(const Byte* scalar, Byte* result) {
+    ge_encode(ge_scalar_mul(ge_generator(), scalar), result);
+}
+
+bool ristretto255_sum(const Byte* points, std::size_t count, Byte* result) {
+    Ge sum = ge_identity();
+    for (std::size_t item_idx = 0; item_idx < count; ++item_idx) {
+        Ge p;
+        if (ge_decode(points + item_idx * kRistretto255PointBytesLen, p) == 0) {
+            return false;
+        }
+        sum = ge_add(sum, ge_to_cached(p));
+    }
+    ge_encode(sum, result);
+    return true;
+}
+
+bool ristretto255_sub(const Byte* lhs, const Byte* rhs, Byte* result) {
+    Ge p;
+    Ge q;
+    if (ge_decode(lhs, p) == 0 || ge_decode(rhs, q) == 0) {
+        return false;
+    }
+    ge_encode(ge_add(p, ge_to_cached(ge_neg(q))), result);
+    return true;
+}
+
+bool ristretto255_small_log(const Byte* point, std::size_t bit_count, std::uint64_t& log) {
+    if (bit_count < 1 || bit_count > 48) {
+        throw std::invalid_argument("bit_count is not in range [1, 48].");
+    }
+    Ge target;
+    if (ge_decode(point, target) == 0) {
+        return false;
+    }
+    const std::uint64_t baby_step_count = std::uint64_t(1) << ((bit_count + 1) / 2);
+    const std::uint64_t giant_step_count = ((std::uint64_t(1) << bit_count) + baby_step_count - 1) / baby_step_count;
+    const GeCached generator = ge_to_cached(ge_generator());
+
+    // Baby steps are j * G for j in [0, baby_step_count), sorted by fingerprint.
+    std::vector<LogTableEntry> table(static_cast<std::size_t>(baby_step_count));
+    std::vector<Ge> batch;
+    std::vector<std::uint64_t> fingerprints(kLogBatchSize);
+    Ge current = ge_identity();
+    for (std::uint64_t begin = 0; begin < baby_step_count; begin += kLogBatchSize) {
+        std::uint64_t end = std::min<std::uint64_t>(begin + kLogBatchSize, baby_step_count);
+        batch.clear();
+        for (std::uint64_t step = begin; step < end; ++step) {
+            batch.push_back(current);
+            current = ge_add(current, generator);
+        }
+        ge_fingerprints(batch, fingerprints.data());
+        for (std::uint64_t step = begin; step < end; ++step) {
+            table[static_cast<std::size_t>(step)] = LogTableEntry{fingerprints[step - begin], step};
+        }
+    }
+    std::sort(table.begin(), table.end());
+
+    // Giant steps are target - i * baby_step_count * G, where current is baby_step_count * G after the baby steps.
+    const GeCached giant_stride = ge_to_cached(ge_neg(current));
+    Byte target_bytes[kRistretto255PointBytesLen];
+    ge_encode(target, target_bytes);
+    current = target;
+    for (std::uint64_t begin = 0; begin < giant_step_count; begin += kLogBatchSize) {
+        std::uint64_t end = std::min<std::uint64_t>(begin + kLogBatchSize, giant_step_count);
+        batch.clear();
+        for (std::uint64_t step = begin; step < end; ++step) {
+            batch.push_back(current);
+            current = ge_add(current, giant_stride);
+        }
+        ge_fingerprints(batch, fingerprints.data());
+        for (std::uint64_t step = begin; step < end; ++step) {
+            auto range = std::equal_range(table.begin(), table.end(), LogTableEntry{fingerprints[step - begin], 0});
+            for (auto entry = range.first; entry != range.second; ++entry) {
+                std::uint64_t candidate = step * baby_step_count + entry->baby_step;
+                Byte scalar[kRistretto255ScalarBytesLen] = {0};
+                for (std::size_t byte_idx = 0; byte_idx < sizeof(candidate); ++byte_idx) {
+                    scalar[byte_idx] = static_cast<Byte>(candidate >> (8 * byte_idx));
+                }
+                Byte candidate_bytes[kRistretto255PointBytesLen];
+                ristretto255_base_mul(scalar, candidate_bytes);
+                if (std::equal(candidate_bytes, candidate_bytes + kRistretto255PointBytesLen, target_bytes) &&
+                        candidate < (std::uint64_t(1) << bit_count)) {
+                    log = candidate;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Computes scalar^(l - 2) by Fermat's little theorem.
+// The exponent is public, so branching on its bits is constant time.
+void ristretto255_scalar_invert(const Byte* scalar, Byte* inverse) {
+    std::uint64_t a[4];
+    for (std::size_t limb_idx = 0; limb_idx < 4; ++limb_idx) {
+        a[limb_idx] = 0;
+        for (std::size_t byte_idx = 0; byte_idx < 8; ++byte_idx) {
+            a[limb_idx] |= static_cast<std::uint64_t>(scalar[8 * limb_idx + byte_idx]) << (8 * byte_idx);
+        }
+    }
+    std::uint64_t a_mont[4];
+    sc_mont_mul(a, kOrderMontgomeryR2, a_mont);
+
+    std::uint64_t exponent[4] = {kOrder[0] - 2, kOrder[1], kOrder[2], kOrder[3]};
+    std::uint64_t r[4] = {a_mont[0], a_mont[1], a_mont[2], a_mont[3]};
+    // The top bit of l - 2 is bit 252, which is consumed by starting from a.
+    for (std::size_t bit_idx = 252; bit_idx-- > 0;) {
+        sc_mont_mul(r, r, r);
+        if ((exponent[bit_idx / 64] >> (bit_idx % 64)) & 1) {
+            sc_mont_mul(r, a_mont, r);
+        }
+    }
+    const std::uint64_t one[4] = {1, 0, 0, 0};
+    sc_mont_mul(r, one, r);
+    for (std::size_t limb_idx = 0; limb_idx < 4; ++limb_idx) {
+        for (std::size_t byte_idx = 0; byte_idx < 8; ++byte_idx) {
+            inverse[8 * limb_idx + byte_idx] = static_cast<Byte>(r[limb_idx] >> (8 * byte_idx));
+        }
+    }
+}
+
+}  // namespace setops
+}  // namespace petace
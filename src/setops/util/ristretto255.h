@@ -0,0 +1,111 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+#include "setops/util/defines.h"
+
+namespace petace {
+namespace setops {
+
+// The byte length of an encoded Ristretto255 element.
+const std::size_t kRistretto255PointBytesLen = 32;
+// The byte length of a Ristretto255 scalar in little-endian order.
+const std::size_t kRistretto255ScalarBytesLen = 32;
+// The byte length of uniform bytes that are mapped to a Ristretto255 element.
+const std::size_t kRistretto255UniformBytesLen = 64;
+
+/**
+ * @brief Maps uniformly random bytes to a Ristretto255 element as in RFC 9496, e.g., the output of a hash function.
+ *
+ * @param[in] uniform_bytes The kRistretto255UniformBytesLen input bytes.
+ * @param[out] point The kRistretto255PointBytesLen bytes of the encoded element.
+ */
+void ristretto255_from_uniform_bytes(const Byte* uniform_bytes, Byte* point);
+
+/**
+ * @brief Maps uniformly random bytes to a Ristretto255 element and multiplies it by a scalar in constant time.
+ *
+ * This is equivalent to but faster than ristretto255_from_uniform_bytes followed by ristretto255_scalar_mul.
+ *
+ * @param[in] uniform_bytes The kRistretto255UniformBytesLen input bytes.
+ * @param[in] scalar The kRistretto255ScalarBytesLen bytes of the scalar.
+ * @param[out] result The kRistretto255PointBytesLen bytes of the encoded product.
+ */
+void ristretto255_from_uniform_bytes_mul(const Byte* uniform_bytes, const Byte* scalar, Byte* result);
+
+/**
+ * @brief Multiplies an encoded Ristretto255 element by a scalar in constant time.
+ *
+ * @param[in] point The kRistretto255PointBytesLen bytes of the encoded element.
+ * @param[in] scalar The kRistretto255ScalarBytesLen bytes of the scalar.
+ * @param[out] result The kRistretto255PointBytesLen bytes of the encoded product.
+ * @return False if point is not a valid encoding, in which case result is not written.
+ */
+bool ristretto255_scalar_mul(const Byte* point, const Byte* scalar, Byte* result);
+
+/**
+ * @brief Multiplies the generator of RFC 9496 by a scalar in constant time.
+ *
+ * @param[in] scalar The kRistretto255ScalarBytesLen bytes of the scalar.
+ * @param[out] result The kRistretto255PointBytesLen bytes of the encoded product.
+ */
+void ristretto255_base_mul(const Byte* scalar, Byte* result);
+
+/**
+ * @brief Adds encoded Ristretto255 elements.
+ *
+ * @param[in] points The count * kRistretto255PointBytesLen bytes of encoded elements.
+ * @param[in] count The number of elements, where the sum of no element is the identity.
+ * @param[out] result The kRistretto255PointBytesLen bytes of the encoded sum.
+ * @return False if any element is not a valid encoding, in which case result is not written.
+ */
+bool ristretto255_sum(const Byte* points, std::size_t count, Byte* result);
+
+/**
+ * @brief Subtracts an encoded Ristretto255 element from another.
+ *
+ * @param[in] lhs The kRistretto255PointBytesLen bytes of the encoded minuend.
+ * @param[in] rhs The kRistretto255PointBytesLen bytes of the encoded subtrahend.
+ * @param[out] result The kRistretto255PointBytesLen bytes of the encoded difference.
+ * @return False if lhs or rhs is not a valid encoding, in which case result is not written.
+ */
+bool ristretto255_sub(const Byte* lhs, const Byte* rhs, Byte* result);
+
+/**
+ * @brief Finds the discrete logarithm of an element to the base of the generator if it is small.
+ *
+ * Baby-step giant-step with 2^ceil(bit_count / 2) baby steps, which takes time and memory in proportion to that many
+ * elements. The running time depends on the logarithm, so the logarithm must not be secret to whoever can observe it.
+ *
+ * @param[in] point The kRistretto255PointBytesLen bytes of the encoded element.
+ * @param[in] bit_count The bound of the logarithm in bits, 1 to 48.
+ * @param[out] log The logarithm below 2^bit_count.
+ * @return False if point is not a valid encoding or its logarithm is not below 2^bit_count.
+ * @throws std::invalid_argument if bit_count is out of range.
+ */
+bool ristretto255_small_log(const Byte* point, std::size_t bit_count, std::uint64_t& log);
+
+/**
+ * @brief Inverts a scalar modulo the group order in constant time.
+ *
+ * @param[in] scalar The kRistretto255ScalarBytesLen bytes of a non-zero scalar below the group order.
+ * @param[out] inverse The kRistretto255ScalarBytesLen bytes of the inverse below the group order.
+ */
+void ristretto255_scalar_invert(const Byte* scalar, Byte* inverse);
+
+}  // namespace setops
+}  // namespace petace
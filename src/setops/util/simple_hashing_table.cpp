@@ -0,0 +1,87 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/simple_hashing_table.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "solo/cuckoo_hashing.h"
+
+namespace petace {
+namespace setops {
+
+SimpleHashingTable::SimpleHashingTable(const std::vector<Item>& keys, std::size_t num_of_bins,
+        std::size_t num_of_fun, const std::vector<Byte>& seed, std::size_t num_threads, std::size_t stash_size) {
+    if (num_of_bins == 0 || num_of_fun == 0) {
+        throw std::invalid_argument("num_of_bins or num_of_fun is 0.");
+    }
+    if (num_of_fun + stash_size > 256) {
+        throw std::invalid_argument("num_of_fun and stash_size are larger than 256.");
+    }
+    // Only the addresses of keys are taken from cuckoo hashing, and keys are never moved between bins.
+    solo::CuckooHashing<kItemBytesLen> hashing(num_of_bins, seed);
+    hashing.set_num_of_hash_functions(num_of_fun);
+    hashing.insert(keys);
+    auto addresses = hashing.get_element_addresses();
+    std::size_t entry_count = keys.size() * num_of_fun;
+    if (addresses.size() != entry_count) {
+        throw std::runtime_error("cuckoo hashing returns unexpected addresses.");
+    }
+
+    std::vector<std::size_t> cursors(num_of_bins + stash_size + 1, 0);
+#pragma omp parallel for num_threads(num_threads)
+    for (std::size_t entry_idx = 0; entry_idx < entry_count; ++entry_idx) {
+#pragma omp atomic
+        ++cursors[addresses[entry_idx] + 1];
+    }
+    for (std::size_t bin_idx = num_of_bins; bin_idx < num_of_bins + stash_size; ++bin_idx) {
+        cursors[bin_idx + 1] = keys.size();
+    }
+    for (std::size_t bin_idx = 0; bin_idx < num_of_bins + stash_size; ++bin_idx) {
+        cursors[bin_idx + 1] += cursors[bin_idx];
+    }
+    offsets_ = cursors;
+
+    values_.resize(offsets_.back());
+    function_ids_.resize(offsets_.back());
+#pragma omp parallel for num_threads(num_threads)
+    for (std::size_t entry_idx = 0; entry_idx < entry_count; ++entry_idx) {
+        std::size_t slot = 0;
+#pragma omp atomic capture
+        slot = cursors[addresses[entry_idx]]++;
+        std::size_t function_id = entry_idx % num_of_fun;
+        values_[slot] = keys[entry_idx / num_of_fun];
+        values_[slot][0] ^= static_cast<Byte>(function_id);
+        function_ids_[slot] = static_cast<std::uint8_t>(function_id);
+    }
+
+    std::size_t stash_entry_count = stash_size * keys.size();
+#pragma omp parallel for num_threads(num_threads)
+    for (std::size_t stash_entry_idx = 0; stash_entry_idx < stash_entry_count; ++stash_entry_idx) {
+        std::size_t slot = entry_count + stash_entry_idx;
+        std::size_t function_id = num_of_fun + stash_entry_idx / keys.size();
+        values_[slot] = keys[stash_entry_idx % keys.size()];
+        values_[slot][0] ^= static_cast<Byte>(function_id);
+        function_ids_[slot] = static_cast<std::uint8_t>(function_id);
+    }
+}
+
+std::size_t SimpleHashingTable::bin_of(std::size_t entry_idx) const {
+    return static_cast<std::size_t>(std::upper_bound(offsets_.begin(), offsets_.end(), entry_idx) - offsets_.begin()) -
+           1;
+}
+
+}  // namespace setops
+}  // namespace petace
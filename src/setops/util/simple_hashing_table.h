@@ -0,0 +1,111 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "setops/util/defines.h"
+
+namespace petace {
+namespace setops {
+
+/**
+ * @brief A simple hashing table of keys in compressed sparse row layout.
+ *
+ * Every key is placed in the bin of each hash function, as the entry of the key with its first byte XORed by the
+ * function ID. Entries of all bins are stored back to back in one array, where bin i holds entries in [bin_begin(i),
+ * bin_end(i)). Compared with a vector per bin, the table takes two allocations in total and is scanned sequentially.
+ * Bins are those of solo::CuckooHashing with the same seed, so that the table matches the cuckoo hashing table of the
+ * other party.
+ *
+ * Stash bins follow the bins of hash functions, one per stash slot of the other party. Stash bin j holds every key
+ * with its first byte XORed by num_of_fun + j, so that a key in any stash slot finds its match there.
+ */
+class SimpleHashingTable {
+public:
+    /**
+     * @brief Places keys in bins with a parallel counting pass.
+     *
+     * The order of entries in a bin is unspecified.
+     *
+     * @param[in] keys The keys.
+     * @param[in] num_of_bins The number of bins.
+     * @param[in] num_of_fun The number of hash functions.
+     * @param[in] seed The seed of hash functions.
+     * @param[in] num_threads The number of threads.
+     * @param[in] stash_size The number of stash bins appended after num_of_bins bins.
+     * @throws std::invalid_argument if there is no bin or no hash function, or if num_of_fun + stash_size is above 256.
+     */
+    SimpleHashingTable(const std::vector<Item>& keys, std::size_t num_of_bins, std::size_t num_of_fun,
+            const std::vector<Byte>& seed, std::size_t num_threads, std::size_t stash_size = 0);
+
+    /**
+     * @brief Returns the number of bins, including stash bins.
+     */
+    std::size_t bin_count() const {
+        return offsets_.size() - 1;
+    }
+
+    /**
+     * @brief Returns the total number of entries of all bins.
+     */
+    std::size_t entry_count() const {
+        return values_.size();
+    }
+
+    /**
+     * @brief Returns the index of the first entry of a bin.
+     */
+    std::size_t bin_begin(std::size_t bin_idx) const {
+        return offsets_[bin_idx];
+    }
+
+    /**
+     * @brief Returns the index past the last entry of a bin.
+     */
+    std::size_t bin_end(std::size_t bin_idx) const {
+        return offsets_[bin_idx + 1];
+    }
+
+    /**
+     * @brief Returns the bin that holds an entry.
+     */
+    std::size_t bin_of(std::size_t entry_idx) const;
+
+    /**
+     * @brief Returns the values of all entries, which are keys with the first byte XORed by the function ID.
+     */
+    const std::vector<Item>& values() const {
+        return values_;
+    }
+
+    /**
+     * @brief Returns the IDs of hash functions that placed all entries.
+     */
+    const std::vector<std::uint8_t>& function_ids() const {
+        return function_ids_;
+    }
+
+private:
+    std::vector<std::size_t> offsets_{};
+
+    std::vector<Item> values_{};
+
+    std::vector<std::uint8_t> function_ids_{};
+};
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,265 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/worker_pool.h"
+
+#include <omp.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+// Parses a CPU list of the Linux sysfs format, such as "0-3,8,10-11".
+std::vector<int> parse_cpu_list(const std::string& cpu_list) {
+    std::vector<int> cpus;
+    std::istringstream stream(cpu_list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        std::size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// Returns the sorted CPUs that the process is allowed to run on.
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+        throw std::runtime_error("sched_getaffinity failed.");
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &cpu_set)) {
+            cpus.push_back(cpu);
+        }
+    }
+#endif
+    return cpus;
+}
+
+// Returns the sorted CPUs of a NUMA node.
+std::vector<int> numa_node_cpus(int numa_node) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(numa_node) + "/cpulist");
+    if (!in.is_open()) {
+        throw std::invalid_argument("numa_node " + std::to_string(numa_node) + " does not exist.");
+    }
+    std::string cpu_list;
+    std::getline(in, cpu_list);
+    return parse_cpu_list(cpu_list);
+}
+
+// Returns the CPU quota of the cgroup rounded up to whole CPUs, or 0 if the quota is unlimited or unknown.
+std::size_t cgroup_cpu_quota() {
+    long long quota = -1;
+    long long period = 0;
+    std::ifstream cgroup_v2("/sys/fs/cgroup/cpu.max");
+    if (cgroup_v2.is_open()) {
+        std::string quota_str;
+        cgroup_v2 >> quota_str >> period;
+        if (quota_str != "max") {
+            std::istringstream(quota_str) >> quota;
+        }
+    } else {
+        std::ifstream quota_file("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+        std::ifstream period_file("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+        quota_file >> quota;
+        period_file >> period;
+    }
+    if (quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return static_cast<std::size_t>((quota + period - 1) / period);
+}
+
+#ifdef __linux__
+cpu_set_t to_cpu_set(const std::vector<int>& cpus) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &cpu_set);
+    }
+    return cpu_set;
+}
+#endif
+
+std::vector<int> intersect_sorted(const std::vector<int>& lhs, const std::vector<int>& rhs) {
+    std::vector<int> intersection;
+    std::set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::back_inserter(intersection));
+    return intersection;
+}
+
+}  // namespace
+
+WorkerPoolOptions WorkerPoolOptions::from_params(const nlohmann::json& params) {
+    WorkerPoolOptions options;
+    auto threads = params.find("threads");
+    if (threads == params.end()) {
+        return options;
+    }
+    long long num_threads = threads->value("num_threads", 0LL);
+    if (num_threads < 0) {
+        throw std::invalid_argument("threads.num_threads is negative.");
+    }
+    options.num_threads = static_cast<std::size_t>(num_threads);
+    options.cpu_affinity = threads->value("cpu_affinity", std::vector<int>());
+    for (int cpu : options.cpu_affinity) {
+        if (cpu < 0) {
+            throw std::invalid_argument("threads.cpu_affinity has a negative CPU.");
+        }
+    }
+    options.numa_node = threads->value("numa_node", -1);
+    if (options.numa_node < -1) {
+        throw std::invalid_argument("threads.numa_node is invalid.");
+    }
+    return options;
+}
+
+WorkerPool::WorkerPool(const WorkerPoolOptions& options) : options_(options) {
+    if (!options_.cpu_affinity.empty() || options_.numa_node >= 0) {
+#ifndef __linux__
+        throw std::invalid_argument("cpu_affinity and numa_node are only supported on Linux.");
+#endif
+        cpus_ = allowed_cpus();
+        if (!options_.cpu_affinity.empty()) {
+            std::vector<int> cpu_affinity = options_.cpu_affinity;
+            std::sort(cpu_affinity.begin(), cpu_affinity.end());
+            cpus_ = intersect_sorted(cpus_, cpu_affinity);
+        }
+        if (options_.numa_node >= 0) {
+            cpus_ = intersect_sorted(cpus_, numa_node_cpus(options_.numa_node));
+        }
+        if (cpus_.empty()) {
+            throw std::invalid_argument("no allowed CPU matches cpu_affinity and numa_node.");
+        }
+    }
+
+    if (options_.num_threads != 0) {
+        num_threads_ = options_.num_threads;
+        return;
+    }
+    std::size_t num_threads = static_cast<std::size_t>(omp_get_max_threads());
+    if (!cpus_.empty()) {
+        num_threads = std::min(num_threads, cpus_.size());
+    }
+    std::size_t cpu_quota = cgroup_cpu_quota();
+    if (cpu_quota != 0) {
+        num_threads = std::min(num_threads, cpu_quota);
+    }
+    num_threads_ = std::max<std::size_t>(num_threads, 1);
+}
+
+std::shared_ptr<WorkerPool> WorkerPool::get(const WorkerPoolOptions& options) {
+    // Pools are held weakly, so that a pool is released with the last protocol using it.
+    static std::mutex pools_mutex;
+    static std::vector<std::weak_ptr<WorkerPool>> pools;
+    std::lock_guard<std::mutex> lock(pools_mutex);
+    pools.erase(std::remove_if(pools.begin(), pools.end(),
+                        [](const std::weak_ptr<WorkerPool>& pool) { return pool.expired(); }),
+            pools.end());
+    for (const auto& weak_pool : pools) {
+        std::shared_ptr<WorkerPool> pool = weak_pool.lock();
+        if (pool != nullptr && pool->options_ == options) {
+            return pool;
+        }
+    }
+    std::shared_ptr<WorkerPool> pool(new WorkerPool(options));
+    pools.push_back(pool);
+    return pool;
+}
+
+void WorkerPool::bind(std::size_t num_threads, std::size_t cpu_offset) const {
+    if (cpus_.empty()) {
+        return;
+    }
+#ifdef __linux__
+    std::size_t team_size = num_threads == 0 ? num_threads_ : num_threads;
+    // The calling thread keeps all CPUs of the slice, which threads it creates later, such as the teams of background
+    // tasks, inherit. Other team threads are pinned to one CPU each.
+    cpu_set_t slice_cpu_set;
+    CPU_ZERO(&slice_cpu_set);
+    for (std::size_t cpu_idx = 0; cpu_idx < std::min(team_size, cpus_.size()); ++cpu_idx) {
+        CPU_SET(cpus_[(cpu_offset + cpu_idx) % cpus_.size()], &slice_cpu_set);
+    }
+    if (sched_setaffinity(0, sizeof(slice_cpu_set), &slice_cpu_set) != 0) {
+        throw std::runtime_error("sched_setaffinity failed.");
+    }
+    bool all_bound = true;
+#pragma omp parallel num_threads(team_size) reduction(&& : all_bound)
+    {
+        std::size_t thread_idx = static_cast<std::size_t>(omp_get_thread_num());
+        if (thread_idx != 0) {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpus_[(cpu_offset + thread_idx) % cpus_.size()], &cpu_set);
+            if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+                all_bound = false;
+            }
+        }
+    }
+    if (!all_bound) {
+        throw std::runtime_error("sched_setaffinity failed.");
+    }
+#else
+    (void)num_threads;
+    (void)cpu_offset;
+#endif
+}
+
+ScopedWorkerBinding::ScopedWorkerBinding(const WorkerPool& pool, std::size_t num_threads, std::size_t cpu_offset) {
+    if (pool.cpus().empty()) {
+        return;
+    }
+    team_size_ = num_threads == 0 ? pool.num_threads() : num_threads;
+    saved_cpus_ = allowed_cpus();
+    pool.bind(num_threads, cpu_offset);
+}
+
+ScopedWorkerBinding::~ScopedWorkerBinding() {
+    if (saved_cpus_.empty()) {
+        return;
+    }
+#ifdef __linux__
+    // Team threads were created by the calling thread, so that they are restored to its CPUs as well. Failures are
+    // ignored, since a destructor must not throw.
+    cpu_set_t cpu_set = to_cpu_set(saved_cpus_);
+#pragma omp parallel num_threads(team_size_)
+    {
+        (void)sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+    }
+#endif
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,147 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+namespace petace {
+namespace setops {
+
+/**
+ * @brief Options of the worker threads of a protocol, read from the "threads" block of its JSON params:
+ *
+ * "threads": {
+ *     "num_threads": 0,
+ *     "cpu_affinity": [],
+ *     "numa_node": -1
+ * }
+ */
+struct WorkerPoolOptions {
+    // The number of worker threads, or 0 for one per usable CPU within the cgroup CPU quota.
+    std::size_t num_threads = 0;
+    // The CPUs that workers are pinned to, or empty to use all CPUs allowed for the process.
+    std::vector<int> cpu_affinity{};
+    // The NUMA node whose CPUs workers are pinned to, or -1 for no NUMA binding.
+    int numa_node = -1;
+
+    /**
+     * @brief Reads options from the "threads" block of JSON params, where the block and every field are optional.
+     *
+     * @param[in] params The JSON params of a protocol.
+     * @throws std::invalid_argument if a field has an invalid value.
+     */
+    static WorkerPoolOptions from_params(const nlohmann::json& params);
+
+    bool operator==(const WorkerPoolOptions& other) const {
+        return num_threads == other.num_threads && cpu_affinity == other.cpu_affinity && numa_node == other.numa_node;
+    }
+};
+
+/**
+ * @brief The worker threads that all protocols run their OpenMP regions on.
+ *
+ * Workers are the persistent OpenMP team of the calling thread, so a pool only decides the team size and pins the
+ * team to CPUs. Pools are shared: protocols created with equal options get the same pool while any of them holds it.
+ * When workers are pinned to a NUMA node, buffers that are first touched by the team, such as PointBuffer created with
+ * a thread count, are allocated on that node.
+ */
+class WorkerPool {
+public:
+    /**
+     * @brief Returns the shared pool of the given options, creating it if no pool of them is held.
+     *
+     * @param[in] options The options of worker threads.
+     * @throws std::invalid_argument if no CPU is usable under the options.
+     */
+    static std::shared_ptr<WorkerPool> get(const WorkerPoolOptions& options);
+
+    /**
+     * @brief Returns the number of worker threads.
+     */
+    std::size_t num_threads() const {
+        return num_threads_;
+    }
+
+    /**
+     * @brief Returns the CPUs that workers are pinned to, or empty if workers are not pinned.
+     */
+    const std::vector<int>& cpus() const {
+        return cpus_;
+    }
+
+    /**
+     * @brief Pins the calling thread and its OpenMP team of num_threads threads to a slice of the CPUs of the pool.
+     *
+     * The slice is num_threads CPUs of the pool from index cpu_offset, round robin. The calling thread may run on any
+     * CPU of the slice, and so may threads it creates later. Other team threads are pinned to one CPU of the slice
+     * each by thread number. Threads that run at the same time, such as a background task and the calling thread, can
+     * take disjoint slices with different offsets. This does nothing if workers are not pinned. Protocols use
+     * ScopedWorkerBinding instead, so that the affinity of the caller is restored.
+     *
+     * @param[in] num_threads The size of the team, or 0 for the number of worker threads.
+     * @param[in] cpu_offset The index of the first CPU of the slice.
+     * @throws std::runtime_error if the affinity cannot be set.
+     */
+    void bind(std::size_t num_threads = 0, std::size_t cpu_offset = 0) const;
+
+private:
+    explicit WorkerPool(const WorkerPoolOptions& options);
+
+    WorkerPool(const WorkerPool& copy) = delete;
+
+    WorkerPool& operator=(const WorkerPool& assign) = delete;
+
+    WorkerPoolOptions options_{};
+
+    std::size_t num_threads_ = 1;
+
+    std::vector<int> cpus_{};
+};
+
+/**
+ * @brief Binds the calling thread and its OpenMP team by WorkerPool::bind for its lifetime.
+ *
+ * On destruction, the calling thread and num_threads threads of its team are allowed to run on the CPUs that the
+ * calling thread was allowed to run on before, so that a protocol does not change the affinity of its caller.
+ */
+class ScopedWorkerBinding {
+public:
+    /**
+     * @brief Binds the calling thread and its team, see WorkerPool::bind.
+     *
+     * @param[in] pool The worker pool.
+     * @param[in] num_threads The size of the team, or 0 for the number of worker threads.
+     * @param[in] cpu_offset The index of the first CPU of the slice.
+     * @throws std::runtime_error if the affinity cannot be read or set.
+     */
+    ScopedWorkerBinding(const WorkerPool& pool, std::size_t num_threads = 0, std::size_t cpu_offset = 0);
+
+    ~ScopedWorkerBinding();
+
+    ScopedWorkerBinding(const ScopedWorkerBinding& copy) = delete;
+
+    ScopedWorkerBinding& operator=(const ScopedWorkerBinding& assign) = delete;
+
+private:
+    std::size_t team_size_ = 0;
+    // The CPUs that the calling thread was allowed to run on, or empty if nothing was bound.
+    std::vector<int> saved_cpus_{};
+};
+
+}  // namespace setops
+}  // namespace petace
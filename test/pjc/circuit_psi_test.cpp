@@ -83,8 +83,8 @@ class CircuitPSITest : public ::testing::Test {
                 "output_file": "data/receiver_output_file.csv"
             },
             "circuit_psi_params": {
-                "epsilon": 0.27,
-                "fun_epsilon": 0.27,
+                "epsilon": 1.1,
+                "fun_epsilon": 1.27,
                 "fun_num": 3,
                 "hint_fun_num": 3
             }
@@ -451,11 +451,71 @@ TEST_F(CircuitPSITest, unbalanced_null_feature_test) {
     }
 }
 
+TEST_F(CircuitPSITest, balanced_stash_test) {
+    t_[0] = std::thread([this]() { circuit_psi_balanced(sender_params_stash_zero_); });
+    t_[1] = std::thread([this]() { circuit_psi_balanced(receiver_params_stash_zero_); });
+
+    t_[0].join();
+    t_[1].join();
+
+    balanced_output_.resize(balanced_sender_output_.size());
+    for (std::size_t i = 0; i < balanced_sender_output_.size(); i++) {
+        balanced_output_[i].resize(balanced_sender_output_[i].size());
+        for (std::size_t j = 0; j < balanced_sender_output_[i].size(); j++) {
+            if (i == 0) {
+                balanced_output_[i][j] = balanced_sender_output_[i][j] ^ balanced_receiver_output_[i][j];
+            } else {
+                balanced_output_[i][j] = balanced_sender_output_[i][j] + balanced_receiver_output_[i][j];
+            }
+        }
+    }
+    actual_results_.resize(balanced_output_.size());
+    for (std::size_t i = 0; i < balanced_output_.size(); i++) {
+        actual_results_[i] = 0;
+        for (std::size_t j = 0; j < balanced_output_[i].size(); j++) {
+            if (i == 0) {
+                actual_results_[i] += balanced_output_[i][j];
+            } else {
+                actual_results_[i] += balanced_output_[0][j] * balanced_output_[i][j];
+            }
+        }
+    }
+
+    EXPECT_EQ(actual_results_.size(), expected_results_.size());
+    for (std::size_t i = 0; i < actual_results_.size(); i++) {
+        EXPECT_EQ(expected_results_[i], actual_results_[i]);
+    }
+}
+
+TEST_F(CircuitPSITest, circuit_psi_stash_unsupported) {
+    json sender_params = sender_params_stash_zero_;
+    json receiver_params = receiver_params_stash_zero_;
+    sender_params["circuit_psi_params"]["epsilon"] = 0.27;
+    receiver_params["circuit_psi_params"]["epsilon"] = 0.27;
+    t_[0] = std::thread([this, &sender_params]() {
+        EXPECT_THROW(circuit_psi_stash_not_zero(sender_params), std::invalid_argument);
+    });
+    t_[1] = std::thread([this, &receiver_params]() {
+        EXPECT_THROW(circuit_psi_stash_not_zero(receiver_params), std::invalid_argument);
+    });
+
+    t_[0].join();
+    t_[1].join();
+}
+
 TEST_F(CircuitPSITest, circuit_psi_stash_not_zero) {
-    t_[0] = std::thread(
-            [this]() { EXPECT_THROW(circuit_psi_stash_not_zero(sender_params_stash_zero_), std::invalid_argument); });
-    t_[1] = std::thread(
-            [this]() { EXPECT_THROW(circuit_psi_stash_not_zero(receiver_params_stash_zero_), std::invalid_argument); });
+    json sender_params = sender_params_stash_zero_;
+    json receiver_params = receiver_params_stash_zero_;
+    sender_params["circuit_psi_params"]["epsilon"] = 0.27;
+    receiver_params["circuit_psi_params"]["epsilon"] = 0.27;
+    sender_params["circuit_psi_params"]["stash_failure_bits"] = 0;
+    receiver_params["circuit_psi_params"]["stash_failure_bits"] = 0;
+    t_[0] = std::thread([this, &sender_params]() {
+        EXPECT_THROW(circuit_psi_stash_not_zero(sender_params), std::invalid_argument);
+    });
+    t_[1] = std::thread([this, &receiver_params]() {
+        EXPECT_THROW(circuit_psi_stash_not_zero(receiver_params), std::invalid_argument);
+    });
 
     t_[0].join();
     t_[1].join();
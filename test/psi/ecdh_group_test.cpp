@@ -0,0 +1,198 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/psi/ecdh_group.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "solo/prng.h"
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+std::unique_ptr<EcdhGroup> create_group(int curve_id) {
+    auto group = EcdhGroup::create(curve_id);
+    auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
+    group->create_secret_key(prng_factory.create());
+    return group;
+}
+
+// Checks that both orders of encryption of each key give the same compare tag, and different keys do not.
+void test_commutative(int curve_id) {
+    auto sender = create_group(curve_id);
+    auto receiver = create_group(curve_id);
+    std::size_t point_byte_count = sender->point_byte_count();
+    std::vector<std::string> keys = {"alice", "bob", "charlie", ""};
+
+    std::vector<ByteVector> tags;
+    for (const auto& key : keys) {
+        ByteVector sender_encrypted(point_byte_count);
+        ByteVector receiver_encrypted(point_byte_count);
+        sender->encrypt_key(key, sender_encrypted.data());
+        receiver->encrypt_key(key, receiver_encrypted.data());
+
+        ByteVector sender_tag(kECCMaxCompareBytesLen);
+        ByteVector receiver_tag(kECCMaxCompareBytesLen);
+        ASSERT_TRUE(sender->doublely_encrypt_key(receiver_encrypted.data(), sender_tag.size(), sender_tag.data()));
+        ASSERT_TRUE(receiver->doublely_encrypt_key(sender_encrypted.data(), receiver_tag.size(), receiver_tag.data()));
+        EXPECT_EQ(sender_tag, receiver_tag);
+        tags.push_back(sender_tag);
+    }
+    for (std::size_t idx = 1; idx < tags.size(); ++idx) {
+        EXPECT_NE(tags[idx - 1], tags[idx]);
+    }
+}
+
+void test_decrypt(int curve_id) {
+    auto server = create_group(curve_id);
+    auto client = create_group(curve_id);
+    std::size_t point_byte_count = server->point_byte_count();
+    for (const auto& key : std::vector<std::string>{"alice", "bob", ""}) {
+        ByteVector server_encrypted(point_byte_count);
+        ByteVector client_encrypted(point_byte_count);
+        server->encrypt_key(key, server_encrypted.data());
+        client->encrypt_key(key, client_encrypted.data());
+
+        ByteVector doublely_encrypted(point_byte_count);
+        ASSERT_TRUE(server->doublely_encrypt_key(
+                client_encrypted.data(), doublely_encrypted.size(), doublely_encrypted.data()));
+        ByteVector tag(kECCMaxCompareBytesLen);
+        ASSERT_TRUE(client->decrypt_key(doublely_encrypted.data(), tag.size(), tag.data()));
+        auto tag_begin = server_encrypted.begin() + client->tag_offset(tag.size());
+        EXPECT_EQ(tag, ByteVector(tag_begin, tag_begin + tag.size()));
+    }
+}
+
+}  // namespace
+
+TEST(EcdhGroupTest, create_test) {
+    EXPECT_EQ(EcdhGroup::create(kP256CurveId)->point_byte_count(), kEccPointLen);
+    EXPECT_EQ(EcdhGroup::create(kCurve25519CurveId)->point_byte_count(), std::size_t(32));
+    EXPECT_THROW(EcdhGroup::create(0), std::invalid_argument);
+}
+
+TEST(EcdhGroupTest, tag_offset_test) {
+    auto p256 = EcdhGroup::create(kP256CurveId);
+    EXPECT_EQ(p256->tag_offset(kECCCompareBytesLen), p256->point_byte_count() - kECCCompareBytesLen);
+    EXPECT_EQ(p256->tag_offset(p256->point_byte_count()), std::size_t(0));
+    // Ristretto255 tags skip the first byte, whose lowest bit is always 0, and never reach the last byte, whose
+    // highest bit is always 0.
+    auto ristretto255 = EcdhGroup::create(kCurve25519CurveId);
+    EXPECT_EQ(ristretto255->tag_offset(kECCMaxCompareBytesLen), std::size_t(1));
+    EXPECT_EQ(ristretto255->tag_offset(ristretto255->point_byte_count()), std::size_t(0));
+}
+
+TEST(EcdhGroupTest, p256_commutative_test) {
+    test_commutative(kP256CurveId);
+}
+
+TEST(EcdhGroupTest, curve25519_commutative_test) {
+    test_commutative(kCurve25519CurveId);
+}
+
+TEST(EcdhGroupTest, p256_decrypt_test) {
+    test_decrypt(kP256CurveId);
+}
+
+TEST(EcdhGroupTest, curve25519_decrypt_test) {
+    test_decrypt(kCurve25519CurveId);
+}
+
+TEST(EcdhGroupTest, indexed_encrypt_test) {
+    std::vector<std::string> keys = {"alice", "bob", "charlie", ""};
+    std::vector<std::size_t> indices = {3, 0, 2, 0, 1};
+    for (int curve_id : EcdhGroup::supported_curve_ids()) {
+        auto group = create_group(curve_id);
+        std::size_t point_byte_count = group->point_byte_count();
+        ByteVector encrypted_keys(indices.size() * point_byte_count);
+        group->encrypt_keys(Span<const std::string>(keys.data(), keys.size()),
+                Span<const std::size_t>(indices.data(), indices.size()), encrypted_keys.data());
+        for (std::size_t idx = 0; idx < indices.size(); ++idx) {
+            ByteVector encrypted_key(point_byte_count);
+            group->encrypt_key(keys[indices[idx]], encrypted_key.data());
+            EXPECT_EQ(ByteVector(encrypted_keys.begin() + idx * point_byte_count,
+                              encrypted_keys.begin() + (idx + 1) * point_byte_count),
+                    encrypted_key)
+                    << curve_id << ", " << idx;
+        }
+    }
+}
+
+TEST(EcdhGroupTest, batched_double_encrypt_test) {
+    std::vector<std::string> keys = {"alice", "bob", "charlie"};
+    for (int curve_id : EcdhGroup::supported_curve_ids()) {
+        auto group = create_group(curve_id);
+        std::size_t point_byte_count = group->point_byte_count();
+        ByteVector encrypted_keys(keys.size() * point_byte_count);
+        group->encrypt_keys(Span<const std::string>(keys.data(), keys.size()), encrypted_keys.data());
+
+        ByteVector doublely_encrypted_keys(keys.size() * point_byte_count);
+        ByteVector tags(keys.size() * kECCCompareBytesLen);
+        ASSERT_TRUE(group->doublely_encrypt_keys(
+                encrypted_keys.data(), keys.size(), point_byte_count, doublely_encrypted_keys.data()));
+        ASSERT_TRUE(group->decrypt_keys(
+                doublely_encrypted_keys.data(), keys.size(), kECCCompareBytesLen, tags.data()));
+        for (std::size_t idx = 0; idx < keys.size(); ++idx) {
+            ByteVector doublely_encrypted_key(point_byte_count);
+            ASSERT_TRUE(group->doublely_encrypt_key(
+                    encrypted_keys.data() + idx * point_byte_count, point_byte_count, doublely_encrypted_key.data()));
+            EXPECT_EQ(ByteVector(doublely_encrypted_keys.begin() + idx * point_byte_count,
+                              doublely_encrypted_keys.begin() + (idx + 1) * point_byte_count),
+                    doublely_encrypted_key)
+                    << curve_id << ", " << idx;
+            ByteVector tag(kECCCompareBytesLen);
+            ASSERT_TRUE(group->decrypt_key(doublely_encrypted_key.data(), kECCCompareBytesLen, tag.data()));
+            EXPECT_EQ(ByteVector(tags.begin() + idx * kECCCompareBytesLen,
+                              tags.begin() + (idx + 1) * kECCCompareBytesLen),
+                    tag)
+                    << curve_id << ", " << idx;
+        }
+    }
+
+    // An invalid point in the middle of a batch fails the batch.
+    auto group = create_group(kP256CurveId);
+    ByteVector encrypted_keys(keys.size() * group->point_byte_count());
+    group->encrypt_keys(Span<const std::string>(keys.data(), keys.size()), encrypted_keys.data());
+    std::fill_n(encrypted_keys.begin() + group->point_byte_count(), group->point_byte_count(), 0xff);
+    ByteVector tags(keys.size() * kECCCompareBytesLen);
+    EXPECT_FALSE(group->doublely_encrypt_keys(encrypted_keys.data(), keys.size(), kECCCompareBytesLen, tags.data()));
+    EXPECT_FALSE(group->decrypt_keys(encrypted_keys.data(), keys.size(), kECCCompareBytesLen, tags.data()));
+}
+
+TEST(EcdhGroupTest, p256_invalid_point_test) {
+    auto group = create_group(kP256CurveId);
+    ByteVector tag(kECCCompareBytesLen);
+    // x = 1 is not on P-256, since 1 - 3 + b is not a square modulo p.
+    ByteVector encrypted_key(group->point_byte_count(), 0);
+    encrypted_key.front() = 0x02;
+    encrypted_key.back() = 1;
+    EXPECT_FALSE(group->doublely_encrypt_key(encrypted_key.data(), kECCCompareBytesLen, tag.data()));
+    // x = 2^256 - 1 is not a canonical coordinate.
+    encrypted_key.assign(group->point_byte_count(), 0xff);
+    encrypted_key.front() = 0x02;
+    EXPECT_FALSE(group->doublely_encrypt_key(encrypted_key.data(), kECCCompareBytesLen, tag.data()));
+    // 0xff is not a point encoding.
+    encrypted_key.front() = 0xff;
+    EXPECT_FALSE(group->doublely_encrypt_key(encrypted_key.data(), kECCCompareBytesLen, tag.data()));
+}
+
+}  // namespace setops
+}  // namespace petace
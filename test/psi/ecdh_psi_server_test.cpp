@@ -0,0 +1,133 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/psi/ecdh_psi_server.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "nlohmann/json.hpp"
+
+#include "network/net_factory.h"
+
+#include "setops/psi/ecdh_psi.h"
+
+namespace petace {
+namespace setops {
+
+using json = nlohmann::json;
+
+class ECDHPSIServerTest : public ::testing::Test {
+public:
+    void SetUp() {
+        server_params_ = R"({
+            "common": {
+                "is_sender": true,
+                "verbose": false
+            },
+            "ecdh_params": {
+                "curve_id": 415,
+                "obtain_result": true,
+                "chunk_size": 2
+            }
+        })"_json;
+        partner_params_ = server_params_;
+        partner_params_["common"]["is_sender"] = false;
+    }
+
+    std::shared_ptr<network::Network> build_net(int remote_port, int local_port) {
+        network::NetParams net_params;
+        net_params.remote_addr = "127.0.0.1";
+        net_params.remote_port = remote_port;
+        net_params.local_port = local_port;
+        return network::NetFactory::get_instance().build(network::NetScheme::SOCKET, net_params);
+    }
+
+    void run_partner(int partner_idx, bool cardinality_only) {
+        auto net = build_net(kBasePort + 2 * partner_idx, kBasePort + 2 * partner_idx + 1);
+        EcdhPSI psi;
+        psi.init(net, partner_params_);
+        if (cardinality_only) {
+            partner_cardinalities_[partner_idx] = psi.process_cardinality_only(net, partner_keys_[partner_idx]);
+        } else {
+            psi.process(net, partner_keys_[partner_idx], partner_output_keys_[partner_idx]);
+        }
+    }
+
+public:
+    static const int kBasePort = 30340;
+    static const std::size_t kPartnerCount = 3;
+
+    json server_params_;
+    json partner_params_;
+
+    std::vector<std::string> server_keys_ = {"c", "h", "e", "g", "y", "z"};
+    std::vector<std::vector<std::string>> partner_keys_ = {{"b", "c", "e", "g"}, {"h", "z", "x"}, {"a", "c", "y"}};
+    std::vector<std::vector<std::string>> expected_results_ = {{"c", "e", "g"}, {"h", "z"}, {"c", "y"}};
+    std::vector<std::vector<std::string>> partner_output_keys_ = std::vector<std::vector<std::string>>(kPartnerCount);
+    std::vector<std::size_t> partner_cardinalities_ = std::vector<std::size_t>(kPartnerCount, 0);
+};
+
+TEST_F(ECDHPSIServerTest, concurrent_sessions_test) {
+    auto encrypted_set = EcdhPSI::encrypt_set(server_params_, server_keys_);
+    WorkerPoolOptions options;
+    options.num_threads = 2;
+    EcdhPSIServer server(encrypted_set, kPartnerCount, options);
+
+    std::vector<EcdhPSISession> sessions(kPartnerCount);
+    std::vector<std::thread> partners;
+    for (std::size_t partner_idx = 0; partner_idx < kPartnerCount; ++partner_idx) {
+        int port = kBasePort + 2 * static_cast<int>(partner_idx);
+        sessions[partner_idx].params = server_params_;
+        sessions[partner_idx].cardinality_only = partner_idx == 1;
+        partners.emplace_back([this, partner_idx]() {
+            run_partner(static_cast<int>(partner_idx), partner_idx == 1);
+        });
+        sessions[partner_idx].net = build_net(port + 1, port);
+    }
+    server.run(server_keys_, sessions);
+    for (auto& partner : partners) {
+        partner.join();
+    }
+
+    for (std::size_t partner_idx = 0; partner_idx < kPartnerCount; ++partner_idx) {
+        EXPECT_EQ(sessions[partner_idx].error, nullptr);
+        if (partner_idx == 1) {
+            EXPECT_EQ(sessions[partner_idx].cardinality, expected_results_[partner_idx].size());
+            EXPECT_EQ(partner_cardinalities_[partner_idx], expected_results_[partner_idx].size());
+        } else {
+            EXPECT_EQ(sessions[partner_idx].output_keys, expected_results_[partner_idx]);
+            EXPECT_EQ(partner_output_keys_[partner_idx], expected_results_[partner_idx]);
+        }
+    }
+}
+
+TEST_F(ECDHPSIServerTest, mismatched_input_keys) {
+    auto encrypted_set = EcdhPSI::encrypt_set(server_params_, server_keys_);
+    EcdhPSIServer server(encrypted_set, kPartnerCount);
+    std::vector<EcdhPSISession> sessions;
+    EXPECT_THROW(server.run(partner_keys_[0], sessions), std::invalid_argument);
+}
+
+TEST_F(ECDHPSIServerTest, invalid_arguments) {
+    auto encrypted_set = EcdhPSI::encrypt_set(server_params_, server_keys_);
+    EXPECT_THROW(EcdhPSIServer(nullptr, 1), std::invalid_argument);
+    EXPECT_THROW(EcdhPSIServer(encrypted_set, 0), std::invalid_argument);
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -15,6 +15,11 @@
 #include "setops/psi/ecdh_psi.h"
 
 #include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <thread>
@@ -25,7 +30,10 @@
 
 #include "network/net_factory.h"
 
+#include "setops/psi/ecdh_encrypted_set.h"
+#include "setops/psi/ecdh_incremental_state.h"
 #include "setops/util/dummy_data_util.h"
+#include "setops/util/ristretto255.h"
 
 namespace petace {
 namespace setops {
@@ -57,7 +65,13 @@ class ECDHPSITest : public ::testing::Test {
             },
             "ecdh_params": {
                 "curve_id": 415,
-                "obtain_result": true
+                "obtain_result": true,
+                "chunk_size": 65536,
+                "intersection_scheme": "hash_join",
+                "spill_dir": "",
+                "memory_limit_mb": 1024,
+                "secret_key_file": "",
+                "precomputed_file": ""
             }
         })"_json;
 
@@ -125,6 +139,59 @@ class ECDHPSITest : public ::testing::Test {
         return cardinality;
     }
 
+    void ecdh_psi_with_payloads(const json& params, const std::vector<std::string>& input_keys,
+            const PointBuffer& input_payloads, std::vector<std::string>& output_keys, PointBuffer& output_payloads) {
+        network::NetParams net_params;
+        net_params.remote_addr = params["network"]["address"];
+        net_params.remote_port = params["network"]["remote_port"];
+        net_params.local_port = params["network"]["local_port"];
+        auto net = network::NetFactory::get_instance().build(network::NetScheme::SOCKET, net_params);
+
+        EcdhPSI psi;
+        psi.init(net, params);
+        psi.process_with_payloads(net, input_keys, input_payloads, output_keys, output_payloads);
+    }
+
+    std::size_t ecdh_psi_intersection_sum(const json& params, const std::vector<std::string>& input_keys,
+            const std::vector<std::uint64_t>& input_values, std::uint64_t& sum) {
+        network::NetParams net_params;
+        net_params.remote_addr = params["network"]["address"];
+        net_params.remote_port = params["network"]["remote_port"];
+        net_params.local_port = params["network"]["local_port"];
+        auto net = network::NetFactory::get_instance().build(network::NetScheme::SOCKET, net_params);
+
+        EcdhPSI psi;
+        psi.init(net, params);
+        return psi.process_intersection_sum(net, input_keys, input_values, sum);
+    }
+
+    void ecdh_psi_multi_id(const json& params, const std::vector<std::vector<std::string>>& input_keys,
+            std::vector<std::vector<std::string>>& output_keys, std::vector<std::size_t>& output_id_indices) {
+        network::NetParams net_params;
+        net_params.remote_addr = params["network"]["address"];
+        net_params.remote_port = params["network"]["remote_port"];
+        net_params.local_port = params["network"]["local_port"];
+        auto net = network::NetFactory::get_instance().build(network::NetScheme::SOCKET, net_params);
+
+        EcdhPSI psi;
+        psi.init(net, params);
+        psi.process_multi_id(net, input_keys, output_keys, output_id_indices);
+    }
+
+    void ecdh_psi_bitmap_and_indices(const json& params, const std::vector<std::string>& input_keys,
+            std::vector<std::uint8_t>& output_bitmap, std::vector<std::size_t>& output_indices) {
+        network::NetParams net_params;
+        net_params.remote_addr = params["network"]["address"];
+        net_params.remote_port = params["network"]["remote_port"];
+        net_params.local_port = params["network"]["local_port"];
+        auto net = network::NetFactory::get_instance().build(network::NetScheme::SOCKET, net_params);
+
+        EcdhPSI psi;
+        psi.init(net, params);
+        psi.process_bitmap(net, input_keys, output_bitmap);
+        psi.process_indices(net, input_keys, output_indices);
+    }
+
     std::size_t ecdh_psi_cardinality_random(const json& params, std::size_t intersection_size) {
         std::size_t data_size = 10 * intersection_size;
         auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
@@ -267,6 +334,673 @@ TEST_F(ECDHPSITest, random_receiver_without_obtain_result) {
     EXPECT_EQ(receiver_cardinality, 0);
 }
 
+TEST_F(ECDHPSITest, chunked_test) {
+    json sender_chunked_params = sender_params_;
+    json receiver_chunked_params = receiver_params_;
+    sender_chunked_params["ecdh_params"]["chunk_size"] = 4;
+    receiver_chunked_params["ecdh_params"]["chunk_size"] = 4;
+
+    t_[0] = std::thread([this, &sender_chunked_params]() { ecdh_psi_default(sender_chunked_params); });
+    t_[1] = std::thread([this, &receiver_chunked_params]() { ecdh_psi_default(receiver_chunked_params); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(output_keys_0_, default_expected_results_);
+    EXPECT_EQ(output_keys_1_, default_expected_results_);
+}
+
+TEST_F(ECDHPSITest, chunked_random_test) {
+    json sender_chunked_params = sender_params_;
+    json receiver_chunked_params = receiver_params_;
+    sender_chunked_params["ecdh_params"]["chunk_size"] = 3;
+    receiver_chunked_params["ecdh_params"]["chunk_size"] = 3;
+
+    std::size_t sender_cardinality = 0;
+    std::size_t receiver_cardinality = 0;
+    t_[0] = std::thread([this, &sender_cardinality, &sender_chunked_params]() {
+        sender_cardinality = ecdh_psi_cardinality_random(sender_chunked_params, 5);
+    });
+    t_[1] = std::thread([this, &receiver_cardinality, &receiver_chunked_params]() {
+        receiver_cardinality = ecdh_psi_cardinality_random(receiver_chunked_params, 5);
+    });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(sender_cardinality, receiver_cardinality);
+    EXPECT_EQ(sender_cardinality, 5);
+}
+
+TEST_F(ECDHPSITest, compressed_tags_test) {
+    for (int curve_id : EcdhGroup::supported_curve_ids()) {
+        for (bool sender_obtain_result : {true, false}) {
+            json sender_compressed_params = sender_params_;
+            json receiver_compressed_params = receiver_params_;
+            sender_compressed_params["ecdh_params"]["curve_id"] = curve_id;
+            receiver_compressed_params["ecdh_params"]["curve_id"] = curve_id;
+            sender_compressed_params["ecdh_params"]["obtain_result"] = sender_obtain_result;
+            sender_compressed_params["ecdh_params"]["compress_tags"] = true;
+            receiver_compressed_params["ecdh_params"]["compress_tags"] = true;
+
+            std::size_t sender_cardinality = 0;
+            std::size_t receiver_cardinality = 0;
+            t_[0] = std::thread([&]() {
+                sender_cardinality = ecdh_psi_cardinality_random(sender_compressed_params, 200);
+            });
+            t_[1] = std::thread([&]() {
+                receiver_cardinality = ecdh_psi_cardinality_random(receiver_compressed_params, 200);
+            });
+
+            t_[0].join();
+            t_[1].join();
+
+            EXPECT_EQ(sender_cardinality, sender_obtain_result ? 200 : 0);
+            EXPECT_EQ(receiver_cardinality, 200);
+        }
+    }
+
+    json sender_sum_params = sender_without_obtain_result_params_;
+    json receiver_sum_params = receiver_params_;
+    sender_sum_params["ecdh_params"]["compress_tags"] = true;
+    receiver_sum_params["ecdh_params"]["compress_tags"] = true;
+    std::vector<std::uint64_t> sender_values = {1, 10, 100, 1000, 10000, 100000};
+    std::size_t sender_cardinality = 0;
+    std::size_t receiver_cardinality = 0;
+    std::uint64_t sender_sum = 0;
+    std::uint64_t receiver_sum = 0;
+    t_[0] = std::thread([&]() {
+        sender_cardinality =
+                ecdh_psi_intersection_sum(sender_sum_params, default_sender_keys_, sender_values, sender_sum);
+    });
+    t_[1] = std::thread([&]() {
+        receiver_cardinality = ecdh_psi_intersection_sum(
+                receiver_sum_params, default_receiver_keys_, std::vector<std::uint64_t>(), receiver_sum);
+    });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(sender_cardinality, default_expected_cardinality_);
+    EXPECT_EQ(receiver_cardinality, default_expected_cardinality_);
+    EXPECT_EQ(sender_sum, 1101);
+    EXPECT_EQ(receiver_sum, 1101);
+}
+
+TEST_F(ECDHPSITest, bitmap_and_indices_test) {
+    std::vector<std::uint8_t> expected_bitmap;
+    std::vector<std::size_t> expected_indices;
+    for (std::size_t idx = 0; idx < default_receiver_keys_.size(); ++idx) {
+        bool matched = std::find(default_expected_results_.begin(), default_expected_results_.end(),
+                               default_receiver_keys_[idx]) != default_expected_results_.end();
+        expected_bitmap.push_back(matched ? 1 : 0);
+        if (matched) {
+            expected_indices.push_back(idx);
+        }
+    }
+    std::vector<std::uint8_t> sender_bitmap;
+    std::vector<std::uint8_t> receiver_bitmap;
+    std::vector<std::size_t> sender_indices;
+    std::vector<std::size_t> receiver_indices;
+    t_[0] = std::thread([&]() {
+        ecdh_psi_bitmap_and_indices(
+                sender_without_obtain_result_params_, default_sender_keys_, sender_bitmap, sender_indices);
+    });
+    t_[1] = std::thread([&]() {
+        ecdh_psi_bitmap_and_indices(receiver_params_, default_receiver_keys_, receiver_bitmap, receiver_indices);
+    });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_TRUE(sender_bitmap.empty());
+    EXPECT_TRUE(sender_indices.empty());
+    EXPECT_EQ(receiver_bitmap, expected_bitmap);
+    EXPECT_EQ(receiver_indices, expected_indices);
+    EXPECT_EQ(expected_indices.size(), default_expected_cardinality_);
+}
+
+TEST_F(ECDHPSITest, inconsistent_chunk_size) {
+    json receiver_invalid_params = receiver_params_;
+    receiver_invalid_params["ecdh_params"]["chunk_size"] = 1024;
+
+    t_[0] = std::thread([this]() { EXPECT_THROW(ecdh_psi_default(sender_params_), std::invalid_argument); });
+    t_[1] = std::thread([this, &receiver_invalid_params]() {
+        EXPECT_THROW(ecdh_psi_default(receiver_invalid_params), std::invalid_argument);
+    });
+
+    t_[0].join();
+    t_[1].join();
+}
+
+TEST_F(ECDHPSITest, sort_intersection_scheme) {
+    json sender_sort_params = sender_params_;
+    json receiver_sort_params = receiver_params_;
+    sender_sort_params["ecdh_params"]["intersection_scheme"] = "sort";
+    receiver_sort_params["ecdh_params"]["intersection_scheme"] = "sort";
+
+    t_[0] = std::thread([this, &sender_sort_params]() { ecdh_psi_default(sender_sort_params); });
+    t_[1] = std::thread([this, &receiver_sort_params]() { ecdh_psi_default(receiver_sort_params); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(output_keys_0_, default_expected_results_);
+    EXPECT_EQ(output_keys_1_, default_expected_results_);
+}
+
+TEST_F(ECDHPSITest, statistical_security_bits_test) {
+    json sender_short_tag_params = sender_params_;
+    json receiver_short_tag_params = receiver_params_;
+    sender_short_tag_params["ecdh_params"]["statistical_security_bits"] = 20;
+    receiver_short_tag_params["ecdh_params"]["statistical_security_bits"] = 20;
+    receiver_short_tag_params["ecdh_params"]["spill_dir"] = ".";
+
+    t_[0] = std::thread([this, &sender_short_tag_params]() { ecdh_psi_default(sender_short_tag_params); });
+    t_[1] = std::thread([this, &receiver_short_tag_params]() { ecdh_psi_default(receiver_short_tag_params); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(output_keys_0_, default_expected_results_);
+    EXPECT_EQ(output_keys_1_, default_expected_results_);
+}
+
+TEST_F(ECDHPSITest, inconsistent_statistical_security_bits) {
+    json receiver_invalid_params = receiver_params_;
+    receiver_invalid_params["ecdh_params"]["statistical_security_bits"] = 64;
+
+    t_[0] = std::thread([this]() { EXPECT_THROW(ecdh_psi_default(sender_params_), std::invalid_argument); });
+    t_[1] = std::thread([this, &receiver_invalid_params]() {
+        EXPECT_THROW(ecdh_psi_default(receiver_invalid_params), std::invalid_argument);
+    });
+
+    t_[0].join();
+    t_[1].join();
+}
+
+TEST_F(ECDHPSITest, out_of_core_test) {
+    json sender_out_of_core_params = sender_params_;
+    json receiver_out_of_core_params = receiver_params_;
+    sender_out_of_core_params["ecdh_params"]["chunk_size"] = 4;
+    sender_out_of_core_params["ecdh_params"]["spill_dir"] = ".";
+    sender_out_of_core_params["ecdh_params"]["memory_limit_mb"] = 1;
+    receiver_out_of_core_params["ecdh_params"]["chunk_size"] = 4;
+    receiver_out_of_core_params["ecdh_params"]["spill_dir"] = ".";
+    receiver_out_of_core_params["ecdh_params"]["memory_limit_mb"] = 1;
+
+    t_[0] = std::thread([this, &sender_out_of_core_params]() { ecdh_psi_default(sender_out_of_core_params); });
+    t_[1] = std::thread([this, &receiver_out_of_core_params]() { ecdh_psi_default(receiver_out_of_core_params); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(output_keys_0_, default_expected_results_);
+    EXPECT_EQ(output_keys_1_, default_expected_results_);
+}
+
+TEST_F(ECDHPSITest, out_of_core_with_in_memory_test) {
+    json sender_out_of_core_params = sender_params_;
+    sender_out_of_core_params["ecdh_params"]["spill_dir"] = ".";
+
+    t_[0] = std::thread([this, &sender_out_of_core_params]() { ecdh_psi_default(sender_out_of_core_params); });
+    t_[1] = std::thread([this]() { ecdh_psi_default(receiver_params_); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(output_keys_0_, default_expected_results_);
+    EXPECT_EQ(output_keys_1_, default_expected_results_);
+}
+
+TEST_F(ECDHPSITest, out_of_core_random_test) {
+    json sender_out_of_core_params = sender_params_;
+    json receiver_out_of_core_params = receiver_without_obtain_result_params_;
+    sender_out_of_core_params["ecdh_params"]["chunk_size"] = 3;
+    sender_out_of_core_params["ecdh_params"]["spill_dir"] = ".";
+    receiver_out_of_core_params["ecdh_params"]["chunk_size"] = 3;
+    receiver_out_of_core_params["ecdh_params"]["spill_dir"] = ".";
+
+    std::size_t sender_cardinality = 0;
+    std::size_t receiver_cardinality = 0;
+    t_[0] = std::thread([this, &sender_cardinality, &sender_out_of_core_params]() {
+        sender_cardinality = ecdh_psi_cardinality_random(sender_out_of_core_params, 5);
+    });
+    t_[1] = std::thread([this, &receiver_cardinality, &receiver_out_of_core_params]() {
+        receiver_cardinality = ecdh_psi_cardinality_random(receiver_out_of_core_params, 5);
+    });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(sender_cardinality, 5);
+    EXPECT_EQ(receiver_cardinality, 0);
+}
+
+TEST_F(ECDHPSITest, encrypted_set_with_spill_dir) {
+    json sender_out_of_core_params = sender_params_;
+    sender_out_of_core_params["ecdh_params"]["spill_dir"] = ".";
+    auto encrypted_set = EcdhPSI::encrypt_set(sender_params_, default_sender_keys_);
+
+    t_[0] = std::thread([&sender_out_of_core_params, &encrypted_set]() {
+        network::NetParams net_params;
+        net_params.remote_addr = sender_out_of_core_params["network"]["address"];
+        net_params.remote_port = sender_out_of_core_params["network"]["remote_port"];
+        net_params.local_port = sender_out_of_core_params["network"]["local_port"];
+        auto net = network::NetFactory::get_instance().build(network::NetScheme::SOCKET, net_params);
+        EcdhPSI psi;
+        EXPECT_THROW(psi.init(net, sender_out_of_core_params, encrypted_set), std::invalid_argument);
+    });
+    t_[1] = std::thread([this]() { EXPECT_THROW(ecdh_psi_default(receiver_params_), std::invalid_argument); });
+
+    t_[0].join();
+    t_[1].join();
+}
+
+TEST_F(ECDHPSITest, precomputed_test) {
+    json sender_precomputed_params = sender_params_;
+    sender_precomputed_params["ecdh_params"]["secret_key_file"] = "ecdh_psi_test_sender.key";
+    sender_precomputed_params["ecdh_params"]["precomputed_file"] = "ecdh_psi_test_sender.bin";
+    EcdhPSI::precompute(sender_precomputed_params, default_sender_keys_);
+    sender_precomputed_params["ecdh_params"]["secret_key_file"] = "";
+
+    t_[0] = std::thread([this, &sender_precomputed_params]() { ecdh_psi_default(sender_precomputed_params); });
+    t_[1] = std::thread([this]() { ecdh_psi_default(receiver_params_); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(output_keys_0_, default_expected_results_);
+    EXPECT_EQ(output_keys_1_, default_expected_results_);
+
+    std::size_t sender_cardinality = 0;
+    std::size_t receiver_cardinality = 0;
+    t_[0] = std::thread([this, &sender_cardinality, &sender_precomputed_params]() {
+        sender_cardinality = ecdh_psi_cardinality_default(sender_precomputed_params);
+    });
+    t_[1] = std::thread(
+            [this, &receiver_cardinality]() { receiver_cardinality = ecdh_psi_cardinality_default(receiver_params_); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(sender_cardinality, default_expected_cardinality_);
+    EXPECT_EQ(receiver_cardinality, default_expected_cardinality_);
+
+    std::remove("ecdh_psi_test_sender.key");
+    std::remove("ecdh_psi_test_sender.bin");
+}
+
+TEST_F(ECDHPSITest, unbalanced_test) {
+    for (int curve_id : EcdhGroup::supported_curve_ids()) {
+        json sender_unbalanced_params = sender_without_obtain_result_params_;
+        json receiver_unbalanced_params = receiver_params_;
+        sender_unbalanced_params["ecdh_params"]["curve_id"] = curve_id;
+        sender_unbalanced_params["ecdh_params"]["unbalanced"] = true;
+        sender_unbalanced_params["ecdh_params"]["secret_key_file"] = "ecdh_psi_test_sender.key";
+        sender_unbalanced_params["ecdh_params"]["precomputed_file"] = "ecdh_psi_test_sender.bin";
+        sender_unbalanced_params["ecdh_params"]["filter_file"] = "ecdh_psi_test_sender.filter";
+        receiver_unbalanced_params["ecdh_params"]["curve_id"] = curve_id;
+        receiver_unbalanced_params["ecdh_params"]["unbalanced"] = true;
+        receiver_unbalanced_params["ecdh_params"]["filter_file"] = "ecdh_psi_test_receiver.filter";
+        EcdhPSI::precompute(sender_unbalanced_params, default_sender_keys_);
+
+        // The first session builds and transfers the filter, and later sessions load it from filter files.
+        for (std::size_t session_idx = 0; session_idx < 2; ++session_idx) {
+            t_[0] = std::thread([this, &sender_unbalanced_params]() { ecdh_psi_default(sender_unbalanced_params); });
+            t_[1] = std::thread(
+                    [this, &receiver_unbalanced_params]() { ecdh_psi_default(receiver_unbalanced_params); });
+
+            t_[0].join();
+            t_[1].join();
+
+            EXPECT_TRUE(output_keys_0_.empty());
+            EXPECT_EQ(output_keys_1_, default_expected_results_);
+            sender_unbalanced_params["ecdh_params"]["precomputed_file"] = "";
+        }
+
+        std::size_t receiver_cardinality = 0;
+        t_[0] = std::thread(
+                [this, &sender_unbalanced_params]() { ecdh_psi_cardinality_default(sender_unbalanced_params); });
+        t_[1] = std::thread([this, &receiver_cardinality, &receiver_unbalanced_params]() {
+            receiver_cardinality = ecdh_psi_cardinality_default(receiver_unbalanced_params);
+        });
+
+        t_[0].join();
+        t_[1].join();
+
+        EXPECT_EQ(receiver_cardinality, default_expected_cardinality_);
+
+        // A set changed under the same secret key rebuilds the cached filter.
+        std::vector<std::string> changed_sender_keys = {"c", "h", "g", "y", "z", "b"};
+        sender_unbalanced_params["ecdh_params"]["precomputed_file"] = "ecdh_psi_test_sender.bin";
+        EcdhPSI::precompute(sender_unbalanced_params, changed_sender_keys);
+        t_[0] = std::thread([this, &sender_unbalanced_params]() { ecdh_psi_default(sender_unbalanced_params); });
+        t_[1] = std::thread([this, &receiver_unbalanced_params]() { ecdh_psi_default(receiver_unbalanced_params); });
+
+        t_[0].join();
+        t_[1].join();
+
+        EXPECT_EQ(output_keys_1_, std::vector<std::string>({"b", "c", "g"}));
+
+        // Both parties reject a small set with more keys than filter fingerprints are sized for.
+        json sender_small_filter_params = sender_unbalanced_params;
+        json receiver_small_filter_params = receiver_unbalanced_params;
+        sender_small_filter_params["ecdh_params"]["filter_max_lookups"] = default_receiver_keys_.size() - 1;
+        receiver_small_filter_params["ecdh_params"]["filter_max_lookups"] = default_receiver_keys_.size() - 1;
+        t_[0] = std::thread([this, &sender_small_filter_params]() {
+            EXPECT_THROW(ecdh_psi_default(sender_small_filter_params), std::invalid_argument);
+        });
+        t_[1] = std::thread([this, &receiver_small_filter_params]() {
+            EXPECT_THROW(ecdh_psi_default(receiver_small_filter_params), std::invalid_argument);
+        });
+
+        t_[0].join();
+        t_[1].join();
+
+        std::remove("ecdh_psi_test_sender.key");
+        std::remove("ecdh_psi_test_sender.bin");
+        std::remove("ecdh_psi_test_sender.filter");
+        std::remove("ecdh_psi_test_receiver.filter");
+    }
+}
+
+TEST_F(ECDHPSITest, incremental_test) {
+    std::vector<std::string> sender_keys = default_sender_keys_;
+    std::vector<std::string> receiver_keys = default_receiver_keys_;
+    for (int curve_id : EcdhGroup::supported_curve_ids()) {
+        default_sender_keys_ = sender_keys;
+        default_receiver_keys_ = receiver_keys;
+        json sender_incremental_params = sender_params_;
+        json receiver_incremental_params = receiver_params_;
+        sender_incremental_params["ecdh_params"]["curve_id"] = curve_id;
+        sender_incremental_params["ecdh_params"]["incremental"] = true;
+        sender_incremental_params["ecdh_params"]["state_file"] = "ecdh_psi_test_sender.state";
+        receiver_incremental_params["ecdh_params"]["curve_id"] = curve_id;
+        receiver_incremental_params["ecdh_params"]["incremental"] = true;
+        receiver_incremental_params["ecdh_params"]["state_file"] = "ecdh_psi_test_receiver.state";
+
+        // The first run creates both states from scratch.
+        t_[0] = std::thread([this, &sender_incremental_params]() { ecdh_psi_default(sender_incremental_params); });
+        t_[1] = std::thread([this, &receiver_incremental_params]() { ecdh_psi_default(receiver_incremental_params); });
+        t_[0].join();
+        t_[1].join();
+        EXPECT_EQ(output_keys_0_, default_expected_results_);
+        EXPECT_EQ(output_keys_1_, default_expected_results_);
+
+        // The second run only exchanges keys both parties added and removed.
+        default_sender_keys_ = {"c", "h", "g", "y", "z", "b", "x"};
+        default_receiver_keys_ = {"b", "e", "g", "x", "q"};
+        t_[0] = std::thread([this, &sender_incremental_params]() { ecdh_psi_default(sender_incremental_params); });
+        t_[1] = std::thread([this, &receiver_incremental_params]() { ecdh_psi_default(receiver_incremental_params); });
+        t_[0].join();
+        t_[1].join();
+        EXPECT_EQ(output_keys_0_, std::vector<std::string>({"g", "b", "x"}));
+        EXPECT_EQ(output_keys_1_, std::vector<std::string>({"b", "g", "x"}));
+
+        std::size_t sender_cardinality = 0;
+        std::size_t receiver_cardinality = 0;
+        t_[0] = std::thread([this, &sender_cardinality, &sender_incremental_params]() {
+            sender_cardinality = ecdh_psi_cardinality_default(sender_incremental_params);
+        });
+        t_[1] = std::thread([this, &receiver_cardinality, &receiver_incremental_params]() {
+            receiver_cardinality = ecdh_psi_cardinality_default(receiver_incremental_params);
+        });
+        t_[0].join();
+        t_[1].join();
+        EXPECT_EQ(sender_cardinality, 3);
+        EXPECT_EQ(receiver_cardinality, 3);
+
+        // A run on a state the other party did not save with is rejected by both parties.
+        std::remove("ecdh_psi_test_receiver.state");
+        t_[0] = std::thread([this, &sender_incremental_params]() {
+            EXPECT_THROW(ecdh_psi_default(sender_incremental_params), std::invalid_argument);
+        });
+        t_[1] = std::thread([this, &receiver_incremental_params]() {
+            EXPECT_THROW(ecdh_psi_default(receiver_incremental_params), std::invalid_argument);
+        });
+        t_[0].join();
+        t_[1].join();
+
+        std::remove("ecdh_psi_test_sender.state");
+        std::remove("ecdh_psi_test_receiver.state");
+    }
+}
+
+TEST_F(ECDHPSITest, incremental_state_without_keys) {
+    std::vector<std::string> keys = {"alice@example.com", "bob@example.com"};
+    EcdhIncrementalState state(kCurve25519CurveId, ByteVector(kRandSeedBytesLen, 1), kRistretto255PointBytesLen, true);
+    PointBuffer digests;
+    state.digest_keys(keys, 1, digests);
+    PointBuffer encrypted_keys(keys.size(), kRistretto255PointBytesLen);
+    PointBuffer tags(keys.size(), kIncrementalTagBytesLen);
+    PointBuffer no_tags(0, kIncrementalTagBytesLen);
+    state.update(digests, encrypted_keys, tags, PointBuffer(0, kIncrementalKeyDigestBytesLen), no_tags, no_tags,
+            std::array<Byte, kIncrementalStateIdBytesLen>{});
+    state.save("ecdh_psi_test_sender.state");
+
+    std::string bytes;
+    {
+        std::ifstream in("ecdh_psi_test_sender.state", std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    for (const auto& key : keys) {
+        EXPECT_EQ(bytes.find(key), std::string::npos);
+    }
+
+    // Keys are matched by their digests after loading, and removed keys come back as their encrypted keys.
+    auto loaded_state = EcdhIncrementalState::load("ecdh_psi_test_sender.state");
+    EXPECT_EQ(loaded_state->size(), keys.size());
+    PointBuffer input_digests;
+    loaded_state->digest_keys({"bob@example.com", "carol@example.com"}, 1, input_digests);
+    std::vector<std::size_t> added_indices;
+    PointBuffer removed_digests;
+    PointBuffer removed_encrypted_keys;
+    loaded_state->diff(input_digests, added_indices, removed_digests, removed_encrypted_keys);
+    EXPECT_EQ(added_indices, std::vector<std::size_t>({1}));
+    ASSERT_EQ(removed_digests.size(), std::size_t(1));
+    EXPECT_EQ(std::memcmp(removed_digests.point_data(0), digests.point_data(0), kIncrementalKeyDigestBytesLen), 0);
+    EXPECT_EQ(removed_encrypted_keys.size(), std::size_t(1));
+
+    std::remove("ecdh_psi_test_sender.state");
+}
+
+TEST_F(ECDHPSITest, payload_test) {
+    // Every payload is its key repeated, so that payloads of matched keys are easy to check.
+    const std::size_t payload_byte_count = 5;
+    PointBuffer sender_payloads(default_sender_keys_.size(), payload_byte_count);
+    for (std::size_t item_idx = 0; item_idx < default_sender_keys_.size(); ++item_idx) {
+        std::fill_n(sender_payloads.point_data(item_idx), payload_byte_count, Byte(default_sender_keys_[item_idx][0]));
+    }
+    for (int curve_id : EcdhGroup::supported_curve_ids()) {
+        json sender_payload_params = sender_without_obtain_result_params_;
+        json receiver_payload_params = receiver_params_;
+        sender_payload_params["ecdh_params"]["curve_id"] = curve_id;
+        receiver_payload_params["ecdh_params"]["curve_id"] = curve_id;
+        PointBuffer sender_output_payloads;
+        PointBuffer receiver_output_payloads;
+        t_[0] = std::thread([&]() {
+            ecdh_psi_with_payloads(sender_payload_params, default_sender_keys_, sender_payloads, output_keys_0_,
+                    sender_output_payloads);
+        });
+        t_[1] = std::thread([&]() {
+            ecdh_psi_with_payloads(receiver_payload_params, default_receiver_keys_, PointBuffer(), output_keys_1_,
+                    receiver_output_payloads);
+        });
+
+        t_[0].join();
+        t_[1].join();
+
+        EXPECT_TRUE(output_keys_0_.empty());
+        EXPECT_TRUE(sender_output_payloads.empty());
+        ASSERT_EQ(output_keys_1_, default_expected_results_);
+        ASSERT_EQ(receiver_output_payloads.size(), output_keys_1_.size());
+        ASSERT_EQ(receiver_output_payloads.point_byte_count(), payload_byte_count);
+        for (std::size_t item_idx = 0; item_idx < output_keys_1_.size(); ++item_idx) {
+            ByteSpan payload = receiver_output_payloads[item_idx];
+            EXPECT_TRUE(std::all_of(payload.begin(), payload.end(),
+                    [&](Byte byte) { return byte == Byte(output_keys_1_[item_idx][0]); }));
+        }
+    }
+}
+
+TEST_F(ECDHPSITest, intersection_sum_test) {
+    // Values of matched keys "c", "e" and "g" add up to 1101 times the scale.
+    std::vector<std::uint64_t> sender_values = {1, 10, 100, 1000, 10000, 100000};
+    std::vector<std::uint64_t> scales = {1, std::uint64_t(1) << 28};
+    for (int curve_id : EcdhGroup::supported_curve_ids()) {
+        for (std::uint64_t scale : scales) {
+            std::vector<std::uint64_t> scaled_values(sender_values);
+            for (auto& value : scaled_values) {
+                value *= scale;
+            }
+            json sender_sum_params = sender_without_obtain_result_params_;
+            json receiver_sum_params = receiver_params_;
+            sender_sum_params["ecdh_params"]["curve_id"] = curve_id;
+            receiver_sum_params["ecdh_params"]["curve_id"] = curve_id;
+            std::size_t sender_cardinality = 0;
+            std::size_t receiver_cardinality = 0;
+            std::uint64_t sender_sum = 0;
+            std::uint64_t receiver_sum = 0;
+            t_[0] = std::thread([&]() {
+                sender_cardinality =
+                        ecdh_psi_intersection_sum(sender_sum_params, default_sender_keys_, scaled_values, sender_sum);
+            });
+            t_[1] = std::thread([&]() {
+                receiver_cardinality = ecdh_psi_intersection_sum(
+                        receiver_sum_params, default_receiver_keys_, std::vector<std::uint64_t>(), receiver_sum);
+            });
+
+            t_[0].join();
+            t_[1].join();
+
+            EXPECT_EQ(sender_cardinality, default_expected_cardinality_);
+            EXPECT_EQ(receiver_cardinality, default_expected_cardinality_);
+            EXPECT_EQ(sender_sum, 1101 * scale);
+            EXPECT_EQ(receiver_sum, 1101 * scale);
+        }
+    }
+}
+
+TEST_F(ECDHPSITest, multi_id_test) {
+    // Rows of emails, phone numbers and device IDs in priority order.
+    std::vector<std::vector<std::string>> sender_keys = {
+            {"a@x", "z@x", "y@x", "", "e@x"},
+            {"333", "222", "777", "888", "999"},
+            {"d9", "d8", "d3", "d7", "d6"},
+    };
+    std::vector<std::vector<std::string>> receiver_keys = {
+            {"a@x", "b@x", "c@x", "", "e@x", "f@x"},
+            {"111", "222", "333", "444", "555", "666"},
+            {"d1", "d2", "d3", "d4", "d5", "d1"},
+    };
+    // The receiver's third row shares phone "333" with the sender's first row, which is already matched on email,
+    // so it is matched on its device ID instead. Missing emails never match each other.
+    std::vector<std::vector<std::string>> expected_sender_keys = {
+            {"a@x", "z@x", "y@x", "e@x"},
+            {"333", "222", "777", "999"},
+            {"d9", "d8", "d3", "d6"},
+    };
+    std::vector<std::vector<std::string>> expected_receiver_keys = {
+            {"a@x", "b@x", "c@x", "e@x"},
+            {"111", "222", "333", "555"},
+            {"d1", "d2", "d3", "d5"},
+    };
+    std::vector<std::size_t> expected_id_indices = {0, 1, 2, 0};
+    for (int curve_id : EcdhGroup::supported_curve_ids()) {
+        json sender_multi_id_params = sender_params_;
+        json receiver_multi_id_params = receiver_params_;
+        sender_multi_id_params["ecdh_params"]["curve_id"] = curve_id;
+        receiver_multi_id_params["ecdh_params"]["curve_id"] = curve_id;
+        std::vector<std::vector<std::string>> sender_output_keys;
+        std::vector<std::vector<std::string>> receiver_output_keys;
+        std::vector<std::size_t> sender_id_indices;
+        std::vector<std::size_t> receiver_id_indices;
+        t_[0] = std::thread([&]() {
+            ecdh_psi_multi_id(sender_multi_id_params, sender_keys, sender_output_keys, sender_id_indices);
+        });
+        t_[1] = std::thread([&]() {
+            ecdh_psi_multi_id(receiver_multi_id_params, receiver_keys, receiver_output_keys, receiver_id_indices);
+        });
+
+        t_[0].join();
+        t_[1].join();
+
+        EXPECT_EQ(sender_output_keys, expected_sender_keys);
+        EXPECT_EQ(receiver_output_keys, expected_receiver_keys);
+        EXPECT_EQ(sender_id_indices, expected_id_indices);
+        EXPECT_EQ(receiver_id_indices, expected_id_indices);
+    }
+}
+
+TEST_F(ECDHPSITest, precomputed_input_mismatch) {
+    json sender_precomputed_params = sender_params_;
+    json receiver_precomputed_params = receiver_params_;
+    sender_precomputed_params["ecdh_params"]["secret_key_file"] = "ecdh_psi_test_sender.key";
+    sender_precomputed_params["ecdh_params"]["precomputed_file"] = "ecdh_psi_test_sender.bin";
+    receiver_precomputed_params["ecdh_params"]["secret_key_file"] = "ecdh_psi_test_receiver.key";
+    receiver_precomputed_params["ecdh_params"]["precomputed_file"] = "ecdh_psi_test_receiver.bin";
+    EcdhPSI::precompute(sender_precomputed_params, default_receiver_keys_);
+    EcdhPSI::precompute(receiver_precomputed_params, default_sender_keys_);
+
+    t_[0] = std::thread([this, &sender_precomputed_params]() {
+        EXPECT_THROW(ecdh_psi_default(sender_precomputed_params), std::invalid_argument);
+    });
+    t_[1] = std::thread([this, &receiver_precomputed_params]() {
+        EXPECT_THROW(ecdh_psi_default(receiver_precomputed_params), std::invalid_argument);
+    });
+
+    t_[0].join();
+    t_[1].join();
+
+    std::remove("ecdh_psi_test_sender.key");
+    std::remove("ecdh_psi_test_sender.bin");
+    std::remove("ecdh_psi_test_receiver.key");
+    std::remove("ecdh_psi_test_receiver.bin");
+}
+
+TEST_F(ECDHPSITest, precomputed_file_truncated) {
+    json sender_precomputed_params = sender_params_;
+    sender_precomputed_params["ecdh_params"]["secret_key_file"] = "ecdh_psi_test_sender.key";
+    sender_precomputed_params["ecdh_params"]["precomputed_file"] = "ecdh_psi_test_sender.bin";
+    EcdhPSI::precompute(sender_precomputed_params, default_sender_keys_);
+    EXPECT_EQ(EcdhEncryptedSet::load("ecdh_psi_test_sender.bin")->size(), default_sender_keys_.size());
+
+    std::string bytes;
+    {
+        std::ifstream in("ecdh_psi_test_sender.bin", std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream out("ecdh_psi_test_sender.bin", std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 1));
+    }
+    EXPECT_THROW(EcdhEncryptedSet::load("ecdh_psi_test_sender.bin"), std::invalid_argument);
+
+    std::remove("ecdh_psi_test_sender.key");
+    std::remove("ecdh_psi_test_sender.bin");
+}
+
+TEST_F(ECDHPSITest, persisted_secret_key) {
+    json sender_key_params = sender_params_;
+    sender_key_params["ecdh_params"]["secret_key_file"] = "ecdh_psi_test_sender.key";
+    sender_key_params["ecdh_params"]["precomputed_file"] = "ecdh_psi_test_sender.bin";
+    EcdhPSI::precompute(sender_key_params, default_sender_keys_);
+    sender_key_params["ecdh_params"]["precomputed_file"] = "";
+
+    t_[0] = std::thread([this, &sender_key_params]() { ecdh_psi_default(sender_key_params); });
+    t_[1] = std::thread([this]() { ecdh_psi_default(receiver_params_); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(output_keys_0_, default_expected_results_);
+    EXPECT_EQ(output_keys_1_, default_expected_results_);
+
+    std::remove("ecdh_psi_test_sender.key");
+    std::remove("ecdh_psi_test_sender.bin");
+}
+
 TEST_F(ECDHPSITest, inconsistent_curve_id) {
     json receiver_invalid_params = receiver_params_;
     receiver_invalid_params["ecdh_params"]["curve_id"] = 414;
@@ -297,5 +1031,67 @@ TEST_F(ECDHPSITest, unexpected_ecurve_id) {
     t_[1].join();
 }
 
+TEST_F(ECDHPSITest, curve25519_test) {
+    json sender_curve25519_params = sender_params_;
+    json receiver_curve25519_params = receiver_params_;
+    sender_curve25519_params["ecdh_params"]["curve_id"] = kCurve25519CurveId;
+    sender_curve25519_params["ecdh_params"]["chunk_size"] = 4;
+    receiver_curve25519_params["ecdh_params"]["curve_id"] = kCurve25519CurveId;
+    receiver_curve25519_params["ecdh_params"]["chunk_size"] = 4;
+
+    t_[0] = std::thread([this, &sender_curve25519_params]() { ecdh_psi_default(sender_curve25519_params); });
+    t_[1] = std::thread([this, &receiver_curve25519_params]() { ecdh_psi_default(receiver_curve25519_params); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(output_keys_0_, default_expected_results_);
+    EXPECT_EQ(output_keys_1_, default_expected_results_);
+}
+
+TEST_F(ECDHPSITest, curve25519_random_test) {
+    json sender_curve25519_params = sender_params_;
+    json receiver_curve25519_params = receiver_params_;
+    sender_curve25519_params["ecdh_params"]["curve_id"] = kCurve25519CurveId;
+    receiver_curve25519_params["ecdh_params"]["curve_id"] = kCurve25519CurveId;
+
+    std::size_t sender_cardinality = 0;
+    std::size_t receiver_cardinality = 0;
+    t_[0] = std::thread([this, &sender_cardinality, &sender_curve25519_params]() {
+        sender_cardinality = ecdh_psi_cardinality_random(sender_curve25519_params, 5);
+    });
+    t_[1] = std::thread([this, &receiver_cardinality, &receiver_curve25519_params]() {
+        receiver_cardinality = ecdh_psi_cardinality_random(receiver_curve25519_params, 5);
+    });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(sender_cardinality, 5);
+    EXPECT_EQ(receiver_cardinality, 5);
+}
+
+TEST_F(ECDHPSITest, curve25519_precomputed_test) {
+    json sender_precomputed_params = sender_params_;
+    json receiver_curve25519_params = receiver_params_;
+    sender_precomputed_params["ecdh_params"]["curve_id"] = kCurve25519CurveId;
+    sender_precomputed_params["ecdh_params"]["secret_key_file"] = "ecdh_psi_test_sender.key";
+    sender_precomputed_params["ecdh_params"]["precomputed_file"] = "ecdh_psi_test_sender.bin";
+    receiver_curve25519_params["ecdh_params"]["curve_id"] = kCurve25519CurveId;
+    EcdhPSI::precompute(sender_precomputed_params, default_sender_keys_);
+
+    t_[0] = std::thread([this, &sender_precomputed_params]() { ecdh_psi_default(sender_precomputed_params); });
+    t_[1] = std::thread([this, &receiver_curve25519_params]() { ecdh_psi_default(receiver_curve25519_params); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(output_keys_0_, default_expected_results_);
+    EXPECT_EQ(output_keys_1_, default_expected_results_);
+
+    std::remove("ecdh_psi_test_sender.key");
+    std::remove("ecdh_psi_test_sender.bin");
+}
+
 }  // namespace setops
 }  // namespace petace
@@ -83,7 +83,7 @@ class KKRTPSITest : public ::testing::Test {
                 "output_file": "data/receiver_output_file.csv"
             },
             "kkrt_psi_params": {
-                "epsilon": 0.27,
+                "epsilon": 1.1,
                 "fun_num": 3,
                 "sender_obtain_result": true
             }
@@ -202,7 +202,7 @@ class KKRTPSITest : public ::testing::Test {
         }
     }
 
-    void kkrt_psi_cardinality_default_stash_not_zero(const json& params) {
+    std::size_t kkrt_psi_cardinality_default_stash_not_zero(const json& params) {
         network::NetParams net_params;
         net_params.remote_addr = params["network"]["address"];
         net_params.remote_port = params["network"]["remote_port"];
@@ -215,10 +215,10 @@ class KKRTPSITest : public ::testing::Test {
         psi.init(net, params);
         if (is_sender) {
             psi.preprocess_data(net, default_sender_keys_, default_sender_keys_);
-            psi.process_cardinality_only(net, default_sender_keys_);
+            return psi.process_cardinality_only(net, default_sender_keys_);
         } else {
             psi.preprocess_data(net, default_receiver_keys_, default_receiver_keys_);
-            psi.process_cardinality_only(net, default_receiver_keys_);
+            return psi.process_cardinality_only(net, default_receiver_keys_);
         }
     }
 
@@ -337,6 +337,44 @@ TEST_F(KKRTPSITest, random_test) {
     EXPECT_EQ(sender_cardinality, 5);
 }
 
+TEST_F(KKRTPSITest, large_random_test) {
+    std::size_t sender_cardinality = 0;
+    std::size_t receiver_cardinality = 0;
+    t_[0] = std::thread([this, &sender_cardinality]() {
+        sender_cardinality = kkrt_psi_cardinality_random(sender_params_, 2000);
+    });
+    t_[1] = std::thread([this, &receiver_cardinality]() {
+        receiver_cardinality = kkrt_psi_cardinality_random(receiver_params_, 2000);
+    });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(sender_cardinality, receiver_cardinality);
+    EXPECT_EQ(sender_cardinality, 2000);
+}
+
+TEST_F(KKRTPSITest, batched_random_test) {
+    json sender_params = sender_params_;
+    json receiver_params = receiver_params_;
+    sender_params["kkrt_psi_params"]["bin_batch_size"] = 1000;
+    receiver_params["kkrt_psi_params"]["bin_batch_size"] = 1000;
+    std::size_t sender_cardinality = 0;
+    std::size_t receiver_cardinality = 0;
+    t_[0] = std::thread([this, &sender_params, &sender_cardinality]() {
+        sender_cardinality = kkrt_psi_cardinality_random(sender_params, 2000);
+    });
+    t_[1] = std::thread([this, &receiver_params, &receiver_cardinality]() {
+        receiver_cardinality = kkrt_psi_cardinality_random(receiver_params, 2000);
+    });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(sender_cardinality, receiver_cardinality);
+    EXPECT_EQ(sender_cardinality, 2000);
+}
+
 TEST_F(KKRTPSITest, random_sender_without_obtain_result) {
     std::size_t sender_cardinality = 0;
     std::size_t receiver_cardinality = 5;
@@ -363,23 +401,80 @@ TEST_F(KKRTPSITest, random_sender_without_obtain_result) {
 }
 
 TEST_F(KKRTPSITest, kkrt_psi_stash_not_zero) {
-    t_[0] = std::thread([this]() {
-        EXPECT_THROW(kkrt_psi_default_stash_not_zero(sender_params_stash_zero_), std::invalid_argument);
+    output_keys_0_.clear();
+    output_keys_1_.clear();
+    t_[0] = std::thread([this]() { kkrt_psi_default_stash_not_zero(sender_params_stash_zero_); });
+    t_[1] = std::thread([this]() { kkrt_psi_default_stash_not_zero(receiver_params_stash_zero_); });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(output_keys_0_, default_expected_results_);
+    EXPECT_EQ(output_keys_1_, default_expected_results_);
+}
+
+TEST_F(KKRTPSITest, kkrt_psi_cardinality_stash_not_zero) {
+    std::size_t sender_cardinality = 0;
+    std::size_t receiver_cardinality = 0;
+    t_[0] = std::thread([this, &sender_cardinality]() {
+        sender_cardinality = kkrt_psi_cardinality_default_stash_not_zero(sender_params_stash_zero_);
     });
-    t_[1] = std::thread([this]() {
-        EXPECT_THROW(kkrt_psi_default_stash_not_zero(receiver_params_stash_zero_), std::invalid_argument);
+    t_[1] = std::thread([this, &receiver_cardinality]() {
+        receiver_cardinality = kkrt_psi_cardinality_default_stash_not_zero(receiver_params_stash_zero_);
     });
 
     t_[0].join();
     t_[1].join();
+
+    EXPECT_EQ(sender_cardinality, default_expected_cardinality_);
+    EXPECT_EQ(receiver_cardinality, default_expected_cardinality_);
 }
 
-TEST_F(KKRTPSITest, kkrt_psi_cardinality_stash_not_zero) {
-    t_[0] = std::thread([this]() {
-        EXPECT_THROW(kkrt_psi_cardinality_default_stash_not_zero(sender_params_stash_zero_), std::invalid_argument);
+TEST_F(KKRTPSITest, kkrt_psi_cardinality_random_stash_not_zero) {
+    std::size_t sender_cardinality = 0;
+    std::size_t receiver_cardinality = 0;
+    t_[0] = std::thread([this, &sender_cardinality]() {
+        sender_cardinality = kkrt_psi_cardinality_random(sender_params_stash_zero_, 300);
     });
-    t_[1] = std::thread([this]() {
-        EXPECT_THROW(kkrt_psi_cardinality_default_stash_not_zero(receiver_params_stash_zero_), std::invalid_argument);
+    t_[1] = std::thread([this, &receiver_cardinality]() {
+        receiver_cardinality = kkrt_psi_cardinality_random(receiver_params_stash_zero_, 300);
+    });
+
+    t_[0].join();
+    t_[1].join();
+
+    EXPECT_EQ(sender_cardinality, 300);
+    EXPECT_EQ(receiver_cardinality, 300);
+}
+
+TEST_F(KKRTPSITest, kkrt_psi_stash_unsupported) {
+    json sender_params = sender_params_stash_zero_;
+    json receiver_params = receiver_params_stash_zero_;
+    sender_params["kkrt_psi_params"]["epsilon"] = 0.27;
+    receiver_params["kkrt_psi_params"]["epsilon"] = 0.27;
+    t_[0] = std::thread([this, &sender_params]() {
+        EXPECT_THROW(kkrt_psi_default_stash_not_zero(sender_params), std::invalid_argument);
+    });
+    t_[1] = std::thread([this, &receiver_params]() {
+        EXPECT_THROW(kkrt_psi_default_stash_not_zero(receiver_params), std::invalid_argument);
+    });
+
+    t_[0].join();
+    t_[1].join();
+}
+
+TEST_F(KKRTPSITest, kkrt_psi_stash_overflow) {
+    json sender_params = sender_params_stash_zero_;
+    json receiver_params = receiver_params_stash_zero_;
+    sender_params["kkrt_psi_params"]["epsilon"] = 0.27;
+    receiver_params["kkrt_psi_params"]["epsilon"] = 0.27;
+    sender_params["kkrt_psi_params"]["stash_failure_bits"] = 0;
+    receiver_params["kkrt_psi_params"]["stash_failure_bits"] = 0;
+    t_[0] = std::thread([this, &sender_params]() {
+        EXPECT_THROW(kkrt_psi_default_stash_not_zero(sender_params), std::invalid_argument);
+    });
+    t_[1] = std::thread([this, &receiver_params]() {
+        EXPECT_THROW(kkrt_psi_default_stash_not_zero(receiver_params), std::invalid_argument);
     });
 
     t_[0].join();
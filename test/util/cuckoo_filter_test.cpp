@@ -0,0 +1,105 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/cuckoo_filter.h"
+
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+
+#include "solo/prng.h"
+
+namespace petace {
+namespace setops {
+
+class CuckooFilterTest : public ::testing::Test {
+public:
+    void SetUp() {
+        auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
+        auto prng = prng_factory.create();
+        tags_.resize(size_, kCuckooFilterTagBytesLen);
+        other_tags_.resize(size_, kCuckooFilterTagBytesLen);
+        prng->generate(tags_.byte_count(), tags_.data());
+        prng->generate(other_tags_.byte_count(), other_tags_.data());
+    }
+
+public:
+    std::size_t size_ = 100000;
+    PointBuffer tags_;
+    PointBuffer other_tags_;
+};
+
+TEST_F(CuckooFilterTest, contains) {
+    CuckooFilter filter(tags_, 4);
+    EXPECT_EQ(filter.size(), size_);
+    // About 34 bits per tag.
+    EXPECT_LE(filter.byte_count(), size_ * 9 / 2);
+    for (std::size_t idx = 0; idx < size_; ++idx) {
+        ASSERT_TRUE(filter.contains(tags_.point_data(idx)));
+    }
+    std::size_t false_positives = 0;
+    for (std::size_t idx = 0; idx < size_; ++idx) {
+        false_positives += filter.contains(other_tags_.point_data(idx)) ? 1 : 0;
+    }
+    EXPECT_LE(false_positives, std::size_t(1));
+}
+
+TEST_F(CuckooFilterTest, fingerprint_bytes_len) {
+    EXPECT_EQ(cuckoo_filter_fingerprint_bytes_len(40, 1), std::size_t(6));
+    EXPECT_EQ(cuckoo_filter_fingerprint_bytes_len(60, 1), std::size_t(8));
+    EXPECT_THROW(cuckoo_filter_fingerprint_bytes_len(61, 1), std::invalid_argument);
+    EXPECT_EQ(cuckoo_filter_fingerprint_bytes_len(40, std::size_t(1) << 12), std::size_t(7));
+    EXPECT_EQ(cuckoo_filter_fingerprint_bytes_len(40, std::size_t(1) << 20), std::size_t(8));
+    EXPECT_THROW(cuckoo_filter_fingerprint_bytes_len(41, std::size_t(1) << 20), std::invalid_argument);
+
+    CuckooFilter filter(tags_, cuckoo_filter_fingerprint_bytes_len(40, 1));
+    EXPECT_EQ(filter.fingerprint_bytes_len(), std::size_t(6));
+    // About 51 bits per tag.
+    EXPECT_LE(filter.byte_count(), size_ * 27 / 4);
+    for (std::size_t idx = 0; idx < size_; ++idx) {
+        ASSERT_TRUE(filter.contains(tags_.point_data(idx)));
+    }
+    for (std::size_t idx = 0; idx < size_; ++idx) {
+        ASSERT_FALSE(filter.contains(other_tags_.point_data(idx)));
+    }
+}
+
+TEST_F(CuckooFilterTest, duplicates) {
+    PointBuffer duplicated_tags(3 * size_, kCuckooFilterTagBytesLen);
+    for (std::size_t idx = 0; idx < duplicated_tags.size(); ++idx) {
+        std::copy_n(tags_.point_data(idx % size_), kCuckooFilterTagBytesLen, duplicated_tags.point_data(idx));
+    }
+    CuckooFilter filter(duplicated_tags, 4);
+    EXPECT_EQ(filter.size(), size_);
+    for (std::size_t idx = 0; idx < size_; ++idx) {
+        ASSERT_TRUE(filter.contains(tags_.point_data(idx)));
+    }
+}
+
+TEST_F(CuckooFilterTest, empty) {
+    CuckooFilter default_filter;
+    EXPECT_FALSE(default_filter.contains(tags_.point_data(0)));
+    CuckooFilter filter(PointBuffer(), 4);
+    EXPECT_EQ(filter.size(), std::size_t(0));
+    EXPECT_FALSE(filter.contains(tags_.point_data(0)));
+}
+
+TEST_F(CuckooFilterTest, invalid_tag_length) {
+    EXPECT_THROW(CuckooFilter(PointBuffer(1, kCuckooFilterTagBytesLen + 1), 4), std::invalid_argument);
+    EXPECT_THROW(CuckooFilter(tags_, 0), std::invalid_argument);
+    EXPECT_THROW(CuckooFilter(tags_, kCuckooFilterMaxFingerprintBytesLen + 1), std::invalid_argument);
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,78 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/cuckoo_stash.h"
+
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace petace {
+namespace setops {
+
+TEST(CuckooStashTest, max_stash_size) {
+    EXPECT_EQ(max_stash_size(std::size_t(1) << 20, 1.27, 3, 40), 0);
+    EXPECT_EQ(max_stash_size(std::size_t(1) << 20, 1.27, 3, 0), 0);
+    EXPECT_EQ(max_stash_size(std::size_t(1) << 20, 2.4, 2, 40), 3);
+    EXPECT_EQ(max_stash_size(std::size_t(1) << 20, 1.2, 3, 40), 3);
+    EXPECT_EQ(max_stash_size(std::size_t(1) << 12, 1.2, 3, 20), 3);
+    EXPECT_EQ(max_stash_size(4096, 1.1, 3, 40), 6);
+    EXPECT_EQ(max_stash_size(4, 1.1, 3, 128), 39);
+    EXPECT_EQ(max_stash_size(0, 1.1, 3, 40), 0);
+    EXPECT_EQ(max_stash_size(4, 0.27, 3, 0), 0);
+    EXPECT_THROW(max_stash_size(1000, 1.0, 3, 40), std::invalid_argument);
+    EXPECT_THROW(max_stash_size(std::size_t(1) << 20, 0.27, 3, 40), std::invalid_argument);
+}
+
+TEST(CuckooStashTest, check_stash_params) {
+    EXPECT_NO_THROW(check_stash_params(1.1, 3, 40));
+    EXPECT_NO_THROW(check_stash_params(2.4, 2, 40));
+    EXPECT_NO_THROW(check_stash_params(0.27, 3, 0));
+    EXPECT_THROW(check_stash_params(1.0, 3, 40), std::invalid_argument);
+    EXPECT_THROW(check_stash_params(2.0, 2, 40), std::invalid_argument);
+    EXPECT_THROW(check_stash_params(1.27, 1, 40), std::invalid_argument);
+    EXPECT_THROW(check_stash_params(1.27, 3, 129), std::invalid_argument);
+    EXPECT_THROW(check_stash_params(1.27, 250, 40), std::invalid_argument);
+}
+
+TEST(CuckooStashTest, find_stash_ids) {
+    std::vector<bool> bin_occupancy = {true, false, true, true};
+    std::vector<std::size_t> entry_ids = {3, 0, 0, 4};
+    EXPECT_EQ(find_stash_ids(bin_occupancy, entry_ids, 6), std::vector<std::size_t>({1, 2, 5}));
+}
+
+TEST(CuckooStashTest, append_stash_entries) {
+    std::vector<Item> keys(3);
+    for (std::size_t idx = 0; idx < keys.size(); ++idx) {
+        keys[idx].fill(static_cast<Byte>(idx + 1));
+    }
+    std::vector<Item> values(2);
+    std::vector<std::size_t> function_ids(2, 0);
+    std::vector<std::size_t> entry_ids(2, 0);
+    append_stash_entries(keys, {2}, 3, 2, values, function_ids, entry_ids);
+    ASSERT_EQ(values.size(), 4);
+    Item expected = keys[2];
+    expected[0] ^= Byte(3);
+    EXPECT_EQ(values[2], expected);
+    EXPECT_EQ(function_ids[2], 3);
+    EXPECT_EQ(entry_ids[2], 2);
+    EXPECT_EQ(function_ids[3], std::numeric_limits<std::size_t>::max());
+
+    EXPECT_THROW(append_stash_entries(keys, {0, 1, 2}, 3, 2, values, function_ids, entry_ids), std::invalid_argument);
+}
+
+}  // namespace setops
+}  // namespace petace
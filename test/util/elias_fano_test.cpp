@@ -0,0 +1,96 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/elias_fano.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+
+#include "solo/prng.h"
+
+#include "setops/util/radix_sort.h"
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+bool equal_points(const PointBuffer& lhs, const PointBuffer& rhs) {
+    return lhs.size() == rhs.size() && lhs.point_byte_count() == rhs.point_byte_count() &&
+           std::memcmp(lhs.data(), rhs.data(), lhs.byte_count()) == 0;
+}
+
+}  // namespace
+
+TEST(EliasFanoTest, round_trip) {
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    for (std::size_t point_byte_count : {1, 5, 8, 9, 12, 16}) {
+        for (std::size_t size : {0, 1, 2, 1000, 150000}) {
+            PointBuffer points(size, point_byte_count);
+            prng->generate(points.byte_count(), points.data());
+            // Duplicates give gaps of zero.
+            for (std::size_t idx = 0; idx < size; idx += 7) {
+                std::memcpy(points.point_data(idx), points.point_data(idx / 2), point_byte_count);
+            }
+            radix_sort_points(points, 4);
+            for (std::size_t num_threads : {1, 4}) {
+                std::vector<std::uint64_t> encoded;
+                elias_fano_encode_points(points, num_threads, encoded);
+                PointBuffer decoded;
+                elias_fano_decode_points(encoded, num_threads, decoded);
+                EXPECT_TRUE(equal_points(decoded, points)) << point_byte_count << " bytes, " << size << " points";
+            }
+        }
+    }
+}
+
+TEST(EliasFanoTest, compression_ratio) {
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    PointBuffer points(1 << 20, 12);
+    prng->generate(points.byte_count(), points.data());
+    radix_sort_points(points, 4);
+    std::vector<std::uint64_t> encoded;
+    elias_fano_encode_points(points, 4, encoded);
+    // About 96 - 20 + 2 bits per point.
+    EXPECT_LT(encoded.size() * sizeof(std::uint64_t), points.byte_count() * 82 / 96);
+}
+
+TEST(EliasFanoTest, invalid_inputs) {
+    std::vector<std::uint64_t> encoded;
+    PointBuffer long_points(2, kECCMaxCompareBytesLen + 1);
+    EXPECT_THROW(elias_fano_encode_points(long_points, 1, encoded), std::invalid_argument);
+
+    PointBuffer unsorted_points(2, 4);
+    const Byte bytes[] = {0xf0, 0, 0, 0, 0x10, 0, 0, 0};
+    std::memcpy(unsorted_points.data(), bytes, sizeof(bytes));
+    EXPECT_THROW(elias_fano_encode_points(unsorted_points, 1, encoded), std::invalid_argument);
+
+    PointBuffer points(1000, 12);
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    prng->generate(points.byte_count(), points.data());
+    radix_sort_points(points, 1);
+    elias_fano_encode_points(points, 1, encoded);
+    PointBuffer decoded;
+    std::vector<std::uint64_t> truncated(encoded.begin(), encoded.end() - 1);
+    EXPECT_THROW(elias_fano_decode_points(truncated, 1, decoded), std::invalid_argument);
+    std::vector<std::uint64_t> oversized = encoded;
+    oversized[0] = ~std::uint64_t(0);
+    EXPECT_THROW(elias_fano_decode_points(oversized, 1, decoded), std::invalid_argument);
+    EXPECT_THROW(elias_fano_decode_points(std::vector<std::uint64_t>(), 1, decoded), std::invalid_argument);
+}
+
+}  // namespace setops
+}  // namespace petace
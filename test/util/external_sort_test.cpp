@@ -0,0 +1,94 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/external_sort.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "solo/prng.h"
+
+namespace petace {
+namespace setops {
+
+class ExternalSortTest : public ::testing::Test {
+public:
+    void SetUp() {
+        auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
+        auto prng = prng_factory.create();
+        records_.resize(record_count_, kECCCompareBytesLen);
+        prng->generate(records_.byte_count(), records_.data());
+        // Some duplicates.
+        for (std::size_t idx = 0; idx < record_count_; idx += 10) {
+            std::memcpy(records_.point_data(idx), records_.point_data(0), kECCCompareBytesLen);
+        }
+        RecordWriter writer(input_file_.path(), kECCCompareBytesLen);
+        writer.write(records_);
+        writer.close();
+    }
+
+    void expect_sorted(const std::string& path) {
+        PointBuffer expected = records_;
+        sort_points(expected);
+        RecordReader reader(path, kECCCompareBytesLen);
+        EXPECT_EQ(reader.size(), record_count_);
+        PointBuffer sorted;
+        reader.read(sorted, record_count_ + 1);
+        ASSERT_EQ(sorted.size(), record_count_);
+        EXPECT_EQ(std::memcmp(sorted.data(), expected.data(), expected.byte_count()), 0);
+    }
+
+public:
+    std::size_t record_count_ = 10000;
+    PointBuffer records_;
+    ScopedFile input_file_{"external_sort_test_input.bin"};
+    ScopedFile output_file_{"external_sort_test_output.bin"};
+};
+
+TEST_F(ExternalSortTest, single_run) {
+    external_sort(input_file_.path(), output_file_.path(), kECCCompareBytesLen, std::size_t(1) << 20);
+    expect_sorted(output_file_.path());
+}
+
+TEST_F(ExternalSortTest, multi_pass_merge) {
+    // 128 records per run and a fan-in of 2.
+    external_sort(input_file_.path(), output_file_.path(), kECCCompareBytesLen, 4096);
+    expect_sorted(output_file_.path());
+    EXPECT_FALSE(std::ifstream(output_file_.path() + ".run0_0").good());
+    EXPECT_FALSE(std::ifstream(output_file_.path() + ".run1_0").good());
+}
+
+TEST_F(ExternalSortTest, in_place) {
+    external_sort(input_file_.path(), input_file_.path(), kECCCompareBytesLen, 4096);
+    expect_sorted(input_file_.path());
+}
+
+TEST_F(ExternalSortTest, empty) {
+    ScopedFile empty_file("external_sort_test_empty.bin");
+    RecordWriter(empty_file.path(), kECCCompareBytesLen).close();
+    external_sort(empty_file.path(), output_file_.path(), kECCCompareBytesLen, 4096);
+    EXPECT_EQ(RecordReader(output_file_.path(), kECCCompareBytesLen).size(), 0);
+}
+
+TEST_F(ExternalSortTest, memory_limit_too_small) {
+    EXPECT_THROW(external_sort(input_file_.path(), output_file_.path(), kECCCompareBytesLen, 32),
+            std::invalid_argument);
+}
+
+}  // namespace setops
+}  // namespace petace
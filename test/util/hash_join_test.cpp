@@ -0,0 +1,89 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/hash_join.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "solo/prng.h"
+
+namespace petace {
+namespace setops {
+
+class HashJoinTest : public ::testing::Test {
+public:
+    void SetUp() {
+        auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
+        auto prng = prng_factory.create();
+        build_tags_.resize(build_size_, kECCCompareBytesLen);
+        probe_tags_.resize(probe_size_, kECCCompareBytesLen);
+        prng->generate(build_tags_.byte_count(), build_tags_.data());
+        prng->generate(probe_tags_.byte_count(), probe_tags_.data());
+        // Every third probe tag is copied from build tags.
+        expected_matched_.assign(probe_size_, 0);
+        for (std::size_t idx = 0; idx < probe_size_; idx += 3) {
+            auto build_tag = build_tags_[(idx * 7) % build_size_];
+            std::copy(build_tag.begin(), build_tag.end(), probe_tags_[idx].begin());
+            expected_matched_[idx] = 1;
+        }
+        expected_count_ = static_cast<std::size_t>(std::count(expected_matched_.begin(), expected_matched_.end(), 1));
+    }
+
+public:
+    std::size_t build_size_ = 100000;
+    std::size_t probe_size_ = 30000;
+    PointBuffer build_tags_;
+    PointBuffer probe_tags_;
+    std::vector<std::uint8_t> expected_matched_;
+    std::size_t expected_count_ = 0;
+};
+
+TEST_F(HashJoinTest, matched) {
+    for (std::size_t num_threads : {1, 4}) {
+        std::vector<std::uint8_t> matched;
+        hash_join(build_tags_, probe_tags_, num_threads, matched);
+        EXPECT_EQ(matched, expected_matched_);
+    }
+}
+
+TEST_F(HashJoinTest, count) {
+    for (std::size_t num_threads : {1, 4}) {
+        EXPECT_EQ(hash_join_count(build_tags_, probe_tags_, num_threads), expected_count_);
+        EXPECT_EQ(hash_join_count(probe_tags_, build_tags_, num_threads), expected_count_);
+    }
+}
+
+TEST_F(HashJoinTest, empty) {
+    std::vector<std::uint8_t> matched;
+    hash_join(PointBuffer(0, kECCCompareBytesLen), probe_tags_, 4, matched);
+    EXPECT_EQ(matched, std::vector<std::uint8_t>(probe_size_, 0));
+    EXPECT_EQ(hash_join_count(build_tags_, PointBuffer(0, kECCCompareBytesLen), 4), 0);
+}
+
+TEST_F(HashJoinTest, tag_too_long) {
+    PointBuffer long_tags(1, kHashJoinMaxTagBytesLen + 1);
+    EXPECT_THROW(hash_join_count(long_tags, long_tags, 4), std::invalid_argument);
+}
+
+TEST_F(HashJoinTest, tag_length_mismatch) {
+    PointBuffer short_tags(1, kECCCompareBytesLen - 1);
+    EXPECT_THROW(hash_join_count(build_tags_, short_tags, 4), std::invalid_argument);
+}
+
+}  // namespace setops
+}  // namespace petace
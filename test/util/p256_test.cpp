@@ -0,0 +1,99 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/p256.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+const char kTestDst[] = "QUUX-V01-CS02-with-P256_XMD:SHA-256_SSWU_RO_";
+
+ByteVector from_hex(const std::string& hex) {
+    ByteVector bytes(hex.size() / 2);
+    for (std::size_t idx = 0; idx < bytes.size(); ++idx) {
+        bytes[idx] = static_cast<Byte>(std::stoi(hex.substr(2 * idx, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+ByteVector point_at(const PointBuffer& points, std::size_t idx) {
+    ConstByteSpan point = points[idx];
+    return ByteVector(point.begin(), point.end());
+}
+
+}  // namespace
+
+// Test vectors are from RFC 9380, Appendix J.1.1.
+TEST(P256Test, hash_to_curve) {
+    std::vector<std::string> messages = {"", "abc", "abcdef0123456789"};
+    std::vector<std::string> expected_points = {
+            "04"
+            "2c15230b26dbc6fc9a37051158c95b79656e17a1a920b11394ca91c44247d3e4"
+            "8a7a74985cc5c776cdfe4b1f19884970453912e9d31528c060be9ab5c43e8415",
+            "04"
+            "0bb8b87485551aa43ed54f009230450b492fead5f1cc91658775dac4a3388a0f"
+            "5c41b3d0731a27a7b14bc0bf0ccded2d8751f83493404c84a88e71ffd424212e",
+            "04"
+            "65038ac8f2b1def042a5df0b33b1f4eca6bff7cb0f9c6c1526811864e544ed80"
+            "cad44d40a656e7aff4002a8de287abc8ae0482b5ae825822bb870d6df9b56ca3",
+    };
+    PointBuffer points;
+    p256_hash_to_curve_batch(Span<const std::string>(messages.data(), messages.size()), kTestDst, points);
+    ASSERT_EQ(points.size(), messages.size());
+    ASSERT_EQ(points.point_byte_count(), kP256UncompressedPointBytesLen);
+    for (std::size_t idx = 0; idx < messages.size(); ++idx) {
+        EXPECT_EQ(point_at(points, idx), from_hex(expected_points[idx])) << messages[idx];
+    }
+}
+
+TEST(P256Test, hash_to_curve_batch_matches_single) {
+    std::vector<std::string> messages;
+    for (std::size_t idx = 0; idx < 100; ++idx) {
+        messages.push_back("key" + std::to_string(idx));
+    }
+    PointBuffer batch_points;
+    p256_hash_to_curve_batch(Span<const std::string>(messages.data(), messages.size()), kTestDst, batch_points);
+    for (std::size_t idx = 0; idx < messages.size(); ++idx) {
+        PointBuffer single_point;
+        p256_hash_to_curve_batch(Span<const std::string>(&messages[idx], 1), kTestDst, single_point);
+        EXPECT_EQ(point_at(single_point, 0), point_at(batch_points, idx));
+    }
+
+    PointBuffer other_dst_point;
+    p256_hash_to_curve_batch(Span<const std::string>(messages.data(), 1), "other", other_dst_point);
+    EXPECT_NE(point_at(other_dst_point, 0), point_at(batch_points, 0));
+}
+
+TEST(P256Test, hash_to_curve_invalid_dst) {
+    std::vector<std::string> messages = {"abc"};
+    PointBuffer points;
+    EXPECT_THROW(p256_hash_to_curve_batch(Span<const std::string>(messages.data(), messages.size()), "", points),
+            std::invalid_argument);
+    EXPECT_THROW(p256_hash_to_curve_batch(
+                         Span<const std::string>(messages.data(), messages.size()), std::string(256, 'd'), points),
+            std::invalid_argument);
+    p256_hash_to_curve_batch(Span<const std::string>(), kTestDst, points);
+    EXPECT_TRUE(points.empty());
+}
+
+}  // namespace setops
+}  // namespace petace
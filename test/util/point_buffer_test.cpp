@@ -0,0 +1,98 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/point_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "solo/prng.h"
+
+#include "setops/util/permutation.h"
+
+namespace petace {
+namespace setops {
+
+TEST(PointBufferTest, layout) {
+    PointBuffer points(10, kEccPointLen);
+    EXPECT_EQ(points.size(), 10);
+    EXPECT_EQ(points.point_byte_count(), kEccPointLen);
+    EXPECT_EQ(points.byte_count(), 10 * kEccPointLen);
+    for (std::size_t idx = 0; idx < points.size(); ++idx) {
+        EXPECT_EQ(points[idx].data(), points.data() + idx * kEccPointLen);
+        EXPECT_EQ(points[idx].size(), kEccPointLen);
+    }
+    EXPECT_EQ(points.point_data(points.size()), points.data() + points.byte_count());
+
+    points.resize(4, kECCCompareBytesLen);
+    EXPECT_EQ(points.size(), 4);
+    EXPECT_EQ(points.byte_count(), 4 * kECCCompareBytesLen);
+    points.clear();
+    EXPECT_TRUE(points.empty());
+    EXPECT_EQ(points.size(), 0);
+}
+
+TEST(PointBufferTest, zero_filled) {
+    for (std::size_t num_threads : {0, 1, 3, 8}) {
+        PointBuffer points(1001, kEccPointLen, num_threads);
+        EXPECT_EQ(points.size(), 1001);
+        EXPECT_TRUE(std::all_of(points.data(), points.data() + points.byte_count(), [](Byte b) { return b == 0; }))
+                << num_threads;
+    }
+
+    PointBuffer points(3, kECCCompareBytesLen);
+    std::memset(points.data(), 0xff, points.byte_count());
+    points.resize(6, kECCCompareBytesLen);
+    EXPECT_TRUE(std::all_of(points.point_data(3), points.point_data(6), [](Byte b) { return b == 0; }));
+}
+
+TEST(PointBufferTest, sort_and_search) {
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    PointBuffer points(1000, kECCCompareBytesLen);
+    prng->generate(points.byte_count(), points.data());
+    PointBuffer origin = points;
+
+    sort_points(points);
+    for (std::size_t idx = 1; idx < points.size(); ++idx) {
+        EXPECT_LE(std::memcmp(points[idx - 1].data(), points[idx].data(), kECCCompareBytesLen), 0);
+    }
+    for (std::size_t idx = 0; idx < origin.size(); ++idx) {
+        EXPECT_TRUE(binary_search_point(points, origin[idx].data()));
+    }
+    Byte missing[kECCCompareBytesLen];
+    prng->generate(kECCCompareBytesLen, missing);
+    EXPECT_FALSE(binary_search_point(points, missing));
+}
+
+TEST(PointBufferTest, permute_and_undo) {
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    PointBuffer points(100, kEccPointLen);
+    prng->generate(points.byte_count(), points.data());
+    PointBuffer origin = points;
+
+    std::vector<std::size_t> permutation;
+    generate_permutation(prng, points.size(), permutation);
+    permute_and_undo(permutation, true, points);
+    for (std::size_t idx = 0; idx < points.size(); ++idx) {
+        EXPECT_EQ(std::memcmp(points[idx].data(), origin[permutation[idx]].data(), kEccPointLen), 0);
+    }
+    permute_and_undo(permutation, false, points);
+    EXPECT_EQ(std::memcmp(points.data(), origin.data(), origin.byte_count()), 0);
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,71 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/radix_sort.h"
+
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include "solo/prng.h"
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+bool equal_points(const PointBuffer& lhs, const PointBuffer& rhs) {
+    return lhs.size() == rhs.size() && lhs.point_byte_count() == rhs.point_byte_count() &&
+           std::memcmp(lhs.data(), rhs.data(), lhs.byte_count()) == 0;
+}
+
+}  // namespace
+
+TEST(RadixSortTest, same_as_sort_points) {
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    for (std::size_t point_byte_count : {1, 5, 12, 16, 33}) {
+        PointBuffer points(10000, point_byte_count);
+        prng->generate(points.byte_count(), points.data());
+        // Duplicates and a shared leading byte are kept in order.
+        for (std::size_t idx = 0; idx < points.size(); ++idx) {
+            points.point_data(idx)[0] = 0x5a;
+            if (idx % 10 == 0) {
+                std::memcpy(points.point_data(idx), points.point_data(idx / 2), point_byte_count);
+            }
+        }
+        PointBuffer expected = points;
+        sort_points(expected);
+        for (std::size_t num_threads : {1, 4}) {
+            PointBuffer sorted = points;
+            radix_sort_points(sorted, num_threads);
+            EXPECT_TRUE(equal_points(sorted, expected)) << point_byte_count << " bytes, " << num_threads << " threads";
+        }
+    }
+}
+
+TEST(RadixSortTest, small_inputs) {
+    PointBuffer empty(0, kECCCompareBytesLen);
+    radix_sort_points(empty, 4);
+    EXPECT_TRUE(empty.empty());
+
+    PointBuffer points(3, 2);
+    const Byte bytes[] = {2, 1, 1, 2, 1, 1};
+    std::memcpy(points.data(), bytes, sizeof(bytes));
+    radix_sort_points(points, 8);
+    const Byte expected[] = {1, 1, 1, 2, 2, 1};
+    EXPECT_EQ(std::memcmp(points.data(), expected, sizeof(expected)), 0);
+}
+
+}  // namespace setops
+}  // namespace petace
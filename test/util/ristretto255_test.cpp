@@ -0,0 +1,202 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/ristretto255.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "solo/prng.h"
+
+namespace petace {
+namespace setops {
+
+namespace {
+
+ByteVector from_hex(const std::string& hex) {
+    ByteVector bytes(hex.size() / 2);
+    for (std::size_t idx = 0; idx < bytes.size(); ++idx) {
+        bytes[idx] = static_cast<Byte>(std::stoi(hex.substr(2 * idx, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+ByteVector scalar_of(std::size_t value) {
+    ByteVector scalar(kRistretto255ScalarBytesLen, 0);
+    for (std::size_t idx = 0; idx < sizeof(value); ++idx) {
+        scalar[idx] = static_cast<Byte>(value >> (8 * idx));
+    }
+    return scalar;
+}
+
+ByteVector random_scalar(petace::solo::PRNG& prng) {
+    ByteVector scalar(kRistretto255ScalarBytesLen);
+    prng.generate(scalar.size(), scalar.data());
+    scalar.back() &= 0x0f;
+    return scalar;
+}
+
+}  // namespace
+
+// Test vectors are from RFC 9496, Appendix A.
+TEST(Ristretto255Test, multiples_of_generator) {
+    ByteVector generator = from_hex("e2f2ae0a6abc4e71a884a961c500515f58e30b6aa582dd8db6a65945e08d2d76");
+    std::vector<std::string> expected_multiples = {
+            "e2f2ae0a6abc4e71a884a961c500515f58e30b6aa582dd8db6a65945e08d2d76",
+            "6a493210f7499cd17fecb510ae0cea23a110e8d5b901f8acadd3095c73a3b919",
+            "94741f5d5d52755ece4f23f044ee27d5d1ea1e2bd196b462166b16152a9d0259",
+            "da80862773358b466ffadfe0b3293ab3d9fd53c5ea6c955358f568322daf6a57",
+    };
+    for (std::size_t idx = 0; idx < expected_multiples.size(); ++idx) {
+        ByteVector result(kRistretto255PointBytesLen);
+        ASSERT_TRUE(ristretto255_scalar_mul(generator.data(), scalar_of(idx + 1).data(), result.data()));
+        EXPECT_EQ(result, from_hex(expected_multiples[idx]));
+    }
+
+    ByteVector identity(kRistretto255PointBytesLen);
+    ASSERT_TRUE(ristretto255_scalar_mul(generator.data(), scalar_of(0).data(), identity.data()));
+    EXPECT_EQ(identity, ByteVector(kRistretto255PointBytesLen, 0));
+}
+
+TEST(Ristretto255Test, from_uniform_bytes) {
+    std::vector<std::pair<std::string, std::string>> vectors = {
+            {"5d1be09e3d0c82fc538112490e35701979d99e06ca3e2b5b54bffe8b4dc772c1"
+             "4d98b696a1bbfb5ca32c436cc61c16563790306c79eaca7705668b47dffe5bb6",
+                    "3066f82a1a747d45120d1740f14358531a8f04bbffe6a819f86dfe50f44a0a46"},
+            {"9fd70f3d192882ffe365e873def2b08f2ae0ad324b2c4373e6fb63464db1dd50"
+             "eebdc4ac5948632eb42b7db490b7699a4a12ca3455143a3bb3b7d3947d2f69ec",
+                    "14a7b1e0e930c6bcd92372841762704aa2547c548f0fccae900356deeabe353d"},
+    };
+    for (const auto& vector : vectors) {
+        ByteVector point(kRistretto255PointBytesLen);
+        ristretto255_from_uniform_bytes(from_hex(vector.first).data(), point.data());
+        EXPECT_EQ(point, from_hex(vector.second));
+    }
+}
+
+TEST(Ristretto255Test, invalid_encodings) {
+    std::vector<std::string> invalid_encodings = {
+            // Non-canonical field elements.
+            "00ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff",
+            "ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff7f",
+            "edffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff7f",
+            // Negative field elements.
+            "0100000000000000000000000000000000000000000000000000000000000000",
+            "01ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff7f",
+            // Non-square x^2.
+            "26948d35ca62e643e26a83177332e6b6afeb9d08e4268b650f1f5bbd8d81d371",
+            "4eac077a713c57b4f4397629a4145982c661f48044dd3f96427d40b147d9742f",
+    };
+    ByteVector result(kRistretto255PointBytesLen);
+    for (const auto& encoding : invalid_encodings) {
+        EXPECT_FALSE(ristretto255_scalar_mul(from_hex(encoding).data(), scalar_of(1).data(), result.data()))
+                << encoding;
+    }
+}
+
+TEST(Ristretto255Test, commutative_scalar_mul) {
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    for (std::size_t round = 0; round < 8; ++round) {
+        ByteVector uniform_bytes(kRistretto255UniformBytesLen);
+        prng->generate(uniform_bytes.size(), uniform_bytes.data());
+        ByteVector scalar_a = random_scalar(*prng);
+        ByteVector scalar_b = random_scalar(*prng);
+
+        ByteVector point(kRistretto255PointBytesLen);
+        ByteVector product_a(kRistretto255PointBytesLen);
+        ristretto255_from_uniform_bytes(uniform_bytes.data(), point.data());
+        ASSERT_TRUE(ristretto255_scalar_mul(point.data(), scalar_a.data(), product_a.data()));
+        ByteVector fused_product_a(kRistretto255PointBytesLen);
+        ristretto255_from_uniform_bytes_mul(uniform_bytes.data(), scalar_a.data(), fused_product_a.data());
+        EXPECT_EQ(fused_product_a, product_a);
+
+        ByteVector product_b(kRistretto255PointBytesLen);
+        ristretto255_from_uniform_bytes_mul(uniform_bytes.data(), scalar_b.data(), product_b.data());
+        ByteVector product_ab(kRistretto255PointBytesLen);
+        ByteVector product_ba(kRistretto255PointBytesLen);
+        ASSERT_TRUE(ristretto255_scalar_mul(product_a.data(), scalar_b.data(), product_ab.data()));
+        ASSERT_TRUE(ristretto255_scalar_mul(product_b.data(), scalar_a.data(), product_ba.data()));
+        EXPECT_EQ(product_ab, product_ba);
+    }
+}
+
+TEST(Ristretto255Test, scalar_invert) {
+    ByteVector inverse(kRistretto255ScalarBytesLen);
+    ristretto255_scalar_invert(scalar_of(1).data(), inverse.data());
+    EXPECT_EQ(inverse, scalar_of(1));
+    // The inverse of 2 is (l + 1) / 2.
+    ristretto255_scalar_invert(scalar_of(2).data(), inverse.data());
+    EXPECT_EQ(inverse, from_hex("f7e97a2e8d31092c6bce7b51ef7c6f0a00000000000000000000000000000008"));
+
+    auto prng = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128).create();
+    for (std::size_t round = 0; round < 8; ++round) {
+        ByteVector uniform_bytes(kRistretto255UniformBytesLen);
+        prng->generate(uniform_bytes.size(), uniform_bytes.data());
+        ByteVector scalar = random_scalar(*prng);
+        ristretto255_scalar_invert(scalar.data(), inverse.data());
+
+        ByteVector point(kRistretto255PointBytesLen);
+        ByteVector product(kRistretto255PointBytesLen);
+        ByteVector restored(kRistretto255PointBytesLen);
+        ristretto255_from_uniform_bytes(uniform_bytes.data(), point.data());
+        ASSERT_TRUE(ristretto255_scalar_mul(point.data(), scalar.data(), product.data()));
+        ASSERT_TRUE(ristretto255_scalar_mul(product.data(), inverse.data(), restored.data()));
+        EXPECT_EQ(restored, point);
+    }
+}
+
+TEST(Ristretto255Test, sum_and_sub) {
+    ByteVector points(3 * kRistretto255PointBytesLen);
+    for (std::size_t idx = 0; idx < 3; ++idx) {
+        ristretto255_base_mul(scalar_of(idx + 5).data(), points.data() + idx * kRistretto255PointBytesLen);
+    }
+    ByteVector sum(kRistretto255PointBytesLen);
+    ByteVector expected(kRistretto255PointBytesLen);
+    ASSERT_TRUE(ristretto255_sum(points.data(), 3, sum.data()));
+    ristretto255_base_mul(scalar_of(18).data(), expected.data());
+    EXPECT_EQ(sum, expected);
+
+    ByteVector difference(kRistretto255PointBytesLen);
+    ASSERT_TRUE(ristretto255_sub(sum.data(), points.data(), difference.data()));
+    ristretto255_base_mul(scalar_of(13).data(), expected.data());
+    EXPECT_EQ(difference, expected);
+
+    ASSERT_TRUE(ristretto255_sum(points.data(), 0, sum.data()));
+    EXPECT_EQ(sum, ByteVector(kRistretto255PointBytesLen, 0));
+}
+
+TEST(Ristretto255Test, small_log) {
+    const std::size_t bit_count = 21;
+    ByteVector point(kRistretto255PointBytesLen);
+    for (std::size_t value : {0, 1, 2, 1023, 1024, 1025, 123456, (1 << bit_count) - 1}) {
+        ristretto255_base_mul(scalar_of(value).data(), point.data());
+        std::uint64_t log = 0;
+        ASSERT_TRUE(ristretto255_small_log(point.data(), bit_count, log)) << value;
+        EXPECT_EQ(log, value);
+    }
+
+    std::uint64_t log = 0;
+    ristretto255_base_mul(scalar_of(1 << bit_count).data(), point.data());
+    EXPECT_FALSE(ristretto255_small_log(point.data(), bit_count, log));
+    ByteVector uniform_bytes(kRistretto255UniformBytesLen, 7);
+    ristretto255_from_uniform_bytes(uniform_bytes.data(), point.data());
+    EXPECT_FALSE(ristretto255_small_log(point.data(), bit_count, log));
+    EXPECT_THROW(ristretto255_small_log(point.data(), 0, log), std::invalid_argument);
+}
+
+}  // namespace setops
+}  // namespace petace
@@ -0,0 +1,112 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/simple_hashing_table.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "solo/prng.h"
+#include "solo/simple_hashing.h"
+
+namespace petace {
+namespace setops {
+
+class SimpleHashingTableTest : public ::testing::Test {
+public:
+    void SetUp() {
+        auto prng_factory = petace::solo::PRNGFactory(petace::solo::PRNGScheme::SHAKE_128);
+        auto prng = prng_factory.create();
+        keys_.resize(key_count_);
+        prng->generate(keys_.size() * sizeof(Item), reinterpret_cast<Byte*>(keys_.data()));
+        seed_.resize(kRandSeedBytesLen);
+        prng->generate(seed_.size(), seed_.data());
+    }
+
+public:
+    std::size_t key_count_ = 10000;
+    std::size_t num_of_bins_ = 12700;
+    std::size_t num_of_fun_ = 3;
+    std::vector<Item> keys_;
+    std::vector<Byte> seed_;
+};
+
+TEST_F(SimpleHashingTableTest, same_bins_as_simple_hashing) {
+    solo::SimpleHashing<kItemBytesLen> simple_hashing(num_of_bins_, seed_);
+    simple_hashing.set_num_of_hash_functions(num_of_fun_);
+    simple_hashing.insert(keys_);
+    simple_hashing.map_elements();
+    auto bin_values = simple_hashing.obtain_bin_entry_values();
+    auto bin_function_ids = simple_hashing.obtain_bin_entry_function_ids();
+
+    for (std::size_t num_threads : {1, 4}) {
+        SimpleHashingTable table(keys_, num_of_bins_, num_of_fun_, seed_, num_threads);
+        ASSERT_EQ(table.bin_count(), num_of_bins_);
+        ASSERT_EQ(table.entry_count(), key_count_ * num_of_fun_);
+        EXPECT_EQ(table.bin_begin(0), 0);
+        EXPECT_EQ(table.bin_end(num_of_bins_ - 1), table.entry_count());
+        for (std::size_t bin_idx = 0; bin_idx < num_of_bins_; ++bin_idx) {
+            std::vector<std::pair<Item, std::size_t>> expected;
+            for (std::size_t idx = 0; idx < bin_values[bin_idx].size(); ++idx) {
+                expected.emplace_back(bin_values[bin_idx][idx], bin_function_ids[bin_idx][idx]);
+            }
+            std::vector<std::pair<Item, std::size_t>> entries;
+            for (std::size_t idx = table.bin_begin(bin_idx); idx < table.bin_end(bin_idx); ++idx) {
+                entries.emplace_back(table.values()[idx], table.function_ids()[idx]);
+            }
+            std::sort(expected.begin(), expected.end());
+            std::sort(entries.begin(), entries.end());
+            ASSERT_EQ(entries, expected) << bin_idx;
+        }
+    }
+}
+
+TEST_F(SimpleHashingTableTest, stash_bins) {
+    std::size_t stash_size = 2;
+    SimpleHashingTable table(keys_, num_of_bins_, num_of_fun_, seed_, 4, stash_size);
+    ASSERT_EQ(table.bin_count(), num_of_bins_ + stash_size);
+    EXPECT_EQ(table.bin_begin(num_of_bins_), key_count_ * num_of_fun_);
+    for (std::size_t stash_idx = 0; stash_idx < stash_size; ++stash_idx) {
+        std::size_t bin_idx = num_of_bins_ + stash_idx;
+        ASSERT_EQ(table.bin_end(bin_idx) - table.bin_begin(bin_idx), key_count_);
+        for (std::size_t key_idx = 0; key_idx < key_count_; ++key_idx) {
+            std::size_t entry_idx = table.bin_begin(bin_idx) + key_idx;
+            Item expected = keys_[key_idx];
+            expected[0] ^= static_cast<Byte>(num_of_fun_ + stash_idx);
+            ASSERT_EQ(table.values()[entry_idx], expected);
+            ASSERT_EQ(table.function_ids()[entry_idx], num_of_fun_ + stash_idx);
+            ASSERT_EQ(table.bin_of(entry_idx), bin_idx);
+        }
+    }
+}
+
+TEST_F(SimpleHashingTableTest, empty_keys) {
+    SimpleHashingTable table(std::vector<Item>(), num_of_bins_, num_of_fun_, seed_, 4);
+    EXPECT_EQ(table.bin_count(), num_of_bins_);
+    EXPECT_EQ(table.entry_count(), 0);
+    EXPECT_EQ(table.bin_end(num_of_bins_ - 1), 0);
+}
+
+TEST_F(SimpleHashingTableTest, invalid_arguments) {
+    EXPECT_THROW(SimpleHashingTable(keys_, 0, num_of_fun_, seed_, 1), std::invalid_argument);
+    EXPECT_THROW(SimpleHashingTable(keys_, num_of_bins_, 0, seed_, 1), std::invalid_argument);
+    EXPECT_THROW(SimpleHashingTable(keys_, num_of_bins_, num_of_fun_, seed_, 1, 254), std::invalid_argument);
+}
+
+}  // namespace setops
+}  // namespace petace
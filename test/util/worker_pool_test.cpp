@@ -0,0 +1,149 @@
+// Copyright 2023 TikTok Pte. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "setops/util/worker_pool.h"
+
+#include <omp.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace petace {
+namespace setops {
+
+TEST(WorkerPoolTest, options_from_params) {
+    WorkerPoolOptions options = WorkerPoolOptions::from_params(R"({"common": {}})"_json);
+    EXPECT_EQ(options.num_threads, 0);
+    EXPECT_TRUE(options.cpu_affinity.empty());
+    EXPECT_EQ(options.numa_node, -1);
+
+    options = WorkerPoolOptions::from_params(R"({"threads": {"num_threads": 3, "cpu_affinity": [0, 2]}})"_json);
+    EXPECT_EQ(options.num_threads, 3);
+    EXPECT_EQ(options.cpu_affinity, std::vector<int>({0, 2}));
+    EXPECT_EQ(options.numa_node, -1);
+
+    EXPECT_THROW(WorkerPoolOptions::from_params(R"({"threads": {"num_threads": -1}})"_json), std::invalid_argument);
+    EXPECT_THROW(WorkerPoolOptions::from_params(R"({"threads": {"cpu_affinity": [-1]}})"_json), std::invalid_argument);
+    EXPECT_THROW(WorkerPoolOptions::from_params(R"({"threads": {"numa_node": -2}})"_json), std::invalid_argument);
+}
+
+TEST(WorkerPoolTest, shared_pools) {
+    WorkerPoolOptions options;
+    auto pool = WorkerPool::get(options);
+    EXPECT_GE(pool->num_threads(), 1);
+    EXPECT_LE(pool->num_threads(), static_cast<std::size_t>(omp_get_max_threads()));
+    EXPECT_TRUE(pool->cpus().empty());
+    EXPECT_EQ(WorkerPool::get(options), pool);
+
+    options.num_threads = 5;
+    auto sized_pool = WorkerPool::get(options);
+    EXPECT_NE(sized_pool, pool);
+    EXPECT_EQ(sized_pool->num_threads(), 5);
+}
+
+#ifdef __linux__
+TEST(WorkerPoolTest, bind) {
+    cpu_set_t saved_cpu_set;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(saved_cpu_set), &saved_cpu_set), 0);
+    int cpu = -1;
+    for (int idx = 0; idx < CPU_SETSIZE && cpu < 0; ++idx) {
+        if (CPU_ISSET(idx, &saved_cpu_set)) {
+            cpu = idx;
+        }
+    }
+    ASSERT_GE(cpu, 0);
+
+    WorkerPoolOptions options;
+    options.cpu_affinity = {cpu, CPU_SETSIZE - 1};
+    if (CPU_ISSET(CPU_SETSIZE - 1, &saved_cpu_set)) {
+        options.cpu_affinity.pop_back();
+    }
+    auto pool = WorkerPool::get(options);
+    EXPECT_EQ(pool->cpus(), std::vector<int>({cpu}));
+    EXPECT_EQ(pool->num_threads(), 1);
+    pool->bind();
+    EXPECT_EQ(sched_getcpu(), cpu);
+
+    // A slice from an offset pins the calling thread to the CPUs of the slice only.
+    int other_cpu = -1;
+    for (int idx = cpu + 1; idx < CPU_SETSIZE && other_cpu < 0; ++idx) {
+        if (CPU_ISSET(idx, &saved_cpu_set)) {
+            other_cpu = idx;
+        }
+    }
+    if (other_cpu >= 0) {
+        options.cpu_affinity = {cpu, other_cpu};
+        auto two_cpu_pool = WorkerPool::get(options);
+        EXPECT_EQ(two_cpu_pool->cpus(), std::vector<int>({cpu, other_cpu}));
+        two_cpu_pool->bind(1, 1);
+        EXPECT_EQ(sched_getcpu(), other_cpu);
+        two_cpu_pool->bind(1, 2);
+        EXPECT_EQ(sched_getcpu(), cpu);
+    }
+
+    options.cpu_affinity = {CPU_SETSIZE - 1};
+    if (!CPU_ISSET(CPU_SETSIZE - 1, &saved_cpu_set)) {
+        EXPECT_THROW(WorkerPool::get(options), std::invalid_argument);
+    }
+    options.cpu_affinity.clear();
+    options.numa_node = 1 << 20;
+    EXPECT_THROW(WorkerPool::get(options), std::invalid_argument);
+
+    ASSERT_EQ(sched_setaffinity(0, sizeof(saved_cpu_set), &saved_cpu_set), 0);
+}
+
+TEST(WorkerPoolTest, scoped_binding) {
+    cpu_set_t saved_cpu_set;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(saved_cpu_set), &saved_cpu_set), 0);
+    int cpu = -1;
+    for (int idx = 0; idx < CPU_SETSIZE && cpu < 0; ++idx) {
+        if (CPU_ISSET(idx, &saved_cpu_set)) {
+            cpu = idx;
+        }
+    }
+    ASSERT_GE(cpu, 0);
+
+    WorkerPoolOptions options;
+    options.cpu_affinity = {cpu};
+    options.num_threads = 2;
+    auto pool = WorkerPool::get(options);
+    {
+        ScopedWorkerBinding binding(*pool);
+        cpu_set_t bound_cpu_set;
+        ASSERT_EQ(sched_getaffinity(0, sizeof(bound_cpu_set), &bound_cpu_set), 0);
+        EXPECT_EQ(CPU_COUNT(&bound_cpu_set), 1);
+        EXPECT_TRUE(CPU_ISSET(cpu, &bound_cpu_set));
+    }
+    // The calling thread and its team get back the CPUs they were allowed to run on.
+    cpu_set_t restored_cpu_set;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(restored_cpu_set), &restored_cpu_set), 0);
+    EXPECT_TRUE(CPU_EQUAL(&restored_cpu_set, &saved_cpu_set));
+    bool team_restored = true;
+#pragma omp parallel num_threads(2) reduction(&& : team_restored)
+    {
+        cpu_set_t team_cpu_set;
+        team_restored = sched_getaffinity(0, sizeof(team_cpu_set), &team_cpu_set) == 0 &&
+                        CPU_EQUAL(&team_cpu_set, &saved_cpu_set);
+    }
+    EXPECT_TRUE(team_restored);
+}
+#endif
+
+}  // namespace setops
+}  // namespace petace